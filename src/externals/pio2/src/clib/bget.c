@@ -403,6 +403,11 @@
 #if PIO_USE_MALLOC
 #include <stdlib.h>
 #endif
+#if PIO_USE_POOL
+/* With PIO_USE_POOL, this is the pio_pool that the functions below
+ * pass their calls to. It is created in compute_buffer_init(). */
+extern void *CN_bpool;
+#endif
 
 #define TestProg    20000             /* Generate built-in test program
                                          if defined.  The value specifies
@@ -523,6 +528,7 @@ static struct bfhead freelist = {     /* List of free buffers */
 
 #ifdef BufStats
 static bufsize totalloc = 0;          /* Total space currently allocated */
+static bufsize maxalloc = 0;          /* Largest value of totalloc */
 static long numget = 0, numrel = 0;   /* Number of bget() and brel() calls */
 #ifdef BECtl
 static long numpblk = 0;              /* Number of pool blocks */
@@ -573,6 +579,7 @@ void bpoolrelease()
 
 #ifdef BufStats
     totalloc = 0;             /* Total space currently allocated */
+    maxalloc = 0;
     numget = 0;
     numrel = 0;   /* Number of bget() and brel() calls */
 #ifdef BECtl
@@ -623,6 +630,9 @@ bufsize requested_size;
     //    printf("bget allocate %ld %x\n",requested_size,buf);
     return(buf);
 #endif
+#if PIO_USE_POOL
+    return CN_bpool ? pio_pool_get(CN_bpool, requested_size) : NULL;
+#endif
 
 
     if(size<=0)
@@ -700,6 +710,8 @@ bufsize requested_size;
 
 #ifdef BufStats
                     totalloc += size;
+                    if (totalloc > maxalloc)
+                        maxalloc = totalloc;
                     numget++;             /* Increment number of bget() calls */
 #endif
                     buf = (void *) ((((char *) ba) + sizeof(struct bhead)));
@@ -720,6 +732,8 @@ bufsize requested_size;
 
 #ifdef BufStats
                     totalloc += b->bh.bsize;
+                    if (totalloc > maxalloc)
+                        maxalloc = totalloc;
                     numget++;             /* Increment number of bget() calls */
 #endif
                     /* Negate size to mark buffer allocated. */
@@ -769,6 +783,8 @@ bufsize requested_size;
                 bdh->tsize = size;
 #ifdef BufStats
                 totalloc += size;
+                if (totalloc > maxalloc)
+                    maxalloc = totalloc;
                 numget++;             /* Increment number of bget() calls */
                 numdget++;            /* Direct bget() call count */
 #endif
@@ -814,6 +830,11 @@ bufsize size;
 {
     char *buf = (char *) bget(size);
 
+#if PIO_USE_POOL
+    if (buf != NULL)
+        memset(buf, 0, size);
+    return buf;
+#endif
     if (buf != NULL) {
         struct bhead *b;
         bufsize rsize;
@@ -849,6 +870,9 @@ bufsize size;
 
 #if PIO_USE_MALLOC
     return(realloc(buf, size));
+#endif
+#if PIO_USE_POOL
+    return CN_bpool ? pio_pool_getr(CN_bpool, buf, size) : NULL;
 #endif
     if ((nbuf = bget(size)) == NULL) { /* Acquire new buffer */
         return NULL;
@@ -887,6 +911,11 @@ void *buf;
     free(buf);
     return;
 #endif
+#if PIO_USE_POOL
+    if (CN_bpool)
+        pio_pool_rel(CN_bpool, buf);
+    return;
+#endif
 
 
     if(buf==NULL) return;       /* allow for null buffer */
@@ -1121,6 +1150,15 @@ bufsize len;
 void bfreespace(bufsize *totfree, bufsize *maxfree)
 {
     struct bfhead *b = freelist.ql.flink;
+#if PIO_USE_POOL
+    PIO_Offset pool_totfree = 0, pool_maxfree = -1;
+
+    if (CN_bpool)
+        pio_pool_freespace(CN_bpool, &pool_totfree, &pool_maxfree);
+    *totfree = pool_totfree;
+    *maxfree = pool_maxfree;
+    return;
+#endif
     *totfree = 0;
     *maxfree = -1;
     while (b != &freelist) {
@@ -1139,12 +1177,38 @@ void bstats(curalloc, totfree, maxfree, nget, nrel)
     bufsize *curalloc, *totfree, *maxfree;
 long *nget, *nrel;
 {
+#if PIO_USE_POOL
+    PIO_Offset pool_inuse = 0, pool_nget = 0, pool_nrel = 0;
+
+    if (CN_bpool)
+        pio_pool_stats(CN_bpool, NULL, &pool_inuse, NULL, NULL, &pool_nget, &pool_nrel);
+    *curalloc = pool_inuse;
+    *nget = pool_nget;
+    *nrel = pool_nrel;
+    bfreespace(totfree, maxfree);
+    return;
+#endif
     *nget = numget;
     *nrel = numrel;
     *curalloc = totalloc;
     bfreespace(totfree, maxfree);
 }
 
+/*  BSTATSH  --  Return the largest amount of space allocated at once. */
+
+void bstatsh(bufsize *highwater)
+{
+#if PIO_USE_POOL
+    PIO_Offset pool_highwater = 0;
+
+    if (CN_bpool)
+        pio_pool_stats(CN_bpool, NULL, NULL, NULL, &pool_highwater, NULL, NULL);
+    *highwater = pool_highwater;
+    return;
+#endif
+    *highwater = maxalloc;
+}
+
 #ifdef BECtl
 
 /*  BSTATSE  --  Return extended statistics  */
@@ -30,6 +30,7 @@ void    bectl       _((int (*compact)(bufsize sizereq, int sequence),
                        void (*release)(void *buf), bufsize pool_incr));
 void    bstats      _((bufsize *curalloc, bufsize *totfree, bufsize *maxfree,
                        long *nget, long *nrel));
+void    bstatsh     _((bufsize *highwater));
 void    bstatse     _((bufsize *pool_incr, long *npool, long *npget,
                        long *nprel, long *ndget, long *ndrel));
 void    bufdump     _((void *buf));
@@ -43,6 +43,10 @@
 /** The maximum number of dimensions allowed in a netCDF file. */
 #define PIO_MAX_DIMS NC_MAX_DIMS
 
+/** The number of buckets in the hash table of write multi buffers of
+ * a file. */
+#define PIO_WMB_HASH_SIZE 64
+
 /** Pass this to PIOc_set_iosystem_error_handling() as the iosysid in
  * order to set default error handling. */
 #define PIO_DEFAULT (-1)
@@ -130,14 +134,171 @@ typedef struct var_desc_t
     /** Non-zero if fill mode is turned on for this var. */
     int use_fill;
 
-    /** Buffer that contains the holegrid fill values used to fill in
-     * missing sections of data when using the subset rearranger. */
-    void *fillbuf;
+    /** The decomposition (ioid) and record of the last write of fill
+     * values to the holes of this var with the subset rearranger. The
+     * holes are not filled again for the same ioid and record. -1 if
+     * they were never filled. */
+    int fill_ioid;
+    int fill_frame;
 
     /** Data buffer for this variable. */
     void *iobuf;
+
+    /** Non-zero if this var is in the list of vars of the file with
+     * pending pnetcdf requests. */
+    int pending;
+
+    /** Bytes of data in the pending pnetcdf requests of this var. This
+     * is the same on all IO tasks. */
+    PIO_Offset pending_bytes;
 } var_desc_t;
 
+/**
+ * A buffer of fill values, shared read-only by all vars of a file that
+ * fill their holes with the same value. See get_fill_buf().
+ */
+typedef struct fill_buf_t
+{
+    /** Size in bytes of the fill value. */
+    int size;
+
+    /** The fill value. */
+    void *fillvalue;
+
+    /** Number of values in buf. */
+    PIO_Offset len;
+
+    /** The buffer, len copies of fillvalue. */
+    void *buf;
+
+    /** Pointer to the next fill buffer of the file. */
+    struct fill_buf_t *next;
+} fill_buf_t;
+
+/**
+ * A message for the IO tasks with async, packed into one buffer so
+ * that it can be sent with one broadcast. See msg_pack().
+ */
+typedef struct msg_buf_t
+{
+    /** The packed data. NULL on tasks that only count bytes. */
+    char *buf;
+
+    /** Number of bytes packed. */
+    PIO_Offset len;
+
+    /** Allocated size of buf. */
+    PIO_Offset size;
+
+    /** Position of the next byte to unpack. */
+    PIO_Offset pos;
+
+    /** Number of messages in a batch. */
+    int count;
+
+    /** True if only the length is kept. Only the computation master
+     * task holds the packed data. */
+    bool count_only;
+
+    /** True if memory for the buffer could not be allocated. */
+    bool nomem;
+} msg_buf_t;
+
+/**
+ * Cached metadata of an attribute. See file_meta_t.
+ */
+typedef struct att_meta_t
+{
+    /** Name of the attribute. */
+    const char *name;
+
+    /** Type of the attribute. */
+    nc_type xtype;
+
+    /** Number of values of the attribute. */
+    PIO_Offset len;
+
+    /** The values, or NULL if the attribute was too large to
+     * cache. */
+    const void *value;
+} att_meta_t;
+
+/**
+ * Cached metadata of a dimension. See file_meta_t.
+ */
+typedef struct dim_meta_t
+{
+    /** Name of the dimension. */
+    const char *name;
+
+    /** Length of the dimension. Not valid for unlimited dimensions of
+     * files open for writing. */
+    PIO_Offset len;
+
+    /** Non-zero if the dimension is unlimited. */
+    char unlim;
+} dim_meta_t;
+
+/**
+ * Cached metadata of a variable. See file_meta_t.
+ */
+typedef struct var_meta_t
+{
+    /** Name of the variable. */
+    const char *name;
+
+    /** Type of the variable. */
+    nc_type xtype;
+
+    /** Number of dimensions of the variable. */
+    int ndims;
+
+    /** IDs of the dimensions of the variable. */
+    int *dimids;
+
+    /** Number of attributes of the variable. */
+    int natts;
+
+    /** The attributes of the variable. */
+    att_meta_t *atts;
+} var_meta_t;
+
+/**
+ * Metadata of a file, cached on all tasks so that the PIOc_inq_*
+ * functions need no communication. It is filled in one collective
+ * call at open and enddef, and dropped by all calls that change the
+ * metadata. The names and attribute values point into buf.
+ */
+typedef struct file_meta_t
+{
+    /** The packed metadata, as broadcast from the IO root. */
+    char *buf;
+
+    /** Number of dimensions in the file. */
+    int ndims;
+
+    /** Number of variables in the file. */
+    int nvars;
+
+    /** Number of global attributes in the file. */
+    int ngatts;
+
+    /** ID of the unlimited dimension, -1 if there is none. */
+    int unlimdimid;
+
+    /** The dimensions, indexed by dimid. */
+    dim_meta_t *dims;
+
+    /** The variables, indexed by varid. */
+    var_meta_t *vars;
+
+    /** All attributes, the global ones first. */
+    att_meta_t *atts;
+
+    /** The dimension IDs of all variables. */
+    int *dimids;
+} file_meta_t;
+
 /**
  * IO region structure.
  *
@@ -176,7 +337,10 @@ enum PIO_REARR_COMM_TYPE
     PIO_REARR_COMM_P2P = (0),
 
     /** Collective */
-    PIO_REARR_COMM_COLL
+    PIO_REARR_COMM_COLL,
+
+    /** Neighborhood collective on a distributed graph communicator */
+    PIO_REARR_COMM_NEIGHBOR
 };
 
 /**
@@ -198,6 +362,19 @@ enum PIO_REARR_COMM_FC_DIR
     PIO_REARR_COMM_FC_2D_DISABLE
 };
 
+/**
+ * How the subset rearranger assigns compute tasks to IO tasks. The
+ * values must match the definitions in the fortran interface.
+ */
+enum PIO_SUBSET_PARTITION
+{
+    /** Contiguous blocks of compute ranks */
+    PIO_SUBSET_PARTITION_RANK = (0),
+
+    /** IO tasks on the same node, balancing the data of each IO task */
+    PIO_SUBSET_PARTITION_NODE
+};
+
 /* Constant to indicate unlimited requests. */
 #define PIO_REARR_COMM_UNLIMITED_PEND_REQ -1
 
@@ -239,6 +416,95 @@ typedef struct rearr_opt
     rearr_comm_fc_opt_t io2comp;
 } rearr_opt_t;
 
+/**
+ * Communication plan for one direction (comp2io or io2comp) of a
+ * rearrangement. The exchange pattern of an io_desc_t does not change
+ * after the decomposition is created, so the arguments to pio_swapm()
+ * are built on the first rearrangement and reused after that.
+ */
+typedef struct rearr_comm_plan_t
+{
+    /** Number of variables the send/recv types were built for. */
+    int nvars;
+
+    /** Non-zero if the plan was built with a non-NULL send buffer. */
+    int have_sbuf;
+
+    /** Number of tasks in the communicator of the exchange. */
+    int ntasks;
+
+    /** Arrays (length ntasks) of counts, displacements and types
+     * passed to pio_swapm(). */
+    int *sendcounts;
+    int *recvcounts;
+    int *sdispls;
+    int *rdispls;
+    MPI_Datatype *sendtypes;
+    MPI_Datatype *recvtypes;
+
+    /** Non-zero if the send/recv types were created for this plan
+     * and must be freed with it. */
+    int own_types;
+} rearr_comm_plan_t;
+
+/**
+ * Intra-node path of rearrange_comp2io(). Compute tasks copy their
+ * data into their segment of an MPI-3 shared memory window, and IO
+ * tasks on the same node gather it from there with the sindex and
+ * rindex maps, instead of receiving it in a message. See
+ * PIOc_set_rearr_shm().
+ */
+typedef struct rearr_shm_t
+{
+    /** Non-zero if some pair of tasks on this node moves data through
+     * the window. If zero, none of the other fields are used. */
+    int active;
+
+    /** The tasks of the rearranger communicator on this node. */
+    MPI_Comm node_comm;
+
+    /** Array (length of the rearranger communicator) of the rank of
+     * each task in node_comm, or -1 for tasks on other nodes. */
+    int *node_rank;
+
+    /** Non-zero if this task has data for an IO task on its node. */
+    int copy_out;
+
+    /** Number of runs of the data of this task that IO tasks on its
+     * node read, and arrays (length nput) of the start and length of
+     * each. Only these are copied into the window. */
+    int nput;
+    PIO_Offset *put_start;
+    PIO_Offset *put_len;
+
+    /** Number of variables the window has room for. Zero until the
+     * window is allocated. */
+    int nvars;
+
+    /** The shared memory window, and the segment of this task. */
+    MPI_Win win;
+    void *base;
+
+    /** Number of compute tasks on this node that this IO task gathers
+     * data from. */
+    int npeers;
+
+    /** Arrays (length npeers) of the rank in node_comm, the ndof, the
+     * number of runs gathered by this IO task, and the segment of
+     * each of those compute tasks. */
+    int *peer;
+    int *peer_ndof;
+    int *peer_nruns;
+    void **peer_base;
+
+    /** Start of each run of elements that are contiguous both in the
+     * data of its compute task and in the data of this IO task, in
+     * each of them, and its length, in the order of the peers. */
+    PIO_Offset *sidx;
+    PIO_Offset *ridx;
+    PIO_Offset *rlen;
+} rearr_shm_t;
+
 /**
  * IO descriptor structure.
  *
@@ -280,6 +546,11 @@ typedef struct io_desc_t
     /** Maximum number of regions in the decomposition. */
     int maxregions;
 
+    /** Number of regions of this task in the decomposition before and
+     * after neighboring regions were merged. */
+    int nregions_found;
+    int nregions;
+
     /** Does this decomp leave holes in the field (true) or write
      * everywhere (false) */
     bool needsfill;
@@ -303,9 +574,18 @@ typedef struct io_desc_t
     /** Maximum llen participating. */
     int maxiobuflen;
 
-    /** Array (length nrecvs) of computation tasks received from. */
+    /** Array (length nrecvs) of computation tasks received from. For
+     * the subset rearranger, the array (length nrfrom) of the
+     * computation task of each run of the IO buffer. */
     int *rfrom;
 
+    /** For the subset rearranger, the number of runs of points of the
+     * IO buffer that come from one computation task, and an array
+     * (length nrfrom) of the number of points in each. The runs cover
+     * the IO buffer in order. */
+    int nrfrom;
+    int *rfromlen;
+
     /** Array (length nrecvs) of counts of data to be received from
      * each computation task by the IO tasks. */
     int *rcount;
@@ -318,7 +598,9 @@ typedef struct io_desc_t
      * for computation taks (send side during writes). */
     PIO_Offset *sindex;
 
-    /** Index for the IO tasks (receive side during writes). */
+    /** Index for the IO tasks (receive side during writes). Not used
+     * by the subset rearranger, which receives the data in IO
+     * order. */
     PIO_Offset *rindex;
 
     /** Array (of length nrecvs) of receive MPI types in pio_swapm() call. */
@@ -355,6 +637,56 @@ typedef struct io_desc_t
      * group. */
     MPI_Comm subset_comm;
 
+    /** Number of tasks this task exchanges data with, in either
+     * direction (PIO_REARR_COMM_NEIGHBOR only). */
+    int num_neighbors;
+
+    /** Array (length num_neighbors) of the ranks of those tasks in the
+     * communicator used by the rearranger, or NULL if no neighbor
+     * communicator has been created. */
+    int *neighbors;
+
+    /** True once performance_tune_rearranger() has chosen the
+     * rearranger options of this decomposition. */
+    bool rearr_tuned;
+
+    /** Distributed graph communicator connecting this task to its
+     * neighbors. Only valid if neighbors is not NULL. */
+    MPI_Comm neighbor_comm;
+
+    /** Cached communication plan for moving data from compute to IO
+     * tasks. NULL until the first call to rearrange_comp2io(). */
+    rearr_comm_plan_t *comp2io_plan;
+
+    /** Cached communication plan for moving data from IO to compute
+     * tasks. NULL until the first call to rearrange_io2comp(). */
+    rearr_comm_plan_t *io2comp_plan;
+
+    /** Shared memory state for rearrange_comp2io() between tasks on
+     * the same node, or NULL if it is not used. */
+    rearr_shm_t *shm;
+
+    /** Duplicate of the communicator of the rearranger, used for the
+     * nonblocking transfers of PIOc_iwrite_darray() so that they
+     * cannot match other messages. MPI_COMM_NULL until first used. */
+    MPI_Comm iwrite_comm;
+
+    /** The PIO type of the data. */
+    int piotype;
+
+    /** Hash of the map, dimensions and rearranger this decomposition
+     * was created from, used by PIOc_InitDecomp() to find an existing
+     * decomposition of the same map. 0 if it cannot be reused. */
+    unsigned long long maphash;
+
+    /** Number of this decomposition among those created in its IO
+     * system. The same on all tasks, unlike ioid. */
+    int decomp_seq;
+
+    /** Number of times this decomposition has been returned by
+     * PIOc_InitDecomp() and not yet freed by PIOc_freedecomp(). */
+    int refcount;
+
     /** Pointer to the next io_desc_t in the list. */
     struct io_desc_t *next;
 } io_desc_t;
@@ -471,6 +803,50 @@ typedef struct iosystem_desc_t
     /** Rearranger options. */
     rearr_opt_t rearr_opts;
 
+    /** True if the rearranger options of each decomposition are
+     * tuned on its first write. See PIOc_set_rearr_tune(). */
+    bool rearr_tune;
+
+    /** True if rearrange_comp2io() moves data between tasks on the
+     * same node through shared memory. See PIOc_set_rearr_shm(). */
+    bool rearr_shm;
+
+    /** How the subset rearranger assigns compute tasks to IO
+     * tasks. See PIO_SUBSET_PARTITION. */
+    int subset_partition;
+
+    /** Number of decompositions created in this IO system. */
+    int num_decomps;
+
+    /** Bytes of data in pending pnetcdf iput requests of a file at
+     * which the requests are completed. 0 to complete them only when
+     * forced. See PIOc_set_flush_policy(). */
+    PIO_Offset flush_budget;
+
+    /** Bytes of data completed by each wait for pnetcdf requests when
+     * a file is flushed. 0 to complete all requests at once, or a
+     * stripe width if striping hints are set. See
+     * PIOc_set_flush_policy(). */
+    PIO_Offset flush_chunk;
+
+    /** With async, define mode calls queued on the computation tasks,
+     * to be sent to the IO tasks as one PIO_MSG_BATCH message. */
+    msg_buf_t batch;
+
+    /** Bytes of queued calls at which the batch is sent. 0 if calls
+     * are not queued. See PIOc_set_msg_batch(). */
+    PIO_Offset batch_limit;
+
+    /** Bytes of data per active IO task that the box rearranger aims
+     * for when it picks the IO tasks of a decomposition. 0 to use all
+     * IO tasks, limited by the blocksize. See
+     * PIOc_set_iotask_target(). */
+    PIO_Offset iotask_target;
+
+    /** Number of computation tasks on each node, used with
+     * iotask_target. */
+    int ranks_per_node;
+
     /** Pointer to the next iosystem_desc_t in the list. */
     struct iosystem_desc_t *next;
 } iosystem_desc_t;
@@ -510,10 +886,61 @@ typedef struct wmulti_buffer
     /** Pointer to the data. */
     void *data;
 
+    /** Number of arrays that vid, frame and fillvalue have room
+     * for. */
+    int capacity;
+
+    /** Size in bytes of the memory allocated for data. */
+    PIO_Offset datasize;
+
     /** Pointer to the next multi-buffer in the list. */
     struct wmulti_buffer *next;
+
+    /** Pointer to the next multi-buffer in the same hash bucket. */
+    struct wmulti_buffer *hnext;
 } wmulti_buffer;
 
+/**
+ * A write started with PIOc_iwrite_darray() that has not yet been
+ * completed with PIOc_wait().
+ */
+typedef struct darray_req_t
+{
+    /** The request ID returned to the user. */
+    int id;
+
+    /** The decomposition and variable being written. */
+    int ioid;
+    int varid;
+
+    /** Record number of the write, or -1 for non-record vars. */
+    int frame;
+
+    /** Copy of the data of this task. This is the send buffer of the
+     * rearrangement, so the user array may be reused at once. */
+    void *data;
+
+    /** Fill value for missing data, or NULL if the decomposition does
+     * not need one. */
+    void *fillvalue;
+
+    /** Buffer the IO tasks receive the data in. */
+    void *iobuf;
+
+    /** Number of MPI requests still moving data to the IO tasks. */
+    int nreqs;
+
+    /** The MPI requests. */
+    MPI_Request *reqs;
+
+    /** Non-zero once the data has arrived and the write has been
+     * issued. The request stays in the list until PIOc_wait(). */
+    int done;
+
+    /** Pointer to the next request, in the order they were started. */
+    struct darray_req_t *next;
+} darray_req_t;
+
 /**
  * File descriptor structure.
  *
@@ -534,8 +961,20 @@ typedef struct file_desc_t
     /** The PIO_TYPE value that was used to open this file. */
     int iotype;
 
-    /** List of variables in this file. */
-    struct var_desc_t varlist[PIO_MAX_VARS];
+    /** Info about the variables in this file, indexed by varid. An
+     * entry is only allocated when the var is first used, see
+     * get_var_desc(). */
+    struct var_desc_t **varlist;
+
+    /** Allocated length of varlist. */
+    int varlist_size;
+
+    /** IDs of the vars with an entry in varlist, in the order they
+     * were first used. */
+    int *active_varids;
+
+    /** Number of vars with an entry in varlist. */
+    int nactive_vars;
 
     /** ??? */
     int mode;
@@ -544,6 +983,61 @@ typedef struct file_desc_t
      * the same communication pattern prior to a write. */
     struct wmulti_buffer buffer;
 
+    /** Hash table of the multi-buffers in the buffer list, by ioid
+     * and recordvar. */
+    struct wmulti_buffer *buffer_hash[PIO_WMB_HASH_SIZE];
+
+    /** Number of times the arrays of a multi-buffer were grown. */
+    PIO_Offset wmb_nrealloc;
+
+    /** Number of bytes copied when multi-buffers were grown. */
+    PIO_Offset wmb_bytes_copied;
+
+    /** List of writes started with PIOc_iwrite_darray() and not yet
+     * completed. */
+    darray_req_t *darray_reqs;
+
+    /** Last request in darray_reqs, where new requests are added. */
+    darray_req_t *darray_reqs_tail;
+
+    /** ID of the last request started on this file. */
+    int last_darray_req;
+
+    /** IDs of the vars with pending pnetcdf requests, in the order
+     * of their first request. */
+    int *pending_varids;
+
+    /** Number of vars with pending pnetcdf requests. */
+    int npending_vars;
+
+    /** Allocated length of pending_varids. */
+    int pending_varids_size;
+
+    /** Bytes of data copied to the attached pnetcdf buffer (bput)
+     * since the last flush. This is the same on all IO tasks, and is
+     * at least the usage of the buffer on any of them. */
+    PIO_Offset bput_bytes;
+
+    /** Bytes of data in pending pnetcdf iput requests since the last
+     * flush. This is the same on all IO tasks. */
+    PIO_Offset iput_bytes;
+
+    /** Buffers of fill values for the holes of subset
+     * decompositions. They are kept until the file is closed, since
+     * pending pnetcdf requests may use them. */
+    fill_buf_t *fillbufs;
+
+    /** True while the file is in define mode. */
+    bool indefine;
+
+    /** Cached metadata of the file, NULL if not valid. */
+    file_meta_t *meta;
+
+    /** With async, the first error of the calls of a batch for this
+     * file. Only kept on the IO tasks. It is returned by the next
+     * PIOc_enddef() or PIOc_closefile(). */
+    int batch_err;
+
     /** Pointer to the next file_desc_t in the list of open files. */
     struct file_desc_t *next;
 
@@ -770,9 +1264,20 @@ extern "C" {
     int PIOc_writemap_from_f90(const char *file, int ndims, const int *gdims,
                                PIO_Offset maplen, const PIO_Offset *map, int f90_comm);
 
+    /* Read and write decomposition maps in binary, with MPI-IO. */
+    int PIOc_readmap_bin(const char *file, int *ndims, int **gdims, PIO_Offset *fmaplen,
+                         PIO_Offset **map, MPI_Comm comm);
+    int PIOc_writemap_bin(const char *file, int ndims, const int *gdims, PIO_Offset maplen,
+                          const PIO_Offset *map, MPI_Comm comm);
+
     /* Write a decomposition file. */
     int PIOc_write_decomp(const char *file, int iosysid, int ioid, MPI_Comm comm);
 
+    /* Write and read a binary decomposition file. */
+    int PIOc_write_decomp_bin(const char *file, int iosysid, int ioid, MPI_Comm comm);
+    int PIOc_read_decomp_bin(int iosysid, const char *file, int *ioid, MPI_Comm comm,
+                             int pio_type);
+
     /* Write a decomposition file using netCDF. */
     int PIOc_write_nc_decomp(int iosysid, const char *filename, int cmode, int ioid,
                              char *title, char *history, int fortran_order);
@@ -808,6 +1313,12 @@ extern "C" {
                             int max_pend_req_c2i,
                             bool enable_hs_i2c, bool enable_isend_i2c,
                             int max_pend_req_i2c);
+    int PIOc_set_rearr_tune(int iosysid, bool enable);
+    int PIOc_set_flush_policy(int iosysid, PIO_Offset budget, PIO_Offset chunk);
+    int PIOc_set_rearr_shm(int iosysid, bool enable);
+    int PIOc_set_subset_partition(int iosysid, int partition);
+    int PIOc_set_msg_batch(int iosysid, PIO_Offset batch_size);
+    int PIOc_set_iotask_target(int iosysid, PIO_Offset target, int ranks_per_node);
     /* Distributed data. */
     int PIOc_advanceframe(int ncid, int varid);
     int PIOc_setframe(int ncid, int varid, int frame);
@@ -815,8 +1326,15 @@ extern "C" {
                           void *fillvalue);
     int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars, PIO_Offset arraylen,
                                 void *array, const int *frame, void **fillvalue, bool flushtodisk);
+    int PIOc_iwrite_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                           void *fillvalue, int *request);
+    int PIOc_wait(int ncid, int request);
+    int PIOc_get_write_buffer_stats(int ncid, PIO_Offset *nreallocp, PIO_Offset *bytes_copiedp);
     int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array);
+    int PIOc_read_darray_multi(int ncid, const int *varids, int ioid, int nvars,
+                               PIO_Offset arraylen, void *array);
     int PIOc_get_local_array_size(int ioid);
+    int PIOc_get_region_stats(int ioid, int *nfoundp, int *nregionsp);
 
     /* Handling files. */
     int PIOc_redef(int ncid);
@@ -841,6 +1359,10 @@ extern "C" {
     /* Set the IO node data buffer size limit. */
     PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit);
 
+    /* Get statistics of the compute buffer pool. */
+    int PIOc_get_buffer_pool_stats(PIO_Offset *requestedp, PIO_Offset *inusep,
+                                   PIO_Offset *footprintp, PIO_Offset *highwaterp);
+
     /* Set the error hanlding for a file. */
     int PIOc_Set_File_Error_Handling(int ncid, int method);
 
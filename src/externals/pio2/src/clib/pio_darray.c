@@ -41,6 +41,60 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
     return oldsize;
 }
 
+/**
+ * Get statistics of the compute buffer pool of this task, which holds
+ * the data aggregated by PIOc_write_darray().
+ *
+ * With the size-class pool (PIO_USE_POOL), footprint - requested is
+ * the memory lost to fragmentation. With bget, requested is the same
+ * as inuse, and footprint is inuse plus the free space of the
+ * pool. With PIO_USE_MALLOC, there are no statistics, and all are
+ * zero.
+ *
+ * @param requestedp pointer that gets the bytes asked for in blocks
+ * that are in use. Ignored if NULL.
+ * @param inusep pointer that gets the bytes of the blocks that are in
+ * use. Ignored if NULL.
+ * @param footprintp pointer that gets the bytes held by the
+ * pool. Ignored if NULL.
+ * @param highwaterp pointer that gets the largest value of inuse so
+ * far. Ignored if NULL.
+ * @returns 0 for success, error code otherwise.
+ */
+int PIOc_get_buffer_pool_stats(PIO_Offset *requestedp, PIO_Offset *inusep,
+                               PIO_Offset *footprintp, PIO_Offset *highwaterp)
+{
+    PIO_Offset requested = 0, inuse = 0, footprint = 0, highwater = 0;
+
+#if PIO_USE_POOL
+    if (CN_bpool)
+        pio_pool_stats(CN_bpool, &requested, &inuse, &footprint, &highwater, NULL, NULL);
+#elif !PIO_USE_MALLOC
+    if (CN_bpool)
+    {
+        bufsize curalloc, totfree, maxfree, maxalloc;
+        long nget, nrel;
+
+        bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+        bstatsh(&maxalloc);
+        requested = inuse = curalloc;
+        footprint = curalloc + totfree;
+        highwater = maxalloc;
+    }
+#endif /* PIO_USE_POOL */
+
+    if (requestedp)
+        *requestedp = requested;
+    if (inusep)
+        *inusep = inuse;
+    if (footprintp)
+        *footprintp = footprint;
+    if (highwaterp)
+        *highwaterp = highwater;
+
+    return PIO_NOERR;
+}
+
 /**
  * Write one or more arrays with the same IO decomposition to the
  * file.
@@ -103,6 +157,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     io_desc_t *iodesc;     /* Pointer to IO description information. */
     int rlen;              /* total data buffer size. */
     var_desc_t *vdesc0;    /* pointer to var_desc structure for each var. */
+    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
     int ierr;              /* Return code. */
 
     /* Get the file info. */
@@ -114,7 +169,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     if (nvars <= 0 || !varids)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
     for (int v = 0; v < nvars; v++)
-        if (varids[v] < 0 || varids[v] > PIO_MAX_VARS)
+        if (varids[v] < 0 || varids[v] >= PIO_MAX_VARS)
             return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
 
     LOG((1, "PIOc_write_darray_multi ncid = %d ioid = %d nvars = %d arraylen = %ld "
@@ -131,8 +186,54 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET,
               "unknown rearranger", __FILE__, __LINE__);
 
+    /* If async is in use, and this is not an IO task, bcast the
+     * parameters. The IO tasks also get the number of dims of the
+     * vars, which they can't find out during the write. The data
+     * itself is moved by the rearranger. */
+    if (ios->async)
+    {
+        if (!ios->ioproc)
+        {
+            int fndims[nvars];
+            char frame_present = frame ? true : false;
+            int fillsize = fillvalue ? nvars * iodesc->basetype_size : 0;
+            char flush_char = flushtodisk;
+            msg_buf_t mb;
+
+            /* This may send other messages, so do it first. */
+            for (int v = 0; v < nvars; v++)
+                if ((ierr = get_var_ndims(file, varids[v], &fndims[v])))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &nvars, sizeof(int));
+            msg_pack(&mb, varids, nvars * sizeof(int));
+            msg_pack(&mb, &ioid, sizeof(int));
+            msg_pack(&mb, fndims, nvars * sizeof(int));
+            msg_pack(&mb, &frame_present, 1);
+            if (frame_present)
+                msg_pack(&mb, frame, nvars * sizeof(int));
+            msg_pack(&mb, &fillsize, sizeof(int));
+            if (fillsize)
+                msg_pack(&mb, fillvalue, fillsize);
+            msg_pack(&mb, &flush_char, 1);
+            mpierr = send_packed_msg(ios, PIO_MSG_WRITEDARRAY, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_write_darray_multi sent ncid = %d nvars = %d ioid = %d "
+                 "frame_present = %d fillsize = %d", ncid, nvars, ioid, frame_present, fillsize));
+        }
+
+        /* Handle MPI errors. */
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            return check_mpi(file, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
     /* Get a pointer to the variable info for the first variable. */
-    vdesc0 = &file->varlist[varids[0]];
+    if ((ierr = get_var_desc(varids[0], file, &vdesc0)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     /* if the buffer is already in use in pnetcdf we need to flush first */
     if (file->iotype == PIO_IOTYPE_PNETCDF && vdesc0->iobuf)
@@ -176,10 +277,65 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         LOG((3, "allocated token for variable buffer"));
     }
 
+    /* On the first write of this decomposition, find the fastest
+     * rearranger options, if the iosystem asks for it. */
+    if (ios->rearr_tune && !iodesc->rearr_tuned)
+        if ((ierr = performance_tune_rearranger(ios, iodesc)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
     /* Move data from compute to IO tasks. */
     if ((ierr = rearrange_comp2io(ios, iodesc, array, vdesc0->iobuf, nvars)))
         return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
+    /* With async, the computation tasks are done once the data has
+     * left them. The IO tasks write it while they go on. */
+    if (ios->async && !ios->ioproc)
+        return PIO_NOERR;
+
+    /* Write the data and the holegrid, if there is one. */
+    if ((ierr = write_darray_multi_iobuf(file, iodesc, nvars, varids, frame, fillvalue,
+                                         flushtodisk)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write one or more arrays with the same decomposition that have
+ * already been moved to the IO tasks. The data is in the iobuf of
+ * the first variable. This is the second half of
+ * PIOc_write_darray_multi(), and is also used by PIOc_wait().
+ *
+ * For the subset rearranger, the holegrid is also written with the
+ * fill values. For pnetcdf, the buffers are freed in
+ * flush_output_buffer(), otherwise they are freed here.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param iodesc pointer to the decomposition.
+ * @param nvars the number of variables.
+ * @param varids an array of length nvars containing the variable ids.
+ * @param frame an array of length nvars with the record number of
+ * each variable, or NULL for non-record vars.
+ * @param fillvalue an array (of length nvars) of the fill values to
+ * be used for missing data.
+ * @param flushtodisk non-zero to cause buffers to be flushed to disk.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int write_darray_multi_iobuf(file_desc_t *file, io_desc_t *iodesc, int nvars,
+                             const int *varids, const int *frame, void *fillvalue,
+                             bool flushtodisk)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    var_desc_t *vdesc0;    /* pointer to var_desc structure for each var. */
+    int ierr;              /* Return code. */
+
+    pioassert(file && file->iosystem && iodesc && nvars > 0 && varids, "invalid input",
+              __FILE__, __LINE__);
+    ios = file->iosystem;
+    if ((ierr = get_var_desc(varids[0], file, &vdesc0)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
     /* Write the darray based on the iotype. */
     LOG((2, "about to write darray for iotype = %d", file->iotype));
     switch (file->iotype)
@@ -190,10 +346,18 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
                                               iodesc->maxregions, iodesc->firstregion, iodesc->llen,
                                               iodesc->num_aiotasks, vdesc0->iobuf, frame)))
             return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+        /* Track the pending requests. The largest buffer length is
+         * used so the count is the same on all IO tasks. */
+        if (ios->ioproc && file->iotype == PIO_IOTYPE_PNETCDF)
+            for (int v = 0; v < nvars; v++)
+                if ((ierr = add_pending_var(file, varids[v], iodesc->maxiobuflen *
+                                            iodesc->basetype_size, false)))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
         break;
     case PIO_IOTYPE_NETCDF4C:
     case PIO_IOTYPE_NETCDF:
-        if ((ierr = write_darray_multi_serial(file, nvars, varids, iodesc, 0, frame)))
+        if ((ierr = write_darray_multi_serial(file, nvars, varids, iodesc, 0, NULL, frame)))
             return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
         break;
@@ -222,57 +386,74 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
      * missing value a 'holegrid' is used to describe the missing
      * points. This is generally faster than the netcdf method of
      * filling the entire array with missing values before overwriting
-     * those values later. */
+     * those values later.
+     *
+     * The holes are only filled once for each decomposition and
+     * record of a var, from a buffer shared by all vars with the same
+     * fill value. netCDF-4 files already read the fill value of a
+     * var in places that were never written, so the holes are not
+     * written at all when that is the value wanted. */
     if (iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill)
     {
         LOG((2, "nvars = %d holegridsize = %ld iodesc->needsfill = %d\n", nvars,
              iodesc->holegridsize, iodesc->needsfill));
 
-	pioassert(!vdesc0->fillbuf, "buffer overwrite",__FILE__, __LINE__);
+        for (int v = 0; v < nvars; v++)
+        {
+            var_desc_t *vdesc;
+            void *fill = (char *)fillvalue + iodesc->basetype_size * v;
+            int fill_frame;
+            void *fillbuf;
 
-        /* Get a buffer. */
-	if (ios->io_rank == 0)
-	    vdesc0->fillbuf = bget(iodesc->maxholegridsize * iodesc->basetype_size * nvars);
-	else if (iodesc->holegridsize > 0)
-	    vdesc0->fillbuf = bget(iodesc->holegridsize * iodesc->basetype_size * nvars);
+            if ((ierr = get_var_desc(varids[v], file, &vdesc)))
+                return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
-        /* copying the fill value into the data buffer for the box
-         * rearranger. This will be overwritten with data where
-         * provided. */
-        for (int nv = 0; nv < nvars; nv++)
-            for (int i = 0; i < iodesc->holegridsize; i++)
-                memcpy(&((char *)vdesc0->fillbuf)[iodesc->basetype_size * (i + nv * iodesc->holegridsize)],
-                       &((char *)fillvalue)[iodesc->basetype_size * nv], iodesc->basetype_size);
+            /* Were the holes already filled? */
+            fill_frame = frame ? frame[v] : vdesc->record;
+            if (vdesc->fill_ioid == iodesc->ioid && vdesc->fill_frame == fill_frame)
+                continue;
 
-        /* Write the darray based on the iotype. */
-        switch (file->iotype)
-        {
-        case PIO_IOTYPE_PNETCDF:
-        case PIO_IOTYPE_NETCDF4P:
-            if ((ierr = pio_write_darray_multi_nc(file, nvars, varids,
-                                                  iodesc->ndims, iodesc->basetype, iodesc->maxfillregions,
-                                                  iodesc->fillregion, iodesc->holegridsize,
-                                                  iodesc->num_aiotasks, vdesc0->fillbuf, frame)))
-                return pio_err(ios, file, ierr, __FILE__, __LINE__);
-            break;
-        case PIO_IOTYPE_NETCDF4C:
-        case PIO_IOTYPE_NETCDF:
-            if ((ierr = write_darray_multi_serial(file, nvars, varids, iodesc, 1, frame)))
+            /* Does the netCDF-4 library take care of them? */
+            if ((file->iotype == PIO_IOTYPE_NETCDF4C || file->iotype == PIO_IOTYPE_NETCDF4P) &&
+                vdesc->use_fill && vdesc->fillvalue && vdesc->type_size == iodesc->basetype_size &&
+                !memcmp(vdesc->fillvalue, fill, iodesc->basetype_size))
+                continue;
+
+            /* Get a buffer. */
+            if ((ierr = get_fill_buf(file, iodesc->basetype_size, fill, iodesc->holegridsize,
+                                     &fillbuf)))
                 return pio_err(ios, file, ierr, __FILE__, __LINE__);
-            break;
-        default:
-            return pio_err(ios, file, PIO_EBADIOTYPE, __FILE__, __LINE__);
-        }
 
-        /* For PNETCDF fillbuf is freed in flush_output_buffer() */
-        if (file->iotype != PIO_IOTYPE_PNETCDF)
-        {
-            /* Free resources. */
-            if (vdesc0->fillbuf)
+            /* Write the darray based on the iotype. */
+            switch (file->iotype)
             {
-                brel(vdesc0->fillbuf);
-                vdesc0->fillbuf = NULL;
+            case PIO_IOTYPE_PNETCDF:
+            case PIO_IOTYPE_NETCDF4P:
+                if ((ierr = pio_write_darray_multi_nc(file, 1, &varids[v], iodesc->ndims,
+                                                      iodesc->basetype, iodesc->maxfillregions,
+                                                      iodesc->fillregion, iodesc->holegridsize,
+                                                      iodesc->num_aiotasks, fillbuf,
+                                                      frame ? &frame[v] : NULL)))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
+                if (ios->ioproc && file->iotype == PIO_IOTYPE_PNETCDF)
+                    if ((ierr = add_pending_var(file, varids[v], iodesc->maxholegridsize *
+                                                iodesc->basetype_size, false)))
+                        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+                break;
+            case PIO_IOTYPE_NETCDF4C:
+            case PIO_IOTYPE_NETCDF:
+                if ((ierr = write_darray_multi_serial(file, 1, &varids[v], iodesc, 1, fillbuf,
+                                                      frame ? &frame[v] : NULL)))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
+                break;
+            default:
+                return pio_err(ios, file, PIO_EBADIOTYPE, __FILE__, __LINE__);
             }
+
+            /* Only now are the holes filled. After an error they are
+             * written again on the next call. */
+            vdesc->fill_ioid = iodesc->ioid;
+            vdesc->fill_frame = fill_frame;
         }
     }
 
@@ -328,6 +509,73 @@ int find_var_fillvalue(file_desc_t *file, int varid, var_desc_t *vdesc)
     return PIO_NOERR;
 }
 
+/**
+ * Get the default netCDF fill value for an MPI type.
+ *
+ * @param basetype the MPI type of the data.
+ * @param fillvalue pointer to storage for one value of the type,
+ * that gets the fill value.
+ * @returns 0 for success, PIO_EBADTYPE if there is no fill value for
+ * the type.
+ * @ingroup PIO_write_darray
+ */
+int find_default_fillvalue(MPI_Datatype basetype, void *fillvalue)
+{
+    void *fill;
+    int size;
+    signed char byte_fill = PIO_FILL_BYTE;
+    char char_fill = PIO_FILL_CHAR;
+    short short_fill = PIO_FILL_SHORT;
+    int int_fill = PIO_FILL_INT;
+    float float_fill = PIO_FILL_FLOAT;
+    double double_fill = PIO_FILL_DOUBLE;
+#ifdef _NETCDF4
+    unsigned char ubyte_fill = PIO_FILL_UBYTE;
+    unsigned short ushort_fill = PIO_FILL_USHORT;
+    unsigned int uint_fill = PIO_FILL_UINT;
+    long long int64_fill = PIO_FILL_INT64;
+    long long uint64_fill = PIO_FILL_UINT64;
+#endif /* _NETCDF4 */
+    int mpierr;
+
+    pioassert(fillvalue, "invalid input", __FILE__, __LINE__);
+
+    /* This must be done with an if statement, not a case, or
+     * openmpi will not build. */
+    if (basetype == MPI_BYTE)
+        fill = &byte_fill;
+    else if (basetype == MPI_CHAR)
+        fill = &char_fill;
+    else if (basetype == MPI_SHORT)
+        fill = &short_fill;
+    else if (basetype == MPI_INT)
+        fill = &int_fill;
+    else if (basetype == MPI_FLOAT)
+        fill = &float_fill;
+    else if (basetype == MPI_DOUBLE)
+        fill = &double_fill;
+#ifdef _NETCDF4
+    else if (basetype == MPI_UNSIGNED_CHAR)
+        fill = &ubyte_fill;
+    else if (basetype == MPI_UNSIGNED_SHORT)
+        fill = &ushort_fill;
+    else if (basetype == MPI_UNSIGNED)
+        fill = &uint_fill;
+    else if (basetype == MPI_LONG_LONG)
+        fill = &int64_fill;
+    else if (basetype == MPI_UNSIGNED_LONG_LONG)
+        fill = &uint64_fill;
+#endif /* _NETCDF4 */
+    else
+        return PIO_EBADTYPE;
+
+    if ((mpierr = MPI_Type_size(basetype, &size)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    memcpy(fillvalue, fill, size);
+
+    return PIO_NOERR;
+}
+
 /**
  * Write a distributed array to the output file.
  *
@@ -419,7 +667,8 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
          arraylen, iodesc->ndof));
 
     /* Get var description. */
-    vdesc = &(file->varlist[varid]);
+    if ((ierr = get_var_desc(varid, file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
     LOG((2, "vdesc record %d ndims %d nreqs %d", vdesc->record, vdesc->ndims,
          vdesc->nreqs));
 
@@ -434,31 +683,9 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     recordvar = vdesc->record >= 0 ? 1 : 0;
     LOG((3, "recordvar = %d", recordvar));
 
-    /* Move to end of list or the entry that matches this ioid. */
-    for (wmb = &file->buffer; wmb->next; wmb = wmb->next)
-        if (wmb->ioid == ioid && wmb->recordvar == recordvar)
-            break;
-
-    /* If we did not find an existing wmb entry, create a new wmb. */
-    if (wmb->ioid != ioid || wmb->recordvar != recordvar)
-    {
-        /* Allocate a buffer. */
-        if (!(wmb->next = bget((bufsize)sizeof(wmulti_buffer))))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-        LOG((3, "allocated multi-buffer"));
-
-        /* Set pointer to newly allocated buffer and initialize.*/
-        wmb = wmb->next;
-        wmb->recordvar = recordvar;
-        wmb->next = NULL;
-        wmb->ioid = ioid;
-        wmb->num_arrays = 0;
-        wmb->arraylen = arraylen;
-        wmb->vid = NULL;
-        wmb->data = NULL;
-        wmb->frame = NULL;
-        wmb->fillvalue = NULL;
-    }
+    /* Find the multi-buffer for this ioid, or create one. */
+    if ((ierr = get_wmb(file, ioid, recordvar, &wmb)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
     LOG((2, "wmb->num_arrays = %d arraylen = %d iodesc->basetype_size = %d\n",
          wmb->num_arrays, arraylen, iodesc->basetype_size));
 
@@ -466,9 +693,16 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     bfreespace(&totfree, &maxfree);
 
     /* maxfree is the available memory. If that is < 10% greater than
-     * the size of the current request needsflush is true. */
+     * the size of the current request needsflush is true. If the
+     * buffer is full, the request is the size it will grow to. */
     if (needsflush == 0)
-        needsflush = (maxfree <= 1.1 * (1 + wmb->num_arrays) * arraylen * iodesc->basetype_size);
+    {
+        int narrays = 1 + wmb->num_arrays;
+
+        if (wmb->num_arrays == wmb->capacity)
+            narrays = wmb_next_capacity(iodesc, wmb);
+        needsflush = (maxfree <= 1.1 * narrays * arraylen * iodesc->basetype_size);
+    }
 
     /* Tell all tasks on the computation communicator whether we need
      * to flush data. */
@@ -493,35 +727,16 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
             return pio_err(ios, file, ierr, __FILE__, __LINE__);
     }
 
-    /* Get memory for data. */
-    if (arraylen > 0)
-    {
-        if (!(wmb->data = bgetr(wmb->data, (1 + wmb->num_arrays) * arraylen * iodesc->basetype_size)))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-        LOG((2, "got %ld bytes for data", (1 + wmb->num_arrays) * arraylen * iodesc->basetype_size));
-    }
-
-    /* vid is an array of variable ids in the wmb list, grow the list
-     * and add the new entry. */
-    if (!(wmb->vid = bgetr(wmb->vid, sizeof(int) * (1 + wmb->num_arrays))))
-        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-
-    /* wmb->frame is the record number, we assume that the variables
-     * in the wmb list may not all have the same unlimited dimension
-     * value although they usually do. */
-    if (vdesc->record >= 0)
-        if (!(wmb->frame = bgetr(wmb->frame, sizeof(int) * (1 + wmb->num_arrays))))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+    /* Make room for the data, varid, record number and fill value
+     * of this var. */
+    if ((ierr = grow_wmb(file, iodesc, wmb, arraylen)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     /* If we need a fill value, get it. If we are using the subset
      * rearranger and not using the netcdf fill mode then we need to
      * do an extra write to fill in the holes with the fill value. */
     if (iodesc->needsfill)
     {
-        /* Get memory to hold fill value. */
-        if (!(wmb->fillvalue = bgetr(wmb->fillvalue, iodesc->basetype_size * (1 + wmb->num_arrays))))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-
         /* If the user passed a fill value, use that, otherwise use
          * the default fill value of the netCDF type. Copy the fill
          * value to the buffer. */
@@ -534,54 +749,11 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
         }
         else
         {
-            void *fill;
-            signed char byte_fill = PIO_FILL_BYTE;
-            char char_fill = PIO_FILL_CHAR;
-            short short_fill = PIO_FILL_SHORT;
-            int int_fill = PIO_FILL_INT;
-            float float_fill = PIO_FILL_FLOAT;
-            double double_fill = PIO_FILL_DOUBLE;
-#ifdef _NETCDF4
-            unsigned char ubyte_fill = PIO_FILL_UBYTE;
-            unsigned short ushort_fill = PIO_FILL_USHORT;
-            unsigned int uint_fill = PIO_FILL_UINT;
-            long long int64_fill = PIO_FILL_INT64;
-            long long uint64_fill = PIO_FILL_UINT64;
-#endif /* _NETCDF4 */
             vtype = (MPI_Datatype)iodesc->basetype;
             LOG((3, "caller did not provide fill value vtype = %d", vtype));
-
-            /* This must be done with an if statement, not a case, or
-             * openmpi will not build. */
-            if (vtype == MPI_BYTE)
-                fill = &byte_fill;
-            else if (vtype == MPI_CHAR)
-                fill = &char_fill;
-            else if (vtype == MPI_SHORT)
-                fill = &short_fill;
-            else if (vtype == MPI_INT)
-                fill = &int_fill;
-            else if (vtype == MPI_FLOAT)
-                fill = &float_fill;
-            else if (vtype == MPI_DOUBLE)
-                fill = &double_fill;
-#ifdef _NETCDF4
-            else if (vtype == MPI_UNSIGNED_CHAR)
-                fill = &ubyte_fill;
-            else if (vtype == MPI_UNSIGNED_SHORT)
-                fill = &ushort_fill;
-            else if (vtype == MPI_UNSIGNED)
-                fill = &uint_fill;
-            else if (vtype == MPI_LONG_LONG)
-                fill = &int64_fill;
-            else if (vtype == MPI_UNSIGNED_LONG_LONG)
-                fill = &uint64_fill;
-#endif /* _NETCDF4 */
-            else
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
-
-            memcpy((char *)wmb->fillvalue + iodesc->basetype_size * wmb->num_arrays,
-                   fill, iodesc->basetype_size);
+            if ((ierr = find_default_fillvalue(vtype, (char *)wmb->fillvalue +
+                                               iodesc->basetype_size * wmb->num_arrays)))
+                return pio_err(ios, file, ierr, __FILE__, __LINE__);
             LOG((3, "copied fill value"));
         }
     }
@@ -613,6 +785,434 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     return PIO_NOERR;
 }
 
+/**
+ * Get the number of times the write multi buffers of a file were
+ * grown by PIOc_write_darray(), and the number of bytes that were
+ * copied to do it. These show the cost of aggregating variables on
+ * this task.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param nreallocp pointer that gets the number of reallocations. Ignored
+ * if NULL.
+ * @param bytes_copiedp pointer that gets the number of bytes
+ * copied. Ignored if NULL.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_get_write_buffer_stats(int ncid, PIO_Offset *nreallocp, PIO_Offset *bytes_copiedp)
+{
+    file_desc_t *file;     /* Info about file we are writing to. */
+    int ierr;              /* Return code. */
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    if (nreallocp)
+        *nreallocp = file->wmb_nrealloc;
+    if (bytes_copiedp)
+        *bytes_copiedp = file->wmb_bytes_copied;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free a request of PIOc_iwrite_darray() that was not started, and
+ * the buffers it holds.
+ *
+ * @param req pointer to the request.
+ */
+static void free_darray_req(darray_req_t *req)
+{
+    if (req->data)
+        brel(req->data);
+    if (req->fillvalue)
+        brel(req->fillvalue);
+    if (req->iobuf)
+        brel(req->iobuf);
+    free(req->reqs);
+    free(req);
+}
+
+/**
+ * Issue the write of a request of PIOc_iwrite_darray(). Wait for the
+ * data to arrive on the IO tasks, and write it to the file (for
+ * pnetcdf, start a nonblocking put, which is completed at the next
+ * flush). The buffers of the request, other than the one handed to
+ * the variable, are freed.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param req pointer to the request.
+ * @returns 0 for success, non-zero error code for failure.
+ */
+static int write_darray_req(file_desc_t *file, darray_req_t *req)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    io_desc_t *iodesc;     /* The IO description. */
+    var_desc_t *vdesc;     /* Info about the var being written. */
+    int mpierr;            /* Return code from MPI functions. */
+    int ierr;              /* Return code. */
+
+    pioassert(file && file->iosystem && req, "invalid input", __FILE__, __LINE__);
+    ios = file->iosystem;
+    LOG((1, "write_darray_req id = %d varid = %d ioid = %d", req->id, req->varid,
+         req->ioid));
+
+    if (!(iodesc = pio_get_iodesc_from_id(req->ioid)))
+        return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__);
+
+    /* Wait for the data to arrive on the IO tasks. */
+    if ((mpierr = MPI_Waitall(req->nreqs, req->reqs, MPI_STATUSES_IGNORE)))
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    free(req->reqs);
+    req->reqs = NULL;
+    if (req->data)
+        brel(req->data);
+    req->data = NULL;
+
+    /* If the buffer is already in use in pnetcdf we need to flush
+     * first. */
+    if ((ierr = get_var_desc(req->varid, file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+    if (file->iotype == PIO_IOTYPE_PNETCDF && vdesc->iobuf)
+        flush_output_buffer(file, 1, 0);
+    pioassert(!vdesc->iobuf, "buffer overwrite", __FILE__, __LINE__);
+
+    /* Hand the buffer to the variable. This assures that iobuf is
+     * allocated on all iotasks for pnetcdf, as in
+     * PIOc_write_darray_multi(). */
+    vdesc->iobuf = req->iobuf;
+    req->iobuf = NULL;
+    if (!vdesc->iobuf && file->iotype == PIO_IOTYPE_PNETCDF && ios->ioproc)
+        if (!(vdesc->iobuf = bget(1)))
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+
+    if ((ierr = write_darray_multi_iobuf(file, iodesc, 1, &req->varid,
+                                         req->frame >= 0 ? &req->frame : NULL,
+                                         req->fillvalue, false)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+    if (req->fillvalue)
+        brel(req->fillvalue);
+    req->fillvalue = NULL;
+    req->done = 1;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Issue the writes of the requests of PIOc_iwrite_darray() whose
+ * data has arrived on all tasks, so that the file IO starts while
+ * the caller goes on computing, rather than in PIOc_wait(). Writes
+ * are issued in the order the requests were started, so this stops
+ * at the first request that is still moving data.
+ *
+ * This function is collective.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @returns 0 for success, non-zero error code for failure.
+ */
+static int progress_darray_reqs(file_desc_t *file)
+{
+    darray_req_t *req;
+    int arrived;
+    int mpierr;
+    int ierr;
+
+    for (req = file->darray_reqs; req; req = req->next)
+    {
+        if (req->done)
+            continue;
+
+        /* The write is collective, so all tasks must agree that the
+         * data has arrived. */
+        if ((mpierr = MPI_Testall(req->nreqs, req->reqs, &arrived, MPI_STATUSES_IGNORE)))
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &arrived, 1, MPI_INT, MPI_MIN,
+                                    file->iosystem->union_comm)))
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+        if (!arrived)
+            break;
+
+        if ((ierr = write_darray_req(file, req)))
+            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Start writing a distributed array to the output file, without
+ * waiting for the write to finish.
+ *
+ * The data of this task is copied, so the caller may reuse array as
+ * soon as this function returns. The data is then moved to the IO
+ * tasks with nonblocking messages, which progress while the caller
+ * goes on with its work. Each call of this function, and of
+ * PIOc_wait(), issues the writes of earlier requests whose data has
+ * arrived on all tasks, so the file IO of one array overlaps the
+ * moving of the next. The write must be completed with PIOc_wait().
+ * Writes that are not completed by the caller are completed in
+ * PIOc_sync() and PIOc_closefile().
+ *
+ * Unlike PIOc_write_darray(), the data is not added to the write
+ * multi buffer, so it is not aggregated with other variables.
+ *
+ * This function and PIOc_wait() are collective, and must be called by
+ * all tasks in the same order.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written. This should
+ * be at least the length of the local component of the distrubited
+ * array. (Any values beyond length of the local component will be
+ * ignored.)
+ * @param array pointer to an array of length arraylen with the data
+ * to be written. This is a pointer to the distributed portion of the
+ * array that is on this task.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data. If NULL, the default fill value of the type is used.
+ * @param request pointer that gets the ID of the request, to be
+ * passed to PIOc_wait().
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_iwrite_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                       void *fillvalue, int *request)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Info about file we are writing to. */
+    io_desc_t *iodesc;     /* The IO description. */
+    var_desc_t *vdesc;     /* Info about the var being written. */
+    darray_req_t *req;     /* The new request. */
+    int ierr;              /* Return code. */
+
+    LOG((1, "PIOc_iwrite_darray ncid = %d varid = %d ioid = %d arraylen = %d",
+         ncid, varid, ioid, arraylen));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+    ios = file->iosystem;
+
+    /* Check inputs. */
+    if (varid < 0 || varid >= PIO_MAX_VARS || !request)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Sorry, but nonblocking writes are not supported by the async
+     * interface. */
+    if (ios->async)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Can we write to this file? */
+    if (!(file->mode & PIO_WRITE))
+        return pio_err(ios, file, PIO_EPERM, __FILE__, __LINE__);
+
+    /* Get decomposition information. */
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__);
+    pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET,
+              "unknown rearranger", __FILE__, __LINE__);
+
+    /* The local size of the variable must be at least what the
+     * decomposition expects. */
+    if (arraylen < iodesc->ndof)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Get var description. If we don't know the fill value for this
+     * var, get it. */
+    if ((ierr = get_var_desc(varid, file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+    if (!vdesc->fillvalue)
+        if ((ierr = find_var_fillvalue(file, varid, vdesc)))
+            return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__);
+
+    if (!(req = calloc(1, sizeof(darray_req_t))))
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+    req->ioid = ioid;
+    req->varid = varid;
+    req->frame = vdesc->record;
+
+    /* Copy the data of this task. */
+    if (iodesc->ndof > 0)
+    {
+        if (!(req->data = bget(iodesc->basetype_size * (size_t)iodesc->ndof)))
+        {
+            free_darray_req(req);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+        }
+        memcpy(req->data, array, iodesc->basetype_size * (size_t)iodesc->ndof);
+    }
+
+    /* Remember the fill value, if the decomposition needs one. */
+    if (iodesc->needsfill)
+    {
+        if (!(req->fillvalue = bget(iodesc->basetype_size)))
+        {
+            free_darray_req(req);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+        }
+        if (fillvalue)
+            memcpy(req->fillvalue, fillvalue, iodesc->basetype_size);
+        else if ((ierr = find_default_fillvalue(iodesc->basetype, req->fillvalue)))
+        {
+            free_darray_req(req);
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        }
+    }
+
+    /* Allocate the buffer on the IO tasks. For the box rearranger,
+     * start with fill values. They will be overwritten with data
+     * where provided. */
+    if (iodesc->llen > 0)
+    {
+        if (!(req->iobuf = bget(iodesc->basetype_size * (size_t)iodesc->maxiobuflen)))
+        {
+            free_darray_req(req);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+        }
+        if (iodesc->needsfill && iodesc->rearranger == PIO_REARR_BOX)
+            for (int i = 0; i < iodesc->maxiobuflen; i++)
+                memcpy((char *)req->iobuf + iodesc->basetype_size * i, req->fillvalue,
+                       iodesc->basetype_size);
+    }
+
+    /* On the first write of this decomposition, find the fastest
+     * rearranger options, if the iosystem asks for it. */
+    if (ios->rearr_tune && !iodesc->rearr_tuned)
+        if ((ierr = performance_tune_rearranger(ios, iodesc)))
+        {
+            free_darray_req(req);
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        }
+
+    /* Start moving data from compute to IO tasks. */
+    if ((ierr = rearrange_comp2io_start(ios, iodesc, req->data, req->iobuf, 1, &req->nreqs,
+                                        &req->reqs)))
+    {
+        free_darray_req(req);
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+    }
+
+    /* Add the request to the end of the list, so requests are
+     * completed in the order they were started. */
+    req->id = ++file->last_darray_req;
+    if (file->darray_reqs_tail)
+        file->darray_reqs_tail->next = req;
+    else
+        file->darray_reqs = req;
+    file->darray_reqs_tail = req;
+    *request = req->id;
+    LOG((2, "started request %d with %d MPI requests", req->id, req->nreqs));
+
+    /* Issue the writes of earlier requests whose data has arrived. */
+    if ((ierr = progress_darray_reqs(file)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete a write started with PIOc_iwrite_darray(). Issue the write,
+ * if that has not been done yet, and free the request. The request
+ * must already be removed from the list of the file.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param req pointer to the request.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int complete_darray_req(file_desc_t *file, darray_req_t *req)
+{
+    int ierr;
+
+    pioassert(file && req, "invalid input", __FILE__, __LINE__);
+
+    if (!req->done)
+        if ((ierr = write_darray_req(file, req)))
+            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+    free(req);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Complete all writes of a file that were started with
+ * PIOc_iwrite_darray(), in the order they were started.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int wait_all_darray_reqs(file_desc_t *file)
+{
+    darray_req_t *req;
+    int ierr;
+
+    pioassert(file, "invalid input", __FILE__, __LINE__);
+
+    while ((req = file->darray_reqs))
+    {
+        if (!(file->darray_reqs = req->next))
+            file->darray_reqs_tail = NULL;
+        if ((ierr = complete_darray_req(file, req)))
+            return pio_err(NULL, file, ierr, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Wait for a write started with PIOc_iwrite_darray() to finish. The
+ * data is written to the file (for pnetcdf, it may stay in the
+ * pnetcdf buffer until the next flush).
+ *
+ * This function is collective, and must be called by all tasks in
+ * the same order.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param request the ID of the request from PIOc_iwrite_darray().
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_wait(int ncid, int request)
+{
+    file_desc_t *file;     /* Info about file we are writing to. */
+    darray_req_t **prev;   /* Link to the request in the list. */
+    darray_req_t *last = NULL; /* Request before req in the list. */
+    darray_req_t *req;
+    int ierr;              /* Return code. */
+
+    LOG((1, "PIOc_wait ncid = %d request = %d", ncid, request));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    /* Issue the writes of the requests whose data has arrived, so
+     * they go out in the order they were started. */
+    if ((ierr = progress_darray_reqs(file)))
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+
+    /* Find the request and take it out of the list. */
+    for (prev = &file->darray_reqs; *prev; last = *prev, prev = &(*prev)->next)
+        if ((*prev)->id == request)
+            break;
+    if (!(req = *prev))
+        return pio_err(file->iosystem, file, PIO_EINVAL, __FILE__, __LINE__);
+    *prev = req->next;
+    if (file->darray_reqs_tail == req)
+        file->darray_reqs_tail = last;
+
+    if ((ierr = complete_darray_req(file, req)))
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
 /**
  * Read a field from a file to the IO library.
  *
@@ -631,12 +1231,40 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
  */
 int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
                      void *array)
+{
+    return PIOc_read_darray_multi(ncid, &varid, ioid, 1, arraylen, array);
+}
+
+/**
+ * Read multiple fields that share one decomposition from a file to
+ * the IO library. The fields are read into one IO buffer and moved
+ * to the compute tasks in a single rearrangement, instead of one
+ * rearrangement per field.
+ *
+ * @param ncid identifies the netCDF file.
+ * @param varids an array of length nvars containing the variable ids
+ * to be read.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param nvars the number of variables to be read with this call.
+ * @param arraylen the length of the array to be read for each
+ * variable. This is the length of the distrubited array. That is,
+ * the length of the portion of the data that is on the processor.
+ * @param array pointer to the data to be read. There are nvars
+ * arrays of arraylen elements, one for each variable.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_read_darray
+ */
+int PIOc_read_darray_multi(int ncid, const int *varids, int ioid, int nvars,
+                           PIO_Offset arraylen, void *array)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file;     /* Pointer to file information. */
     io_desc_t *iodesc;     /* Pointer to IO description information. */
     void *iobuf = NULL;    /* holds the data as read on the io node. */
+    void *rbuf;            /* The vars as they come from the rearranger. */
     size_t rlen = 0;       /* the length of data in iobuf. */
+    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
     int ierr;           /* Return code. */
 
     /* Get the file info. */
@@ -644,21 +1272,81 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
         return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* Check inputs. */
+    if (nvars <= 0 || !varids)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+    for (int v = 0; v < nvars; v++)
+        if (varids[v] < 0 || varids[v] >= PIO_MAX_VARS)
+            return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+
+    LOG((1, "PIOc_read_darray_multi ncid = %d ioid = %d nvars = %d arraylen = %ld",
+         ncid, ioid, nvars, arraylen));
+
     /* Get the iodesc. */
     if (!(iodesc = pio_get_iodesc_from_id(ioid)))
         return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__);
     pioassert(iodesc->rearranger == PIO_REARR_BOX || iodesc->rearranger == PIO_REARR_SUBSET,
               "unknown rearranger", __FILE__, __LINE__);
 
-    /* ??? */
-    if (ios->iomaster == MPI_ROOT)
+    /* The rearranger puts ndof elements in the array of each var. */
+    if (arraylen < iodesc->ndof)
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* If async is in use, and this is not an IO task, bcast the
+     * parameters, with the number of dims and the record of each
+     * var. The data comes back through the rearranger. */
+    if (ios->async)
+    {
+        if (!ios->ioproc)
+        {
+            int fndims[nvars];
+            int frame[nvars];
+            msg_buf_t mb;
+
+            /* This may send other messages, so do it first. */
+            for (int v = 0; v < nvars; v++)
+            {
+                var_desc_t *vdesc;
+
+                if ((ierr = get_var_ndims(file, varids[v], &fndims[v])))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
+                if ((ierr = get_var_desc(varids[v], file, &vdesc)))
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__);
+                frame[v] = vdesc->record;
+            }
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &nvars, sizeof(int));
+            msg_pack(&mb, varids, nvars * sizeof(int));
+            msg_pack(&mb, &ioid, sizeof(int));
+            msg_pack(&mb, fndims, nvars * sizeof(int));
+            msg_pack(&mb, frame, nvars * sizeof(int));
+            mpierr = send_packed_msg(ios, PIO_MSG_READDARRAY, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_read_darray_multi sent ncid = %d nvars = %d ioid = %d", ncid, nvars,
+                 ioid));
+        }
+
+        /* Handle MPI errors. */
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            return check_mpi(file, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* With the serial iotypes the data of every IO task passes
+     * through the IO master, so it needs room for the largest IO
+     * task. */
+    if (ios->iomaster == MPI_ROOT &&
+        (file->iotype == PIO_IOTYPE_NETCDF || file->iotype == PIO_IOTYPE_NETCDF4C))
         rlen = iodesc->maxiobuflen;
     else
         rlen = iodesc->llen;
 
-    /* Allocate a buffer for one record. */
+    /* Allocate a buffer for one record of each var. */
     if (ios->ioproc && rlen > 0)
-        if (!(iobuf = bget(iodesc->basetype_size * rlen)))
+        if (!(iobuf = bget(iodesc->basetype_size * nvars * rlen)))
             return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
 
     /* Call the correct darray read function based on iotype. */
@@ -666,24 +1354,41 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
     {
     case PIO_IOTYPE_NETCDF:
     case PIO_IOTYPE_NETCDF4C:
-        if ((ierr = pio_read_darray_nc_serial(file, iodesc, varid, iobuf)))
-                return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        if ((ierr = pio_read_darray_nc_serial(file, iodesc, nvars, varids, iobuf)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
         break;
     case PIO_IOTYPE_PNETCDF:
     case PIO_IOTYPE_NETCDF4P:
-        if ((ierr = pio_read_darray_nc(file, iodesc, varid, iobuf)))
+        if ((ierr = pio_read_darray_nc(file, iodesc, nvars, varids, iobuf)))
             return pio_err(ios, file, ierr, __FILE__, __LINE__);
         break;
     default:
         return pio_err(NULL, NULL, PIO_EBADIOTYPE, __FILE__, __LINE__);
     }
 
-    /* Rearrange the data. */
-    if ((ierr = rearrange_io2comp(ios, iodesc, iobuf, array)))
+    /* The rearranger puts the vars ndof elements apart. If the
+     * caller's arrays are longer, rearrange into a temporary
+     * buffer. */
+    rbuf = array;
+    if (nvars > 1 && arraylen > iodesc->ndof)
+        if (!(rbuf = bget(iodesc->basetype_size * nvars * iodesc->ndof)))
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+
+    /* Rearrange the data of all vars at once. */
+    if ((ierr = rearrange_io2comp(ios, iodesc, iobuf, rbuf, nvars)))
         return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
+    if (rbuf != array)
+    {
+        for (int v = 0; v < nvars; v++)
+            memcpy((char *)array + (size_t)v * arraylen * iodesc->basetype_size,
+                   (char *)rbuf + (size_t)v * iodesc->ndof * iodesc->basetype_size,
+                   iodesc->ndof * iodesc->basetype_size);
+        brel(rbuf);
+    }
+
     /* Free the buffer. */
-    if (rlen > 0)
+    if (iobuf)
         brel(iobuf);
 
     return PIO_NOERR;
@@ -25,6 +25,13 @@ extern void *CN_bpool;
 /* Maximum buffer usage. */
 extern PIO_Offset maxusage;
 
+/* Number of arrays a new write multi buffer has room for. */
+#define WMB_MIN_CAPACITY 4
+
+/* Bucket of the write multi buffer of a decomposition in the hash
+ * table of a file. */
+#define WMB_HASH(ioid, recordvar) ((unsigned)(2 * (ioid) + (recordvar)) % PIO_WMB_HASH_SIZE)
+
 /* handler for freeing the memory buffer pool */
 void bpool_free(void *p)
 {
@@ -39,7 +46,9 @@ void bpool_free(void *p)
  * Initialize the compute buffer to size pio_cnbuffer_limit.
  *
  * This routine initializes the compute buffer pool if the bget memory
- * management is used. If malloc is used (that is, PIO_USE_MALLOC is
+ * management is used. If the size-class pool is used (that is,
+ * PIO_USE_POOL is non zero), the pool is created with a limit of
+ * pio_cnbuffer_limit. If malloc is used (that is, PIO_USE_MALLOC is
  * non zero), this function does nothing.
  *
  * @param ios pointer to the iosystem descriptor which will use the
@@ -48,7 +57,13 @@ void bpool_free(void *p)
  */
 int compute_buffer_init(iosystem_desc_t *ios)
 {
-#if !PIO_USE_MALLOC
+#if PIO_USE_POOL
+    int ret;
+
+    if (!CN_bpool)
+        if ((ret = pio_pool_create(pio_cnbuffer_limit, (pio_pool **)&CN_bpool)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+#elif !PIO_USE_MALLOC
 
     if (!CN_bpool)
     {
@@ -109,7 +124,7 @@ int pio_write_darray_multi_nc(file_desc_t *file, int nvars, const int *vid, int
     int fndims;            /* Number of dims for this var in the file. */
     int dsize;             /* Data size (for one region). */
     int tsize;             /* Size of MPI type. */
-    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
+    int mpierr;            /* Return code from MPI function codes. */
     int ierr = PIO_NOERR;
 
     /* Check inputs. */
@@ -129,30 +144,11 @@ int pio_write_darray_multi_nc(file_desc_t *file, int nvars, const int *vid, int
     ios = file->iosystem;
 
     /* Point to var description scruct for first var. */
-    vdesc = file->varlist + vid[0];
-
-    /* If async is in use, send message to IO master task. */
-    if (ios->async)
-    {
-        if (!ios->ioproc)
-        {
-            int msg = 0;
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&file->pio_ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-        }
-
-        /* Handle MPI errors. */
-        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
-            return check_mpi(file, mpierr2, __FILE__, __LINE__);
-        if (mpierr)
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
-    }
+    if ((ierr = get_var_desc(vid[0], file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     /* Find out how many dims this variable has. */
-    if ((ierr = PIOc_inq_varndims(file->pio_ncid, vid[0], &fndims)))
+    if ((ierr = get_var_ndims(file, vid[0], &fndims)))
         return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     /* Find out the size of the MPI type. */
@@ -165,7 +161,7 @@ int pio_write_darray_multi_nc(file_desc_t *file, int nvars, const int *vid, int
     {
         io_region *region = firstregion;
         int rrcnt = 0; /* Number of subarray requests (pnetcdf only). */
-        void *bufptr;
+        void *bufptr = NULL;
         size_t start[fndims];
         size_t count[fndims];
         int ndims = iodesc_ndims;
@@ -289,7 +285,8 @@ int pio_write_darray_multi_nc(file_desc_t *file, int nvars, const int *vid, int
                     for (int nv = 0; nv < nvars; nv++)
                     {
                         /* Get the var info. */
-                        vdesc = file->varlist + vid[nv];
+                        if ((ierr = get_var_desc(vid[nv], file, &vdesc)))
+                            return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
                         /* If this is a record var, set the start for
                          * the record dimension. */
@@ -440,7 +437,14 @@ int find_all_start_count(io_region *region, int maxregions, int fndims,
 
 /**
  * Internal function called by IO tasks other than IO task 0 to send
- * their tmp_start/tmp_count arrays to IO task 0.
+ * their tmp_start/tmp_count arrays and data to IO task 0.
+ *
+ * The length, the number of regions and the start/count arrays are
+ * sent as one message, described by a derived type over their
+ * addresses, so nothing is copied. The data follows in a second
+ * message, counted in elements of the basetype of the decomposition,
+ * so its size in bytes is not limited by an int. IO task 0 receives
+ * both in recv_and_write_data().
  *
  * This is an internal function which is only called on io tasks other
  * than IO task 0. It is called by write_darray_multi_serial().
@@ -452,6 +456,11 @@ int send_all_start_count(iosystem_desc_t *ios, io_desc_t *iodesc, PIO_Offset lle
                          int maxregions, int nvars, int fndims, size_t *tmp_start,
                          size_t *tmp_count, void *iobuf)
 {
+    PIO_Offset hdr[2];     /* Length of the data and number of regions. */
+    int blocklen[3];       /* Size in bytes of each part of the message. */
+    MPI_Aint disp[3];      /* Address of each part of the message. */
+    int nblocks = 1;       /* Number of parts in the message. */
+    MPI_Datatype msgtype;  /* Type describing the whole message. */
     MPI_Status status;     /* Recv status for MPI. */
     int mpierr;  /* Return code from MPI function codes. */
     int ierr;    /* Return code. */
@@ -460,35 +469,159 @@ int send_all_start_count(iosystem_desc_t *ios, io_desc_t *iodesc, PIO_Offset lle
     pioassert(ios && ios->ioproc && ios->io_rank > 0 && maxregions >= 0,
               "invalid inputs", __FILE__, __LINE__);
 
-    /* Do a handshake. */
-    if ((mpierr = MPI_Recv(&ierr, 1, MPI_INT, 0, 0, ios->io_comm, &status)))
+    /* Local length of iobuffer for each field (all fields are the
+     * same length), and the number of data regions. */
+    hdr[0] = llen;
+    hdr[1] = llen > 0 ? maxregions : 0;
+    blocklen[0] = sizeof(hdr);
+    if ((mpierr = MPI_Get_address(hdr, &disp[0])))
         return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
 
-    /* Send local length of iobuffer for each field (all
-     * fields are the same length). */
-    if ((mpierr = MPI_Send((void *)&llen, 1, MPI_OFFSET, 0, ios->io_rank, ios->io_comm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((3, "sent llen = %d", llen));
-
-    /* Send the number of data regions, the start/count for
-     * all regions, and the data buffer with all the data. */
+    /* The start/count for all regions. */
     if (llen > 0)
     {
-        if ((mpierr = MPI_Send((void *)&maxregions, 1, MPI_INT, 0, ios->io_rank + ios->num_iotasks,
-                               ios->io_comm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-        if ((mpierr = MPI_Send(tmp_start, maxregions * fndims, MPI_OFFSET, 0,
-                               ios->io_rank + 2 * ios->num_iotasks, ios->io_comm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-        if ((mpierr = MPI_Send(tmp_count, maxregions * fndims, MPI_OFFSET, 0,
-                               ios->io_rank + 3 * ios->num_iotasks, ios->io_comm)))
+        blocklen[1] = blocklen[2] = maxregions * fndims * sizeof(size_t);
+        if ((mpierr = MPI_Get_address(tmp_start, &disp[1])))
             return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-        if ((mpierr = MPI_Send(iobuf, nvars * llen, iodesc->basetype, 0,
-                               ios->io_rank + 4 * ios->num_iotasks, ios->io_comm)))
+        if ((mpierr = MPI_Get_address(tmp_count, &disp[2])))
             return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-        LOG((3, "sent data for maxregions = %d", maxregions));
+        nblocks = 3;
     }
 
+#if PIO_USE_MPISERIAL
+    if ((mpierr = MPI_Type_hindexed(nblocks, blocklen, disp, MPI_BYTE, &msgtype)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+#else
+    if ((mpierr = MPI_Type_create_hindexed(nblocks, blocklen, disp, MPI_BYTE, &msgtype)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+#endif /* PIO_USE_MPISERIAL */
+    if ((mpierr = MPI_Type_commit(&msgtype)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* Wait for the handshake, so that IO task 0 only has one
+     * message in flight, then send. If IO task 0 failed, the
+     * handshake is its error code, and nothing is sent. */
+    if ((mpierr = MPI_Recv(&ierr, 1, MPI_INT, 0, 0, ios->io_comm, &status)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (ierr)
+    {
+        MPI_Type_free(&msgtype);
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__);
+    }
+    if ((mpierr = MPI_Send(MPI_BOTTOM, 1, msgtype, 0, ios->io_rank, ios->io_comm)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Send(iobuf, nvars * llen, iodesc->basetype, 0, ios->io_rank,
+                           ios->io_comm)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    LOG((3, "sent llen = %d regions = %d", llen, hdr[1]));
+
+    if ((mpierr = MPI_Type_free(&msgtype)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write the data of all regions from one IO task with the serial
+ * netCDF library. This is called from recv_and_write_data().
+ *
+ * @param file a pointer to the open file descriptor for the file
+ * that will be written to.
+ * @param vid an array of the variable ids to be written
+ * @param frame the record dimension for each of the nvars variables
+ * in iobuf.  NULL if this iodesc contains non-record vars.
+ * @param iodesc pointer to the decomposition info.
+ * @param rlen length of the iobuffer of the IO task for a single
+ * field.
+ * @param rregions number of regions of the IO task.
+ * @param nvars the number of variables to be written with this
+ * decomposition.
+ * @param fndims the number of dimensions in the file.
+ * @param tmp_start the start values for all regions.
+ * @param tmp_count the count values for all regions.
+ * @param iobuf the data of the IO task.
+ * @param req the two receives of the next message, which are in
+ * progress while the data is written, or MPI_REQUEST_NULL. They are
+ * tested after each region so that they move along.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int write_serial_regions(file_desc_t *file, const int *vid, const int *frame,
+                                io_desc_t *iodesc, size_t rlen, int rregions, int nvars,
+                                int fndims, const size_t *tmp_start, const size_t *tmp_count,
+                                void *iobuf, MPI_Request *req)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    size_t start[fndims], count[fndims];
+    size_t loffset = 0;
+    void *bufptr;
+    var_desc_t *vdesc;     /* Contains info about the variable. */
+    int flag;
+    int mpierr;  /* Return code from MPI function codes. */
+    int ierr;    /* Return code. */
+
+    if ((ierr = get_var_desc(vid[0], file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
+    for (int regioncnt = 0; regioncnt < rregions; regioncnt++)
+    {
+        LOG((3, "writing data for region with regioncnt = %d", regioncnt));
+
+        /* Get the start/count arrays for this region. */
+        for (int i = 0; i < fndims; i++)
+        {
+            start[i] = tmp_start[i + regioncnt * fndims];
+            count[i] = tmp_count[i + regioncnt * fndims];
+            LOG((3, "start[%d] = %d count[%d] = %d", i, start[i], i, count[i]));
+        }
+
+        /* Process each variable in the buffer. */
+        for (int nv = 0; nv < nvars; nv++)
+        {
+            LOG((3, "writing buffer var %d", nv));
+
+            /* Get a pointer to the correct part of the buffer. */
+            bufptr = (void *)((char *)iobuf + iodesc->basetype_size * (nv * rlen + loffset));
+
+            /* If this var has an unlimited dim, set
+             * the start on that dim to the frame
+             * value for this variable. */
+            if (vdesc->record >= 0)
+            {
+                if (fndims > 1 && iodesc->ndims < fndims && count[1] > 0)
+                {
+                    count[0] = 1;
+                    start[0] = frame[nv];
+                }
+                else if (fndims == iodesc->ndims)
+                {
+                    start[0] += vdesc->record;
+                }
+            }
+
+            /* Call the netCDF functions to write the data. */
+            if ((ierr = nc_put_vara(file->fh, vid[nv], start, count, bufptr)))
+                return check_netcdf2(ios, NULL, ierr, __FILE__, __LINE__);
+
+        } /* next var */
+
+        /* Calculate the total size. */
+        size_t tsize = 1;
+        for (int i = 0; i < fndims; i++)
+            tsize *= count[i];
+
+        /* Keep track of where we are in the buffer. */
+        loffset += tsize;
+
+        LOG((3, " at bottom of loop regioncnt = %d tsize = %d loffset = %d", regioncnt,
+             tsize, loffset));
+
+        /* Let the next message make progress. */
+        if (req[0] != MPI_REQUEST_NULL || req[1] != MPI_REQUEST_NULL)
+            if ((mpierr = MPI_Testall(2, req, &flag, MPI_STATUSES_IGNORE)))
+                return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    } /* next regioncnt */
+
     return PIO_NOERR;
 }
 
@@ -497,6 +630,10 @@ int send_all_start_count(iosystem_desc_t *ios, io_desc_t *iodesc, PIO_Offset lle
  * receives data from all the other IO tasks, and write that data to
  * disk. This is called from write_darray_multi_serial().
  *
+ * The data of the next IO task is received into one of two buffers
+ * while the data of the current one is written from the other, so
+ * that the receives and the writes overlap.
+ *
  * @param file a pointer to the open file descriptor for the file
  * that will be written to.
  * @param vid an array of the variable ids to be written
@@ -505,17 +642,18 @@ int send_all_start_count(iosystem_desc_t *ios, io_desc_t *iodesc, PIO_Offset lle
  * @param iodesc pointer to the decomposition info.
  * @param llen length of the iobuffer on this task for a single
  * field.
+ * @param maxlen the largest llen of any IO task.
  * @param maxregions max number of blocks to be written from this
  * iotask.
  * @param nvars the number of variables to be written with this
  * decomposition.
  * @param fndims the number of dimensions in the file.
  * @param tmp_start pointer to an already allocaed array of length
- * fndims * maxregions. This array will get the start values for all
- * regions.
+ * fndims * maxregions, with the start values for all regions of
+ * this task.
  * @param tmp_count pointer to an already allocaed array of length
- * fndims * maxregions. This array will get the count values for all
- * regions.
+ * fndims * maxregions, with the count values for all regions of
+ * this task.
  * @param iobuf the buffer to be written from this mpi task. May be
  * null. for example we have 8 ionodes and a distributed array with
  * global size 4, then at least 4 nodes will have a null iobuf. In
@@ -527,127 +665,122 @@ int send_all_start_count(iosystem_desc_t *ios, io_desc_t *iodesc, PIO_Offset lle
  * @ingroup PIO_write_darray
  */
 int recv_and_write_data(file_desc_t *file, const int *vid, const int *frame,
-                        io_desc_t *iodesc, PIO_Offset llen, int maxregions, int nvars,
-                        int fndims, size_t *tmp_start, size_t *tmp_count, void *iobuf)
+                        io_desc_t *iodesc, PIO_Offset llen, PIO_Offset maxlen,
+                        int maxregions, int nvars, int fndims, size_t *tmp_start,
+                        size_t *tmp_count, void *iobuf)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     size_t rlen;    /* Length of IO buffer on this task. */
     int rregions;   /* Number of regions in buffer for this task. */
-    size_t start[fndims], count[fndims];
-    size_t loffset;
-    void *bufptr;
-    var_desc_t *vdesc;     /* Contains info about the variable. */
-    MPI_Status status;     /* Recv status for MPI. */
-    int mpierr;  /* Return code from MPI function codes. */
-    int ierr;    /* Return code. */
+    size_t *rstart; /* Start values of the regions of this task. */
+    size_t *rcount; /* Count values of the regions of this task. */
+    void *rdata;    /* Data of this task. */
+    char *rbuf[2] = {NULL, NULL}; /* Messages from the other tasks. */
+    size_t hdrsize; /* Size of the largest message without the data. */
+    size_t msgsize; /* Size of the largest message with the data. */
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL}; /* Receives of next message. */
+    int posted = 0; /* Task whose message is received in req. */
+    int hs = 0;     /* Handshake value. */
+    int last_hs = 0; /* Last task that was sent the handshake. */
+    int mpierr = MPI_SUCCESS;  /* Return code from MPI function codes. */
+    int ierr = PIO_NOERR;      /* Return code. */
 
     ios = file->iosystem;
 
+    /* A message has the length and number of regions, and the
+     * start/count arrays of all regions. It is followed by a message
+     * with the data, which is received after it in the same
+     * buffer. */
+    hdrsize = 2 * sizeof(PIO_Offset) + 2 * maxregions * fndims * sizeof(size_t);
+    msgsize = hdrsize + nvars * maxlen * iodesc->basetype_size;
+
     /* For each of the other tasks that are using this task
      * for IO. */
     for (int rtask = 0; rtask < ios->num_iotasks; rtask++)
     {
-        /* From the remote tasks, we send information about
-         * the data regions. and also the data. */
+        /* From the remote tasks, we get information about
+         * the data regions, and also the data. */
         if (rtask)
         {
-            /* handshake - tell the sending task I'm ready */
-            if ((mpierr = MPI_Send(&ierr, 1, MPI_INT, rtask, 0, ios->io_comm)))
-                return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-            /* Get length of iobuffer for each field on this
-             * task (all fields are the same length). */
-            if ((mpierr = MPI_Recv(&rlen, 1, MPI_OFFSET, rtask, rtask, ios->io_comm,
-                                   &status)))
-                return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-            LOG((3, "received rlen = %d", rlen));
+            PIO_Offset *hdr = (PIO_Offset *)rbuf[rtask % 2];
 
-            /* Get the number of regions, the start/count
-             * values for all regions, and the data buffer. */
-            if (rlen > 0)
-            {
-                if ((mpierr = MPI_Recv(&rregions, 1, MPI_INT, rtask, rtask + ios->num_iotasks,
-                                       ios->io_comm, &status)))
-                    return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-                if ((mpierr = MPI_Recv(tmp_start, rregions * fndims, MPI_OFFSET, rtask,
-                                       rtask + 2 * ios->num_iotasks, ios->io_comm, &status)))
-                    return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-                if ((mpierr = MPI_Recv(tmp_count, rregions * fndims, MPI_OFFSET, rtask,
-                                       rtask + 3 * ios->num_iotasks, ios->io_comm, &status)))
-                    return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-                if ((mpierr = MPI_Recv(iobuf, nvars * rlen, iodesc->basetype, rtask,
-                                       rtask + 4 * ios->num_iotasks, ios->io_comm, &status)))
-                    return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-                LOG((3, "received data rregions = %d fndims = %d", rregions, fndims));
-            }
+            if ((mpierr = MPI_Waitall(2, req, MPI_STATUSES_IGNORE)))
+                break;
+            rlen = hdr[0];
+            rregions = hdr[1];
+            rstart = (size_t *)(hdr + 2);
+            rcount = rstart + rregions * fndims;
+            rdata = rbuf[rtask % 2] + hdrsize;
+            LOG((3, "received rlen = %d rregions = %d fndims = %d", rlen, rregions, fndims));
         }
         else /* task 0 */
         {
             rlen = llen;
             rregions = maxregions;
+            rstart = tmp_start;
+            rcount = tmp_count;
+            rdata = iobuf;
         }
         LOG((3, "rtask = %d rlen = %d rregions = %d", rtask, rlen, rregions));
 
-        /* If there is data from this task, write it. */
-        if (rlen > 0)
+        /* Start getting the next task's message. */
+        if (rtask + 1 < ios->num_iotasks)
         {
-            loffset = 0;
-            for (int regioncnt = 0; regioncnt < rregions; regioncnt++)
-            {
-                LOG((3, "writing data for region with regioncnt = %d", regioncnt));
-
-                /* Get the start/count arrays for this region. */
-                for (int i = 0; i < fndims; i++)
-                {
-                    start[i] = tmp_start[i + regioncnt * fndims];
-                    count[i] = tmp_count[i + regioncnt * fndims];
-                    LOG((3, "start[%d] = %d count[%d] = %d", i, start[i], i, count[i]));
-                }
-
-                /* Process each variable in the buffer. */
-                for (int nv = 0; nv < nvars; nv++)
-                {
-                    LOG((3, "writing buffer var %d", nv));
-                    vdesc = file->varlist + vid[0];
-
-                    /* Get a pointer to the correct part of the buffer. */
-                    bufptr = (void *)((char *)iobuf + iodesc->basetype_size * (nv * rlen + loffset));
+            int next = (rtask + 1) % 2;
 
-                    /* If this var has an unlimited dim, set
-                     * the start on that dim to the frame
-                     * value for this variable. */
-                    if (vdesc->record >= 0)
-                    {
-                        if (fndims > 1 && iodesc->ndims < fndims && count[1] > 0)
-                        {
-                            count[0] = 1;
-                            start[0] = frame[nv];
-                        }
-                        else if (fndims == iodesc->ndims)
-                        {
-                            start[0] += vdesc->record;
-                        }
-                    }
+            if (!rbuf[next] && !(rbuf[next] = bget(msgsize)))
+            {
+                ierr = PIO_ENOMEM;
+                break;
+            }
+            posted = rtask + 1;
+            if ((mpierr = MPI_Irecv(rbuf[next], hdrsize, MPI_BYTE, rtask + 1, rtask + 1,
+                                    ios->io_comm, &req[0])))
+                break;
+            if ((mpierr = MPI_Irecv(rbuf[next] + hdrsize, nvars * maxlen, iodesc->basetype,
+                                    rtask + 1, rtask + 1, ios->io_comm, &req[1])))
+                break;
 
-                    /* Call the netCDF functions to write the data. */
-                    if ((ierr = nc_put_vara(file->fh, vid[nv], start, count, bufptr)))
-                        return check_netcdf2(ios, NULL, ierr, __FILE__, __LINE__);
+            /* handshake - tell the sending task I'm ready */
+            if ((mpierr = MPI_Send(&hs, 1, MPI_INT, rtask + 1, 0, ios->io_comm)))
+                break;
+            last_hs = rtask + 1;
+        }
 
-                } /* next var */
+        /* If there is data from this task, write it. */
+        if (rlen > 0)
+            if ((ierr = write_serial_regions(file, vid, frame, iodesc, rlen, rregions, nvars,
+                                             fndims, rstart, rcount, rdata, req)))
+                break;
+    } /* next rtask */
 
-                /* Calculate the total size. */
-                size_t tsize = 1;
-                for (int i = 0; i < fndims; i++)
-                    tsize *= count[i];
+    /* On error, the receives in progress must be finished before
+     * their buffers are freed. The task that got the handshake sends
+     * its message, so it is received, otherwise the receives are
+     * cancelled. The tasks still waiting for the handshake get the
+     * error code instead, so they return it rather than hang. The
+     * first error is the one returned, so the return codes of this
+     * cleanup are not checked. */
+    if (ierr || mpierr)
+    {
+        hs = ierr ? ierr : PIO_EIO;
+        if (posted != last_hs)
+            for (int i = 0; i < 2; i++)
+                if (req[i] != MPI_REQUEST_NULL)
+                    MPI_Cancel(&req[i]);
+        MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+        for (int rtask = last_hs + 1; rtask < ios->num_iotasks; rtask++)
+            MPI_Send(&hs, 1, MPI_INT, rtask, 0, ios->io_comm);
+    }
 
-                /* Keep track of where we are in the buffer. */
-                loffset += tsize;
+    for (int i = 0; i < 2; i++)
+        if (rbuf[i])
+            brel(rbuf[i]);
 
-                LOG((3, " at bottom of loop regioncnt = %d tsize = %d loffset = %d", regioncnt,
-                     tsize, loffset));
-            } /* next regioncnt */
-        } /* endif (rlen > 0) */
-    } /* next rtask */
+    if (mpierr)
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (ierr)
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     return PIO_NOERR;
 }
@@ -683,17 +816,16 @@ int recv_and_write_data(file_desc_t *file, const int *vid, const int *frame,
  * @ingroup PIO_write_darray
  */
 int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
-                              io_desc_t *iodesc, int fill, const int *frame)
+                              io_desc_t *iodesc, int fill, void *fillbuf, const int *frame)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     var_desc_t *vdesc;     /* Contains info about the variable. */
     int fndims;            /* Number of dims in the var in the file. */
-    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
     int ierr;              /* Return code. */
 
     /* Check inputs. */
-    pioassert(file && file->iosystem && file->varlist && vid && vid[0] >= 0 &&
-              vid[0] <= PIO_MAX_VARS && iodesc, "invalid input", __FILE__, __LINE__);
+    pioassert(file && file->iosystem && vid && vid[0] >= 0 &&
+              vid[0] < PIO_MAX_VARS && iodesc, "invalid input", __FILE__, __LINE__);
 
     LOG((1, "write_darray_multi_serial nvars = %d iodesc->ndims = %d iodesc->basetype = %d",
          nvars, iodesc->ndims, iodesc->basetype));
@@ -702,7 +834,8 @@ int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
     ios = file->iosystem;
 
     /* Get the var info. */
-    vdesc = file->varlist + vid[0];
+    if ((ierr = get_var_desc(vid[0], file, &vdesc)))
+        return pio_err(ios, file, ierr, __FILE__, __LINE__);
     LOG((2, "vdesc record %d ndims %d nreqs %d ios->async = %d", vdesc->record,
          vdesc->ndims, vdesc->nreqs, ios->async));
 
@@ -710,36 +843,16 @@ int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
     int num_regions = fill ? iodesc->maxfillregions: iodesc->maxregions;
     io_region *region = fill ? iodesc->fillregion : iodesc->firstregion;
     PIO_Offset llen = fill ? iodesc->holegridsize : iodesc->llen;
-    void *iobuf = fill ? vdesc->fillbuf : vdesc->iobuf;
+    PIO_Offset maxlen = fill ? iodesc->maxholegridsize : iodesc->maxiobuflen;
+    void *iobuf = fill ? fillbuf : vdesc->iobuf;
 
 #ifdef TIMING
     /* Start timing this function. */
     GPTLstart("PIO:write_darray_multi_nc_serial");
 #endif
 
-    /* If async is in use, and this is not an IO task, bcast the parameters. */
-    if (ios->async)
-    {
-        if (!ios->ioproc)
-        {
-            int msg = 0;
-
-            if (ios->comp_rank == 0)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&file->pio_ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-        }
-
-        /* Handle MPI errors. */
-        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
-            return check_mpi(file, mpierr2, __FILE__, __LINE__);
-        if (mpierr)
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
-    }
-
     /* Get the number of dimensions. */
-    if ((ierr = PIOc_inq_varndims(file->pio_ncid, vid[0], &fndims)))
+    if ((ierr = get_var_ndims(file, vid[0], &fndims)))
         return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
     /* Only IO tasks participate in this code. */
@@ -769,8 +882,8 @@ int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
         {
             /* Task 0 will receive data from all other IO tasks. */
 
-            if ((ierr = recv_and_write_data(file, vid, frame, iodesc, llen, num_regions, nvars, fndims,
-                                            tmp_start, tmp_count, iobuf)))
+            if ((ierr = recv_and_write_data(file, vid, frame, iodesc, llen, maxlen, num_regions,
+                                            nvars, fndims, tmp_start, tmp_count, iobuf)))
                 return pio_err(ios, file, ierr, __FILE__, __LINE__);
         }
     }
@@ -784,32 +897,37 @@ int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
 }
 
 /**
- * Read an array of data from a file to the (parallel) IO library.
+ * Read arrays of data from a file to the (parallel) IO library.
+ *
+ * With pnetcdf, the reads of all the variables are posted with
+ * ncmpi_iget_varn() and completed with one call to ncmpi_wait_all().
  *
  * @param file a pointer to the open file descriptor for the file
  * that will be written to
  * @param iodesc a pointer to the defined iodescriptor for the buffer
- * @param vid the variable id to be read
- * @param iobuf the buffer to be read into from this mpi task. May be
- * null. for example we have 8 ionodes and a distributed array with
- * global size 4, then at least 4 nodes will have a null iobuf. In
- * practice the box rearranger trys to have at least blocksize bytes
- * on each io task and so if the total number of bytes to write is
- * less than blocksize*numiotasks then some iotasks will have a NULL
- * iobuf.
+ * @param nvars the number of variables to be read.
+ * @param vids an array of the variable ids to be read.
+ * @param iobuf the buffer to be read into from this mpi task, with
+ * iodesc->llen elements for each variable. May be null. for example
+ * we have 8 ionodes and a distributed array with global size 4, then
+ * at least 4 nodes will have a null iobuf. In practice the box
+ * rearranger trys to have at least blocksize bytes on each io task
+ * and so if the total number of bytes to write is less than
+ * blocksize*numiotasks then some iotasks will have a NULL iobuf.
  * @return 0 on success, error code otherwise.
  * @ingroup PIO_read_darray
  */
-int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobuf)
+int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int nvars, const int *vids,
+                       void *iobuf)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
-    var_desc_t *vdesc;     /* Information about the variable. */
-    int ndims;             /* Number of dims in decomposition. */
-    int fndims;            /* Number of dims for this var in file. */
     int ierr;              /* Return code from netCDF functions. */
+#ifdef _PNETCDF
+    int request[nvars];    /* Pnetcdf requests, one per var. */
+#endif
 
     /* Check inputs. */
-    pioassert(file && file->iosystem && iodesc && vid <= PIO_MAX_VARS, "invalid input",
+    pioassert(file && file->iosystem && iodesc && nvars > 0 && vids, "invalid input",
               __FILE__, __LINE__);
 
 #ifdef TIMING
@@ -820,23 +938,33 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
     /* Get the IO system info. */
     ios = file->iosystem;
 
-    /* Get the variable info. */
-    vdesc = file->varlist + vid;
+    for (int v = 0; v < nvars; v++)
+    {
+        var_desc_t *vdesc;     /* Information about the variable. */
+        int vid = vids[v];     /* The variable being read. */
+        int ndims;             /* Number of dims in decomposition. */
+        int fndims;            /* Number of dims for this var in file. */
+        void *bufv = NULL;     /* The part of iobuf for this var. */
+
+        /* Get the variable info. */
+        if ((ierr = get_var_desc(vid, file, &vdesc)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
-    /* Get the number of dimensions in the decomposition. */
-    ndims = iodesc->ndims;
+        /* Get the number of dimensions in the decomposition. */
+        ndims = iodesc->ndims;
 
-    /* Get the number of dims for this var in the file. */
-    if ((ierr = PIOc_inq_varndims(file->pio_ncid, vid, &fndims)))
-        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        /* Get the number of dims for this var in the file. */
+        if ((ierr = get_var_ndims(file, vid, &fndims)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
-    /* Is this a non-record var? */
-    if (fndims == ndims)
-        vdesc->record = -1;
+        /* Is this a non-record var? */
+        if (fndims == ndims)
+            vdesc->record = -1;
+
+        /* IO procs will actially read the data. */
+        if (!ios->ioproc)
+            continue;
 
-    /* IO procs will actially read the data. */
-    if (ios->ioproc)
-    {
         io_region *region;
         size_t start[fndims];
         size_t count[fndims];
@@ -846,6 +974,10 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
         PIO_Offset *startlist[iodesc->maxregions];
         PIO_Offset *countlist[iodesc->maxregions];
 
+        /* Each var has llen elements of iobuf. */
+        if (iobuf)
+            bufv = (char *)iobuf + (size_t)v * iodesc->llen * iodesc->basetype_size;
+
         /* buffer is incremented by byte and loffset is in terms of
            the iodessc->basetype so we need to multiply by the size of
            the basetype. */
@@ -877,9 +1009,9 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
             {
                 /* Get a pointer where we should put the data we read. */
                 if (regioncnt == 0 || region == NULL)
-                    bufptr = iobuf;
+                    bufptr = bufv;
                 else
-                    bufptr=(void *)((char *)iobuf + iodesc->basetype_size * region->loffset);
+                    bufptr=(void *)((char *)bufv + iodesc->basetype_size * region->loffset);
 
                 LOG((2, "%d %d %d", iodesc->llen - region->loffset, iodesc->llen, region->loffset));
 
@@ -941,9 +1073,10 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
                 /* Is this is the last region to process? */
                 if (regioncnt == iodesc->maxregions - 1)
                 {
-                    /* Read a list of subarrays. */
-                    ierr = ncmpi_get_varn_all(file->fh, vid, rrlen, startlist,
-                                              countlist, iobuf, iodesc->llen, iodesc->basetype);
+                    /* Post the read of a list of subarrays. It is
+                     * completed with the other vars below. */
+                    ierr = ncmpi_iget_varn(file->fh, vid, rrlen, startlist, countlist,
+                                           bufv, iodesc->llen, iodesc->basetype, &request[v]);
 
                     /* Release the start and count arrays. */
                     for (int i = 0; i < rrlen; i++)
@@ -967,7 +1100,18 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
             if (region)
                 region = region->next;
         } /* next regioncnt */
+    } /* next var */
+
+#ifdef _PNETCDF
+    /* Complete the reads of all vars together. */
+    if (ios->ioproc && file->iotype == PIO_IOTYPE_PNETCDF)
+    {
+        int status[nvars];
+
+        if ((ierr = ncmpi_wait_all(file->fh, nvars, request, status)))
+            return check_netcdf(file, ierr, __FILE__, __LINE__);
     }
+#endif
 
 #ifdef TIMING
     /* Stop timing this function. */
@@ -978,38 +1122,45 @@ int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobu
 }
 
 /**
- * Read an array of data from a file to the (serial) IO library. This
+ * Read arrays of data from a file to the (serial) IO library. This
  * function is only used with netCDF classic and netCDF-4 serial
  * iotypes.
  *
+ * Each IO task sends the starts and counts of its regions to IO task
+ * 0 once. IO task 0 reads the regions of all the variables for each
+ * IO task in turn, and sends them back in one message.
+ *
  * @param file a pointer to the open file descriptor for the file
- * that will be written to
+ * that will be read from.
  * @param iodesc a pointer to the defined iodescriptor for the buffer
- * @param vid the variable id to be read.
- * @param iobuf the buffer to be written from this mpi task. May be
- * null. for example we have 8 ionodes and a distributed array with
- * global size 4, then at least 4 nodes will have a null iobuf. In
- * practice the box rearranger trys to have at least blocksize bytes
- * on each io task and so if the total number of bytes to write is
- * less than blocksize * numiotasks then some iotasks will have a NULL
- * iobuf.
+ * @param nvars the number of variables to be read.
+ * @param vids an array of the variable ids to be read.
+ * @param iobuf the buffer to be read into from this mpi task, with
+ * iodesc->llen elements for each variable. On IO task 0 it must have
+ * room for iodesc->maxiobuflen elements for each variable, since the
+ * data of the other IO tasks passes through it. May be null. for
+ * example we have 8 ionodes and a distributed array with global size
+ * 4, then at least 4 nodes will have a null iobuf. In practice the
+ * box rearranger trys to have at least blocksize bytes on each io
+ * task and so if the total number of bytes to write is less than
+ * blocksize * numiotasks then some iotasks will have a NULL iobuf.
  * @returns 0 for success, error code otherwise.
  * @ingroup PIO_read_darray
  */
-int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int vid,
+int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int nvars, const int *vids,
                               void *iobuf)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
-    var_desc_t *vdesc;     /* Information about the variable. */
+    var_desc_t *vdesc[nvars]; /* Information about the variables. */
     int ndims;             /* Number of dims in decomposition. */
-    int fndims;            /* Number of dims for this var in file. */
+    int fndims[nvars];     /* Number of dims for each var in file. */
     MPI_Status status;
     int mpierr;  /* Return code from MPI functions. */
     int ierr;
 
     /* Check inputs. */
-    pioassert(file && file->iosystem && iodesc && vid >= 0 && vid <= PIO_MAX_VARS,
-              "invalid input", __FILE__, __LINE__);
+    pioassert(file && file->iosystem && iodesc && nvars > 0 && vids, "invalid input",
+              __FILE__, __LINE__);
 
 #ifdef TIMING
     /* Start timing this function. */
@@ -1017,98 +1168,52 @@ int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int vid,
 #endif
     ios = file->iosystem;
 
-    /* Get var info for this var. */
-    vdesc = file->varlist + vid;
-
     /* Get the number of dims in our decomposition. */
     ndims = iodesc->ndims;
 
-    /* Get number of dims for this var. */
-    if ((ierr = PIOc_inq_varndims(file->pio_ncid, vid, &fndims)))
-        return pio_err(ios, file, ierr, __FILE__, __LINE__);
+    /* Get var info and the number of dims for each var. */
+    for (int v = 0; v < nvars; v++)
+    {
+        if ((ierr = get_var_desc(vids[v], file, &vdesc[v])))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        if ((ierr = get_var_ndims(file, vids[v], &fndims[v])))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
 
-    /* Is this a non-record var? */
-    if (fndims == ndims)
-        vdesc->record = -1;
+        /* Is this a non-record var? */
+        if (fndims[v] == ndims)
+            vdesc[v]->record = -1;
+        else if (ios->ioproc && vdesc[v]->record < 0)
+            vdesc[v]->record = 0;
+    }
 
     if (ios->ioproc)
     {
         io_region *region;
-        size_t start[fndims];
-        size_t count[fndims];
-        size_t tmp_start[fndims * iodesc->maxregions];
-        size_t tmp_count[fndims * iodesc->maxregions];
-        size_t tmp_bufsize;
-        void *bufptr;
+        PIO_Offset tmp_start[ndims * iodesc->maxregions];
+        PIO_Offset tmp_count[ndims * iodesc->maxregions];
 
-        /* buffer is incremented by byte and loffset is in terms of
-           the iodessc->basetype so we need to multiply by the size of
-           the basetype. */
+        /* Put together start/count arrays for all regions, in the
+         * dims of the decomposition. The record, if any, is added
+         * for each var when it is read. */
         region = iodesc->firstregion;
-
-        if (fndims > ndims)
-        {
-            if (vdesc->record < 0)
-                vdesc->record = 0;
-        }
-
-        /* Put together start/count arrays for all regions. */
         for (int regioncnt = 0; regioncnt < iodesc->maxregions; regioncnt++)
         {
-            if (!region || iodesc->llen == 0)
-            {
-                /* Nothing to write for this region. */
-                for (int i = 0; i < fndims; i++)
-                {
-                    tmp_start[i + regioncnt * fndims] = 0;
-                    tmp_count[i + regioncnt * fndims] = 0;
-                }
-                bufptr = NULL;
-            }
-            else
+            for (int i = 0; i < ndims; i++)
             {
-                if (vdesc->record >= 0 && fndims > 1)
-                {
-                    /* This is a record var. Find start for record dims. */
-                    tmp_start[regioncnt * fndims] = vdesc->record;
-
-                    /* Find start/count for all non-record dims. */
-                    for (int i = 1; i < fndims; i++)
-                    {
-                        tmp_start[i + regioncnt * fndims] = region->start[i - 1];
-                        tmp_count[i + regioncnt * fndims] = region->count[i - 1];
-                    }
-
-                    /* Set count for record dimension. */
-                    if (tmp_count[1 + regioncnt * fndims] > 0)
-                        tmp_count[regioncnt * fndims] = 1;
-                }
-                else
-                {
-                    /* Non-time dependent array */
-                    for (int i = 0; i < fndims; i++)
-                    {
-                        tmp_start[i + regioncnt * fndims] = region->start[i];
-                        tmp_count[i + regioncnt * fndims] = region->count[i];
-                    }
-                }
+                tmp_start[i + regioncnt * ndims] = region && iodesc->llen ? region->start[i] : 0;
+                tmp_count[i + regioncnt * ndims] = region && iodesc->llen ? region->count[i] : 0;
+                LOG((3, "tmp_start[%d] = %lld tmp_count[%d] = %lld", i + regioncnt * ndims,
+                     tmp_start[i + regioncnt * ndims], i + regioncnt * ndims,
+                     tmp_count[i + regioncnt * ndims]));
             }
 
-#if PIO_ENABLE_LOGGING
-            /* Log arrays for debug purposes. */
-            LOG((3, "region = %d", region));
-            for (int i = 0; i < fndims; i++)
-                LOG((3, "tmp_start[%d] = %d tmp_count[%d] = %d", i + regioncnt * fndims, tmp_start[i + regioncnt * fndims],
-                     i + regioncnt * fndims, tmp_count[i + regioncnt * fndims]));
-#endif /* PIO_ENABLE_LOGGING */
-
             /* Move to next region. */
             if (region)
                 region = region->next;
         } /* next regioncnt */
 
-        /* IO tasks other than 0 send their starts/counts and data to
-         * IO task 0. */
+        /* IO tasks other than 0 send their starts/counts to IO task
+         * 0, and get the data of all vars back. */
         if (ios->io_rank > 0)
         {
             if ((mpierr = MPI_Send(&iodesc->llen, 1, MPI_OFFSET, 0, ios->io_rank, ios->io_comm)))
@@ -1120,101 +1225,107 @@ int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int vid,
                 if ((mpierr = MPI_Send(&(iodesc->maxregions), 1, MPI_INT, 0,
                                        ios->num_iotasks + ios->io_rank, ios->io_comm)))
                     return check_mpi(file, mpierr, __FILE__, __LINE__);
-                if ((mpierr = MPI_Send(tmp_count, iodesc->maxregions * fndims, MPI_OFFSET, 0,
+                if ((mpierr = MPI_Send(tmp_count, iodesc->maxregions * ndims, MPI_OFFSET, 0,
                                        2 * ios->num_iotasks + ios->io_rank, ios->io_comm)))
                     return check_mpi(file, mpierr, __FILE__, __LINE__);
-                if ((mpierr = MPI_Send(tmp_start, iodesc->maxregions * fndims, MPI_OFFSET, 0,
+                if ((mpierr = MPI_Send(tmp_start, iodesc->maxregions * ndims, MPI_OFFSET, 0,
                                        3 * ios->num_iotasks + ios->io_rank, ios->io_comm)))
                     return check_mpi(file, mpierr, __FILE__, __LINE__);
                 LOG((3, "sent iodesc->maxregions = %d tmp_count and tmp_start arrays", iodesc->maxregions));
 
-                if ((mpierr = MPI_Recv(iobuf, iodesc->llen, iodesc->basetype, 0,
+                if ((mpierr = MPI_Recv(iobuf, nvars * iodesc->llen, iodesc->basetype, 0,
                                        4 * ios->num_iotasks + ios->io_rank, ios->io_comm, &status)))
                     return check_mpi(file, mpierr, __FILE__, __LINE__);
-                LOG((3, "received %d elements of data", iodesc->llen));
+                LOG((3, "received %d elements of data", nvars * iodesc->llen));
             }
         }
         else if (ios->io_rank == 0)
         {
-            /* This is IO task 0. Get starts/counts and data from
-             * other IO tasks. */
-            int maxregions = 0;
-            size_t loffset, regionsize;
-            size_t this_start[fndims * iodesc->maxregions];
-            size_t this_count[fndims * iodesc->maxregions];
-
+            /* This is IO task 0. Get starts/counts from the other IO
+             * tasks, and read their data, then read its own. */
             for (int rtask = 1; rtask <= ios->num_iotasks; rtask++)
             {
+                int maxregions;
+                PIO_Offset llen;
+
                 if (rtask < ios->num_iotasks)
                 {
-                    if ((mpierr = MPI_Recv(&tmp_bufsize, 1, MPI_OFFSET, rtask, rtask, ios->io_comm, &status)))
+                    if ((mpierr = MPI_Recv(&llen, 1, MPI_OFFSET, rtask, rtask, ios->io_comm, &status)))
+                        return check_mpi(file, mpierr, __FILE__, __LINE__);
+                    LOG((3, "received llen = %d", llen));
+                    if (!llen)
+                        continue;
+                    if ((mpierr = MPI_Recv(&maxregions, 1, MPI_INT, rtask, ios->num_iotasks + rtask,
+                                           ios->io_comm, &status)))
                         return check_mpi(file, mpierr, __FILE__, __LINE__);
-                    LOG((3, "received tmp_bufsize = %d", tmp_bufsize));
-
-                    if (tmp_bufsize > 0)
-                    {
-                        if ((mpierr = MPI_Recv(&maxregions, 1, MPI_INT, rtask, ios->num_iotasks + rtask,
-                                               ios->io_comm, &status)))
-                            return check_mpi(file, mpierr, __FILE__, __LINE__);
-                        if ((mpierr = MPI_Recv(this_count, maxregions * fndims, MPI_OFFSET, rtask,
-                                               2 * ios->num_iotasks + rtask, ios->io_comm, &status)))
-                            return check_mpi(file, mpierr, __FILE__, __LINE__);
-                        if ((mpierr = MPI_Recv(this_start, maxregions * fndims, MPI_OFFSET, rtask,
-                                               3 * ios->num_iotasks + rtask, ios->io_comm, &status)))
-                            return check_mpi(file, mpierr, __FILE__, __LINE__);
-                        LOG((3, "received maxregions = %d this_count, this_start arrays ", maxregions));
-                    }
                 }
                 else
                 {
                     maxregions = iodesc->maxregions;
-                    tmp_bufsize = iodesc->llen;
+                    llen = iodesc->llen;
                 }
-                LOG((3, "maxregions = %d tmp_bufsize = %d", maxregions, tmp_bufsize));
 
-                /* Now get each region of data. */
-                loffset = 0;
-                for (int regioncnt = 0; regioncnt < maxregions; regioncnt++)
+                PIO_Offset this_start[ndims * maxregions];
+                PIO_Offset this_count[ndims * maxregions];
+
+                if (rtask < ios->num_iotasks)
+                {
+                    if ((mpierr = MPI_Recv(this_count, maxregions * ndims, MPI_OFFSET, rtask,
+                                           2 * ios->num_iotasks + rtask, ios->io_comm, &status)))
+                        return check_mpi(file, mpierr, __FILE__, __LINE__);
+                    if ((mpierr = MPI_Recv(this_start, maxregions * ndims, MPI_OFFSET, rtask,
+                                           3 * ios->num_iotasks + rtask, ios->io_comm, &status)))
+                        return check_mpi(file, mpierr, __FILE__, __LINE__);
+                    LOG((3, "received maxregions = %d this_count, this_start arrays ", maxregions));
+                }
+                else
                 {
-                    /* Get pointer where data should go. */
-                    bufptr = (void *)((char *)iobuf + iodesc->basetype_size * loffset);
-                    regionsize = 1;
+                    memcpy(this_start, tmp_start, ndims * maxregions * sizeof(PIO_Offset));
+                    memcpy(this_count, tmp_count, ndims * maxregions * sizeof(PIO_Offset));
+                }
+
+                /* Read each region of each var. The data of each var
+                 * is llen elements after that of the var before. */
+                for (int v = 0; v < nvars; v++)
+                {
+                    size_t loffset = (size_t)v * llen;
+                    int rec = fndims[v] > ndims ? 1 : 0; /* Number of record dims. */
 
-                    /* ??? */
-                    if (rtask < ios->num_iotasks)
+                    for (int regioncnt = 0; regioncnt < maxregions; regioncnt++)
                     {
-                        for (int m = 0; m < fndims; m++)
+                        size_t start[fndims[v]];
+                        size_t count[fndims[v]];
+                        size_t regionsize = 1;
+
+                        /* A record var reads one record of the region. */
+                        if (rec)
                         {
-                            start[m] = this_start[m + regioncnt * fndims];
-                            count[m] = this_count[m + regioncnt * fndims];
-                            regionsize *= count[m];
+                            start[0] = vdesc[v]->record;
+                            count[0] = 1;
                         }
-                    }
-                    else
-                    {
-                        for (int m = 0; m < fndims; m++)
+                        for (int m = 0; m < ndims; m++)
                         {
-                            start[m] = tmp_start[m + regioncnt * fndims];
-                            count[m] = tmp_count[m + regioncnt * fndims];
-                            regionsize *= count[m];
+                            start[m + rec] = this_start[m + regioncnt * ndims];
+                            count[m + rec] = this_count[m + regioncnt * ndims];
+                            regionsize *= count[m + rec];
                         }
+                        if (!regionsize)
+                            continue;
+
+                        /* Read the data. */
+                        if ((ierr = nc_get_vara(file->fh, vids[v], start, count,
+                                                (char *)iobuf + iodesc->basetype_size * loffset)))
+                            return check_netcdf(file, ierr, __FILE__, __LINE__);
+                        loffset += regionsize;
                     }
-                    loffset += regionsize;
-
-                    /* Read the data. */
-                    ierr = nc_get_vara(file->fh, vid, start, count, bufptr);
-
-                    /* Check error code of netCDF call. */
-                    if (ierr)
-                        return check_netcdf(file, ierr, __FILE__, __LINE__);
                 }
 
                 /* The decomposition may not use all of the active io
                  * tasks. rtask here is the io task rank and
                  * ios->num_iotasks is the number of iotasks actually
                  * used in this decomposition. */
-                if (rtask < ios->num_iotasks && tmp_bufsize > 0)
-                    if ((mpierr = MPI_Send(iobuf, tmp_bufsize, iodesc->basetype, rtask,
+                if (rtask < ios->num_iotasks)
+                    if ((mpierr = MPI_Send(iobuf, nvars * llen, iodesc->basetype, rtask,
                                            4 * ios->num_iotasks + rtask, ios->io_comm)))
                         return check_mpi(file, mpierr, __FILE__, __LINE__);
             }
@@ -1229,9 +1340,262 @@ int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int vid,
     return PIO_NOERR;
 }
 
+/**
+ * Get the number of dimensions of a var in the file. The number is
+ * kept in the var_desc_t, so the netCDF layer is only asked the first
+ * time. In async mode the IO tasks get it with the darray messages
+ * instead, since they can't ask the computation tasks for it in the
+ * middle of a write or read.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param varid the ID of the var.
+ * @param ndimsp pointer that gets the number of dims.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int get_var_ndims(file_desc_t *file, int varid, int *ndimsp)
+{
+    var_desc_t *vdesc;
+    int ierr;
+
+    pioassert(file && ndimsp, "invalid input", __FILE__, __LINE__);
+
+    if ((ierr = get_var_desc(varid, file, &vdesc)))
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+
+    /* PIOc_inq_varndims() sets vdesc->ndims. */
+    if (vdesc->ndims < 0)
+        if ((ierr = PIOc_inq_varndims(file->pio_ncid, varid, ndimsp)))
+            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__);
+    *ndimsp = vdesc->ndims;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get a buffer of len fill values for a file. Buffers are shared by
+ * all writes to the file with the same fill value, and must not be
+ * changed. They are freed with the file, in free_fill_bufs().
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param size size in bytes of the fill value.
+ * @param fillvalue pointer to the fill value.
+ * @param len number of values needed.
+ * @param bufp pointer that gets the buffer, or NULL if len is 0.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int get_fill_buf(file_desc_t *file, int size, const void *fillvalue, PIO_Offset len,
+                 void **bufp)
+{
+    fill_buf_t *fb;
+
+    pioassert(file && size > 0 && fillvalue && len >= 0 && bufp, "invalid input",
+              __FILE__, __LINE__);
+
+    *bufp = NULL;
+    if (!len)
+        return PIO_NOERR;
+
+    /* Use a buffer of this value that is long enough. */
+    for (fb = file->fillbufs; fb; fb = fb->next)
+    {
+        if (fb->size == size && fb->len >= len && !memcmp(fb->fillvalue, fillvalue, size))
+        {
+            *bufp = fb->buf;
+            return PIO_NOERR;
+        }
+    }
+
+    /* Otherwise make one. Shorter buffers of the same value are kept,
+     * since pending requests may still use them. */
+    if (!(fb = calloc(1, sizeof(fill_buf_t))))
+        return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+    if (!(fb->fillvalue = malloc(size)) || !(fb->buf = bget(len * size)))
+    {
+        free(fb->fillvalue);
+        free(fb);
+        return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+    }
+    fb->size = size;
+    fb->len = len;
+    memcpy(fb->fillvalue, fillvalue, size);
+
+    /* Copy the value, then double the filled part each time. */
+    memcpy(fb->buf, fillvalue, size);
+    for (PIO_Offset n = 1; n < len; n *= 2)
+        memcpy((char *)fb->buf + n * size, fb->buf, min(n, len - n) * size);
+    LOG((3, "get_fill_buf made buffer of %lld values of size %d", len, size));
+
+    fb->next = file->fillbufs;
+    file->fillbufs = fb;
+    *bufp = fb->buf;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free the buffers of fill values of a file.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @ingroup PIO_write_darray
+ */
+void free_fill_bufs(file_desc_t *file)
+{
+    fill_buf_t *fb;
+
+    while ((fb = file->fillbufs))
+    {
+        file->fillbufs = fb->next;
+        brel(fb->buf);
+        free(fb->fillvalue);
+        free(fb);
+    }
+}
+
+/**
+ * Add a var to the list of vars of a file with pending pnetcdf
+ * requests, and count the bytes of data in its new requests. This is
+ * called on IO tasks after each pnetcdf bput or iput, with the same
+ * bytes on all IO tasks, so that flush_output_buffer() can decide
+ * when to complete the requests without communication.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param varid the ID of the var.
+ * @param bytes bytes of data in the new requests.
+ * @param bput true if the requests were made with bput, and use the
+ * attached buffer.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int add_pending_var(file_desc_t *file, int varid, PIO_Offset bytes, bool bput)
+{
+    var_desc_t *vdesc;
+    int ret;
+
+    pioassert(file && varid >= 0 && varid < PIO_MAX_VARS && bytes >= 0, "invalid input",
+              __FILE__, __LINE__);
+    if ((ret = get_var_desc(varid, file, &vdesc)))
+        return pio_err(NULL, file, ret, __FILE__, __LINE__);
+
+    /* Add the var to the list the first time it has requests. */
+    if (!vdesc->pending)
+    {
+        if (file->npending_vars == file->pending_varids_size)
+        {
+            int size = file->pending_varids_size ? 2 * file->pending_varids_size : 16;
+            int *varids;
+
+            if (!(varids = realloc(file->pending_varids, size * sizeof(int))))
+                return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+            file->pending_varids = varids;
+            file->pending_varids_size = size;
+        }
+        file->pending_varids[file->npending_vars++] = varid;
+        vdesc->pending = 1;
+    }
+
+    vdesc->pending_bytes += bytes;
+    if (bput)
+        file->bput_bytes += bytes;
+    else
+        file->iput_bytes += bytes;
+    LOG((3, "add_pending_var varid = %d bytes = %lld bput_bytes = %lld iput_bytes = %lld",
+         varid, bytes, file->bput_bytes, file->iput_bytes));
+
+    return PIO_NOERR;
+}
+
+#ifdef _PNETCDF
+/**
+ * Find the bytes of data a pnetcdf put of count elements of a var
+ * will take in the file, and in the attached buffer for bput. This
+ * only uses local information, so it may be called on IO tasks
+ * alone.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @param varid the ID of the var.
+ * @param count array of element counts along each dimension of the
+ * var, or NULL for a scalar.
+ * @param bytesp pointer that gets the number of bytes.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int pnetcdf_put_bytes(file_desc_t *file, int varid, const PIO_Offset *count,
+                      PIO_Offset *bytesp)
+{
+    nc_type xtype;
+    int ndims;
+    PIO_Offset bytes;
+    int ierr;
+
+    pioassert(file && bytesp, "invalid input", __FILE__, __LINE__);
+
+    if ((ierr = ncmpi_inq_var(file->fh, varid, NULL, &xtype, &ndims, NULL, NULL)))
+        return check_netcdf(file, ierr, __FILE__, __LINE__);
+    if ((ierr = pioc_pnetcdf_inq_type(file->pio_ncid, xtype, NULL, &bytes)))
+        return pio_err(NULL, file, ierr, __FILE__, __LINE__);
+    if (count)
+        for (int d = 0; d < ndims; d++)
+            bytes *= count[d];
+    *bytesp = bytes;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Find the bytes of pending data to wait for at once when a file is
+ * flushed. This is the chunk size of the iosystem, or the stripe
+ * width given by the striping hints.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @return the chunk size in bytes, or 0 to wait for all requests at
+ * once.
+ */
+static PIO_Offset flush_chunk_size(iosystem_desc_t *ios)
+{
+    char val[MPI_MAX_INFO_VAL + 1];
+    PIO_Offset unit = 0, factor = 0;
+    int flag;
+
+    if (ios->flush_chunk > 0)
+        return ios->flush_chunk;
+    if (ios->info == MPI_INFO_NULL)
+        return 0;
+
+    if (!MPI_Info_get(ios->info, "striping_unit", MPI_MAX_INFO_VAL, val, &flag) && flag)
+        unit = atoll(val);
+    if (!MPI_Info_get(ios->info, "striping_factor", MPI_MAX_INFO_VAL, val, &flag) && flag)
+        factor = atoll(val);
+    if (unit <= 0)
+        return 0;
+
+    return factor > 0 ? unit * factor : unit;
+}
+
+/**
+ * Compare two var IDs, for qsort.
+ */
+static int compare_varids(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+#endif /* _PNETCDF */
+
 /**
  * Flush the output buffer. This is only relevant for files opened
- * with pnetcdf.
+ * with pnetcdf. It is called on all IO tasks.
+ *
+ * Unless forced, the pending requests are only completed when the
+ * attached buffer would overflow, or the data in pending iput
+ * requests exceeds the flush budget of the iosystem. The buffer
+ * usage is only checked (with a reduction over the IO tasks) when
+ * the data put with bput since the last flush, which bounds it, is
+ * close to the limit.
+ *
+ * Only the vars with pending requests are visited, in order of var
+ * ID. Their requests are waited for in chunks of the flush chunk
+ * size, and then their IO buffers are freed.
  *
  * @param file a pointer to the open file descriptor for the file
  * that will be written to
@@ -1246,99 +1610,144 @@ int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
     int ierr = PIO_NOERR;
 
 #ifdef _PNETCDF
+    iosystem_desc_t *ios;
     var_desc_t *vdesc;
     PIO_Offset usage = 0;
+    PIO_Offset chunk;     /* Bytes to wait for at once. */
+    PIO_Offset rbytes;    /* Bytes in the gathered requests. */
+    int reqcnt = 0;
+    int rcnt = 0;
+    int *request;         /* The requests to wait for. */
+    int *status;          /* The status of each request. */
+#ifdef MPIO_ONESIDED
+    int prev_record = -1;
+#endif
 
     /* Check inputs. */
-    pioassert(file, "invalid input", __FILE__, __LINE__);
-
-    /* Find out the buffer usage. */
-    if ((ierr = ncmpi_inq_buffer_usage(file->fh, &usage)))
-	/* allow the buffer to be undefined */
-	if (ierr != NC_ENULLABUF)
-	    return pio_err(NULL, file, PIO_EBADID, __FILE__, __LINE__);
+    pioassert(file && file->iosystem, "invalid input", __FILE__, __LINE__);
+    ios = file->iosystem;
 
-    /* If we are not forcing a flush, spread the usage to all IO
-     * tasks. */
-    if (!force && file->iosystem->io_comm != MPI_COMM_NULL)
+    if (!force)
     {
-        usage += addsize;
-        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &usage, 1,  MPI_OFFSET,  MPI_MAX,
-                                    file->iosystem->io_comm)))
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
+        /* The buffer usage can not exceed the bytes put with bput,
+         * which are the same on all IO tasks. Only find the real
+         * usage when this is close to the limit. */
+        if (file->bput_bytes + addsize >= pio_buffer_size_limit)
+        {
+            if ((ierr = ncmpi_inq_buffer_usage(file->fh, &usage)))
+            {
+                /* allow the buffer to be undefined */
+                if (ierr != NC_ENULLABUF)
+                    return pio_err(NULL, file, PIO_EBADID, __FILE__, __LINE__);
+                ierr = PIO_NOERR;
+            }
+
+            /* Spread the usage to all IO tasks. */
+            usage += addsize;
+            if (ios->io_comm != MPI_COMM_NULL)
+                if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &usage, 1,  MPI_OFFSET,  MPI_MAX,
+                                            ios->io_comm)))
+                    return check_mpi(file, mpierr, __FILE__, __LINE__);
+
+            /* Keep track of the maximum usage. */
+            if (usage > maxusage)
+                maxusage = usage;
+
+            /* Tighten the bound to the real usage. */
+            file->bput_bytes = usage - addsize;
+            if (usage >= pio_buffer_size_limit)
+                force = true;
+        }
+
+        /* Complete the iput requests if they exceed the budget. */
+        if (ios->flush_budget > 0 && file->iput_bytes >= ios->flush_budget)
+            force = true;
+
+        if (!force)
+            return PIO_NOERR;
     }
 
-    /* Keep track of the maximum usage. */
-    if (usage > maxusage)
-        maxusage = usage;
+    LOG((2, "flush_output_buffer npending_vars = %d bput_bytes = %lld iput_bytes = %lld",
+         file->npending_vars, file->bput_bytes, file->iput_bytes));
 
-    /* If the user forces it, or the buffer has exceeded the size
-     * limit, then flush to disk. */
-    if (force || usage >= pio_buffer_size_limit)
+    /* Visit the pending vars in order of var ID. */
+    qsort(file->pending_varids, file->npending_vars, sizeof(int), compare_varids);
+    for (int v = 0; v < file->npending_vars; v++)
+        reqcnt += file->varlist[file->pending_varids[v]]->nreqs;
+
+    /* There may be many pending requests, so these are not on the
+     * stack. */
+    if (!(request = malloc(max(reqcnt, 1) * sizeof(int))))
+        return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+    if (!(status = malloc(max(reqcnt, 1) * sizeof(int))))
     {
-        int rcnt;
-        int  maxreq;
-        int reqcnt;
-        maxreq = 0;
-        reqcnt = 0;
-        rcnt = 0;
-        for (int i = 0; i < PIO_MAX_VARS; i++)
-        {
-            vdesc = file->varlist + i;
-            reqcnt += vdesc->nreqs;
-            if (vdesc->nreqs > 0)
-                maxreq = i;
-        }
-        int request[reqcnt];
-        int status[reqcnt];
+        free(request);
+        return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+    }
 
-        for (int i = 0; i <= maxreq; i++)
-        {
-            vdesc = file->varlist + i;
+    chunk = flush_chunk_size(ios);
+    rbytes = 0;
+    for (int v = 0; v < file->npending_vars; v++)
+    {
+        vdesc = file->varlist[file->pending_varids[v]];
 #ifdef MPIO_ONESIDED
-            /*onesided optimization requires that all of the requests in a wait_all call represent
-              a contiguous block of data in the file */
-            if (rcnt > 0 && (prev_record != vdesc->record || vdesc->nreqs==0))
-            {
-                ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
-                rcnt = 0;
-            }
-            prev_record = vdesc->record;
+        /*onesided optimization requires that all of the requests in a wait_all call represent
+          a contiguous block of data in the file */
+        if (rcnt > 0 && (prev_record != vdesc->record || vdesc->nreqs==0))
+        {
+            ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+            rcnt = 0;
+            rbytes = 0;
+        }
+        prev_record = vdesc->record;
 #endif
-            for (reqcnt = 0; reqcnt < vdesc->nreqs; reqcnt++)
-                request[rcnt++] = max(vdesc->request[reqcnt], NC_REQ_NULL);
+        for (int r = 0; r < vdesc->nreqs; r++)
+            request[rcnt++] = max(vdesc->request[r], NC_REQ_NULL);
+        rbytes += vdesc->pending_bytes;
 
-            if (vdesc->request != NULL)
-                free(vdesc->request);
-            vdesc->request = NULL;
-            vdesc->nreqs = 0;
+        if (vdesc->request != NULL)
+            free(vdesc->request);
+        vdesc->request = NULL;
+        vdesc->nreqs = 0;
 
 #ifdef FLUSH_EVERY_VAR
+        ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+        rcnt = 0;
+        rbytes = 0;
+#endif
+
+        /* The pending bytes are the same on all IO tasks, so all of
+         * them wait here together. */
+        if (chunk > 0 && rbytes >= chunk && rcnt > 0)
+        {
+            LOG((3, "flush_output_buffer waiting for %d requests of %lld bytes", rcnt, rbytes));
             ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
             rcnt = 0;
-#endif
+            rbytes = 0;
         }
+    }
 
-        if (rcnt > 0)
-            ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+    if (rcnt > 0)
+        ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+    free(request);
+    free(status);
 
-        /* Release resources. */
-        for (int i = 0; i < PIO_MAX_VARS; i++)
+    /* Release resources. */
+    for (int v = 0; v < file->npending_vars; v++)
+    {
+        vdesc = file->varlist[file->pending_varids[v]];
+        if (vdesc->iobuf)
         {
-            vdesc = file->varlist + i;
-            if (vdesc->iobuf)
-            {
-		LOG((3,"freeing variable buffer in flush_output_buffer"));
-                brel(vdesc->iobuf);
-                vdesc->iobuf = NULL;
-            }
-            if (vdesc->fillbuf)
-            {
-                brel(vdesc->fillbuf);
-                vdesc->fillbuf = NULL;
-            }
+            LOG((3,"freeing variable buffer in flush_output_buffer"));
+            brel(vdesc->iobuf);
+            vdesc->iobuf = NULL;
         }
+        vdesc->pending = 0;
+        vdesc->pending_bytes = 0;
     }
+    file->npending_vars = 0;
+    file->bput_bytes = 0;
+    file->iput_bytes = 0;
 
 #endif /* _PNETCDF */
     return ierr;
@@ -1402,7 +1811,15 @@ void cn_buffer_report(iosystem_desc_t *ios, bool collective)
  */
 void free_cn_buffer_pool(iosystem_desc_t *ios)
 {
-#if !PIO_USE_MALLOC
+#if PIO_USE_POOL
+    LOG((2, "free_cn_buffer_pool CN_bpool = %d", CN_bpool));
+    if (CN_bpool)
+    {
+        cn_buffer_report(ios, false);
+        pio_pool_free(CN_bpool);
+        CN_bpool = NULL;
+    }
+#elif !PIO_USE_MALLOC
     LOG((2, "free_cn_buffer_pool CN_bpool = %d", CN_bpool));
     /* Note: it is possible that CN_bpool has been freed and set to NULL by bpool_free() */
     if (CN_bpool)
@@ -1466,6 +1883,8 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
         if (wmb->frame)
             brel(wmb->frame);
         wmb->frame = NULL;
+        wmb->capacity = 0;
+        wmb->datasize = 0;
 
         if (ret)
             return pio_err(NULL, file, ret, __FILE__, __LINE__);
@@ -1474,6 +1893,167 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
     return PIO_NOERR;
 }
 
+/**
+ * Find the write multi buffer of a file for a decomposition, and
+ * create it if there is none. The buffers are kept in the list
+ * file->buffer, in the order they were created, and in the hash table
+ * file->buffer_hash, so they can be found without walking the list.
+ *
+ * @param file pointer to the file info.
+ * @param ioid the ID of the decomposition.
+ * @param recordvar non-zero for the buffer of record vars.
+ * @param wmbp pointer that gets the multi buffer.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int get_wmb(file_desc_t *file, int ioid, int recordvar, wmulti_buffer **wmbp)
+{
+    wmulti_buffer *wmb;
+    wmulti_buffer *last;
+    unsigned h;
+
+    /* Check inputs. */
+    pioassert(file && wmbp, "invalid input", __FILE__, __LINE__);
+
+    h = WMB_HASH(ioid, recordvar);
+    for (wmb = file->buffer_hash[h]; wmb; wmb = wmb->hnext)
+        if (wmb->ioid == ioid && wmb->recordvar == recordvar)
+            break;
+
+    if (!wmb)
+    {
+        if (!(wmb = bget((bufsize)sizeof(wmulti_buffer))))
+            return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+        LOG((3, "allocated multi-buffer ioid = %d recordvar = %d", ioid, recordvar));
+
+        wmb->ioid = ioid;
+        wmb->recordvar = recordvar;
+        wmb->num_arrays = 0;
+        wmb->arraylen = 0;
+        wmb->vid = NULL;
+        wmb->frame = NULL;
+        wmb->fillvalue = NULL;
+        wmb->data = NULL;
+        wmb->capacity = 0;
+        wmb->datasize = 0;
+        wmb->next = NULL;
+
+        /* Add it to the end of the list and the front of its
+         * bucket. */
+        for (last = &file->buffer; last->next; last = last->next)
+            ;
+        last->next = wmb;
+        wmb->hnext = file->buffer_hash[h];
+        file->buffer_hash[h] = wmb;
+    }
+
+    *wmbp = wmb;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Find the number of arrays a write multi buffer will have room for
+ * when it next grows. The capacity doubles, up to the number of
+ * arrays that fit in iodesc->maxbytes (see
+ * compute_maxaggregate_bytes()).
+ *
+ * @param iodesc pointer to the decomposition of the buffer.
+ * @param wmb pointer to the multi buffer.
+ * @returns the new capacity.
+ * @ingroup PIO_write_darray
+ */
+int wmb_next_capacity(const io_desc_t *iodesc, const wmulti_buffer *wmb)
+{
+    int maxarrays;
+    int capacity;
+
+    pioassert(iodesc && wmb, "invalid input", __FILE__, __LINE__);
+
+    maxarrays = iodesc->basetype_size > 0 ? iodesc->maxbytes / iodesc->basetype_size : 0;
+    capacity = wmb->capacity ? 2 * wmb->capacity : WMB_MIN_CAPACITY;
+    if (capacity > maxarrays)
+        capacity = maxarrays;
+
+    return max(capacity, wmb->num_arrays + 1);
+}
+
+/**
+ * Make room in a write multi buffer for one more array of
+ * data. The buffer grows by doubling its capacity, so that adding n
+ * variables copies O(n) arrays rather than O(n^2). The growth is
+ * counted in file->wmb_nrealloc and file->wmb_bytes_copied.
+ *
+ * @param file pointer to the file info.
+ * @param iodesc pointer to the decomposition of the buffer.
+ * @param wmb pointer to the multi buffer.
+ * @param arraylen the length of the new array.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int grow_wmb(file_desc_t *file, io_desc_t *iodesc, wmulti_buffer *wmb, PIO_Offset arraylen)
+{
+    PIO_Offset datasize;  /* Bytes needed for the data. */
+    int capacity;
+
+    /* Check inputs. */
+    pioassert(file && iodesc && wmb && arraylen >= 0, "invalid input", __FILE__, __LINE__);
+
+    capacity = wmb->capacity;
+    if (wmb->num_arrays == wmb->capacity)
+    {
+        capacity = wmb_next_capacity(iodesc, wmb);
+        LOG((2, "grow_wmb ioid = %d capacity %d -> %d", wmb->ioid, wmb->capacity, capacity));
+
+        if (wmb->num_arrays)
+        {
+            file->wmb_nrealloc++;
+            file->wmb_bytes_copied += wmb->num_arrays * sizeof(int);
+            if (wmb->frame)
+                file->wmb_bytes_copied += wmb->num_arrays * sizeof(int);
+            if (wmb->fillvalue)
+                file->wmb_bytes_copied += wmb->num_arrays * iodesc->basetype_size;
+        }
+
+        /* vid is an array of variable ids in the buffer. */
+        if (!(wmb->vid = bgetr(wmb->vid, sizeof(int) * capacity)))
+            return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+
+        /* frame is the record number of each var, record vars may
+         * not all be on the same record. */
+        if (wmb->recordvar)
+            if (!(wmb->frame = bgetr(wmb->frame, sizeof(int) * capacity)))
+                return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+
+        /* fillvalue has the fill value of each var, if the
+         * decomposition does not cover the whole array. */
+        if (iodesc->needsfill)
+            if (!(wmb->fillvalue = bgetr(wmb->fillvalue, iodesc->basetype_size * capacity)))
+                return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+
+        wmb->capacity = capacity;
+    }
+
+    /* Grow the data to the capacity, or more if the arrays got
+     * longer. */
+    datasize = (1 + wmb->num_arrays) * arraylen * iodesc->basetype_size;
+    if (datasize > wmb->datasize)
+    {
+        datasize = max(datasize, capacity * arraylen * iodesc->basetype_size);
+        if (wmb->num_arrays)
+        {
+            file->wmb_nrealloc++;
+            file->wmb_bytes_copied += wmb->num_arrays * wmb->arraylen * iodesc->basetype_size;
+        }
+        if (!(wmb->data = bgetr(wmb->data, datasize)))
+            return pio_err(NULL, file, PIO_ENOMEM, __FILE__, __LINE__);
+        LOG((2, "got %lld bytes for data", datasize));
+        wmb->datasize = datasize;
+    }
+
+    return PIO_NOERR;
+}
+
 /**
  * Compute the maximum aggregate number of bytes. This is called by
  * subset_rearrange_create() and box_rearrange_create().
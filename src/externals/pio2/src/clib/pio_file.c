@@ -190,8 +190,7 @@ int PIOc_closefile(int ncid)
         {
             int msg = PIO_MSG_CLOSE_FILE;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -230,6 +229,11 @@ int PIOc_closefile(int ncid)
         default:
             return pio_err(ios, file, PIO_EBADIOTYPE, __FILE__, __LINE__);
         }
+
+        /* With async, errors of the calls sent to the IO tasks in a
+         * batch since the last enddef are returned here. */
+        if (!ierr)
+            ierr = file->batch_err;
     }
 
     /* Broadcast and check the return code. */
@@ -270,8 +274,7 @@ int PIOc_deletefile(int iosysid, const char *filename)
     {
         if (!ios->ioproc)
         {
-            if (ios->comp_rank==0)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             len = strlen(filename);
             if (!mpierr)
@@ -339,31 +342,16 @@ int PIOc_sync(int ncid)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
-    /* If async is in use, send message to IO master tasks. */
-    if (ios->async)
-    {
-        if (!ios->ioproc)
-        {
-            int msg = PIO_MSG_SYNC;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-        }
-
-        /* Handle MPI errors. */
-        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
-            check_mpi(file, mpierr2, __FILE__, __LINE__);
-        if (mpierr)
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
-    }
-
+    /* Write the buffered data. With async, this sends the data to
+     * the IO tasks before the sync message. */
     if (file->mode & PIO_WRITE)
     {
         LOG((3, "PIOc_sync checking buffers"));
 
+        /* Complete the writes started with PIOc_iwrite_darray(). */
+        if ((ierr = wait_all_darray_reqs(file)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+
         /*  cn_buffer_report( *ios, true); */
         wmb = &file->buffer;
         while (wmb)
@@ -384,7 +372,31 @@ int PIOc_sync(int ncid)
                 brel(twmb);
             }
         }
+        memset(file->buffer_hash, 0, sizeof(file->buffer_hash));
+    }
 
+    /* If async is in use, send message to IO master tasks. */
+    if (ios->async)
+    {
+        if (!ios->ioproc)
+        {
+            int msg = PIO_MSG_SYNC;
+
+            mpierr = send_msg(ios, msg);
+
+            if (!mpierr)
+                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
+        }
+
+        /* Handle MPI errors. */
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            check_mpi(file, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
+    if (file->mode & PIO_WRITE)
+    {
         if (ios->ioproc)
         {
             switch(file->iotype)
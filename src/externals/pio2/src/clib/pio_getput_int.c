@@ -13,18 +13,154 @@
 #include <pio.h>
 #include <pio_internal.h>
 
+/**
+ * Get the length in bytes of a type of a file. The lengths of the
+ * atomic types are known without asking the IO tasks.
+ *
+ * @param ncid the ncid of the open file.
+ * @param xtype the type.
+ * @param lenp pointer that gets the length of the type.
+ * @return PIO_NOERR for success, error code otherwise.
+ */
+static int get_type_len(int ncid, nc_type xtype, PIO_Offset *lenp)
+{
+    int type_size;
+
+    if (xtype != NC_STRING && !find_mpi_type(xtype, NULL, &type_size))
+    {
+        *lenp = type_size;
+        return PIO_NOERR;
+    }
+
+    return PIOc_inq_type(ncid, xtype, NULL, lenp);
+}
+
+/**
+ * Write a netCDF attribute with the netCDF library. This is only
+ * called on IO tasks, and does not communicate, so it can also be
+ * used for calls sent to the IO tasks in a batch.
+ *
+ * @param file pointer to the file info.
+ * @param varid the variable ID.
+ * @param name the name of the attribute.
+ * @param atttype the nc_type of the attribute.
+ * @param len the length of the attribute array.
+ * @param memtype the type of the data in memory.
+ * @param op a pointer with the attribute data.
+ * @return PIO_NOERR for success, error code otherwise.
+ */
+int put_att_nc(file_desc_t *file, int varid, const char *name, nc_type atttype,
+               PIO_Offset len, nc_type memtype, const void *op)
+{
+    int ierr = PIO_NOERR;
+
+    pioassert(file && file->iosystem->ioproc && name && op, "invalid input",
+              __FILE__, __LINE__);
+
+#ifdef _PNETCDF
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+    {
+        switch(memtype)
+        {
+        case NC_BYTE:
+            ierr = ncmpi_put_att_schar(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_CHAR:
+            ierr = ncmpi_put_att_text(file->fh, varid, name, len, op);
+            break;
+        case NC_SHORT:
+            ierr = ncmpi_put_att_short(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_INT:
+            ierr = ncmpi_put_att_int(file->fh, varid, name, atttype, len, op);
+            break;
+        case PIO_LONG_INTERNAL:
+            ierr = ncmpi_put_att_long(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_FLOAT:
+            ierr = ncmpi_put_att_float(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_DOUBLE:
+            ierr = ncmpi_put_att_double(file->fh, varid, name, atttype, len, op);
+            break;
+        default:
+            return pio_err(file->iosystem, file, PIO_EBADTYPE, __FILE__, __LINE__);
+        }
+    }
+#endif /* _PNETCDF */
+
+    if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
+    {
+        switch(memtype)
+        {
+        case NC_CHAR:
+            ierr = nc_put_att_text(file->fh, varid, name, len, op);
+            break;
+        case NC_BYTE:
+            ierr = nc_put_att_schar(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_SHORT:
+            ierr = nc_put_att_short(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_INT:
+            ierr = nc_put_att_int(file->fh, varid, name, atttype, len, op);
+            break;
+        case PIO_LONG_INTERNAL:
+            ierr = nc_put_att_long(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_FLOAT:
+            ierr = nc_put_att_float(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_DOUBLE:
+            ierr = nc_put_att_double(file->fh, varid, name, atttype, len, op);
+            break;
+#ifdef _NETCDF4
+        case NC_UBYTE:
+            ierr = nc_put_att_uchar(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_USHORT:
+            ierr = nc_put_att_ushort(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_UINT:
+            ierr = nc_put_att_uint(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_INT64:
+            LOG((3, "about to call nc_put_att_longlong"));
+            ierr = nc_put_att_longlong(file->fh, varid, name, atttype, len, op);
+            break;
+        case NC_UINT64:
+            ierr = nc_put_att_ulonglong(file->fh, varid, name, atttype, len, op);
+            break;
+            /* case NC_STRING: */
+            /*      ierr = nc_put_att_string(file->fh, varid, name, atttype, len, op); */
+            /*      break; */
+#endif /* _NETCDF4 */
+        default:
+            return pio_err(file->iosystem, file, PIO_EBADTYPE, __FILE__, __LINE__);
+        }
+    }
+
+    return ierr;
+}
+
 /**
  * Write a netCDF attribute of any type, converting to any type.
  *
  * This routine is called collectively by all tasks in the communicator
  * ios.union_comm.
  *
+ * With async, if a batch size was set with PIOc_set_msg_batch() and
+ * the file is in define mode, the call is queued and sent to the IO
+ * tasks later with other calls. Its errors are then returned by
+ * PIOc_enddef() or PIOc_closefile().
+ *
  * @param ncid the ncid of the open file, obtained from
  * PIOc_openfile() or PIOc_createfile().
  * @param varid the variable ID.
  * @param name the name of the attribute.
  * @param atttype the nc_type of the attribute.
  * @param len the length of the attribute array.
+ * @param memtype the type of the data in memory.
  * @param op a pointer with the attribute data.
  * @return PIO_NOERR for success, error code otherwise.
  */
@@ -33,7 +169,6 @@ int PIOc_put_att_tc(int ncid, int varid, const char *name, nc_type atttype,
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file;     /* Pointer to file information. */
-    PIO_Offset atttype_len;    /* Length (in bytes) of the att type in file. */
     PIO_Offset memtype_len;    /* Length of the att data type in memory. */
     int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
     int ierr;           /* Return code from function calls. */
@@ -43,6 +178,8 @@ int PIOc_put_att_tc(int ncid, int varid, const char *name, nc_type atttype,
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide some valid parameters. */
     if (!name || !op || strlen(name) > NC_MAX_NAME || len < 0)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -50,60 +187,43 @@ int PIOc_put_att_tc(int ncid, int varid, const char *name, nc_type atttype,
     LOG((1, "PIOc_put_att_tc ncid = %d varid = %d name = %s atttype = %d len = %d memtype = %d",
          ncid, varid, name, atttype, len, memtype));
 
-    /* Run these on all tasks if async is not in use, but only on
-     * non-IO tasks if async is in use. */
-    if (!ios->async || !ios->ioproc)
-    {
-        /* Get the length (in bytes) of the type in file. */
-        if ((ierr = PIOc_inq_type(ncid, atttype, NULL, &atttype_len)))
-            return check_netcdf(file, ierr, __FILE__, __LINE__);
-
-        /* Get the length (in bytes) of the type in memory. */
-        if (memtype == PIO_LONG_INTERNAL)
-            memtype_len = sizeof(long int);
-        else
-        {
-            if ((ierr = PIOc_inq_type(ncid, memtype, NULL, &memtype_len)))
-                return check_netcdf(file, ierr, __FILE__, __LINE__);
-        }
-        LOG((2, "PIOc_put_att atttype_len = %d memtype_len = %d", ncid, atttype_len, memtype_len));
-    }
-
-    /* If async is in use, and this is not an IO task, bcast the parameters. */
+    /* If async is in use, and this is not an IO task, send the
+     * parameters. */
     if (ios->async)
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_PUT_ATT;
+            msg_buf_t mb;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            /* Get the length (in bytes) of the type in memory. */
+            if (memtype == PIO_LONG_INTERNAL)
+                memtype_len = sizeof(long int);
+            else if ((ierr = get_type_len(ncid, memtype, &memtype_len)))
+                return check_netcdf(file, ierr, __FILE__, __LINE__);
 
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            int namelen = strlen(name);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&atttype, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&len, 1, MPI_OFFSET,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&atttype_len, 1, MPI_OFFSET,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&memtype, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&memtype_len, 1, MPI_OFFSET,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)op, len * memtype_len, MPI_BYTE, ios->compmaster,
-                                   ios->intercomm);
-            LOG((2, "PIOc_put_att finished bcast ncid = %d varid = %d namelen = %d name = %s "
-                 "len = %d atttype_len = %d memtype = %d memtype_len = %d", ncid, varid, namelen,
-                 name, len, atttype_len, memtype, memtype_len));
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &atttype, sizeof(nc_type));
+            msg_pack(&mb, &len, sizeof(PIO_Offset));
+            msg_pack(&mb, &memtype, sizeof(nc_type));
+            msg_pack(&mb, &memtype_len, sizeof(PIO_Offset));
+            msg_pack(&mb, op, len * memtype_len);
+            LOG((2, "PIOc_put_att packed ncid = %d varid = %d name = %s len = %d memtype = %d "
+                 "memtype_len = %d", ncid, varid, name, len, memtype, memtype_len));
+
+            /* In define mode the call may be queued, to be sent to
+             * the IO tasks with other calls. */
+            if (ios->batch_limit && file->indefine)
+            {
+                ierr = queue_msg(ios, PIO_MSG_PUT_ATT, &mb);
+                msg_buf_free(&mb);
+                return ierr;
+            }
+
+            mpierr = send_packed_msg(ios, PIO_MSG_PUT_ATT, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -111,110 +231,121 @@ int PIOc_put_att_tc(int ncid, int varid, const char *name, nc_type atttype,
             check_mpi(file, mpierr2, __FILE__, __LINE__);
         if (mpierr)
             return check_mpi(file, mpierr, __FILE__, __LINE__);
-
-        /* Broadcast values currently only known on computation tasks to IO tasks. */
-        if ((mpierr = MPI_Bcast(&atttype_len, 1, MPI_OFFSET, ios->comproot, ios->my_comm)))
-            check_mpi(file, mpierr, __FILE__, __LINE__);
-        if ((mpierr = MPI_Bcast(&memtype_len, 1, MPI_OFFSET, ios->comproot, ios->my_comm)))
-            check_mpi(file, mpierr, __FILE__, __LINE__);
-        LOG((2, "PIOc_put_att bcast from comproot = %d atttype_len = %d", ios->comproot,
-             atttype_len, memtype_len));
     }
 
     /* If this is an IO task, then call the netCDF function. */
     if (ios->ioproc)
-    {
+        ierr = put_att_nc(file, varid, name, atttype, len, memtype, op);
+
+    /* Broadcast and check the return code. */
+    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    if (ierr)
+        return check_netcdf(file, ierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Read a netCDF attribute with the netCDF library. This is only
+ * called on IO tasks, and does not communicate.
+ *
+ * @param file pointer to the file info.
+ * @param varid the variable ID.
+ * @param name the name of the attribute.
+ * @param memtype the type of the data in memory.
+ * @param ip a pointer that gets the attribute data.
+ * @return PIO_NOERR for success, error code otherwise.
+ */
+int get_att_nc(file_desc_t *file, int varid, const char *name, nc_type memtype, void *ip)
+{
+    int ierr = PIO_NOERR;
+
+    LOG((2, "calling pnetcdf/netcdf"));
 #ifdef _PNETCDF
-        if (file->iotype == PIO_IOTYPE_PNETCDF)
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+    {
+        switch(memtype)
         {
-            switch(memtype)
-            {
-            case NC_BYTE:
-                ierr = ncmpi_put_att_schar(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_CHAR:
-                ierr = ncmpi_put_att_text(file->fh, varid, name, len, op);
-                break;
-            case NC_SHORT:
-                ierr = ncmpi_put_att_short(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_INT:
-                ierr = ncmpi_put_att_int(file->fh, varid, name, atttype, len, op);
-                break;
-            case PIO_LONG_INTERNAL:
-                ierr = ncmpi_put_att_long(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_FLOAT:
-                ierr = ncmpi_put_att_float(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_DOUBLE:
-                ierr = ncmpi_put_att_double(file->fh, varid, name, atttype, len, op);
-                break;
-            default:
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
-            }
+        case NC_BYTE:
+            ierr = ncmpi_get_att_schar(file->fh, varid, name, ip);
+            break;
+        case NC_CHAR:
+            ierr = ncmpi_get_att_text(file->fh, varid, name, ip);
+            break;
+        case NC_SHORT:
+            ierr = ncmpi_get_att_short(file->fh, varid, name, ip);
+            break;
+        case NC_INT:
+            ierr = ncmpi_get_att_int(file->fh, varid, name, ip);
+            break;
+        case PIO_LONG_INTERNAL:
+            ierr = ncmpi_get_att_long(file->fh, varid, name, ip);
+            break;
+        case NC_FLOAT:
+            ierr = ncmpi_get_att_float(file->fh, varid, name, ip);
+            break;
+        case NC_DOUBLE:
+            ierr = ncmpi_get_att_double(file->fh, varid, name, ip);
+            break;
+        default:
+            return pio_err(file->iosystem, file, PIO_EBADTYPE, __FILE__, __LINE__);
         }
+    }
 #endif /* _PNETCDF */
 
-        if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
+    if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
+    {
+        switch(memtype)
         {
-            switch(memtype)
-            {
-            case NC_CHAR:
-                ierr = nc_put_att_text(file->fh, varid, name, len, op);
-                break;
-            case NC_BYTE:
-                ierr = nc_put_att_schar(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_SHORT:
-                ierr = nc_put_att_short(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_INT:
-                ierr = nc_put_att_int(file->fh, varid, name, atttype, len, op);
-                break;
-            case PIO_LONG_INTERNAL:
-                ierr = nc_put_att_long(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_FLOAT:
-                ierr = nc_put_att_float(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_DOUBLE:
-                ierr = nc_put_att_double(file->fh, varid, name, atttype, len, op);
-                break;
+        case NC_CHAR:
+            ierr = nc_get_att_text(file->fh, varid, name, ip);
+            break;
+        case NC_BYTE:
+            ierr = nc_get_att_schar(file->fh, varid, name, ip);
+            break;
+        case NC_SHORT:
+            ierr = nc_get_att_short(file->fh, varid, name, ip);
+            break;
+        case NC_INT:
+            ierr = nc_get_att_int(file->fh, varid, name, ip);
+            break;
+        case PIO_LONG_INTERNAL:
+            ierr = nc_get_att_long(file->fh, varid, name, ip);
+            break;
+        case NC_FLOAT:
+            ierr = nc_get_att_float(file->fh, varid, name, ip);
+            break;
+        case NC_DOUBLE:
+            ierr = nc_get_att_double(file->fh, varid, name, ip);
+            break;
 #ifdef _NETCDF4
-            case NC_UBYTE:
-                ierr = nc_put_att_uchar(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_USHORT:
-                ierr = nc_put_att_ushort(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_UINT:
-                ierr = nc_put_att_uint(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_INT64:
-                LOG((3, "about to call nc_put_att_longlong"));
-                ierr = nc_put_att_longlong(file->fh, varid, name, atttype, len, op);
-                break;
-            case NC_UINT64:
-                ierr = nc_put_att_ulonglong(file->fh, varid, name, atttype, len, op);
-                break;
-                /* case NC_STRING: */
-                /*      ierr = nc_put_att_string(file->fh, varid, name, atttype, len, op); */
-                /*      break; */
+        case NC_UBYTE:
+            ierr = nc_get_att_uchar(file->fh, varid, name, ip);
+            break;
+        case NC_USHORT:
+            ierr = nc_get_att_ushort(file->fh, varid, name, ip);
+            break;
+        case NC_UINT:
+            ierr = nc_get_att_uint(file->fh, varid, name, ip);
+            break;
+        case NC_INT64:
+            LOG((3, "about to call nc_get_att_longlong"));
+            ierr = nc_get_att_longlong(file->fh, varid, name, ip);
+            break;
+        case NC_UINT64:
+            ierr = nc_get_att_ulonglong(file->fh, varid, name, ip);
+            break;
+            /* case NC_STRING: */
+            /*      ierr = nc_get_att_string(file->fh, varid, name, ip); */
+            /*      break; */
 #endif /* _NETCDF4 */
-            default:
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
-            }
+        default:
+            return pio_err(file->iosystem, file, PIO_EBADTYPE, __FILE__, __LINE__);
         }
     }
 
-    /* Broadcast and check the return code. */
-    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
-        return check_mpi(file, mpierr, __FILE__, __LINE__);
-    if (ierr)
-        return check_netcdf(file, ierr, __FILE__, __LINE__);
-
-    return PIO_NOERR;
+    return ierr;
 }
 
 /**
@@ -257,6 +388,23 @@ int PIOc_get_att_tc(int ncid, int varid, const char *name, nc_type memtype, void
     LOG((1, "PIOc_get_att_tc ncid %d varid %d name %s memtype %d",
          ncid, varid, name, memtype));
 
+    /* Answer from the metadata cache if it has the values, and they
+     * need no conversion. */
+    if (file->meta)
+    {
+        att_meta_t *att;
+        PIO_Offset typelen;
+
+        if ((ierr = file_meta_att(file->meta, varid, name, &att, NULL)))
+            return check_netcdf(file, ierr, __FILE__, __LINE__);
+        if (att->value && att->xtype == memtype &&
+            !pioc_pnetcdf_inq_type(ncid, memtype, NULL, &typelen))
+        {
+            memcpy(ip, att->value, att->len * typelen);
+            return PIO_NOERR;
+        }
+    }
+
     /* Run these on all tasks if async is not in use, but only on
      * non-IO tasks if async is in use. */
     if (!ios->async || !ios->ioproc)
@@ -288,38 +436,24 @@ int PIOc_get_att_tc(int ncid, int varid, const char *name, nc_type memtype, void
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_GET_ATT;
-            LOG((2, "sending parameters"));
-
-            /* Send the message to IO master. */
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            msg_buf_t mb;
 
             /* Send the function parameters. */
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            int namelen = strlen(name);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&file->iotype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&atttype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&attlen, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&atttype_len, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&memtype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&memtype_len, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            LOG((2, "Bcast complete ncid = %d varid = %d namelen = %d name = %s iotype = %d "
-                 "atttype = %d attlen = %d atttype_len = %d", ncid, varid, namelen, name, file->iotype,
-                 atttype, attlen, atttype_len));
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &file->iotype, sizeof(int));
+            msg_pack(&mb, &atttype, sizeof(nc_type));
+            msg_pack(&mb, &attlen, sizeof(PIO_Offset));
+            msg_pack(&mb, &atttype_len, sizeof(PIO_Offset));
+            msg_pack(&mb, &memtype, sizeof(nc_type));
+            msg_pack(&mb, &memtype_len, sizeof(PIO_Offset));
+            mpierr = send_packed_msg(ios, PIO_MSG_GET_ATT, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "sent ncid = %d varid = %d name = %s iotype = %d atttype = %d "
+                 "attlen = %d atttype_len = %d", ncid, varid, name, file->iotype, atttype,
+                 attlen, atttype_len));
         }
 
         /* Handle MPI errors. */
@@ -343,91 +477,7 @@ int PIOc_get_att_tc(int ncid, int varid, const char *name, nc_type memtype, void
 
     /* If this is an IO task, then call the netCDF function. */
     if (ios->ioproc)
-    {
-        LOG((2, "calling pnetcdf/netcdf"));
-#ifdef _PNETCDF
-        if (file->iotype == PIO_IOTYPE_PNETCDF)
-        {
-            switch(memtype)
-            {
-            case NC_BYTE:
-                ierr = ncmpi_get_att_schar(file->fh, varid, name, ip);
-                break;
-            case NC_CHAR:
-                ierr = ncmpi_get_att_text(file->fh, varid, name, ip);
-                break;
-            case NC_SHORT:
-                ierr = ncmpi_get_att_short(file->fh, varid, name, ip);
-                break;
-            case NC_INT:
-                ierr = ncmpi_get_att_int(file->fh, varid, name, ip);
-                break;
-            case PIO_LONG_INTERNAL:
-                ierr = ncmpi_get_att_long(file->fh, varid, name, ip);
-                break;
-            case NC_FLOAT:
-                ierr = ncmpi_get_att_float(file->fh, varid, name, ip);
-                break;
-            case NC_DOUBLE:
-                ierr = ncmpi_get_att_double(file->fh, varid, name, ip);
-                break;
-            default:
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
-            }
-        }
-#endif /* _PNETCDF */
-
-        if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
-        {
-            switch(memtype)
-            {
-            case NC_CHAR:
-                ierr = nc_get_att_text(file->fh, varid, name, ip);
-                break;
-            case NC_BYTE:
-                ierr = nc_get_att_schar(file->fh, varid, name, ip);
-                break;
-            case NC_SHORT:
-                ierr = nc_get_att_short(file->fh, varid, name, ip);
-                break;
-            case NC_INT:
-                ierr = nc_get_att_int(file->fh, varid, name, ip);
-                break;
-            case PIO_LONG_INTERNAL:
-                ierr = nc_get_att_long(file->fh, varid, name, ip);
-                break;
-            case NC_FLOAT:
-                ierr = nc_get_att_float(file->fh, varid, name, ip);
-                break;
-            case NC_DOUBLE:
-                ierr = nc_get_att_double(file->fh, varid, name, ip);
-                break;
-#ifdef _NETCDF4
-            case NC_UBYTE:
-                ierr = nc_get_att_uchar(file->fh, varid, name, ip);
-                break;
-            case NC_USHORT:
-                ierr = nc_get_att_ushort(file->fh, varid, name, ip);
-                break;
-            case NC_UINT:
-                ierr = nc_get_att_uint(file->fh, varid, name, ip);
-                break;
-            case NC_INT64:
-                LOG((3, "about to call nc_get_att_longlong"));
-                ierr = nc_get_att_longlong(file->fh, varid, name, ip);
-                break;
-            case NC_UINT64:
-                ierr = nc_get_att_ulonglong(file->fh, varid, name, ip);
-                break;
-                /* case NC_STRING: */
-                /*      ierr = nc_get_att_string(file->fh, varid, name, ip); */
-                /*      break; */
-#endif /* _NETCDF4 */
-            default:
-                return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
-            }
-        }
-    }
+        ierr = get_att_nc(file, varid, name, memtype, ip);
 
     /* Broadcast and check the return code. */
     LOG((2, "ierr = %d", ierr));
@@ -549,37 +599,28 @@ int PIOc_get_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_GET_VARS;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            msg_buf_t mb;
 
             /* Send the function parameters and associated informaiton
              * to the msg handler. */
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&start_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && start_present)
-                mpierr = MPI_Bcast((PIO_Offset *)start, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&count_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && count_present)
-                mpierr = MPI_Bcast((PIO_Offset *)count, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&stride_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && stride_present)
-                mpierr = MPI_Bcast((PIO_Offset *)stride, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&xtype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&num_elem, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&typelen, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack(&mb, &ndims, sizeof(int));
+            msg_pack(&mb, &start_present, 1);
+            if (start_present)
+                msg_pack(&mb, start, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &count_present, 1);
+            if (count_present)
+                msg_pack(&mb, count, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &stride_present, 1);
+            if (stride_present)
+                msg_pack(&mb, stride, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &xtype, sizeof(nc_type));
+            msg_pack(&mb, &num_elem, sizeof(PIO_Offset));
+            msg_pack(&mb, &typelen, sizeof(PIO_Offset));
+            mpierr = send_packed_msg(ios, PIO_MSG_GET_VARS, &mb);
+            msg_buf_free(&mb);
             LOG((2, "PIOc_get_vars_tc ncid = %d varid = %d ndims = %d start_present = %d "
                  "count_present = %d stride_present = %d xtype = %d num_elem = %d", ncid, varid,
                  ndims, start_present, count_present, stride_present, xtype, num_elem));
@@ -886,9 +927,11 @@ int PIOc_put_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
     char stride_present = stride ? true : false;  /* Is stride non-NULL? */
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes; /* Bytes put with pnetcdf bput. */
     nc_type vartype;   /* The type of the var we are reading from. */
     int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
     int ierr;          /* Return code from function calls. */
+    int ret;           /* Return code that does not replace ierr. */
 
     LOG((1, "PIOc_put_vars_tc ncid = %d varid = %d start_present = %d "
          "count_present = %d stride_present = %d xtype = %d", ncid, varid,
@@ -942,37 +985,28 @@ int PIOc_put_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_PUT_VARS;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            msg_buf_t mb;
 
             /* Send the function parameters and associated informaiton
              * to the msg handler. */
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&start_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && start_present)
-                mpierr = MPI_Bcast((PIO_Offset *)start, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&count_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && count_present)
-                mpierr = MPI_Bcast((PIO_Offset *)count, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&stride_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && stride_present)
-                mpierr = MPI_Bcast((PIO_Offset *)stride, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&xtype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&num_elem, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&typelen, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack(&mb, &ndims, sizeof(int));
+            msg_pack(&mb, &start_present, 1);
+            if (start_present)
+                msg_pack(&mb, start, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &count_present, 1);
+            if (count_present)
+                msg_pack(&mb, count, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &stride_present, 1);
+            if (stride_present)
+                msg_pack(&mb, stride, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &xtype, sizeof(nc_type));
+            msg_pack(&mb, &num_elem, sizeof(PIO_Offset));
+            msg_pack(&mb, &typelen, sizeof(PIO_Offset));
+            mpierr = send_packed_msg(ios, PIO_MSG_PUT_VARS, &mb);
+            msg_buf_free(&mb);
             LOG((2, "PIOc_put_vars_tc ncid = %d varid = %d ndims = %d start_present = %d "
                  "count_present = %d stride_present = %d xtype = %d num_elem = %d", ncid, varid,
                  ndims, start_present, count_present, stride_present, xtype, num_elem));
@@ -1058,6 +1092,15 @@ int PIOc_put_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
                 /* This is not a scalar var. */
                 PIO_Offset *fake_stride;
 
+                if ((ret = get_var_desc(varid, file, &vdesc)))
+                    return pio_err(ios, file, ret, __FILE__, __LINE__);
+                if (vdesc->nreqs % PIO_REQUEST_ALLOC_CHUNK == 0)
+                    if (!(vdesc->request = realloc(vdesc->request,
+                                                   sizeof(int) * (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK))))
+                        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+                request = vdesc->request + vdesc->nreqs;
+                LOG((2, "PIOc_put_vars_tc request = %d", vdesc->request));
+
                 if (!stride_present)
                 {
                     LOG((2, "stride not present"));
@@ -1070,13 +1113,6 @@ int PIOc_put_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
                     fake_stride = (PIO_Offset *)stride;
 
                 LOG((2, "PIOc_put_vars_tc calling pnetcdf function"));
-                vdesc = &file->varlist[varid];
-                if (vdesc->nreqs % PIO_REQUEST_ALLOC_CHUNK == 0)
-                    if (!(vdesc->request = realloc(vdesc->request,
-                                                   sizeof(int) * (vdesc->nreqs + PIO_REQUEST_ALLOC_CHUNK))))
-                        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-                request = vdesc->request + vdesc->nreqs;
-                LOG((2, "PIOc_put_vars_tc request = %d", vdesc->request));
 
                 /* Only the IO master actually does the call. */
                 if (ios->iomaster == MPI_ROOT)
@@ -1105,20 +1141,30 @@ int PIOc_put_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Off
                         ierr = ncmpi_bput_vars_double(file->fh, varid, start, count, fake_stride, buf, request);
                         break;
                     default:
-                        return pio_err(ios, file, PIO_EBADTYPE, __FILE__, __LINE__);
+                        ret = PIO_EBADTYPE;
                     }
                     LOG((2, "PIOc_put_vars_tc io_rank 0 done with pnetcdf call, ierr=%d", ierr));
                 }
                 else
                     *request = PIO_REQ_NULL;
 
-                vdesc->nreqs++;
-                flush_output_buffer(file, false, 0);
-                LOG((2, "PIOc_put_vars_tc flushed output buffer"));
+                /* Count the bytes put, on all IO tasks. */
+                if (!ret)
+                {
+                    vdesc->nreqs++;
+                    ret = pnetcdf_put_bytes(file, varid, count, &putbytes);
+                }
+                if (!ret)
+                    ret = add_pending_var(file, varid, putbytes, true);
 
                 /* Free malloced resources. */
                 if (!stride_present)
                     free(fake_stride);
+                if (ret)
+                    return pio_err(ios, file, ret, __FILE__, __LINE__);
+
+                flush_output_buffer(file, false, 0);
+                LOG((2, "PIOc_put_vars_tc flushed output buffer"));
             } /* endif ndims == 0 */
         }
 #endif /* _PNETCDF */
@@ -87,6 +87,68 @@ extern "C" {
         PIO_Offset iomap;
     } mapsort;
 
+    /** A size-class pool of memory, used for the compute buffer
+     * instead of bget when PIO_USE_POOL is set. See pio_pool.c. */
+    typedef struct pio_pool pio_pool;
+
+    /** A run of map points in the subset rearranger. Both the offset
+     * on the compute task and the offset in the file increase by one
+     * along the run. */
+    typedef struct maprun
+    {
+        /** Offset of the first point on the compute task. */
+        PIO_Offset soffset;
+
+        /** 1-based offset of the first point in the file. */
+        PIO_Offset iomap;
+
+        /** Number of points in the run. */
+        PIO_Offset len;
+    } maprun;
+
+    /** Regions found from the start of one chunk of a map by
+     * get_regions_chunked(). */
+    typedef struct region_chunk
+    {
+        /** Number of regions found. */
+        int nregions;
+
+        /** Allocated number of regions. */
+        int size;
+
+        /** Position in the map of the start of each region. */
+        int *pos;
+
+        /** Counts (ndims per region) of each region. */
+        PIO_Offset *count;
+
+        /** Next region to look at when the chunks are joined. */
+        int next;
+    } region_chunk;
+
+    /** Used to find the IO task that holds a point of the global
+     * array in the box rearranger. */
+    typedef struct iobox_index
+    {
+        /** Index of the IO task in ios->ioranks. */
+        int ioproc;
+
+        /** Start of the box of the IO task in the first dimension. */
+        PIO_Offset start0;
+
+        /** Largest end (start + count) in the first dimension of this
+         * and all earlier boxes in the sorted index. */
+        PIO_Offset maxend0;
+    } iobox_index;
+
+    /** Used to sort tasks by the amount of data they hold in
+     * node_subset_partition(). */
+    typedef struct task_weight
+    {
+        int task;
+        PIO_Offset weight;
+    } task_weight;
+
     /** swapm defaults. */
     typedef struct pio_swapm_defaults
     {
@@ -106,11 +168,27 @@ extern "C" {
     void pio_get_env(void);
     int  pio_add_to_iodesc_list(io_desc_t *iodesc);
     io_desc_t *pio_get_iodesc_from_id(int ioid);
+
+    /* Find existing decompositions of the same map. */
+    unsigned long long pio_decomp_hash(iosystem_desc_t *ios, int rearranger, int ndims,
+                                       const int *gdimlen, int maplen, const PIO_Offset *compmap);
+    io_desc_t *pio_find_iodesc_by_hash(unsigned long long hash, int rearranger, int ndims,
+                                       const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                                       int piotype, io_desc_t **layout);
+    int find_cached_iodesc(iosystem_desc_t *ios, int piotype, int rearranger, int ndims,
+                           const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                           unsigned long long *hash, io_desc_t **exact, io_desc_t **layout);
+    int copy_iodesc_layout(iosystem_desc_t *ios, io_desc_t *src, io_desc_t *dst);
     int pio_delete_iodesc_from_list(int ioid);
     int pio_num_iosystem(int *niosysid);
 
     int pio_get_file(int ncid, file_desc_t **filep);
     int pio_delete_file_from_list(int ncid);
+
+    /* Get the info about a var, allocating it on first use. */
+    int get_var_desc(int varid, file_desc_t *file, var_desc_t **vdesc);
+    void free_var_descs(file_desc_t *file);
+
     void pio_add_to_file_list(file_desc_t *file);
     void pio_push_request(file_desc_t *file, int request);
 
@@ -148,6 +226,10 @@ extern "C" {
     int CalcStartandCount(int pio_type, int ndims, const int *gdims, int num_io_procs,
                           int myiorank, PIO_Offset *start, PIO_Offset *count, int *num_aiotasks);
 
+    /* Compute start and count values of this io task for a box decomposition. */
+    int calc_box_layout(iosystem_desc_t *ios, int pio_type, int ndims, const int *gdims,
+                        PIO_Offset *start, PIO_Offset *count, int *num_aiotasks);
+
     /* Completes the mapping for the box rearranger. */
     int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc, const int *dest_ioproc,
                        const PIO_Offset *dest_ioindex);
@@ -155,6 +237,12 @@ extern "C" {
     /* Create the MPI communicators needed by the subset rearranger. */
     int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc);
 
+    /* Subset partition using the node of each task and its amount of data. */
+    int node_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc);
+    int assign_subset_groups(int ntasks, const int *node, const int *io_rank,
+                             const PIO_Offset *weight, int num_iotasks, int *group);
+    int compare_task_weight(const void *a, const void *b);
+
     /* Check return from MPI function and print error message. */
     void CheckMPIReturn(int ierr, const char *file, int line);
 
@@ -213,19 +301,62 @@ extern "C" {
 
 
     /* Move data from IO tasks to compute tasks. */
-    int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf);
+    int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
+                          int nvars);
 
     /* Move data from compute tasks to IO tasks. */
     int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
                           int nvars);
+    int setup_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, int nvars,
+                      MPI_Comm *comm);
+    int rearrange_comp2io_start(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                                void *rbuf, int nvars, int *nreqs, MPI_Request **reqs);
+
+    /* Cached communication plans for rearrange_comp2io() and rearrange_io2comp(). */
+    int alloc_rearr_comm_plan(iosystem_desc_t *ios, int ntasks, rearr_comm_plan_t **plan);
+    int free_rearr_comm_plan(rearr_comm_plan_t **plan);
+    int create_comp2io_plan(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                            int have_sbuf);
+    int set_comp2io_plan_types(iosystem_desc_t *ios, io_desc_t *iodesc,
+                               rearr_comm_plan_t *plan, int nvars);
+    int create_io2comp_plan(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                            int have_sbuf);
+    int set_io2comp_plan_types(iosystem_desc_t *ios, io_desc_t *iodesc,
+                               rearr_comm_plan_t *plan, int nvars);
+    int rearr_comm_plan_exchange(rearr_comm_plan_t *plan, void *sbuf, void *rbuf,
+                                 MPI_Comm comm, rearr_comm_fc_opt_t *fc);
+
+    /* Neighborhood collective support for PIO_REARR_COMM_NEIGHBOR. */
+    int create_neighbor_comm(iosystem_desc_t *ios, io_desc_t *iodesc);
+    int free_neighbor_comm(io_desc_t *iodesc);
+    int rearr_neighbor_exchange(io_desc_t *iodesc, rearr_comm_plan_t *plan, void *sbuf,
+                                void *rbuf);
+
+    /* Shared memory path of rearrange_comp2io() between tasks on the same node. */
+    int create_rearr_shm(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm);
+    int free_rearr_shm(io_desc_t *iodesc);
+    int set_rearr_shm_window(io_desc_t *iodesc, int nvars);
+    int rearr_shm_put(io_desc_t *iodesc, void *sbuf, int nvars);
+    int rearr_shm_get(io_desc_t *iodesc, void *rbuf, int nvars);
 
     /* Allocate and initialize storage for decomposition information. */
     int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims, io_desc_t **iodesc);
-    void performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc);
+
+    /* Time the rearranger and pick the fastest options for a decomposition. */
+    int time_rearr_round_trip(iosystem_desc_t *ios, io_desc_t *iodesc, void *cbuf,
+                              void *ibuf, MPI_Comm comm, double *wtime);
+    int performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc);
 
     /* Flush contents of multi-buffer to disk. */
     int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize);
 
+    /* Track a var with pending pnetcdf requests, and the bytes in them. */
+    int add_pending_var(file_desc_t *file, int varid, PIO_Offset bytes, bool bput);
+
+    /* Find the bytes a pnetcdf put will take in the file. */
+    int pnetcdf_put_bytes(file_desc_t *file, int varid, const PIO_Offset *count,
+                          PIO_Offset *bytesp);
+
     /* Compute the size that the IO tasks will need to hold the data. */
     int compute_maxIObuffersize(MPI_Comm io_comm, io_desc_t *iodesc);
 
@@ -261,6 +392,26 @@ extern "C" {
                              const int *mcount, int *mfrom, MPI_Datatype *mtype);
     int compare_offsets(const void *a, const void *b) ;
 
+    /* Compress and merge the map runs of the subset rearranger. */
+    int compare_map_runs(const void *a, const void *b);
+    int get_map_runs(int maplen, const PIO_Offset *compmap, int *nruns, maprun **runs);
+    int sort_map_runs(int nruns, maprun *runs);
+    int merge_map_runs(int ntasks, const int *nruns, maprun *runs, int *noutp,
+                       maprun **outp, int **fromp);
+
+    /* Find the regions of a map, searching chunks of it in parallel. */
+    int get_regions_chunked(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
+                            int nchunks, int *maxregions, io_region *firstregion);
+
+    /* Merge neighboring regions that form one region of the file. */
+    int coalesce_regions(int ndims, io_region *firstregion, int *nregions);
+
+    /* Find the IO task that holds a point in the box rearranger. */
+    int compare_iobox(const void *a, const void *b);
+    bool box_contains(int ndims, const PIO_Offset *box, const PIO_Offset *gcoord);
+    int find_iobox(int ndims, const PIO_Offset *gcoord, int nboxes, const iobox_index *boxindex,
+                   const PIO_Offset *ioboxes);
+
     /* Print a trace statement, for debugging. */
     void print_trace (FILE *fp);
 
@@ -271,9 +422,29 @@ extern "C" {
 
     void free_cn_buffer_pool(iosystem_desc_t *ios);
 
+    /* Size-class pool allocator. */
+    int pio_pool_create(PIO_Offset limit, pio_pool **poolp);
+    void pio_pool_free(pio_pool *pool);
+    void *pio_pool_get(pio_pool *pool, PIO_Offset size);
+    void *pio_pool_getr(pio_pool *pool, void *buf, PIO_Offset size);
+    void pio_pool_rel(pio_pool *pool, void *buf);
+    void pio_pool_freespace(pio_pool *pool, PIO_Offset *totfree, PIO_Offset *maxfree);
+    void pio_pool_stats(pio_pool *pool, PIO_Offset *requested, PIO_Offset *inuse,
+                        PIO_Offset *footprint, PIO_Offset *highwater, PIO_Offset *nget,
+                        PIO_Offset *nrel);
+
     /* Flush PIO's data buffer. */
     int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk);
 
+    /* Find or create the write multi buffer of a decomposition. */
+    int get_wmb(file_desc_t *file, int ioid, int recordvar, wmulti_buffer **wmbp);
+
+    /* Capacity of a write multi buffer after it next grows. */
+    int wmb_next_capacity(const io_desc_t *iodesc, const wmulti_buffer *wmb);
+
+    /* Make room in a write multi buffer for another array. */
+    int grow_wmb(file_desc_t *file, io_desc_t *iodesc, wmulti_buffer *wmb, PIO_Offset arraylen);
+
     int compute_maxaggregate_bytes(iosystem_desc_t *ios, io_desc_t *iodesc);
 
     /* Compute an element of start/count arrays. */
@@ -297,10 +468,57 @@ extern "C" {
 
     /* Write aggregated arrays to file using serial I/O (netCDF-3/netCDF-4 serial) */
     int write_darray_multi_serial(file_desc_t *file, int nvars, const int *vid,
-                                  io_desc_t *iodesc, int fill, const int *frame);
-
-    int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobuf);
-    int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int vid, void *iobuf);
+                                  io_desc_t *iodesc, int fill, void *fillbuf, const int *frame);
+
+    /* Get the number of dims of a var, asking the netCDF layer only once. */
+    int get_var_ndims(file_desc_t *file, int varid, int *ndimsp);
+
+    /* Pack and unpack async messages. */
+    void msg_buf_init(iosystem_desc_t *ios, msg_buf_t *mb);
+    void msg_buf_free(msg_buf_t *mb);
+    void msg_pack(msg_buf_t *mb, const void *data, PIO_Offset len);
+    void msg_pack_str(msg_buf_t *mb, const char *str);
+    int msg_unpack(msg_buf_t *mb, void *data, PIO_Offset len);
+    int msg_unpack_str(msg_buf_t *mb, char *str, int maxlen);
+    void *msg_unpack_ptr(msg_buf_t *mb, PIO_Offset len);
+
+    /* Send an async message to the IO tasks, and receive it there. */
+    int send_msg(iosystem_desc_t *ios, int msg);
+    int send_packed_msg(iosystem_desc_t *ios, int msg, msg_buf_t *mb);
+    int recv_packed_msg(iosystem_desc_t *ios, msg_buf_t *mb);
+
+    /* Queue a define mode call in the batch of the iosystem. */
+    int queue_msg(iosystem_desc_t *ios, int msg, msg_buf_t *mb);
+
+    /* Cache the metadata of a file on all tasks. */
+    int file_meta_build(file_desc_t *file);
+    void file_meta_free(file_desc_t *file);
+    void file_meta_invalidate(file_desc_t *file);
+    int file_meta_atts(file_meta_t *meta, int varid, att_meta_t **attsp, int *nattsp);
+    int file_meta_att(file_meta_t *meta, int varid, const char *name, att_meta_t **attp,
+                      int *attnump);
+
+    /* Shared buffers of fill values. */
+    int get_fill_buf(file_desc_t *file, int size, const void *fillvalue, PIO_Offset len,
+                     void **bufp);
+    void free_fill_bufs(file_desc_t *file);
+
+    /* Write data that has been moved to the IO tasks. */
+    int write_darray_multi_iobuf(file_desc_t *file, io_desc_t *iodesc, int nvars,
+                                 const int *varids, const int *frame, void *fillvalue,
+                                 bool flushtodisk);
+
+    /* Get the default fill value for a type. */
+    int find_default_fillvalue(MPI_Datatype basetype, void *fillvalue);
+
+    /* Complete writes started with PIOc_iwrite_darray(). */
+    int complete_darray_req(file_desc_t *file, darray_req_t *req);
+    int wait_all_darray_reqs(file_desc_t *file);
+
+    int pio_read_darray_nc(file_desc_t *file, io_desc_t *iodesc, int nvars, const int *vids,
+                           void *iobuf);
+    int pio_read_darray_nc_serial(file_desc_t *file, io_desc_t *iodesc, int nvars,
+                                  const int *vids, void *iobuf);
 
     /* Read atts with type conversion. */
     int PIOc_get_att_tc(int ncid, int varid, const char *name, nc_type memtype, void *ip);
@@ -309,6 +527,13 @@ extern "C" {
     int PIOc_put_att_tc(int ncid, int varid, const char *name, nc_type atttype,
                         PIO_Offset len, nc_type memtype, const void *op);
 
+    /* Read an att with the netCDF library on the IO tasks. */
+    int get_att_nc(file_desc_t *file, int varid, const char *name, nc_type memtype, void *ip);
+
+    /* Write an att with the netCDF library on the IO tasks. */
+    int put_att_nc(file_desc_t *file, int varid, const char *name, nc_type atttype,
+                   PIO_Offset len, nc_type memtype, const void *op);
+
     /* Generalized get functions. */
     int PIOc_get_vars_tc(int ncid, int varid, const PIO_Offset *start, const PIO_Offset *count,
                          const PIO_Offset *stride, nc_type xtype, void *buf);
@@ -558,7 +783,9 @@ enum PIO_MSG
     PIO_MSG_EXIT,
     PIO_MSG_GET_ATT,
     PIO_MSG_PUT_ATT,
-    PIO_MSG_INQ_TYPE
+    PIO_MSG_INQ_TYPE,
+    PIO_MSG_BATCH,
+    PIO_MSG_SET_IOTASK_TARGET
 };
 
 #endif /* __PIO_INTERNAL__ */
@@ -9,10 +9,195 @@
 #include <stdio.h>
 
 static io_desc_t *pio_iodesc_list=NULL;
-static io_desc_t *current_iodesc=NULL;
+static io_desc_t *pio_iodesc_tail=NULL;
+static int pio_next_ioid = 512;
 static iosystem_desc_t *pio_iosystem_list=NULL;
+static iosystem_desc_t *pio_iosystem_tail=NULL;
 static file_desc_t *pio_file_list = NULL;
-static file_desc_t *current_file=NULL;
+static file_desc_t *pio_file_tail = NULL;
+
+/** Marks a slot of a handle table whose entry was deleted. */
+static char handle_deleted;
+#define HANDLE_DELETED ((void *)&handle_deleted)
+
+/** Smallest number of slots in a handle table. */
+#define HANDLE_TABLE_MIN_SIZE 64
+
+/**
+ * Open-addressing hash table (with linear probing) from the ID of a
+ * file, decomposition or iosystem to its struct, or from the map hash
+ * of a decomposition to the decomposition. The lists are still the
+ * authority: the tables make lookups of existing IDs O(1), and a
+ * lookup that misses the table falls back to the list. Several
+ * decompositions may have the same map hash, so a key may be in the
+ * table more than once.
+ */
+typedef struct handle_table
+{
+    /** Number of slots, 0 or a power of 2. */
+    int size;
+
+    /** Number of entries. */
+    int count;
+
+    /** Number of entries plus deleted slots. */
+    int used;
+
+    /** The key in each slot. */
+    unsigned long long *ids;
+
+    /** The struct in each slot, NULL if the slot is empty. */
+    void **ptrs;
+} handle_table;
+
+static handle_table file_table;
+static handle_table iodesc_table;
+static handle_table iosystem_table;
+static handle_table maphash_table;
+
+/** Find the first slot to look in for a key. IDs are sequential, or
+ * in the high bits (iosysids), so mix the bits before masking.
+ *
+ * @param id the key.
+ * @param size the number of slots in the table.
+ * @returns the slot.
+ */
+static int handle_slot(unsigned long long id, int size)
+{
+    unsigned long long h = id;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (int)(h & (size - 1));
+}
+
+/** Find the struct with an ID in a handle table.
+ *
+ * @param table pointer to the table.
+ * @param id the ID.
+ * @returns pointer to the struct, or NULL if it is not in the table.
+ */
+static void *handle_find(const handle_table *table, unsigned long long id)
+{
+    if (!table->size)
+        return NULL;
+
+    for (int i = handle_slot(id, table->size); table->ptrs[i]; i = (i + 1) & (table->size - 1))
+        if (table->ptrs[i] != HANDLE_DELETED && table->ids[i] == id)
+            return table->ptrs[i];
+
+    return NULL;
+}
+
+/** Rebuild a handle table with a new number of slots, dropping the
+ * deleted slots.
+ *
+ * @param table pointer to the table.
+ * @param size the new number of slots, a power of 2.
+ * @returns 0 for success, error code otherwise.
+ */
+static int handle_rehash(handle_table *table, int size)
+{
+    unsigned long long *ids;
+    void **ptrs;
+
+    if (!(ids = malloc(size * sizeof(unsigned long long))))
+        return PIO_ENOMEM;
+    if (!(ptrs = calloc(size, sizeof(void *))))
+    {
+        free(ids);
+        return PIO_ENOMEM;
+    }
+
+    for (int j = 0; j < table->size; j++)
+    {
+        int i;
+
+        if (!table->ptrs[j] || table->ptrs[j] == HANDLE_DELETED)
+            continue;
+        for (i = handle_slot(table->ids[j], size); ptrs[i]; i = (i + 1) & (size - 1))
+            ;
+        ids[i] = table->ids[j];
+        ptrs[i] = table->ptrs[j];
+    }
+
+    free(table->ids);
+    free(table->ptrs);
+    table->ids = ids;
+    table->ptrs = ptrs;
+    table->size = size;
+    table->used = table->count;
+
+    return PIO_NOERR;
+}
+
+/** Add a struct to a handle table. The struct must not be in the
+ * table.
+ *
+ * @param table pointer to the table.
+ * @param id the key.
+ * @param ptr pointer to the struct.
+ * @returns 0 for success, error code otherwise.
+ */
+static int handle_insert(handle_table *table, unsigned long long id, void *ptr)
+{
+    int i;
+    int ret;
+
+    /* Keep the table at most 3/4 full, counting deleted slots. */
+    if (4 * (table->used + 1) > 3 * table->size)
+    {
+        int size = table->size ? table->size : HANDLE_TABLE_MIN_SIZE;
+
+        while (4 * (table->count + 1) > 3 * size / 2)
+            size *= 2;
+        if ((ret = handle_rehash(table, size)))
+            return ret;
+    }
+
+    for (i = handle_slot(id, table->size); table->ptrs[i] && table->ptrs[i] != HANDLE_DELETED;
+         i = (i + 1) & (table->size - 1))
+        ;
+    if (!table->ptrs[i])
+        table->used++;
+    table->ids[i] = id;
+    table->ptrs[i] = ptr;
+    table->count++;
+
+    return PIO_NOERR;
+}
+
+/** Remove a struct from a handle table, if it is there. The table is
+ * freed when it becomes empty.
+ *
+ * @param table pointer to the table.
+ * @param id the key.
+ * @param ptr pointer to the struct.
+ */
+static void handle_remove(handle_table *table, unsigned long long id, void *ptr)
+{
+    if (!table->size)
+        return;
+
+    for (int i = handle_slot(id, table->size); table->ptrs[i]; i = (i + 1) & (table->size - 1))
+    {
+        if (table->ptrs[i] == ptr && table->ids[i] == id)
+        {
+            table->ptrs[i] = HANDLE_DELETED;
+            table->count--;
+            break;
+        }
+    }
+
+    if (!table->count)
+    {
+        free(table->ids);
+        free(table->ptrs);
+        memset(table, 0, sizeof(handle_table));
+    }
+}
 
 /** Add a new entry to the global list of open files.
  *
@@ -20,29 +205,23 @@ static file_desc_t *current_file=NULL;
  */
 void pio_add_to_file_list(file_desc_t *file)
 {
-    file_desc_t *cfile;
-
     assert(file);
 
     /* This file will be at the end of the list, and have no next. */
     file->next = NULL;
 
-    /* Get a pointer to the global list of files. */
-    cfile = pio_file_list;
-
-    /* Keep a global pointer to the current file. */
-    current_file = file;
-
     /* If there is nothing in the list, then file will be the first
-     * entry. Otherwise, move to end of the list. */
-    if (!cfile)
+     * entry. Otherwise, add it after the last one. */
+    if (!pio_file_list)
         pio_file_list = file;
     else
-    {
-        while (cfile->next)
-            cfile = cfile->next;
-        cfile->next = file;
-    }
+        pio_file_tail->next = file;
+    pio_file_tail = file;
+
+    /* Index the file by ncid. If this fails, lookups of this file
+     * fall back to the list. */
+    if (handle_insert(&file_table, file->pio_ncid, file))
+        LOG((1, "pio_add_to_file_list could not index ncid %d", file->pio_ncid));
 }
 
 /** Given ncid, find the file_desc_t data for an open file. The ncid
@@ -65,15 +244,10 @@ int pio_get_file(int ncid, file_desc_t **cfile1)
         return PIO_EINVAL;
 
     /* Find the file pointer. */
-    if (current_file && current_file->pio_ncid == ncid)
-        cfile = current_file;
-    else
+    if (!(cfile = handle_find(&file_table, ncid)))
         for (cfile = pio_file_list; cfile; cfile = cfile->next)
             if (cfile->pio_ncid == ncid)
-            {
-                current_file = cfile;
                 break;
-            }
 
     /* If not found, return error. */
     if (!cfile)
@@ -92,6 +266,93 @@ int pio_get_file(int ncid, file_desc_t **cfile1)
     return PIO_NOERR;
 }
 
+/** Get the info about a var of an open file. The entry for the var
+ * is allocated, and the table of vars grown, the first time the var
+ * is used, so the memory used by a file grows with the vars it
+ * uses.
+ *
+ * @param varid the ID of the var.
+ * @param file pointer to the file_desc_t of the file.
+ * @param vdesc pointer that gets a pointer to the var_desc_t of the
+ * var. The pointer stays valid until the file is closed.
+ *
+ * @returns 0 for success, error code otherwise.
+ */
+int get_var_desc(int varid, file_desc_t *file, var_desc_t **vdesc)
+{
+    var_desc_t *v;
+
+    /* Check inputs. */
+    if (!file || !vdesc)
+        return PIO_EINVAL;
+    if (varid < 0 || varid >= PIO_MAX_VARS)
+        return PIO_ENOTVAR;
+
+    /* Grow the table to hold this varid. */
+    if (varid >= file->varlist_size)
+    {
+        int size = file->varlist_size ? 2 * file->varlist_size : 16;
+        var_desc_t **varlist;
+        int *active_varids;
+
+        while (size <= varid)
+            size *= 2;
+        if (size > PIO_MAX_VARS)
+            size = PIO_MAX_VARS;
+        if (!(active_varids = realloc(file->active_varids, size * sizeof(int))))
+            return PIO_ENOMEM;
+        file->active_varids = active_varids;
+        if (!(varlist = realloc(file->varlist, size * sizeof(var_desc_t *))))
+            return PIO_ENOMEM;
+        memset(varlist + file->varlist_size, 0,
+               (size - file->varlist_size) * sizeof(var_desc_t *));
+        file->varlist = varlist;
+        file->varlist_size = size;
+    }
+
+    /* Allocate the entry the first time the var is used. */
+    if (!(v = file->varlist[varid]))
+    {
+        if (!(v = calloc(1, sizeof(var_desc_t))))
+            return PIO_ENOMEM;
+        v->record = -1;
+        v->ndims = -1;
+        v->fill_ioid = -1;
+        file->varlist[varid] = v;
+        file->active_varids[file->nactive_vars++] = varid;
+    }
+
+    *vdesc = v;
+
+    return PIO_NOERR;
+}
+
+/** Free the info about the vars of a file.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ */
+void free_var_descs(file_desc_t *file)
+{
+    assert(file);
+
+    for (int v = 0; v < file->nactive_vars; v++)
+    {
+        var_desc_t *vdesc = file->varlist[file->active_varids[v]];
+
+        if (vdesc->fillvalue)
+            free(vdesc->fillvalue);
+        if (vdesc->request)
+            free(vdesc->request);
+        free(vdesc);
+    }
+    free(file->varlist);
+    free(file->active_varids);
+    file->varlist = NULL;
+    file->active_varids = NULL;
+    file->varlist_size = 0;
+    file->nactive_vars = 0;
+}
+
 /** Delete a file from the list of open files.
  *
  * @param ncid ID of file to delete from list
@@ -111,14 +372,22 @@ int pio_delete_file_from_list(int ncid)
                 pio_file_list = cfile->next;
             else
                 pfile->next = cfile->next;
+            if (pio_file_tail == cfile)
+                pio_file_tail = pfile;
+            handle_remove(&file_table, ncid, cfile);
+
+            /* Free the info about the vars. */
+            free_var_descs(cfile);
+
+            /* Free the buffers of fill values. */
+            free_fill_bufs(cfile);
 
-            if (current_file == cfile)
-                current_file = pfile;
+            /* Free the cached metadata. */
+            file_meta_free(cfile);
 
-            /* Free any fill values that were allocated. */
-            for (int v = 0; v < PIO_MAX_VARS; v++)
-                if (cfile->varlist[v].fillvalue)
-                    free(cfile->varlist[v].fillvalue);
+            /* Free the list of vars with pending requests. */
+            if (cfile->pending_varids)
+                free(cfile->pending_varids);
 
             /* Free the memory used for this file. */
             free(cfile);
@@ -151,6 +420,9 @@ int pio_delete_iosystem_from_list(int piosysid)
                 pio_iosystem_list = ciosystem->next;
             else
                 piosystem->next = ciosystem->next;
+            if (pio_iosystem_tail == ciosystem)
+                pio_iosystem_tail = piosystem;
+            handle_remove(&iosystem_table, piosysid, ciosystem);
             free(ciosystem);
             return PIO_NOERR;
         }
@@ -159,35 +431,36 @@ int pio_delete_iosystem_from_list(int piosysid)
     return PIO_EBADID;
 }
 
-/** Add iosystem info to list.
+/** Add iosystem info to list. The iosysid is one more than that of
+ * the last iosystem in the list, in the upper bits, so IDs are not
+ * reused while an iosystem is open.
  *
  * @param ios pointer to the iosystem_desc_t info to add.
- * @returns 0 on success, error code otherwise
+ * @returns the iosysid of the newly added iosystem.
  */
 int pio_add_to_iosystem_list(iosystem_desc_t *ios)
 {
-    iosystem_desc_t *cios;
     int i = 1;
 
     assert(ios);
 
     ios->next = NULL;
-    cios = pio_iosystem_list;
-    if (!cios)
+    if (!pio_iosystem_list)
         pio_iosystem_list = ios;
     else
     {
-        i++;
-        while (cios->next)
-        {
-            cios = cios->next;
-            i++;
-        }
-        cios->next = ios;
+        i = (pio_iosystem_tail->iosysid >> 16) + 1;
+        pio_iosystem_tail->next = ios;
     }
+    pio_iosystem_tail = ios;
 
     ios->iosysid = i << 16;
 
+    /* Index the iosystem by iosysid. If this fails, lookups of this
+     * iosystem fall back to the list. */
+    if (handle_insert(&iosystem_table, ios->iosysid, ios))
+        LOG((1, "pio_add_to_iosystem_list could not index iosysid %d", ios->iosysid));
+
     return ios->iosysid;
 }
 
@@ -202,6 +475,9 @@ iosystem_desc_t *pio_get_iosystem_from_id(int iosysid)
 
     LOG((2, "pio_get_iosystem_from_id iosysid = %d", iosysid));
 
+    if ((ciosystem = handle_find(&iosystem_table, iosysid)))
+        return ciosystem;
+
     for (ciosystem = pio_iosystem_list; ciosystem; ciosystem = ciosystem->next)
         if (ciosystem->iosysid == iosysid)
             return ciosystem;
@@ -230,26 +506,37 @@ pio_num_iosystem(int *niosysid)
     return PIO_NOERR;
 }
 
-/** Add an iodesc.
+/** Add an iodesc. The ioid is one more than that of the last iodesc
+ * in the list, or 512 for the first.
  *
  * @param io_desc_t pointer to data to add to list.
  * @returns the ioid of the newly added iodesc.
  */
 int pio_add_to_iodesc_list(io_desc_t *iodesc)
 {
-    io_desc_t *ciodesc;
-    int imax = 512;
-
     iodesc->next = NULL;
     if (pio_iodesc_list == NULL)
         pio_iodesc_list = iodesc;
-    else{
-        imax++;
-        for (ciodesc = pio_iodesc_list; ciodesc->next; ciodesc=ciodesc->next, imax=ciodesc->ioid + 1);
-        ciodesc->next = iodesc;
-    }
-    iodesc->ioid = imax;
-    current_iodesc = iodesc;
+    else
+        pio_iodesc_tail->next = iodesc;
+    pio_iodesc_tail = iodesc;
+
+    /* IDs are not reused, so that a var_desc_t can remember the
+     * decomposition its holes were filled with. */
+    iodesc->ioid = pio_next_ioid++;
+
+    /* Index the iodesc by ioid. If this fails, lookups of this iodesc
+     * fall back to the list. */
+    if (handle_insert(&iodesc_table, iodesc->ioid, iodesc))
+        LOG((1, "pio_add_to_iodesc_list could not index ioid %d", iodesc->ioid));
+
+    /* Index it by map hash too, if it can be reused. If this fails,
+     * it is not found by pio_find_iodesc_by_hash(), and a new
+     * decomposition is made instead. */
+    if (iodesc->maphash)
+        if (handle_insert(&maphash_table, iodesc->maphash, iodesc))
+            LOG((1, "pio_add_to_iodesc_list could not index the map hash of ioid %d",
+                 iodesc->ioid));
 
     return iodesc->ioid;
 }
@@ -261,17 +548,14 @@ int pio_add_to_iodesc_list(io_desc_t *iodesc)
  */
 io_desc_t *pio_get_iodesc_from_id(int ioid)
 {
-    io_desc_t *ciodesc = NULL;
+    io_desc_t *ciodesc;
 
-    if (current_iodesc != NULL && current_iodesc->ioid == abs(ioid))
-        ciodesc = current_iodesc;
-    else
-        for (ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
-            if (ciodesc->ioid == abs(ioid))
-            {
-                current_iodesc = ciodesc;
-                break;
-            }
+    if ((ciodesc = handle_find(&iodesc_table, abs(ioid))))
+        return ciodesc;
+
+    for (ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
+        if (ciodesc->ioid == abs(ioid))
+            break;
 
     return ciodesc;
 }
@@ -293,9 +577,11 @@ int pio_delete_iodesc_from_list(int ioid)
                 pio_iodesc_list = ciodesc->next;
             else
                 piodesc->next = ciodesc->next;
-
-            if (current_iodesc == ciodesc)
-                current_iodesc = pio_iodesc_list;
+            if (pio_iodesc_tail == ciodesc)
+                pio_iodesc_tail = piodesc;
+            handle_remove(&iodesc_table, ioid, ciodesc);
+            if (ciodesc->maphash)
+                handle_remove(&maphash_table, ciodesc->maphash, ciodesc);
             free(ciodesc);
             return PIO_NOERR;
         }
@@ -303,3 +589,97 @@ int pio_delete_iodesc_from_list(int ioid)
     }
     return PIO_EBADID;
 }
+
+/** Mix one value into a decomposition hash (FNV-1a on 64-bit
+ * words). */
+#define MIX_HASH(h, v) (((h) ^ (unsigned long long)(v)) * 0x100000001b3ULL)
+
+/** Compute the hash that PIOc_InitDecomp() uses to find an existing
+ * decomposition of the same map. It covers the IO system, the
+ * rearranger and the settings that change how it is set up, the
+ * dimensions and the map of this task.
+ *
+ * @param ios pointer to the IO system info.
+ * @param rearranger the rearranger.
+ * @param ndims the number of dimensions.
+ * @param gdimlen array (length ndims) of the global dimension sizes.
+ * @param maplen the length of the map.
+ * @param compmap the 1-based map of this task.
+ * @returns the hash, never 0.
+ */
+unsigned long long pio_decomp_hash(iosystem_desc_t *ios, int rearranger, int ndims,
+                                   const int *gdimlen, int maplen, const PIO_Offset *compmap)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+
+    assert(ios && (gdimlen || !ndims) && (compmap || !maplen));
+
+    h = MIX_HASH(h, ios->iosysid);
+    h = MIX_HASH(h, rearranger);
+    h = MIX_HASH(h, ios->subset_partition);
+    h = MIX_HASH(h, ios->rearr_opts.comm_type);
+    h = MIX_HASH(h, ndims);
+    for (int d = 0; d < ndims; d++)
+        h = MIX_HASH(h, gdimlen[d]);
+    h = MIX_HASH(h, maplen);
+    for (int m = 0; m < maplen; m++)
+        h = MIX_HASH(h, compmap[m]);
+
+    return h ? h : 1;
+}
+
+/** Find decompositions with the same hash, and the same map and
+ * dimensions on this task. Only decompositions that can be reused
+ * (see PIOc_InitDecomp()) have a hash, and they are indexed by it.
+ * The first one is the one with the lowest ioid, so that all tasks
+ * pick the same one, whatever the order in the table.
+ *
+ * @param hash the hash from pio_decomp_hash().
+ * @param rearranger the rearranger.
+ * @param ndims the number of dimensions.
+ * @param gdimlen array (length ndims) of the global dimension sizes.
+ * @param maplen the length of the map.
+ * @param compmap the 1-based map of this task.
+ * @param piotype the PIO type of the data.
+ * @param layout pointer that gets the first matching decomposition
+ * with a different piotype, or NULL if there is none.
+ * @returns pointer to the first matching decomposition of the same
+ * piotype, or NULL if there is none.
+ */
+io_desc_t *pio_find_iodesc_by_hash(unsigned long long hash, int rearranger, int ndims,
+                                   const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                                   int piotype, io_desc_t **layout)
+{
+    const handle_table *table = &maphash_table;
+    io_desc_t *exact = NULL;
+
+    assert(layout);
+
+    *layout = NULL;
+    if (!table->size)
+        return NULL;
+
+    /* Look at all decompositions with this hash in the table. */
+    for (int i = handle_slot(hash, table->size); table->ptrs[i]; i = (i + 1) & (table->size - 1))
+    {
+        io_desc_t *ciodesc = table->ptrs[i];
+
+        if (ciodesc == HANDLE_DELETED || table->ids[i] != hash)
+            continue;
+        if (ciodesc->rearranger != rearranger || ciodesc->ndims != ndims ||
+            ciodesc->maplen != maplen)
+            continue;
+        if ((ndims && memcmp(ciodesc->dimlen, gdimlen, ndims * sizeof(int))) ||
+            (maplen && memcmp(ciodesc->map, compmap, maplen * sizeof(PIO_Offset))))
+            continue;
+        if (ciodesc->piotype == piotype)
+        {
+            if (!exact || ciodesc->ioid < exact->ioid)
+                exact = ciodesc;
+        }
+        else if (!*layout || ciodesc->ioid < (*layout)->ioid)
+            *layout = ciodesc;
+    }
+
+    return exact;
+}
@@ -17,6 +17,317 @@ extern int my_rank;
 extern int pio_log_level;
 #endif /* PIO_ENABLE_LOGGING */
 
+/** Initial size in bytes of a packed message buffer. */
+#define MSG_BUF_MIN_SIZE 256
+
+/**
+ * Start a packed message. The data are only kept on the computation
+ * master task, which sends them. The other computation tasks only
+ * count the bytes, so that all tasks agree on the length of a batch.
+ *
+ * @param ios pointer to the iosystem info. If NULL, the data are kept.
+ * @param mb pointer to the message buffer.
+ * @internal
+ */
+void msg_buf_init(iosystem_desc_t *ios, msg_buf_t *mb)
+{
+    pioassert(mb, "invalid input", __FILE__, __LINE__);
+
+    memset(mb, 0, sizeof(msg_buf_t));
+    if (ios && ios->compmaster != MPI_ROOT)
+        mb->count_only = true;
+}
+
+/**
+ * Free the memory of a packed message. The buffer may be used again
+ * after msg_buf_init().
+ *
+ * @param mb pointer to the message buffer.
+ * @internal
+ */
+void msg_buf_free(msg_buf_t *mb)
+{
+    pioassert(mb, "invalid input", __FILE__, __LINE__);
+
+    if (mb->buf)
+        free(mb->buf);
+    memset(mb, 0, sizeof(msg_buf_t));
+}
+
+/**
+ * Append data to a packed message. If memory runs out, the nomem
+ * flag of the buffer is set, and the message is not sent.
+ *
+ * @param mb pointer to the message buffer.
+ * @param data pointer to the data.
+ * @param len number of bytes of data.
+ * @internal
+ */
+void msg_pack(msg_buf_t *mb, const void *data, PIO_Offset len)
+{
+    pioassert(mb && len >= 0 && (data || !len || mb->count_only), "invalid input", __FILE__, __LINE__);
+
+    if (!mb->count_only && !mb->nomem && len)
+    {
+        /* Grow the buffer if needed, doubling its size. */
+        if (mb->len + len > mb->size)
+        {
+            PIO_Offset size = max(max(2 * mb->size, mb->len + len), MSG_BUF_MIN_SIZE);
+            char *buf;
+
+            if (!(buf = realloc(mb->buf, size)))
+            {
+                mb->nomem = true;
+                return;
+            }
+            mb->buf = buf;
+            mb->size = size;
+        }
+        memcpy(mb->buf + mb->len, data, len);
+    }
+    mb->len += len;
+}
+
+/**
+ * Append a string, and its length, to a packed message.
+ *
+ * @param mb pointer to the message buffer.
+ * @param str the string.
+ * @internal
+ */
+void msg_pack_str(msg_buf_t *mb, const char *str)
+{
+    int len = strlen(str);
+
+    msg_pack(mb, &len, sizeof(int));
+    msg_pack(mb, str, len);
+}
+
+/**
+ * Get the next data from a packed message.
+ *
+ * @param mb pointer to the message buffer.
+ * @param data pointer that gets the data.
+ * @param len number of bytes of data.
+ * @returns 0 for success, PIO_EINVAL if the message is too short.
+ * @internal
+ */
+int msg_unpack(msg_buf_t *mb, void *data, PIO_Offset len)
+{
+    void *ptr;
+
+    if (!(ptr = msg_unpack_ptr(mb, len)))
+        return PIO_EINVAL;
+    if (len)
+        memcpy(data, ptr, len);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get the next string from a packed message.
+ *
+ * @param mb pointer to the message buffer.
+ * @param str pointer to memory of at least maxlen + 1 chars that gets
+ * the null-terminated string.
+ * @param maxlen the maximum length of the string.
+ * @returns 0 for success, PIO_EINVAL if the message is too short or
+ * the string too long.
+ * @internal
+ */
+int msg_unpack_str(msg_buf_t *mb, char *str, int maxlen)
+{
+    int len;
+    int ret;
+
+    if ((ret = msg_unpack(mb, &len, sizeof(int))))
+        return ret;
+    if (len < 0 || len > maxlen)
+        return PIO_EINVAL;
+    if ((ret = msg_unpack(mb, str, len)))
+        return ret;
+    str[len] = '\0';
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get a pointer to the next data of a packed message, without
+ * copying them. The pointer is valid until the buffer is freed.
+ *
+ * @param mb pointer to the message buffer.
+ * @param len number of bytes of data.
+ * @returns pointer to the data, or NULL if the message is too short.
+ * @internal
+ */
+void *msg_unpack_ptr(msg_buf_t *mb, PIO_Offset len)
+{
+    void *ptr;
+
+    pioassert(mb && !mb->count_only, "invalid input", __FILE__, __LINE__);
+
+    if (len < 0 || mb->pos + len > mb->len)
+        return NULL;
+    ptr = mb->buf + mb->pos;
+    mb->pos += len;
+
+    return ptr;
+}
+
+/**
+ * Send the calls queued in the batch of an iosystem to the IO tasks
+ * as one PIO_MSG_BATCH message. This is called on all computation
+ * tasks.
+ *
+ * @param ios pointer to the iosystem info.
+ * @returns MPI_SUCCESS, or an MPI error code.
+ * @internal
+ */
+static int send_batch(iosystem_desc_t *ios)
+{
+    msg_buf_t batch = ios->batch;
+    int mpierr;
+
+    LOG((2, "send_batch count = %d len = %lld", batch.count, batch.len));
+
+    /* The batch is taken out of the iosystem first, so it is not
+     * sent again by send_packed_msg(). */
+    memset(&ios->batch, 0, sizeof(msg_buf_t));
+    mpierr = send_packed_msg(ios, PIO_MSG_BATCH, &batch);
+    msg_buf_free(&batch);
+
+    return mpierr;
+}
+
+/**
+ * Send a message to the IO tasks with async. This is called on all
+ * computation tasks, only the computation master task sends it. Any
+ * calls queued in the batch of the iosystem are sent first, so the IO
+ * tasks handle all calls in the order they were made.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param msg the message.
+ * @returns MPI_SUCCESS, or an MPI error code.
+ * @internal
+ */
+int send_msg(iosystem_desc_t *ios, int msg)
+{
+    int mpierr;
+
+    pioassert(ios && ios->async && !ios->ioproc, "invalid input", __FILE__, __LINE__);
+
+    if (ios->batch.count)
+        if ((mpierr = send_batch(ios)))
+            return mpierr;
+
+    if (ios->compmaster == MPI_ROOT)
+        if ((mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm)))
+            return mpierr;
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Send a message and its packed parameters to the IO tasks with
+ * async. The parameters are sent with two broadcasts, one for the
+ * length and one for the data, instead of one broadcast for each
+ * parameter. This is called on all computation tasks.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param msg the message.
+ * @param mb pointer to the packed parameters.
+ * @returns MPI_SUCCESS, or an MPI error code. MPI_ERR_NO_MEM if the
+ * parameters could not be packed.
+ * @internal
+ */
+int send_packed_msg(iosystem_desc_t *ios, int msg, msg_buf_t *mb)
+{
+    int mpierr;
+
+    pioassert(mb, "invalid input", __FILE__, __LINE__);
+    LOG((2, "send_packed_msg msg = %d len = %lld", msg, mb->len));
+
+    if (mb->nomem)
+        return MPI_ERR_NO_MEM;
+
+    if ((mpierr = send_msg(ios, msg)))
+        return mpierr;
+    if ((mpierr = MPI_Bcast(&mb->len, 1, MPI_OFFSET, ios->compmaster, ios->intercomm)))
+        return mpierr;
+    if ((mpierr = MPI_Bcast(mb->buf, mb->len, MPI_BYTE, ios->compmaster, ios->intercomm)))
+        return mpierr;
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Receive the packed parameters of a message on the IO tasks. The
+ * caller must free the buffer with msg_buf_free().
+ *
+ * @param ios pointer to the iosystem info.
+ * @param mb pointer to the message buffer that gets the parameters.
+ * @returns 0 for success, error code otherwise.
+ * @internal
+ */
+int recv_packed_msg(iosystem_desc_t *ios, msg_buf_t *mb)
+{
+    int mpierr;
+
+    pioassert(ios && mb, "invalid input", __FILE__, __LINE__);
+
+    msg_buf_init(NULL, mb);
+    if ((mpierr = MPI_Bcast(&mb->len, 1, MPI_OFFSET, 0, ios->intercomm)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (!(mb->buf = malloc(max(mb->len, 1))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    mb->size = mb->len;
+    if ((mpierr = MPI_Bcast(mb->buf, mb->len, MPI_BYTE, 0, ios->intercomm)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    LOG((2, "recv_packed_msg len = %lld", mb->len));
+
+    return PIO_NOERR;
+}
+
+/**
+ * Queue a call in the batch of an iosystem, instead of sending it to
+ * the IO tasks. The batch is sent when it reaches the batch size of
+ * the iosystem, or before the next message. This is called on all
+ * computation tasks.
+ *
+ * @param ios pointer to the iosystem info.
+ * @param msg the message of the call.
+ * @param mb pointer to the packed parameters of the call.
+ * @returns 0 for success, error code otherwise.
+ * @internal
+ */
+int queue_msg(iosystem_desc_t *ios, int msg, msg_buf_t *mb)
+{
+    int mpierr;
+
+    pioassert(ios && ios->async && !ios->ioproc && mb, "invalid input", __FILE__, __LINE__);
+
+    if (!ios->batch.count)
+        msg_buf_init(ios, &ios->batch);
+
+    /* Each call in the batch is the message, the length of the
+     * parameters, and the parameters. */
+    msg_pack(&ios->batch, &msg, sizeof(int));
+    msg_pack(&ios->batch, &mb->len, sizeof(PIO_Offset));
+    msg_pack(&ios->batch, mb->buf, mb->len);
+    ios->batch.count++;
+    if (mb->nomem || ios->batch.nomem)
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    LOG((2, "queue_msg msg = %d count = %d len = %lld", msg, ios->batch.count,
+         ios->batch.len));
+
+    /* Send the batch once it is full. */
+    if (ios->batch.len >= ios->batch_limit)
+        if ((mpierr = send_batch(ios)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
 /** This function is run on the IO tasks to handle nc_inq_type*()
  * functions.
  *
@@ -237,24 +548,26 @@ int inq_handler(iosystem_desc_t *ios)
     int ndims, nvars, ngatts, unlimdimid;
     int *ndimsp = NULL, *nvarsp = NULL, *ngattsp = NULL, *unlimdimidp = NULL;
     char ndims_present, nvars_present, ngatts_present, unlimdimid_present;
-    int mpierr;
+    msg_buf_t mb;
     int ret;
 
     LOG((1, "inq_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&nvars_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ngatts_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&unlimdimid_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &ndims_present, 1)) ||
+        (ret = msg_unpack(&mb, &nvars_present, 1)) ||
+        (ret = msg_unpack(&mb, &ngatts_present, 1)) ||
+        (ret = msg_unpack(&mb, &unlimdimid_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
     LOG((1, "inq_handler ndims_present = %d nvars_present = %d ngatts_present = %d unlimdimid_present = %d",
          ndims_present, nvars_present, ngatts_present, unlimdimid_present));
 
@@ -296,22 +609,25 @@ int inq_dim_handler(iosystem_desc_t *ios, int msg)
     char dimname[NC_MAX_NAME + 1];
     PIO_Offset dimlen;
 
-    int mpierr;
+    msg_buf_t mb;
     int ret;
 
     LOG((1, "inq_dim_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&dimid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&len_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &dimid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &name_present, 1)) ||
+        (ret = msg_unpack(&mb, &len_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
     LOG((2, "inq_handler name_present = %d len_present = %d", name_present,
          len_present));
 
@@ -340,27 +656,28 @@ int inq_dimid_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int *dimidp = NULL, dimid;
-    int mpierr;
-    int id_present;
+    msg_buf_t mb;
+    char id_present;
     int ret;
-    int namelen;
     char name[PIO_MAX_NAME + 1];
 
     LOG((1, "inq_dimid_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&id_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((1, "inq_dimid_handler ncid = %d namelen = %d name = %s id_present = %d",
-         ncid, namelen, name, id_present));
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &id_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((1, "inq_dimid_handler ncid = %d name = %s id_present = %d",
+         ncid, name, id_present));
 
     /* Set non-null pointer. */
     if (id_present)
@@ -386,10 +703,9 @@ int inq_att_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int varid;
-    int mpierr;
+    msg_buf_t mb;
     int ret;
     char name[PIO_MAX_NAME + 1];
-    int namelen;
     nc_type xtype, *xtypep = NULL;
     PIO_Offset len, *lenp = NULL;
     char xtype_present, len_present;
@@ -398,20 +714,19 @@ int inq_att_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, ios->compmaster,
-                            ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&xtype_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&len_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &xtype_present, 1)) ||
+        (ret = msg_unpack(&mb, &len_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
 
     /* Match NULLs in collective function call. */
     if (xtype_present)
@@ -442,22 +757,25 @@ int inq_attname_handler(iosystem_desc_t *ios)
     int attnum;
     char name[NC_MAX_NAME + 1], *namep = NULL;
     char name_present;
-    int mpierr;
+    msg_buf_t mb;
     int ret;
 
     LOG((1, "inq_att_name_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&attnum, 1, MPI_INT,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &attnum, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &name_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
     LOG((2, "inq_attname_handler got ncid = %d varid = %d attnum = %d name_present = %d",
          ncid, varid, attnum, name_present));
 
@@ -486,27 +804,27 @@ int inq_attid_handler(iosystem_desc_t *ios)
     int ncid;
     int varid;
     char name[PIO_MAX_NAME + 1];
-    int namelen;
     int id, *idp = NULL;
     char id_present;
-    int mpierr;
+    msg_buf_t mb;
     int ret;
 
     LOG((1, "inq_attid_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&id_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &id_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
     LOG((2, "inq_attid_handler got ncid = %d varid = %d id_present = %d",
          ncid, varid, id_present));
 
@@ -521,70 +839,79 @@ int inq_attid_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/**
+ * Get the parameters of a put_att call from a packed message.
+ *
+ * @param mb pointer to the packed message.
+ * @param ncid pointer that gets the ncid.
+ * @param varid pointer that gets the varid.
+ * @param name pointer to PIO_MAX_NAME + 1 chars that get the name.
+ * @param atttype pointer that gets the type of the att in the file.
+ * @param attlen pointer that gets the number of elements of the att.
+ * @param memtype pointer that gets the type of the data in memory.
+ * @param op pointer that gets a pointer to the data in the message.
+ * @returns 0 for success, PIO_EINVAL if the message is too short.
+ * @internal
+ */
+static int unpack_put_att(msg_buf_t *mb, int *ncid, int *varid, char *name, nc_type *atttype,
+                          PIO_Offset *attlen, nc_type *memtype, void **op)
+{
+    PIO_Offset memtype_len; /* Length of element of memtype. */
+    int ret;
+
+    if ((ret = msg_unpack(mb, ncid, sizeof(int))) ||
+        (ret = msg_unpack(mb, varid, sizeof(int))) ||
+        (ret = msg_unpack_str(mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(mb, atttype, sizeof(nc_type))) ||
+        (ret = msg_unpack(mb, attlen, sizeof(PIO_Offset))) ||
+        (ret = msg_unpack(mb, memtype, sizeof(nc_type))) ||
+        (ret = msg_unpack(mb, &memtype_len, sizeof(PIO_Offset))))
+        return ret;
+    if (!(*op = msg_unpack_ptr(mb, *attlen * memtype_len)))
+        return PIO_EINVAL;
+
+    return PIO_NOERR;
+}
+
 /** Handle attribute operations. This code only runs on IO tasks.
  *
  * @param ios pointer to the iosystem_desc_t.
- * @param msg the message sent my the comp root task.
  * @returns 0 for success, PIO_EIO for MPI Bcast errors, or error code
  * from netCDF base function.
  * @internal
  */
 int att_put_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
     int varid;
-    int mpierr;
     int ret;
     char name[PIO_MAX_NAME + 1];
-    int namelen;
     PIO_Offset attlen;  /* Number of elements in att array. */
     nc_type atttype;    /* Type of att in file. */
-    PIO_Offset atttype_len; /* Length in bytes of one elementy of type atttype. */
     nc_type memtype;    /* Type of att data in memory. */
-    PIO_Offset memtype_len; /* Length of element of memtype. */
     void *op;
 
     LOG((1, "att_put_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&atttype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&attlen, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&atttype_len, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&memtype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&memtype_len, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    /* Allocate memory for the attribute data. */
-    if (!(op = malloc(attlen * memtype_len)))
-        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(op, attlen * memtype_len, MPI_BYTE, 0, ios->intercomm)))
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = unpack_put_att(&mb, &ncid, &varid, name, &atttype, &attlen, &memtype, &op)))
     {
-        free(op);
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
     }
-    LOG((1, "att_put_handler ncid = %d varid = %d namelen = %d name = %s"
-         "atttype = %d attlen = %d atttype_len = %d memtype = %d memtype_len = 5d",
-         ncid, varid, namelen, name, atttype, attlen, atttype_len, memtype, memtype_len));
+    LOG((1, "att_put_handler ncid = %d varid = %d name = %s atttype = %d attlen = %d "
+         "memtype = %d", ncid, varid, name, atttype, attlen, memtype));
 
     /* Call the function to write the attribute. */
     ret = PIOc_put_att_tc(ncid, varid, name, atttype, attlen, memtype, op);
 
     /* Free resources. */
-    free(op);
+    msg_buf_free(&mb);
 
     /* Did it work? */
     if (ret)
@@ -594,6 +921,101 @@ int att_put_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/**
+ * Write an attribute of a batch. This code only runs on IO tasks.
+ * Unlike att_put_handler() the netCDF call is made directly, since the
+ * computation tasks do not wait for the result. An error is kept in
+ * the file, and returned by the next PIOc_enddef() or
+ * PIOc_closefile().
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @param mb pointer to the packed parameters of the call.
+ * @returns 0 for success, error code if the message is invalid.
+ * @internal
+ */
+static int batch_put_att(iosystem_desc_t *ios, msg_buf_t *mb)
+{
+    file_desc_t *file;
+    int ncid;
+    int varid;
+    char name[PIO_MAX_NAME + 1];
+    PIO_Offset attlen;
+    nc_type atttype;
+    nc_type memtype;
+    void *op;
+    int ret;
+
+    if ((ret = unpack_put_att(mb, &ncid, &varid, name, &atttype, &attlen, &memtype, &op)))
+        return ret;
+    if ((ret = pio_get_file(ncid, &file)))
+        return ret;
+    LOG((2, "batch_put_att ncid = %d varid = %d name = %s", ncid, varid, name));
+
+    if ((ret = put_att_nc(file, varid, name, atttype, attlen, memtype, op)) && !file->batch_err)
+        file->batch_err = ret;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Handle a batch of calls queued on the computation tasks. This code
+ * only runs on IO tasks. The calls are made in the order they were
+ * queued. There is no reply to the computation tasks, which do not
+ * wait for the batch.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @returns 0 for success, error code otherwise.
+ * @internal
+ */
+int batch_handler(iosystem_desc_t *ios)
+{
+    msg_buf_t mb;
+    int count = 0;
+    int ret;
+
+    LOG((1, "batch_handler"));
+    assert(ios);
+
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    while (!ret && mb.pos < mb.len)
+    {
+        msg_buf_t call;
+        int msg;
+
+        /* Each call is the message, the length of its parameters and
+         * the parameters. */
+        msg_buf_init(NULL, &call);
+        if ((ret = msg_unpack(&mb, &msg, sizeof(int))) ||
+            (ret = msg_unpack(&mb, &call.len, sizeof(PIO_Offset))))
+            break;
+        if (!(call.buf = msg_unpack_ptr(&mb, call.len)))
+        {
+            ret = PIO_EINVAL;
+            break;
+        }
+
+        switch (msg)
+        {
+        case PIO_MSG_PUT_ATT:
+            ret = batch_put_att(ios, &call);
+            break;
+        default:
+            LOG((0, "unknown message in batch %d", msg));
+            ret = PIO_EINVAL;
+        }
+        count++;
+    }
+    LOG((2, "batch_handler handled %d calls ret = %d", count, ret));
+
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
 /** Handle attribute operations. This code only runs on IO tasks.
  *
  * @param ios pointer to the iosystem_desc_t.
@@ -606,9 +1028,7 @@ int att_get_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int varid;
-    int mpierr;
     char name[PIO_MAX_NAME + 1];
-    int namelen;
     PIO_Offset attlen;
     nc_type atttype;        /* Type of att in file. */
     PIO_Offset atttype_len; /* Length in bytes of an element of attype. */
@@ -616,36 +1036,33 @@ int att_get_handler(iosystem_desc_t *ios)
     PIO_Offset memtype_len; /* Length in bytes of an element of memype. */
     int *ip;
     int iotype;
+    msg_buf_t mb;           /* The packed parameters. */
     int ret;
 
     LOG((1, "att_get_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&iotype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&atttype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&attlen, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&atttype_len, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&memtype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&memtype_len, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((1, "att_get_handler ncid = %d varid = %d namelen = %d name = %s iotype = %d"
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &iotype, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &atttype, sizeof(nc_type))) ||
+        (ret = msg_unpack(&mb, &attlen, sizeof(PIO_Offset))) ||
+        (ret = msg_unpack(&mb, &atttype_len, sizeof(PIO_Offset))) ||
+        (ret = msg_unpack(&mb, &memtype, sizeof(nc_type))) ||
+        (ret = msg_unpack(&mb, &memtype_len, sizeof(PIO_Offset))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((1, "att_get_handler ncid = %d varid = %d name = %s iotype = %d"
          " atttype = %d attlen = %d atttype_len = %d memtype = %d memtype_len = %d",
-         ncid, varid, namelen, name, iotype, atttype, attlen, atttype_len, memtype, memtype_len));
+         ncid, varid, name, iotype, atttype, attlen, atttype_len, memtype, memtype_len));
 
     /* Allocate space for the attribute data. */
     if (!(ip = malloc(attlen * memtype_len)))
@@ -686,45 +1103,48 @@ int put_vars_handler(iosystem_desc_t *ios)
     int ndims;           /* Number of dimensions. */
     void *buf;           /* Buffer for data storage. */
     PIO_Offset num_elem; /* Number of data elements in the buffer. */
+    msg_buf_t mb;        /* The packed parameters. */
     int mpierr;          /* Error code from MPI function calls. */
+    int ret;
 
     LOG((1, "put_vars_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. The data follow in their own broadcast. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &ndims, sizeof(int))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
 
     /* Now we know how big to make these arrays. */
     PIO_Offset start[ndims], count[ndims], stride[ndims];
 
-    if ((mpierr = MPI_Bcast(&start_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (start_present)    
-        if ((mpierr = MPI_Bcast(start, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((1, "put_vars_handler getting start[0] = %d ndims = %d", start[0], ndims));
-    if ((mpierr = MPI_Bcast(&count_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (count_present)    
-        if ((mpierr = MPI_Bcast(count, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&stride_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (stride_present)
-        if ((mpierr = MPI_Bcast(stride, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&xtype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&num_elem, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&typelen, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    ret = msg_unpack(&mb, &start_present, 1);
+    if (!ret && start_present)
+        ret = msg_unpack(&mb, start, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &count_present, 1);
+    if (!ret && count_present)
+        ret = msg_unpack(&mb, count, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &stride_present, 1);
+    if (!ret && stride_present)
+        ret = msg_unpack(&mb, stride, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &xtype, sizeof(nc_type));
+    if (!ret)
+        ret = msg_unpack(&mb, &num_elem, sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &typelen, sizeof(PIO_Offset));
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
     LOG((1, "put_vars_handler ncid = %d varid = %d ndims = %d "
          "start_present = %d count_present = %d stride_present = %d xtype = %d "
          "num_elem = %d typelen = %d", ncid, varid, ndims, start_present, count_present,
@@ -813,64 +1233,58 @@ int get_vars_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int varid;
-    int mpierr;
-    PIO_Offset typelen; /** Length (in bytes) of this type. */
-    nc_type xtype; /** Type of the data being written. */
-    PIO_Offset *start;
-    PIO_Offset *count;
-    PIO_Offset *stride;
-    char start_present;
-    char count_present;
-    char stride_present;
-    PIO_Offset *startp = NULL, *countp = NULL, *stridep = NULL;
-    int ndims; /** Number of dimensions. */
-    void *buf; /** Buffer for data storage. */
-    PIO_Offset num_elem; /** Number of data elements in the buffer. */
+    PIO_Offset typelen;  /* Length (in bytes) of this type. */
+    nc_type xtype;       /* Type of the data being read. */
+    char start_present;  /* Zero if user passed a NULL start. */
+    char count_present;  /* Zero if user passed a NULL count. */
+    char stride_present; /* Zero if user passed a NULL stride. */
+    PIO_Offset *startp = NULL;
+    PIO_Offset *countp = NULL;
+    PIO_Offset *stridep = NULL;
+    int ndims;           /* Number of dimensions. */
+    void *buf;           /* Buffer for data storage. */
+    PIO_Offset num_elem; /* Number of data elements in the buffer. */
+    msg_buf_t mb;        /* The packed parameters. */
+    int ret;
 
     LOG((1, "get_vars_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&start_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (start_present)
-    {
-        if (!(start = malloc(ndims * sizeof(PIO_Offset))))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);            
-        if ((mpierr = MPI_Bcast(start, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    }
-    if ((mpierr = MPI_Bcast(&count_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (count_present)
-    {
-        if (!(count = malloc(ndims * sizeof(PIO_Offset))))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);            
-        if ((mpierr = MPI_Bcast(count, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    }
-    if ((mpierr = MPI_Bcast(&stride_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (stride_present)
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &ndims, sizeof(int))))
     {
-        if (!(stride = malloc(ndims * sizeof(PIO_Offset))))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);            
-        if ((mpierr = MPI_Bcast(stride, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
     }
-    if ((mpierr = MPI_Bcast(&xtype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&num_elem, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&typelen, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* Now we know how big to make these arrays. */
+    PIO_Offset start[ndims], count[ndims], stride[ndims];
+
+    ret = msg_unpack(&mb, &start_present, 1);
+    if (!ret && start_present)
+        ret = msg_unpack(&mb, start, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &count_present, 1);
+    if (!ret && count_present)
+        ret = msg_unpack(&mb, count, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &stride_present, 1);
+    if (!ret && stride_present)
+        ret = msg_unpack(&mb, stride, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &xtype, sizeof(nc_type));
+    if (!ret)
+        ret = msg_unpack(&mb, &num_elem, sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &typelen, sizeof(PIO_Offset));
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
     LOG((1, "get_vars_handler ncid = %d varid = %d ndims = %d "
          "stride_present = %d xtype = %d num_elem = %d typelen = %d",
          ncid, varid, ndims, stride_present, xtype, num_elem, typelen));
@@ -882,10 +1296,8 @@ int get_vars_handler(iosystem_desc_t *ios)
     /* Set the non-NULL pointers. */
     if (start_present)
         startp = start;
-
     if (count_present)
         countp = count;
-    
     if (stride_present)
         stridep = stride;
 
@@ -941,13 +1353,7 @@ int get_vars_handler(iosystem_desc_t *ios)
 
     /* Free resourses. */
     free(buf);
-    if (start_present)
-        free(start);
-    if (count_present)
-        free(count);
-    if (stride_present)
-        free(stride);
-    
+
     LOG((1, "get_vars_handler succeeded!"));
     return PIO_NOERR;
 }
@@ -963,7 +1369,7 @@ int inq_var_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int varid;
-    int mpierr;
+    msg_buf_t mb;
     char name_present, xtype_present, ndims_present, dimids_present, natts_present;
     char name[NC_MAX_NAME + 1], *namep = NULL;
     nc_type xtype, *xtypep = NULL;
@@ -975,21 +1381,21 @@ int inq_var_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&xtype_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&dimids_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&natts_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &name_present, 1)) ||
+        (ret = msg_unpack(&mb, &xtype_present, 1)) ||
+        (ret = msg_unpack(&mb, &ndims_present, 1)) ||
+        (ret = msg_unpack(&mb, &dimids_present, 1)) ||
+        (ret = msg_unpack(&mb, &natts_present, 1)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
     LOG((2,"inq_var_handler ncid = %d varid = %d name_present = %d xtype_present = %d ndims_present = %d "
          "dimids_present = %d natts_present = %d",
          ncid, varid, name_present, xtype_present, ndims_present, dimids_present, natts_present));
@@ -1234,21 +1640,23 @@ int inq_varid_handler(iosystem_desc_t *ios)
 {
     int ncid;
     int varid;
-    int mpierr;
+    msg_buf_t mb;
     int ret;
-    int namelen;
     char name[PIO_MAX_NAME + 1];
 
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
 
     /* Call the inq_dimid function. */
     if ((ret = PIOc_inq_varid(ncid, name, &varid)))
@@ -1327,10 +1735,9 @@ int change_def_file_handler(iosystem_desc_t *ios, int msg)
  */
 int def_var_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
-    int namelen;
     char name[PIO_MAX_NAME + 1];
-    int mpierr;
     int ret;
     int varid;
     nc_type xtype;
@@ -1341,36 +1748,32 @@ int def_var_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&xtype, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (!(dimids = malloc(ndims * sizeof(int))))
-        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(dimids, ndims, MPI_INT, 0, ios->intercomm)))
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &xtype, sizeof(nc_type))) ||
+        (ret = msg_unpack(&mb, &ndims, sizeof(int))))
     {
-        free(dimids);
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
     }
-    LOG((1, "def_var_handler got parameters namelen = %d "
-         "name = %s ncid = %d", namelen, name, ncid));
-
-    /* Call the function. */
-    if ((ret = PIOc_def_var(ncid, name, xtype, ndims, dimids, &varid)))
+    if (!(dimids = msg_unpack_ptr(&mb, ndims * sizeof(int))))
     {
-        free(dimids);
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
     }
+    LOG((1, "def_var_handler got parameters name = %s ncid = %d", name, ncid));
+
+    /* Call the function. */
+    ret = PIOc_def_var(ncid, name, xtype, ndims, dimids, &varid);
 
     /* Free resources. */
-    free(dimids);
+    msg_buf_free(&mb);
+
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
     LOG((1, "def_var_handler succeeded!"));
     return PIO_NOERR;
@@ -1441,33 +1844,31 @@ int def_var_fill_handler(iosystem_desc_t *ios)
     int fill_mode;
     char fill_value_present;
     PIO_Offset type_size;
-    PIO_Offset *fill_valuep = NULL;
-    int mpierr;
+    void *fill_valuep = NULL;
+    msg_buf_t mb;
+    int ret;
 
     assert(ios);
     LOG((1, "def_var_fill_handler comproot = %d", ios->comproot));
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&fill_mode, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&type_size, 1, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&fill_value_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if (fill_value_present)
+     * task is sending. The fill value is used in place in the
+     * message. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &fill_mode, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &type_size, sizeof(PIO_Offset))) ||
+        (ret = msg_unpack(&mb, &fill_value_present, 1)))
     {
-        if (!(fill_valuep = malloc(type_size)))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
-        if ((mpierr = MPI_Bcast(fill_valuep, type_size, MPI_CHAR, 0, ios->intercomm)))
-        {
-            free(fill_valuep);
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-        }
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    if (fill_value_present && !(fill_valuep = msg_unpack_ptr(&mb, type_size)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
     }
     LOG((1, "def_var_fill_handler got parameters ncid = %d varid = %d fill_mode = %d "
          "type_size = %lld fill_value_present = %d", ncid, varid, fill_mode, type_size, fill_value_present));
@@ -1475,9 +1876,7 @@ int def_var_fill_handler(iosystem_desc_t *ios)
     /* Call the function. */
     PIOc_def_var_fill(ncid, varid, fill_mode, fill_valuep);
 
-    /* Free memory allocated for the fill value. */
-    if (fill_valuep)
-        free(fill_valuep);
+    msg_buf_free(&mb);
 
     LOG((1, "def_var_fill_handler succeeded!"));
     return PIO_NOERR;
@@ -1616,10 +2015,10 @@ int set_var_chunk_cache_handler(iosystem_desc_t *ios)
  */
 int def_dim_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
-    int len, namelen;
+    PIO_Offset len;
     char name[PIO_MAX_NAME + 1];
-    int mpierr;
     int ret;
     int dimid;
 
@@ -1627,17 +2026,18 @@ int def_dim_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&len, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((2, "def_dim_handler got parameters namelen = %d "
-         "name = %s len = %d ncid = %d", namelen, name, len, ncid));
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack(&mb, &len, sizeof(PIO_Offset))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((2, "def_dim_handler got parameters name = %s len = %lld ncid = %d", name, len, ncid));
 
     /* Call the function. */
     if ((ret = PIOc_def_dim(ncid, name, len, &dimid)))
@@ -1657,10 +2057,9 @@ int def_dim_handler(iosystem_desc_t *ios)
  */
 int rename_dim_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
-    int namelen;
     char name[PIO_MAX_NAME + 1];
-    int mpierr;
     int ret;
     int dimid;
 
@@ -1668,17 +2067,19 @@ int rename_dim_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&dimid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((2, "rename_dim_handler got parameters namelen = %d "
-         "name = %s ncid = %d dimid = %d", namelen, name, ncid, dimid));
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &dimid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((2, "rename_dim_handler got parameters name = %s ncid = %d dimid = %d",
+         name, ncid, dimid));
 
     /* Call the function. */
     if ((ret = PIOc_rename_dim(ncid, dimid, name)))
@@ -1698,10 +2099,9 @@ int rename_dim_handler(iosystem_desc_t *ios)
  */
 int rename_var_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
-    int namelen;
     char name[PIO_MAX_NAME + 1];
-    int mpierr;
     int ret;
     int varid;
 
@@ -1709,17 +2109,19 @@ int rename_var_handler(iosystem_desc_t *ios)
     assert(ios);
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((2, "rename_var_handler got parameters namelen = %d "
-         "name = %s ncid = %d varid = %d", namelen, name, ncid, varid));
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((2, "rename_var_handler got parameters name = %s ncid = %d varid = %d",
+         name, ncid, varid));
 
     /* Call the function. */
     if ((ret = PIOc_rename_var(ncid, varid, name)))
@@ -1739,32 +2141,30 @@ int rename_var_handler(iosystem_desc_t *ios)
  */
 int rename_att_handler(iosystem_desc_t *ios)
 {
+    msg_buf_t mb;
     int ncid;
     int varid;
-    int namelen, newnamelen;
     char name[PIO_MAX_NAME + 1], newname[PIO_MAX_NAME + 1];
-    int mpierr;
     int ret;
 
     LOG((1, "rename_att_handler"));
     assert(ios);
 
     /* Get the parameters for this function that the he comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&ncid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&varid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&namelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(name, namelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&newnamelen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(newname, newnamelen + 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    LOG((2, "rename_att_handler got parameters namelen = %d name = %s ncid = %d varid = %d "
-         "newnamelen = %d newname = %s", namelen, name, ncid, varid, newnamelen, newname));
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &varid, sizeof(int))) ||
+        (ret = msg_unpack_str(&mb, name, PIO_MAX_NAME)) ||
+        (ret = msg_unpack_str(&mb, newname, PIO_MAX_NAME)))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((2, "rename_att_handler got parameters name = %s ncid = %d varid = %d "
+         "newname = %s", name, ncid, varid, newname));
 
     /* Call the function. */
     if ((ret = PIOc_rename_att(ncid, varid, name, newname)))
@@ -1910,7 +2310,6 @@ int initdecomp_dof_handler(iosystem_desc_t *ios)
     int iosysid;
     int pio_type;
     int ndims;
-    int maplen;
     int ioid;
     char rearranger_present;
     int rearranger;
@@ -1919,60 +2318,50 @@ int initdecomp_dof_handler(iosystem_desc_t *ios)
     PIO_Offset *iostartp = NULL;
     char iocount_present;
     PIO_Offset *iocountp = NULL;
-    int mpierr = MPI_SUCCESS;  /* Return code from MPI function codes. */
+    PIO_Offset nomap = 0; /* The map of the IO tasks is empty. */
+    msg_buf_t mb;         /* The packed parameters. */
     int ret; /* Return code. */
 
     LOG((1, "initdecomp_dof_handler called"));
     assert(ios);
 
     /* Get the parameters for this function that the the comp master
-     * task is broadcasting. */
-    if ((mpierr = MPI_Bcast(&iosysid, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&pio_type, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&ndims, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &iosysid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &pio_type, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &ndims, sizeof(int))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
 
     /* Now we know the size of these arrays. */
     int dims[ndims];
     PIO_Offset iostart[ndims];
     PIO_Offset iocount[ndims];
 
-    if ((mpierr = MPI_Bcast(dims, ndims, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Bcast(&maplen, 1, MPI_INT, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    PIO_Offset compmap[maplen];
-
-    if ((mpierr = MPI_Bcast(compmap, maplen, MPI_OFFSET, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if ((mpierr = MPI_Bcast(&rearranger_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if (rearranger_present)
-        if ((mpierr = MPI_Bcast(&rearranger, 1, MPI_INT, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if ((mpierr = MPI_Bcast(&iostart_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if (iostart_present)
-        if ((mpierr = MPI_Bcast(iostart, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if ((mpierr = MPI_Bcast(&iocount_present, 1, MPI_CHAR, 0, ios->intercomm)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
-
-    if (iocount_present)
-        if ((mpierr = MPI_Bcast(iocount, ndims, MPI_OFFSET, 0, ios->intercomm)))
-            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    ret = msg_unpack(&mb, dims, ndims * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &rearranger_present, 1);
+    if (!ret && rearranger_present)
+        ret = msg_unpack(&mb, &rearranger, sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &iostart_present, 1);
+    if (!ret && iostart_present)
+        ret = msg_unpack(&mb, iostart, ndims * sizeof(PIO_Offset));
+    if (!ret)
+        ret = msg_unpack(&mb, &iocount_present, 1);
+    if (!ret && iocount_present)
+        ret = msg_unpack(&mb, iocount, ndims * sizeof(PIO_Offset));
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
-    LOG((2, "initdecomp_dof_handler iosysid = %d pio_type = %d ndims = %d maplen = %d "
+    LOG((2, "initdecomp_dof_handler iosysid = %d pio_type = %d ndims = %d "
          "rearranger_present = %d iostart_present = %d iocount_present = %d ",
-         iosysid, pio_type, ndims, maplen, rearranger_present, iostart_present, iocount_present));
+         iosysid, pio_type, ndims, rearranger_present, iostart_present, iocount_present));
 
     if (rearranger_present)
         rearrangerp = &rearranger;
@@ -1981,16 +2370,58 @@ int initdecomp_dof_handler(iosystem_desc_t *ios)
     if (iocount_present)
         iocountp = iocount;
 
-    /* Call the function. */
-    ret = PIOc_InitDecomp(iosysid, pio_type, ndims, dims, maplen, compmap, &ioid, rearrangerp,
+    /* Call the function. The IO tasks hold no data of the
+     * decomposition, so their map is empty. */
+    ret = PIOc_InitDecomp(iosysid, pio_type, ndims, dims, 0, &nomap, &ioid, rearrangerp,
                           iostartp, iocountp);
     
     LOG((1, "PIOc_InitDecomp returned %d", ret));
     return PIO_NOERR;
 }
 
-/** This function is run on the IO tasks to...
- * NOTE: not yet implemented
+/**
+ * Set the number of dims and the record of vars on the IO tasks,
+ * from a darray message. The IO tasks can't find these out
+ * themselves during a darray write or read.
+ *
+ * @param ios pointer to the iosystem_desc_t data.
+ * @param ncid the ncid of the file.
+ * @param nvars the number of vars.
+ * @param varids the IDs of the vars.
+ * @param fndims the number of dims of each var.
+ * @param frame the record of each var, or NULL to leave them as
+ * they are.
+ * @returns 0 for success, error code otherwise.
+ * @internal
+ */
+static int set_darray_var_info(iosystem_desc_t *ios, int ncid, int nvars, const int *varids,
+                               const int *fndims, const int *frame)
+{
+    file_desc_t *file;
+    var_desc_t *vdesc;
+    int ret;
+
+    if ((ret = pio_get_file(ncid, &file)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    for (int v = 0; v < nvars; v++)
+    {
+        if (varids[v] < 0 || varids[v] >= PIO_MAX_VARS)
+            return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
+        if ((ret = get_var_desc(varids[v], file, &vdesc)))
+            return pio_err(ios, file, ret, __FILE__, __LINE__);
+        vdesc->ndims = fndims[v];
+        if (frame)
+            vdesc->record = frame[v];
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * This function is run on the IO tasks to write distributed arrays
+ * with PIOc_write_darray_multi(). The computation tasks flush their
+ * write multi buffers with this message. The data is moved to the
+ * IO tasks by the rearranger.
  *
  * @param ios pointer to the iosystem_desc_t data.
  *
@@ -2000,12 +2431,76 @@ int initdecomp_dof_handler(iosystem_desc_t *ios)
  */
 int writedarray_handler(iosystem_desc_t *ios)
 {
+    int ncid;
+    int nvars;
+    int ioid;
+    char frame_present;
+    int fillsize;
+    void *fillvalue = NULL; /* The fill values, in place in the message. */
+    char flushtodisk;
+    msg_buf_t mb;           /* The packed parameters. */
+    int ret; /* Return code. */
+
+    LOG((1, "writedarray_handler called"));
     assert(ios);
+
+    /* Get the parameters for this function that the the comp master
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &nvars, sizeof(int))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+
+    /* Now we know the size of these arrays. */
+    int varids[nvars];
+    int fndims[nvars];
+    int frame[nvars];
+
+    ret = msg_unpack(&mb, varids, nvars * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &ioid, sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, fndims, nvars * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &frame_present, 1);
+    if (!ret && frame_present)
+        ret = msg_unpack(&mb, frame, nvars * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &fillsize, sizeof(int));
+    if (!ret && fillsize && !(fillvalue = msg_unpack_ptr(&mb, fillsize)))
+        ret = PIO_EINVAL;
+    if (!ret)
+        ret = msg_unpack(&mb, &flushtodisk, 1);
+    if (ret)
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    LOG((2, "writedarray_handler ncid = %d nvars = %d ioid = %d frame_present = %d "
+         "fillsize = %d flushtodisk = %d", ncid, nvars, ioid, frame_present, fillsize,
+         flushtodisk));
+
+    /* Call the function. The IO tasks have no data of their own. */
+    ret = set_darray_var_info(ios, ncid, nvars, varids, fndims, frame_present ? frame : NULL);
+    if (!ret)
+        ret = PIOc_write_darray_multi(ncid, varids, ioid, nvars, 0, NULL,
+                                      frame_present ? frame : NULL, fillvalue, flushtodisk);
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    LOG((1, "writedarray_handler succeeded!"));
     return PIO_NOERR;
 }
 
-/** This function is run on the IO tasks to...
- * NOTE: not yet implemented
+/**
+ * This function is run on the IO tasks to read distributed arrays
+ * with PIOc_read_darray_multi(). The data is moved to the
+ * computation tasks by the rearranger.
  *
  * @param ios pointer to the iosystem_desc_t data.
  *
@@ -2015,7 +2510,51 @@ int writedarray_handler(iosystem_desc_t *ios)
  */
 int readdarray_handler(iosystem_desc_t *ios)
 {
+    int ncid;
+    int nvars;
+    int ioid;
+    msg_buf_t mb; /* The packed parameters. */
+    int ret; /* Return code. */
+
+    LOG((1, "readdarray_handler called"));
     assert(ios);
+
+    /* Get the parameters for this function that the the comp master
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &ncid, sizeof(int))) ||
+        (ret = msg_unpack(&mb, &nvars, sizeof(int))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+
+    /* Now we know the size of these arrays. */
+    int varids[nvars];
+    int fndims[nvars];
+    int frame[nvars];
+
+    ret = msg_unpack(&mb, varids, nvars * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, &ioid, sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, fndims, nvars * sizeof(int));
+    if (!ret)
+        ret = msg_unpack(&mb, frame, nvars * sizeof(int));
+    msg_buf_free(&mb);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    LOG((2, "readdarray_handler ncid = %d nvars = %d ioid = %d", ncid, nvars, ioid));
+
+    if ((ret = set_darray_var_info(ios, ncid, nvars, varids, fndims, frame)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Call the function. The IO tasks get no data. */
+    if ((ret = PIOc_read_darray_multi(ncid, varids, ioid, nvars, 0, NULL)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    LOG((1, "readdarray_handler succeeded!"));
     return PIO_NOERR;
 }
 
@@ -2061,6 +2600,47 @@ int seterrorhandling_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/**
+ * This function is run on the IO tasks to set the data size per IO
+ * task of the box rearranger. The computation tasks have already
+ * found the number of tasks on each node.
+ *
+ * @param ios pointer to the iosystem_desc_t data.
+ * @returns 0 for success, error code otherwise.
+ * @internal
+ */
+int set_iotask_target_handler(iosystem_desc_t *ios)
+{
+    PIO_Offset target;
+    int ranks_per_node;
+    msg_buf_t mb;
+    int ret; /* Return code. */
+
+    LOG((1, "set_iotask_target_handler called"));
+    assert(ios);
+
+    /* Get the parameters for this function that the the comp master
+     * task is sending. */
+    if ((ret = recv_packed_msg(ios, &mb)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = msg_unpack(&mb, &target, sizeof(PIO_Offset))) ||
+        (ret = msg_unpack(&mb, &ranks_per_node, sizeof(int))))
+    {
+        msg_buf_free(&mb);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    msg_buf_free(&mb);
+    LOG((1, "set_iotask_target_handler got params target = %lld ranks_per_node = %d",
+         target, ranks_per_node));
+
+    /* Call the function. */
+    if ((ret = PIOc_set_iotask_target(ios->iosysid, target, ranks_per_node)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    LOG((1, "set_iotask_target_handler succeeded!"));
+    return PIO_NOERR;
+}
+
 /**
  * This function is run on the IO tasks to set the chunk cache
  * parameters for netCDF-4.
@@ -2491,6 +3071,12 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
         case PIO_MSG_SET_FILL:
             set_fill_handler(my_iosys);
             break;
+        case PIO_MSG_BATCH:
+            batch_handler(my_iosys);
+            break;
+        case PIO_MSG_SET_IOTASK_TARGET:
+            set_iotask_target_handler(my_iosys);
+            break;
         case PIO_MSG_EXIT:
             finalize_handler(my_iosys, index);
             msg = -1;
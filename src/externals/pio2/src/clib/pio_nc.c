@@ -48,6 +48,20 @@ int PIOc_inq(int ncid, int *ndimsp, int *nvarsp, int *ngattsp, int *unlimdimidp)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        if (ndimsp)
+            *ndimsp = file->meta->ndims;
+        if (nvarsp)
+            *nvarsp = file->meta->nvars;
+        if (ngattsp)
+            *ngattsp = file->meta->ngatts;
+        if (unlimdimidp)
+            *unlimdimidp = file->meta->unlimdimid;
+        return PIO_NOERR;
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -58,20 +72,16 @@ int PIOc_inq(int ncid, int *ndimsp, int *nvarsp, int *ngattsp, int *unlimdimidp)
             char nvars_present = nvarsp ? true : false;
             char ngatts_present = ngattsp ? true : false;
             char unlimdimid_present = unlimdimidp ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&nvars_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ngatts_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&unlimdimid_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &ndims_present, 1);
+            msg_pack(&mb, &nvars_present, 1);
+            msg_pack(&mb, &ngatts_present, 1);
+            msg_pack(&mb, &unlimdimid_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
             LOG((2, "PIOc_inq ncid = %d ndims_present = %d nvars_present = %d ngatts_present = %d unlimdimid_present = %d",
                  ncid, ndims_present, nvars_present, ngatts_present, unlimdimid_present));
         }
@@ -231,6 +241,11 @@ int PIOc_inq_type(int ncid, nc_type xtype, char *name, PIO_Offset *sizep)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* The sizes of the atomic types are known without asking the
+     * IO tasks. */
+    if (!name && !pioc_pnetcdf_inq_type(ncid, xtype, NULL, sizep))
+        return PIO_NOERR;
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -240,8 +255,7 @@ int PIOc_inq_type(int ncid, nc_type xtype, char *name, PIO_Offset *sizep)
             char name_present = name ? true : false;
             char size_present = sizep ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -328,8 +342,7 @@ int PIOc_inq_format(int ncid, int *formatp)
             int msg = PIO_MSG_INQ_FORMAT;
             char format_present = formatp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -399,6 +412,25 @@ int PIOc_inq_dim(int ncid, int dimid, char *name, PIO_Offset *lenp)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* Answer from the metadata cache, if it is valid. The length of
+     * an unlimited dim is only cached if the file is read-only. */
+    if (file->meta)
+    {
+        dim_meta_t *dim;
+
+        if (dimid < 0 || dimid >= file->meta->ndims)
+            return check_netcdf(file, NC_EBADDIM, __FILE__, __LINE__);
+        dim = &file->meta->dims[dimid];
+        if (!lenp || !dim->unlim || !(file->mode & PIO_WRITE))
+        {
+            if (name)
+                strcpy(name, dim->name);
+            if (lenp)
+                *lenp = dim->len;
+            return PIO_NOERR;
+        }
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -407,20 +439,16 @@ int PIOc_inq_dim(int ncid, int dimid, char *name, PIO_Offset *lenp)
             int msg = PIO_MSG_INQ_DIM;
             char name_present = name ? true : false;
             char len_present = lenp ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&dimid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            LOG((2, "PIOc_inq netcdf Bcast name_present = %d", name_present));
-            if (!mpierr)
-                mpierr = MPI_Bcast(&len_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            LOG((2, "PIOc_inq netcdf Bcast len_present = %d", len_present));
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &dimid, sizeof(int));
+            msg_pack(&mb, &name_present, 1);
+            msg_pack(&mb, &len_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_inq_dim name_present = %d len_present = %d", name_present, len_present));
         }
 
         /* Handle MPI errors. */
@@ -540,6 +568,19 @@ int PIOc_inq_dimid(int ncid, const char *name, int *idp)
 
     LOG((1, "PIOc_inq_dimid ncid = %d name = %s", ncid, name));
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        for (int d = 0; d < file->meta->ndims; d++)
+            if (!strcmp(file->meta->dims[d].name, name))
+            {
+                if (idp)
+                    *idp = d;
+                return PIO_NOERR;
+            }
+        return check_netcdf(file, NC_EBADDIM, __FILE__, __LINE__);
+    }
+
     /* If using async, and not an IO task, then send parameters. */
     if (ios->async)
     {
@@ -547,19 +588,14 @@ int PIOc_inq_dimid(int ncid, const char *name, int *idp)
         {
             int msg = PIO_MSG_INQ_DIMID;
             char id_present = idp ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            int namelen = strlen(name);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&id_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &id_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -617,6 +653,7 @@ int PIOc_inq_var(int ncid, int varid, char *name, nc_type *xtypep, int *ndimsp,
 {
     iosystem_desc_t *ios;
     file_desc_t *file;
+    var_desc_t *vdesc; /* Info about the var. */
     int ndims = 0;    /* The number of dimensions for this variable. */
     int ierr;
     int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
@@ -628,6 +665,32 @@ int PIOc_inq_var(int ncid, int varid, char *name, nc_type *xtypep, int *ndimsp,
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        var_meta_t *var;
+
+        if (varid < 0 || varid >= file->meta->nvars)
+            return check_netcdf(file, NC_ENOTVAR, __FILE__, __LINE__);
+        var = &file->meta->vars[varid];
+        if (name)
+            strcpy(name, var->name);
+        if (xtypep)
+            *xtypep = var->xtype;
+        if (ndimsp)
+        {
+            *ndimsp = var->ndims;
+            if ((ierr = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ierr, __FILE__, __LINE__);
+            vdesc->ndims = var->ndims;
+        }
+        if (dimidsp)
+            memcpy(dimidsp, var->dimids, var->ndims * sizeof(int));
+        if (nattsp)
+            *nattsp = var->natts;
+        return PIO_NOERR;
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -639,24 +702,18 @@ int PIOc_inq_var(int ncid, int varid, char *name, nc_type *xtypep, int *ndimsp,
             char ndims_present = ndimsp ? true : false;
             char dimids_present = dimidsp ? true : false;
             char natts_present = nattsp ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&xtype_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&dimids_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&natts_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack(&mb, &name_present, 1);
+            msg_pack(&mb, &xtype_present, 1);
+            msg_pack(&mb, &ndims_present, 1);
+            msg_pack(&mb, &dimids_present, 1);
+            msg_pack(&mb, &natts_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
             LOG((2, "PIOc_inq_var name_present = %d xtype_present = %d ndims_present = %d "
                  "dimids_present = %d, natts_present = %d nattsp = %d",
                  name_present, xtype_present, ndims_present, dimids_present, natts_present, nattsp));
@@ -742,7 +799,9 @@ int PIOc_inq_var(int ncid, int varid, char *name, nc_type *xtypep, int *ndimsp,
             LOG((2, "PIOc_inq_var about to Bcast ndims = %d ios->ioroot = %d", *ndimsp, ios->ioroot));
         if ((mpierr = MPI_Bcast(ndimsp, 1, MPI_INT, ios->ioroot, ios->my_comm)))
             return check_mpi(file, mpierr, __FILE__, __LINE__);
-        file->varlist[varid].ndims = *ndimsp;
+        if ((ierr = get_var_desc(varid, file, &vdesc)))
+            return pio_err(ios, file, ierr, __FILE__, __LINE__);
+        vdesc->ndims = *ndimsp;
         LOG((2, "PIOc_inq_var Bcast ndims = %d", *ndimsp));
     }
     if (dimidsp)
@@ -866,23 +925,31 @@ int PIOc_inq_varid(int ncid, const char *name, int *varidp)
 
     LOG((1, "PIOc_inq_varid ncid = %d name = %s", ncid, name));
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        for (int v = 0; v < file->meta->nvars; v++)
+            if (!strcmp(file->meta->vars[v].name, name))
+            {
+                if (varidp)
+                    *varidp = v;
+                return PIO_NOERR;
+            }
+        return check_netcdf(file, NC_ENOTVAR, __FILE__, __LINE__);
+    }
+
     if (ios->async)
     {
         if (!ios->ioproc)
         {
             int msg = PIO_MSG_INQ_VARID;
+            msg_buf_t mb;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            int namelen;
-            namelen = strlen(name);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack_str(&mb, name);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -954,6 +1021,20 @@ int PIOc_inq_att(int ncid, int varid, const char *name, nc_type *xtypep,
 
     LOG((1, "PIOc_inq_att ncid = %d varid = %d", ncid, varid));
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        att_meta_t *att;
+
+        if ((ierr = file_meta_att(file->meta, varid, name, &att, NULL)))
+            return check_netcdf(file, ierr, __FILE__, __LINE__);
+        if (xtypep)
+            *xtypep = att->xtype;
+        if (lenp)
+            *lenp = att->len;
+        return PIO_NOERR;
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -961,23 +1042,16 @@ int PIOc_inq_att(int ncid, int varid, const char *name, nc_type *xtypep,
         {
             char xtype_present = xtypep ? true : false;
             char len_present = lenp ? true : false;
-            int namelen = strlen(name);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&xtype_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&len_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &xtype_present, 1);
+            msg_pack(&mb, &len_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -1079,6 +1153,21 @@ int PIOc_inq_attname(int ncid, int varid, int attnum, char *name)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        att_meta_t *atts;
+        int natts;
+
+        if ((ierr = file_meta_atts(file->meta, varid, &atts, &natts)))
+            return check_netcdf(file, ierr, __FILE__, __LINE__);
+        if (attnum < 0 || attnum >= natts)
+            return check_netcdf(file, NC_ENOTATT, __FILE__, __LINE__);
+        if (name)
+            strcpy(name, atts[attnum].name);
+        return PIO_NOERR;
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
@@ -1086,18 +1175,15 @@ int PIOc_inq_attname(int ncid, int varid, int attnum, char *name)
         {
             int msg = PIO_MSG_INQ_ATTNAME;
             char name_present = name ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&attnum, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&name_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack(&mb, &attnum, sizeof(int));
+            msg_pack(&mb, &name_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -1173,28 +1259,35 @@ int PIOc_inq_attid(int ncid, int varid, const char *name, int *idp)
 
     LOG((1, "PIOc_inq_attid ncid = %d varid = %d name = %s", ncid, varid, name));
 
+    /* Answer from the metadata cache, if it is valid. */
+    if (file->meta)
+    {
+        att_meta_t *att;
+        int attnum;
+
+        if ((ierr = file_meta_att(file->meta, varid, name, &att, &attnum)))
+            return check_netcdf(file, ierr, __FILE__, __LINE__);
+        if (idp)
+            *idp = attnum;
+        return PIO_NOERR;
+    }
+
     /* If async is in use, and this is not an IO task, bcast the parameters. */
     if (ios->async)
     {
         if (!ios->ioproc)
         {
             int msg = PIO_MSG_INQ_ATTID;
-            int namelen = strlen(name);
             char id_present = idp ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((char *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&id_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &id_present, 1);
+            mpierr = send_packed_msg(ios, msg, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -1256,6 +1349,8 @@ int PIOc_rename_dim(int ncid, int dimid, const char *name)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide name shorter than NC_MAX_NAME +1. */
     if (!name || strlen(name) > NC_MAX_NAME)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -1267,22 +1362,16 @@ int PIOc_rename_dim(int ncid, int dimid, const char *name)
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_RENAME_DIM; /* Message for async notification. */
-            int namelen = strlen(name);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&dimid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            LOG((2, "PIOc_rename_dim Bcast file->fh = %d dimid = %d namelen = %d name = %s",
-                 file->fh, dimid, namelen, name));
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &dimid, sizeof(int));
+            msg_pack_str(&mb, name);
+            mpierr = send_packed_msg(ios, PIO_MSG_RENAME_DIM, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_rename_dim sent file->fh = %d dimid = %d name = %s",
+                 file->fh, dimid, name));
         }
 
         /* Handle MPI errors. */
@@ -1341,6 +1430,8 @@ int PIOc_rename_var(int ncid, int varid, const char *name)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide name shorter than NC_MAX_NAME +1. */
     if (!name || strlen(name) > NC_MAX_NAME)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -1352,22 +1443,16 @@ int PIOc_rename_var(int ncid, int varid, const char *name)
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_RENAME_VAR; /* Message for async notification. */
-            int namelen = strlen(name);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            LOG((2, "PIOc_rename_var Bcast file->fh = %d varid = %d namelen = %d name = %s",
-                 file->fh, varid, namelen, name));
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            mpierr = send_packed_msg(ios, PIO_MSG_RENAME_VAR, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_rename_var sent file->fh = %d varid = %d name = %s",
+                 file->fh, varid, name));
         }
 
         /* Handle MPI errors. */
@@ -1428,6 +1513,8 @@ int PIOc_rename_att(int ncid, int varid, const char *name,
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide names of correct length. */
     if (!name || strlen(name) > NC_MAX_NAME ||
         !newname || strlen(newname) > NC_MAX_NAME)
@@ -1441,25 +1528,15 @@ int PIOc_rename_att(int ncid, int varid, const char *name,
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_RENAME_ATT; /* Message for async notification. */
-            int namelen = strlen(name);
-            int newnamelen = strlen(newname);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((char *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&newnamelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((char *)newname, newnamelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack_str(&mb, newname);
+            mpierr = send_packed_msg(ios, PIO_MSG_RENAME_ATT, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -1518,6 +1595,8 @@ int PIOc_del_att(int ncid, int varid, const char *name)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide name shorter than NC_MAX_NAME +1. */
     if (!name || strlen(name) > NC_MAX_NAME)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -1532,8 +1611,7 @@ int PIOc_del_att(int ncid, int varid, const char *name)
             int msg = PIO_MSG_DEL_ATT;
             int namelen = strlen(name); /* Length of name string. */
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -1610,8 +1688,7 @@ int PIOc_set_fill(int ncid, int fillmode, int *old_modep)
             int msg = PIO_MSG_SET_FILL;
             int old_modep_present = old_modep ? 1 : 0;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -1725,6 +1802,8 @@ int PIOc_def_dim(int ncid, const char *name, PIO_Offset len, int *idp)
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide name shorter than NC_MAX_NAME +1. */
     if (!name || strlen(name) > NC_MAX_NAME)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -1736,24 +1815,16 @@ int PIOc_def_dim(int ncid, const char *name, PIO_Offset len, int *idp)
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_DEF_DIM;
-            int namelen = strlen(name);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&len, 1, MPI_INT,  ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &len, sizeof(PIO_Offset));
+            mpierr = send_packed_msg(ios, PIO_MSG_DEF_DIM, &mb);
+            msg_buf_free(&mb);
         }
 
-
         /* Handle MPI errors. */
         if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
             check_mpi(file, mpierr2, __FILE__, __LINE__);
@@ -1816,6 +1887,8 @@ int PIOc_def_var(int ncid, const char *name, nc_type xtype, int ndims,
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* User must provide name and storage for varid. */
     if (!name || !varidp || strlen(name) > NC_MAX_NAME)
         return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__);
@@ -1828,24 +1901,16 @@ int PIOc_def_var(int ncid, const char *name, nc_type xtype, int ndims,
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_DEF_VAR;
-            int namelen = strlen(name);
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&(ncid), 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&namelen, 1, MPI_INT,  ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)name, namelen + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&xtype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)dimidsp, ndims, MPI_INT, ios->compmaster, ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack_str(&mb, name);
+            msg_pack(&mb, &xtype, sizeof(nc_type));
+            msg_pack(&mb, &ndims, sizeof(int));
+            msg_pack(&mb, dimidsp, ndims * sizeof(int));
+            mpierr = send_packed_msg(ios, PIO_MSG_DEF_VAR, &mb);
+            msg_buf_free(&mb);
         }
 
         /* Handle MPI errors. */
@@ -1933,6 +1998,8 @@ int PIOc_def_var_fill(int ncid, int varid, int fill_mode, const void *fill_value
         return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
     ios = file->iosystem;
 
+    file_meta_invalidate(file);
+
     /* Caller must provide correct values. */
     if ((fill_mode != NC_FILL && fill_mode != NC_NOFILL) ||
         (fill_mode == NC_FILL && !fill_valuep))
@@ -1955,25 +2022,19 @@ int PIOc_def_var_fill(int ncid, int varid, int fill_mode, const void *fill_value
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_DEF_VAR_FILL;
             char fill_value_present = fill_valuep ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&varid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&fill_mode, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&type_size, 1, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&fill_value_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr && fill_value_present)
-                mpierr = MPI_Bcast((PIO_Offset *)fill_valuep, type_size, MPI_CHAR, ios->compmaster,
-                                   ios->intercomm);
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &ncid, sizeof(int));
+            msg_pack(&mb, &varid, sizeof(int));
+            msg_pack(&mb, &fill_mode, sizeof(int));
+            msg_pack(&mb, &type_size, sizeof(PIO_Offset));
+            msg_pack(&mb, &fill_value_present, 1);
+            if (fill_value_present)
+                msg_pack(&mb, fill_valuep, type_size);
+            mpierr = send_packed_msg(ios, PIO_MSG_DEF_VAR_FILL, &mb);
+            msg_buf_free(&mb);
             LOG((2, "PIOc_def_var_fill ncid = %d varid = %d fill_mode = %d type_size = %d fill_value_present = %d",
                  ncid, varid, fill_mode, type_size, fill_value_present));
         }
@@ -2082,8 +2143,7 @@ int PIOc_inq_var_fill(int ncid, int varid, int *no_fill, void *fill_valuep)
             char fill_value_present = fill_valuep ? true : false;
 
             LOG((2, "sending msg type_size = %d", type_size));
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -54,8 +54,7 @@ int PIOc_def_var_deflate(int ncid, int varid, int shuffle, int deflate,
         {
             int msg = PIO_MSG_DEF_VAR_DEFLATE;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -146,8 +145,7 @@ int PIOc_inq_var_deflate(int ncid, int varid, int *shufflep, int *deflatep,
             char deflate_present = deflatep ? true : false;
             char deflate_level_present = deflate_levelp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -264,8 +262,7 @@ int PIOc_def_var_chunking(int ncid, int varid, int storage, const PIO_Offset *ch
             int msg = PIO_MSG_DEF_VAR_CHUNKING;
             char chunksizes_present = chunksizesp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -387,8 +384,7 @@ int PIOc_inq_var_chunking(int ncid, int varid, int *storagep, PIO_Offset *chunks
             char storage_present = storagep ? true : false;
             char chunksizes_present = chunksizesp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -500,8 +496,7 @@ int PIOc_def_var_endian(int ncid, int varid, int endian)
         if (!ios->ioproc)
         {
             int msg = PIO_MSG_DEF_VAR_ENDIAN;
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -579,8 +574,7 @@ int PIOc_inq_var_endian(int ncid, int varid, int *endianp)
             int msg = PIO_MSG_INQ_VAR_ENDIAN;
             char endian_present = endianp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -669,8 +663,7 @@ int PIOc_set_chunk_cache(int iosysid, int iotype, PIO_Offset size, PIO_Offset ne
         {
             int msg = PIO_MSG_SET_CHUNK_CACHE; /* Message for async notification. */
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&iosysid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -770,8 +763,7 @@ int PIOc_get_chunk_cache(int iosysid, int iotype, PIO_Offset *sizep, PIO_Offset
             char nelems_present = nelemsp ? true : false;
             char preemption_present = preemptionp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&iosysid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -885,8 +877,7 @@ int PIOc_set_var_chunk_cache(int ncid, int varid, PIO_Offset size, PIO_Offset ne
         {
             int msg = PIO_MSG_SET_VAR_CHUNK_CACHE;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1,MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -975,8 +966,7 @@ int PIOc_get_var_chunk_cache(int ncid, int varid, PIO_Offset *sizep, PIO_Offset
             char nelems_present = nelemsp ? true : false;
             char preemption_present = preemptionp ? true : false;
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
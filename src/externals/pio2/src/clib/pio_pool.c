@@ -0,0 +1,724 @@
+/**
+ * @file
+ * A size-class pool allocator for the compute buffer. When PIO is
+ * built with PIO_USE_POOL, bget(), bgetr(), brel() and the other
+ * functions of bget.c call the functions here instead of managing
+ * the first-fit pool of bget.
+ *
+ * Each request is rounded up to one of a set of size classes, four
+ * for each power of two, and a freed block goes on the free list of
+ * its class. The next request of about the same size gets it back
+ * without a search, and without the fragmentation of a first-fit
+ * pool. Blocks of the small classes are carved from slabs, which are
+ * backed by huge pages where the system allows it. Blocks of the
+ * large classes are allocated one at a time, and are given back to
+ * the system when the pool holds more than its limit.
+ *
+ * When PIO is built with OpenMP, the pool is protected by a lock, and
+ * each thread keeps a short cache of small blocks, so that most
+ * requests do not take the lock. The cached blocks go back on the
+ * free lists of their pool when the thread moves on to another pool.
+ */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE /* For posix_memalign() and madvise(). */
+#endif
+#include <config.h>
+#include <pio.h>
+#include <pio_internal.h>
+#include <sys/mman.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* The smallest size class is 2^POOL_MIN_SHIFT bytes. */
+#define POOL_MIN_SHIFT 5
+
+/* Number of size classes for each power of two. */
+#define POOL_STEPS 4
+
+/* Number of size classes. The largest is 2^48 bytes. */
+#define POOL_NCLASS (POOL_STEPS * (48 - POOL_MIN_SHIFT) + 1)
+
+/* Size of the slabs that small blocks are carved from. This is the
+ * size of a huge page on most systems. */
+#define POOL_SLAB_SIZE (2 * 1024 * 1024)
+
+/* Blocks of this size or less are carved from slabs. */
+#define POOL_SMALL_MAX (POOL_SLAB_SIZE / 16)
+
+/* Number of blocks of each small class a thread may cache. */
+#define POOL_CACHE_MAX 16
+
+/* Found in the header of every block of a pool. */
+#define POOL_MAGIC 0x504f4f4c
+
+/* Round up to a multiple of 16 bytes. */
+#define POOL_ALIGN(n) (((n) + 15) & ~(PIO_Offset)15)
+
+#ifdef _OPENMP
+#define POOL_LOCK(pool) omp_set_lock(&(pool)->lock)
+#define POOL_UNLOCK(pool) omp_unset_lock(&(pool)->lock)
+#else
+#define POOL_LOCK(pool)
+#define POOL_UNLOCK(pool)
+#endif /* _OPENMP */
+
+/* The header in front of every block. */
+typedef struct pool_block
+{
+    union
+    {
+        /* Next block on a free list, while the block is free. */
+        struct pool_block *next;
+
+        /* Size that was asked for, while the block is in use. */
+        PIO_Offset size;
+    } u;
+
+    /* Size class of the block. */
+    int sclass;
+
+    /* POOL_MAGIC. */
+    int magic;
+} pool_block;
+
+/* Size of the header, which keeps the user data 16-byte aligned. */
+#define POOL_HEADER POOL_ALIGN((PIO_Offset)sizeof(pool_block))
+
+/* The links in front of the header of a large block, so that all
+ * large blocks can be freed with the pool. */
+typedef struct pool_links
+{
+    struct pool_links *prev;
+    struct pool_links *next;
+} pool_links;
+
+/* Size of the links of a large block. */
+#define POOL_LINKS POOL_ALIGN((PIO_Offset)sizeof(pool_links))
+
+#ifdef _OPENMP
+/* Each thread caches some free small blocks of the pool it used last. */
+typedef struct pool_cache
+{
+    /* The pool of the cached blocks, or NULL. */
+    struct pio_pool *pool;
+
+    /* Next cache of the same pool. */
+    struct pool_cache *next;
+
+    /* Number of cached blocks of each class. */
+    int count[POOL_NCLASS];
+
+    /* Cached blocks of each class. */
+    pool_block *list[POOL_NCLASS];
+} pool_cache;
+#endif /* _OPENMP */
+
+/* A pool of memory. */
+struct pio_pool
+{
+    /* Unique ID of the pool, for logging. */
+    int id;
+
+    /* The amount of memory the pool is meant to hold. Requests are
+     * not refused above this, but the free space reported to
+     * PIOc_write_darray() is what is left below it. */
+    PIO_Offset limit;
+
+    /* Free lists of each size class. */
+    pool_block *free[POOL_NCLASS];
+
+    /* List of slabs. Each slab starts with a pointer to the one
+     * before it. */
+    char *slabs;
+
+    /* The part of the newest slab not yet carved into blocks. */
+    char *slab_pos;
+    char *slab_end;
+
+    /* List of all large blocks, in use or free. */
+    pool_links large;
+
+    /* Bytes asked for, in blocks that are in use. */
+    PIO_Offset requested;
+
+    /* Bytes of the size classes of blocks that are in use. */
+    PIO_Offset inuse;
+
+    /* Bytes taken from the system for slabs and large blocks. */
+    PIO_Offset footprint;
+
+    /* Bytes of the size classes of the blocks on the free lists, small
+     * and large. */
+    PIO_Offset free_small;
+    PIO_Offset free_large;
+
+    /* Bytes of the size classes of the blocks in thread caches. */
+    PIO_Offset cached;
+
+    /* Largest value of inuse. */
+    PIO_Offset highwater;
+
+    /* Number of gets and releases. */
+    PIO_Offset nget;
+    PIO_Offset nrel;
+
+#ifdef _OPENMP
+    /* List of the thread caches that hold blocks of this pool. */
+    pool_cache *caches;
+
+    /* Lock for the free lists, slabs, large blocks and list of
+     * caches. */
+    omp_lock_t lock;
+#endif /* _OPENMP */
+};
+
+/* ID of the last pool created. */
+static int pool_last_id = 0;
+
+/**
+ * Find the size class of a request. There are POOL_STEPS classes for
+ * each power of two, so a block is at most 25% bigger than the
+ * request.
+ *
+ * @param size the size of the request in bytes.
+ * @returns the size class, or -1 if the request is too big.
+ */
+static int pool_class(PIO_Offset size)
+{
+    int b = POOL_MIN_SHIFT;
+    int step;
+
+    if (size <= ((PIO_Offset)1 << POOL_MIN_SHIFT))
+        return 0;
+
+    /* 2^b < size <= 2^(b+1). */
+    while ((size - 1) >> (b + 1))
+        b++;
+    step = (int)((size - ((PIO_Offset)1 << b) + ((PIO_Offset)1 << (b - 2)) - 1) >> (b - 2));
+    if (POOL_STEPS * (b - POOL_MIN_SHIFT) + step >= POOL_NCLASS)
+        return -1;
+
+    return POOL_STEPS * (b - POOL_MIN_SHIFT) + step;
+}
+
+/**
+ * Find the size of the blocks of a size class.
+ *
+ * @param sclass the size class.
+ * @returns the size in bytes.
+ */
+static PIO_Offset pool_class_size(int sclass)
+{
+    int shift = POOL_MIN_SHIFT + sclass / POOL_STEPS;
+
+    return ((PIO_Offset)1 << shift) + (sclass % POOL_STEPS) * ((PIO_Offset)1 << (shift - 2));
+}
+
+/**
+ * Get memory from the system. Memory of a slab or more is aligned to
+ * the slab size and marked for huge pages, where that is possible.
+ *
+ * @param size the number of bytes.
+ * @returns pointer to the memory, or NULL if there is none.
+ */
+static void *pool_sys_alloc(PIO_Offset size)
+{
+    void *mem;
+
+    if (size < POOL_SLAB_SIZE)
+        return malloc(size);
+
+    if (posix_memalign(&mem, POOL_SLAB_SIZE, size))
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(mem, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    return mem;
+}
+
+/**
+ * Add to a counter of a pool. Counters are updated atomically, since
+ * threads update them without the lock.
+ *
+ * @param counter pointer to the counter.
+ * @param n the amount to add.
+ * @returns the new value of the counter.
+ */
+static PIO_Offset pool_add(PIO_Offset *counter, PIO_Offset n)
+{
+    PIO_Offset value;
+
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif /* _OPENMP */
+    value = *counter += n;
+
+    return value;
+}
+
+#ifdef _OPENMP
+static pool_cache pool_thread_cache;
+#pragma omp threadprivate(pool_thread_cache)
+
+/**
+ * Put the blocks of a thread cache back on the free lists of their
+ * pool, and take the cache off the list of caches of the pool. The
+ * pool must be locked.
+ *
+ * @param cache pointer to the cache.
+ */
+static void pool_flush_cache(pool_cache *cache)
+{
+    pio_pool *pool = cache->pool;
+    pool_cache **cp;
+    pool_block *blk;
+    int c;
+
+    for (c = 0; c < POOL_NCLASS; c++)
+    {
+        while ((blk = cache->list[c]))
+        {
+            cache->list[c] = blk->u.next;
+            blk->u.next = pool->free[c];
+            pool->free[c] = blk;
+            pool->free_small += pool_class_size(c);
+            pool_add(&pool->cached, -pool_class_size(c));
+        }
+        cache->count[c] = 0;
+    }
+
+    for (cp = &pool->caches; *cp; cp = &(*cp)->next)
+        if (*cp == cache)
+        {
+            *cp = cache->next;
+            break;
+        }
+    cache->pool = NULL;
+    cache->next = NULL;
+}
+
+/**
+ * Get the cache of this thread for a pool. If the cache holds blocks
+ * of another pool, they are put back on the free lists of that pool
+ * first.
+ *
+ * @param pool pointer to the pool.
+ * @returns pointer to the cache.
+ */
+static pool_cache *pool_get_cache(pio_pool *pool)
+{
+    pool_cache *cache = &pool_thread_cache;
+
+    if (cache->pool != pool)
+    {
+        if (cache->pool)
+        {
+            pio_pool *old = cache->pool;
+
+            POOL_LOCK(old);
+            pool_flush_cache(cache);
+            POOL_UNLOCK(old);
+        }
+        POOL_LOCK(pool);
+        cache->pool = pool;
+        cache->next = pool->caches;
+        pool->caches = cache;
+        POOL_UNLOCK(pool);
+    }
+
+    return cache;
+}
+#endif /* _OPENMP */
+
+/**
+ * Take the first block off a free list. The pool must be locked.
+ *
+ * @param pool pointer to the pool.
+ * @param sclass the size class.
+ * @returns pointer to the block, or NULL if the list is empty.
+ */
+static pool_block *pool_pop_free(pio_pool *pool, int sclass)
+{
+    pool_block *blk;
+
+    if ((blk = pool->free[sclass]))
+    {
+        pool->free[sclass] = blk->u.next;
+        if (pool_class_size(sclass) <= POOL_SMALL_MAX)
+            pool->free_small -= pool_class_size(sclass);
+        else
+            pool->free_large -= pool_class_size(sclass);
+    }
+
+    return blk;
+}
+
+/**
+ * Give a large block back to the system. The pool must be locked.
+ *
+ * @param pool pointer to the pool.
+ * @param blk pointer to the block.
+ */
+static void pool_free_large(pio_pool *pool, pool_block *blk)
+{
+    pool_links *links = (pool_links *)((char *)blk - POOL_LINKS);
+
+    links->prev->next = links->next;
+    links->next->prev = links->prev;
+    pool->footprint -= POOL_LINKS + POOL_ALIGN(POOL_HEADER + pool_class_size(blk->sclass));
+    free(links);
+}
+
+/**
+ * Make a new block of a size class. The pool must be locked.
+ *
+ * @param pool pointer to the pool.
+ * @param sclass the size class.
+ * @returns pointer to the block, or NULL if there is no memory.
+ */
+static pool_block *pool_new_block(pio_pool *pool, int sclass)
+{
+    PIO_Offset size = POOL_ALIGN(POOL_HEADER + pool_class_size(sclass));
+    pool_block *blk;
+
+    if (pool_class_size(sclass) <= POOL_SMALL_MAX)
+    {
+        /* Carve the block from the newest slab, starting a new slab
+         * if there is not enough left. */
+        if (!pool->slab_pos || pool->slab_end - pool->slab_pos < size)
+        {
+            char *slab;
+
+            if (!(slab = pool_sys_alloc(POOL_SLAB_SIZE)))
+                return NULL;
+            *(char **)slab = pool->slabs;
+            pool->slabs = slab;
+            pool->slab_pos = slab + POOL_HEADER;
+            pool->slab_end = slab + POOL_SLAB_SIZE;
+            pool->footprint += POOL_SLAB_SIZE;
+            LOG((3, "pool %d new slab footprint = %lld", pool->id, pool->footprint));
+        }
+        blk = (pool_block *)pool->slab_pos;
+        pool->slab_pos += size;
+    }
+    else
+    {
+        pool_links *links;
+        pool_block *fblk;
+        int c;
+
+        /* Give free large blocks back to the system, largest first,
+         * rather than go over the limit. */
+        for (c = POOL_NCLASS - 1; pool_class_size(c) > POOL_SMALL_MAX && pool->free_large &&
+                 pool->footprint + POOL_LINKS + size > pool->limit; c--)
+            while (pool->footprint + POOL_LINKS + size > pool->limit &&
+                   (fblk = pool_pop_free(pool, c)))
+                pool_free_large(pool, fblk);
+
+        /* Large blocks are allocated one at a time, and linked into
+         * the list of large blocks. */
+        if (!(links = pool_sys_alloc(POOL_LINKS + size)))
+            return NULL;
+        links->prev = &pool->large;
+        links->next = pool->large.next;
+        links->next->prev = links;
+        pool->large.next = links;
+        pool->footprint += POOL_LINKS + size;
+        blk = (pool_block *)((char *)links + POOL_LINKS);
+    }
+    blk->sclass = sclass;
+    blk->magic = POOL_MAGIC;
+
+    return blk;
+}
+
+/**
+ * Create a pool.
+ *
+ * @param limit the amount of memory the pool is meant to hold, in
+ * bytes.
+ * @param poolp pointer that gets the new pool.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_pool_create(PIO_Offset limit, pio_pool **poolp)
+{
+    pio_pool *pool;
+
+    /* Check inputs. */
+    pioassert(limit > 0 && poolp, "invalid input", __FILE__, __LINE__);
+
+    if (!(pool = calloc(1, sizeof(pio_pool))))
+        return PIO_ENOMEM;
+    pool->limit = limit;
+    pool->large.prev = &pool->large;
+    pool->large.next = &pool->large;
+#ifdef _OPENMP
+    omp_init_lock(&pool->lock);
+#pragma omp critical (pio_pool_id)
+#endif /* _OPENMP */
+    pool->id = ++pool_last_id;
+    LOG((2, "pio_pool_create id = %d limit = %lld", pool->id, limit));
+
+    *poolp = pool;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free a pool and all its memory. Blocks that are still in use must
+ * not be used after this.
+ *
+ * @param pool pointer to the pool.
+ */
+void pio_pool_free(pio_pool *pool)
+{
+    char *slab;
+
+    if (!pool)
+        return;
+    LOG((2, "pio_pool_free id = %d footprint = %lld highwater = %lld", pool->id,
+         pool->footprint, pool->highwater));
+
+#ifdef _OPENMP
+    /* Empty the caches of all threads that used the pool, so none of
+     * them keeps blocks of a pool that is gone. */
+    POOL_LOCK(pool);
+    while (pool->caches)
+        pool_flush_cache(pool->caches);
+    POOL_UNLOCK(pool);
+#endif /* _OPENMP */
+
+    while (pool->large.next != &pool->large)
+        pool_free_large(pool, (pool_block *)((char *)pool->large.next + POOL_LINKS));
+    while ((slab = pool->slabs))
+    {
+        pool->slabs = *(char **)slab;
+        free(slab);
+    }
+#ifdef _OPENMP
+    omp_destroy_lock(&pool->lock);
+#endif /* _OPENMP */
+    free(pool);
+}
+
+/**
+ * Get a block of memory from a pool.
+ *
+ * @param pool pointer to the pool.
+ * @param size the number of bytes needed.
+ * @returns pointer to the memory, or NULL if there is none.
+ */
+void *pio_pool_get(pio_pool *pool, PIO_Offset size)
+{
+    pool_block *blk = NULL;
+    PIO_Offset inuse;
+    int sclass;
+
+    pioassert(pool && size >= 0, "invalid input", __FILE__, __LINE__);
+
+    if ((sclass = pool_class(size)) < 0)
+        return NULL;
+
+#ifdef _OPENMP
+    /* Try the cache of this thread first. */
+    if (pool_class_size(sclass) <= POOL_SMALL_MAX)
+    {
+        pool_cache *cache = pool_get_cache(pool);
+
+        if ((blk = cache->list[sclass]))
+        {
+            cache->list[sclass] = blk->u.next;
+            cache->count[sclass]--;
+            pool_add(&pool->cached, -pool_class_size(sclass));
+        }
+    }
+#endif /* _OPENMP */
+
+    if (!blk)
+    {
+        POOL_LOCK(pool);
+        if (!(blk = pool_pop_free(pool, sclass)))
+            blk = pool_new_block(pool, sclass);
+        POOL_UNLOCK(pool);
+        if (!blk)
+            return NULL;
+    }
+    blk->u.size = size;
+
+    pool_add(&pool->requested, size);
+    pool_add(&pool->nget, 1);
+    if ((inuse = pool_add(&pool->inuse, pool_class_size(sclass))) > pool->highwater)
+    {
+        POOL_LOCK(pool);
+        if (inuse > pool->highwater)
+            pool->highwater = inuse;
+        POOL_UNLOCK(pool);
+    }
+
+    return (char *)blk + POOL_HEADER;
+}
+
+/**
+ * Release a block of memory to its pool.
+ *
+ * @param pool pointer to the pool.
+ * @param buf pointer to the memory, as returned by pio_pool_get(). If
+ * NULL, nothing is done.
+ */
+void pio_pool_rel(pio_pool *pool, void *buf)
+{
+    pool_block *blk;
+    PIO_Offset size;
+
+    if (!buf)
+        return;
+    blk = (pool_block *)((char *)buf - POOL_HEADER);
+    pioassert(pool && blk->magic == POOL_MAGIC, "invalid input", __FILE__, __LINE__);
+
+    size = pool_class_size(blk->sclass);
+    pool_add(&pool->requested, -blk->u.size);
+    pool_add(&pool->inuse, -size);
+    pool_add(&pool->nrel, 1);
+
+#ifdef _OPENMP
+    /* Keep the block in the cache of this thread, if there is
+     * room. */
+    if (size <= POOL_SMALL_MAX)
+    {
+        pool_cache *cache = pool_get_cache(pool);
+
+        if (cache->count[blk->sclass] < POOL_CACHE_MAX)
+        {
+            blk->u.next = cache->list[blk->sclass];
+            cache->list[blk->sclass] = blk;
+            cache->count[blk->sclass]++;
+            pool_add(&pool->cached, size);
+            return;
+        }
+    }
+#endif /* _OPENMP */
+
+    POOL_LOCK(pool);
+    if (size > POOL_SMALL_MAX && pool->footprint > pool->limit)
+    {
+        /* Give large blocks back when the pool is over its limit. */
+        pool_free_large(pool, blk);
+    }
+    else
+    {
+        blk->u.next = pool->free[blk->sclass];
+        pool->free[blk->sclass] = blk;
+        if (size <= POOL_SMALL_MAX)
+            pool->free_small += size;
+        else
+            pool->free_large += size;
+    }
+    POOL_UNLOCK(pool);
+}
+
+/**
+ * Change the size of a block of memory. The contents are kept up to
+ * the smaller of the old and new sizes. If the block is already big
+ * enough, it is not moved.
+ *
+ * @param pool pointer to the pool.
+ * @param buf pointer to the memory, as returned by pio_pool_get(). If
+ * NULL, a new block is returned.
+ * @param size the number of bytes needed.
+ * @returns pointer to the memory, or NULL if there is none, in which
+ * case buf is unchanged.
+ */
+void *pio_pool_getr(pio_pool *pool, void *buf, PIO_Offset size)
+{
+    pool_block *blk;
+    void *nbuf;
+
+    if (!buf)
+        return pio_pool_get(pool, size);
+    blk = (pool_block *)((char *)buf - POOL_HEADER);
+    pioassert(pool && blk->magic == POOL_MAGIC && size >= 0, "invalid input",
+              __FILE__, __LINE__);
+
+    /* Keep the block if it is big enough. */
+    if (size <= pool_class_size(blk->sclass))
+    {
+        pool_add(&pool->requested, size - blk->u.size);
+        blk->u.size = size;
+        return buf;
+    }
+
+    if (!(nbuf = pio_pool_get(pool, size)))
+        return NULL;
+    memcpy(nbuf, buf, blk->u.size);
+    pio_pool_rel(pool, buf);
+
+    return nbuf;
+}
+
+/**
+ * Find the free space of a pool, from the memory it has taken from
+ * the system. A large request can use what is left below the limit,
+ * and the free large blocks, which are given back to the system to
+ * make room for it. Free small blocks, in the free lists, thread
+ * caches and the newest slab, only serve small requests, so they
+ * count in the total free space only.
+ *
+ * @param pool pointer to the pool.
+ * @param totfree pointer that gets the total free space.
+ * @param maxfree pointer that gets the largest block that can be
+ * allocated without going over the limit.
+ */
+void pio_pool_freespace(pio_pool *pool, PIO_Offset *totfree, PIO_Offset *maxfree)
+{
+    pioassert(pool && totfree && maxfree, "invalid input", __FILE__, __LINE__);
+
+    POOL_LOCK(pool);
+    *maxfree = pool->footprint < pool->limit ? pool->limit - pool->footprint : 0;
+    *maxfree += pool->free_large;
+    *totfree = *maxfree + pool->free_small + pool_add(&pool->cached, 0);
+    if (pool->slab_pos)
+        *totfree += pool->slab_end - pool->slab_pos;
+    POOL_UNLOCK(pool);
+}
+
+/**
+ * Get statistics of a pool. The difference between footprint and
+ * requested is the memory lost to fragmentation, both inside blocks
+ * (inuse - requested) and in free blocks.
+ *
+ * @param pool pointer to the pool.
+ * @param requested pointer that gets the bytes asked for in blocks
+ * that are in use. Ignored if NULL.
+ * @param inuse pointer that gets the bytes in blocks that are in
+ * use. Ignored if NULL.
+ * @param footprint pointer that gets the bytes taken from the
+ * system. Ignored if NULL.
+ * @param highwater pointer that gets the largest value of inuse so
+ * far. Ignored if NULL.
+ * @param nget pointer that gets the number of gets. Ignored if NULL.
+ * @param nrel pointer that gets the number of releases. Ignored if
+ * NULL.
+ */
+void pio_pool_stats(pio_pool *pool, PIO_Offset *requested, PIO_Offset *inuse,
+                    PIO_Offset *footprint, PIO_Offset *highwater, PIO_Offset *nget,
+                    PIO_Offset *nrel)
+{
+    pioassert(pool, "invalid input", __FILE__, __LINE__);
+
+    POOL_LOCK(pool);
+    if (requested)
+        *requested = pool->requested;
+    if (inuse)
+        *inuse = pool->inuse;
+    if (footprint)
+        *footprint = pool->footprint;
+    if (highwater)
+        *highwater = pool->highwater;
+    if (nget)
+        *nget = pool->nget;
+    if (nrel)
+        *nrel = pool->nrel;
+    POOL_UNLOCK(pool);
+}
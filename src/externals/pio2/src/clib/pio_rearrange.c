@@ -6,6 +6,21 @@
 #include <config.h>
 #include <pio.h>
 #include <pio_internal.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/** Lists of map runs shorter than this are sorted with qsort instead
+ * of a radix sort. */
+#define RADIX_SORT_MIN 256
+
+/** Maps shorter than this are searched for regions in a single
+ * chunk, even when threads are available. */
+#define REGION_CHUNK_MIN 65536
+
+/** Number of timed round trips for each set of options tried by
+ * performance_tune_rearranger(). */
+#define TUNE_NREPS 3
 
 /**
  * Convert a 1-D index into a coordinate value in an arbitrary
@@ -387,6 +402,84 @@ int create_mpi_datatypes(MPI_Datatype basetype, int msgcnt,
     return PIO_NOERR;
 }
 
+/**
+ * Create the derived MPI datatypes of the IO task of the subset
+ * rearranger, which has its data as runs in IO order. The type for
+ * each task has one block per run from that task, at the position of
+ * the run in the IO buffer. Used in define_iodesc_datatypes().
+ *
+ * @param basetype The MPI type of data (MPI_INT, etc.).
+ * @param msgcnt the number of tasks, and of MPI types created.
+ * @param nruns the number of runs.
+ * @param from array (length nruns) of the task of each run.
+ * @param runlen array (length nruns) of the length of each run.
+ * @param mcount array (length msgcnt) of the number of points from
+ * each task. No type is created for tasks with no points.
+ * @param mtype pointer to an array (length msgcnt) which gets the
+ * created datatypes.
+ * @returns 0 on success, error code otherwise.
+ */
+static int create_run_datatypes(MPI_Datatype basetype, int msgcnt, int nruns,
+                                const int *from, const int *runlen, const int *mcount,
+                                MPI_Datatype *mtype)
+{
+    int first[msgcnt + 1]; /* First block of each task. */
+    int fill[msgcnt];      /* Next block of each task. */
+    int *blen;
+    int *displ;
+    int pos = 0;
+    int mpierr; /* Return code from MPI functions. */
+
+    pioassert(msgcnt > 0 && (from || !nruns) && (runlen || !nruns) && mcount && mtype,
+              "invalid input", __FILE__, __LINE__);
+    LOG((1, "create_run_datatypes basetype = %d msgcnt = %d nruns = %d", basetype,
+         msgcnt, nruns));
+
+    /* Group the runs by task, keeping them in IO order. */
+    for (int i = 0; i <= msgcnt; i++)
+        first[i] = 0;
+    for (int r = 0; r < nruns; r++)
+        first[from[r] + 1]++;
+    for (int i = 0; i < msgcnt; i++)
+        first[i + 1] += first[i];
+
+    if (!(blen = malloc(2 * max(1, nruns) * sizeof(int))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    displ = blen + max(1, nruns);
+
+    for (int i = 0; i < msgcnt; i++)
+        fill[i] = first[i];
+    for (int r = 0; r < nruns; r++)
+    {
+        blen[fill[from[r]]] = runlen[r];
+        displ[fill[from[r]]++] = pos;
+        pos += runlen[r];
+    }
+
+    for (int i = 0; i < msgcnt; i++)
+    {
+        if (mcount[i] > 0)
+        {
+            /* Create an indexed datatype with one block per run. */
+            if ((mpierr = MPI_Type_indexed(first[i + 1] - first[i], blen + first[i],
+                                           displ + first[i], basetype, &mtype[i])))
+            {
+                free(blen);
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            }
+            if ((mpierr = MPI_Type_commit(&mtype[i])))
+            {
+                free(blen);
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            }
+        }
+    }
+
+    free(blen);
+
+    return PIO_NOERR;
+}
+
 /**
  * If needed, create the derived MPI datatypes used for comp2io and
  * io2comp transfers.
@@ -433,13 +526,24 @@ int define_iodesc_datatypes(iosystem_desc_t *ios, io_desc_t *iodesc)
                 for (int i = 0; i < iodesc->nrecvs; i++)
                     iodesc->rtype[i] = PIO_DATATYPE_NULL;
 
-                /* The different rearrangers get different values for mfrom. */
-                int *mfrom = iodesc->rearranger == PIO_REARR_SUBSET ? iodesc->rfrom : NULL;
-
-                /* Create the MPI datatypes. */
-                if ((ret = create_mpi_datatypes(iodesc->basetype, iodesc->nrecvs, iodesc->rindex,
-                                                iodesc->rcount, mfrom, iodesc->rtype)))
-                    return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+                /* Create the MPI datatypes. The subset rearranger
+                 * keeps its data as runs, the box rearranger as
+                 * points. */
+                if (iodesc->rearranger == PIO_REARR_SUBSET)
+                {
+                    if ((ret = create_run_datatypes(iodesc->basetype, iodesc->nrecvs,
+                                                    iodesc->nrfrom, iodesc->rfrom,
+                                                    iodesc->rfromlen, iodesc->rcount,
+                                                    iodesc->rtype)))
+                        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+                }
+                else
+                {
+                    if ((ret = create_mpi_datatypes(iodesc->basetype, iodesc->nrecvs,
+                                                    iodesc->rindex, iodesc->rcount, NULL,
+                                                    iodesc->rtype)))
+                        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+                }
             }
         }
     }
@@ -625,7 +729,7 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
             if (recv_buf[i] != 0)
             {
                 iodesc->rcount[nrecvs] = recv_buf[i];
-                iodesc->rfrom[nrecvs] = i;
+                iodesc->rfrom[nrecvs] = ios->compranks[i];
                 nrecvs++;
             }
         }
@@ -745,343 +849,1423 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
 }
 
 /**
- * Moves data from compute tasks to IO tasks. This is called from
- * PIOc_write_darray_multi().
+ * Free a cached communication plan, including any derived MPI types
+ * that belong to it. The plan pointer
+ * is set to NULL. It is not an error to pass a pointer to a NULL
+ * plan.
  *
- * @param ios pointer to the iosystem_desc_t struct.
- * @param iodesc a pointer to the io_desc_t struct.
- * @param sbuf send buffer. May be NULL.
- * @param rbuf receive buffer. May be NULL.
- * @param nvars number of variables.
+ * @param plan pointer to the plan pointer to free.
  * @returns 0 on success, error code otherwise.
  */
-int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
-                      void *rbuf, int nvars)
+int free_rearr_comm_plan(rearr_comm_plan_t **plan)
 {
-    int ntasks;       /* Number of tasks in communicator. */
-    int niotasks;     /* Number of IO tasks. */
-    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
-    int mpierr;       /* Return code from MPI calls. */
-    int ret;
+    rearr_comm_plan_t *p;
+    int mpierr; /* Return code from MPI calls. */
 
-#ifdef TIMING
-    GPTLstart("PIO:rearrange_comp2io");
-#endif
+    pioassert(plan, "invalid input", __FILE__, __LINE__);
 
-    /* Caller must provide these. */
-    pioassert(ios && iodesc && nvars > 0, "invalid input", __FILE__, __LINE__);
+    if (!(p = *plan))
+        return PIO_NOERR;
 
-    LOG((1, "rearrange_comp2io nvars = %d iodesc->rearranger = %d", nvars,
-         iodesc->rearranger));
+    /* Free the types, if this plan created them. */
+    if (p->own_types)
+    {
+        for (int i = 0; i < p->ntasks; i++)
+        {
+            if (p->sendtypes[i] != PIO_DATATYPE_NULL)
+                if ((mpierr = MPI_Type_free(&p->sendtypes[i])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            if (p->recvtypes[i] != PIO_DATATYPE_NULL)
+                if ((mpierr = MPI_Type_free(&p->recvtypes[i])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        }
+    }
 
-    /* Different rearraangers use different communicators. */
-    if (iodesc->rearranger == PIO_REARR_BOX)
+    free(p->sendcounts);
+    free(p->recvcounts);
+    free(p->sdispls);
+    free(p->rdispls);
+    free(p->sendtypes);
+    free(p->recvtypes);
+    free(p);
+    *plan = NULL;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Allocate a communication plan for a communicator of ntasks tasks,
+ * with all counts and displacements zero and all types NULL.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param ntasks number of tasks in the communicator.
+ * @param plan pointer that gets the new plan.
+ * @returns 0 on success, error code otherwise.
+ */
+int alloc_rearr_comm_plan(iosystem_desc_t *ios, int ntasks, rearr_comm_plan_t **plan)
+{
+    rearr_comm_plan_t *p;
+
+    pioassert(ntasks > 0 && plan, "invalid input", __FILE__, __LINE__);
+
+    if (!(p = calloc(1, sizeof(rearr_comm_plan_t))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    *plan = p;
+    p->ntasks = ntasks;
+
+    if (!(p->sendcounts = calloc(ntasks, sizeof(int))) ||
+        !(p->recvcounts = calloc(ntasks, sizeof(int))) ||
+        !(p->sdispls = calloc(ntasks, sizeof(int))) ||
+        !(p->rdispls = calloc(ntasks, sizeof(int))) ||
+        !(p->sendtypes = malloc(ntasks * sizeof(MPI_Datatype))) ||
+        !(p->recvtypes = malloc(ntasks * sizeof(MPI_Datatype))))
     {
-        mycomm = ios->union_comm;
-        niotasks = ios->num_iotasks;
+        free_rearr_comm_plan(plan);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
     }
-    else
+
+    for (int i = 0; i < ntasks; i++)
     {
-        mycomm = iodesc->subset_comm;
-        niotasks = 1;
+        p->sendtypes[i] = PIO_DATATYPE_NULL;
+        p->recvtypes[i] = PIO_DATATYPE_NULL;
     }
 
-    /* Get the number of tasks. */
-    if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
-        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    return PIO_NOERR;
+}
 
-    /* These are parameters to pio_swapm to send data from compute to
-     * IO tasks. */
-    int sendcounts[ntasks];
-    int recvcounts[ntasks];
-    int sdispls[ntasks];
-    int rdispls[ntasks];
-    MPI_Datatype sendtypes[ntasks];
-    MPI_Datatype recvtypes[ntasks];
+/**
+ * Create the derived MPI types of a comp2io plan for nvars
+ * variables. Types from an earlier number of variables are freed
+ * first.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param plan pointer to the comp2io plan.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int set_comp2io_plan_types(iosystem_desc_t *ios, io_desc_t *iodesc,
+                           rearr_comm_plan_t *plan, int nvars)
+{
+    int niotasks;
+    int mpierr; /* Return code from MPI calls. */
 
-    /* Initialize pio_swapm parameter arrays. */
-    for (int i = 0; i < ntasks; i++)
+    pioassert(ios && iodesc && plan && nvars > 0, "invalid input", __FILE__, __LINE__);
+    LOG((2, "set_comp2io_plan_types nvars = %d plan->nvars = %d", nvars, plan->nvars));
+
+    for (int i = 0; i < plan->ntasks; i++)
     {
-        sendcounts[i] = 0;
-        recvcounts[i] = 0;
-        sdispls[i] = 0;
-        rdispls[i] = 0;
-        recvtypes[i] = PIO_DATATYPE_NULL;
-        sendtypes[i] =  PIO_DATATYPE_NULL;
+        if (plan->sendtypes[i] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&plan->sendtypes[i])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        if (plan->recvtypes[i] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&plan->recvtypes[i])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
     }
-    LOG((3, "ntasks = %d iodesc->basetype_size = %d niotasks = %d", ntasks,
-         iodesc->basetype_size, niotasks));
-
-    /* If it has not already been done, define the MPI data types that
-     * will be used for this io_desc_t. */
-    if ((ret = define_iodesc_datatypes(ios, iodesc)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
     /* If this io proc will exchange data with compute tasks create a
      * MPI DataType for that exchange. */
-    LOG((2, "ios->ioproc %d iodesc->nrecvs = %d", ios->ioproc, iodesc->nrecvs));
     if (ios->ioproc && iodesc->nrecvs > 0)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
         {
             if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
             {
-                LOG((3, "iodesc->rtype[%d] = %d iodesc->rearranger = %d", i, iodesc->rtype[i],
-                        iodesc->rearranger));
-                if (iodesc->rearranger == PIO_REARR_SUBSET)
-                {
-                    LOG((3, "exchanging data for subset rearranger"));
-                    recvcounts[i] = 1;
-
-                    /*  Create an MPI derived data type from equally
-                     *  spaced blocks of the same size. The block size
-                     *  is 1, the stride here is the length of the
-                     *  collected array (llen). */
-#if PIO_USE_MPISERIAL
-                    if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
-                                                   iodesc->rtype[i], &recvtypes[i])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-#else
-                    if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
-                                                          iodesc->rtype[i], &recvtypes[i])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-#endif /* PIO_USE_MPISERIAL */
-                    pioassert(recvtypes[i] != PIO_DATATYPE_NULL, "bad mpi type", __FILE__, __LINE__);
-
-                    if ((mpierr = MPI_Type_commit(&recvtypes[i])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-                }
-                else
-                {
-                    LOG((3, "exchanging data for box rearranger"));
-                    LOG((3, "i = %d iodesc->rfrom[i] = %d recvcounts[iodesc->rfrom[i]] = %d", i,
-                         iodesc->rfrom[i], recvcounts[iodesc->rfrom[i]]));
-                    recvcounts[iodesc->rfrom[i]] = 1;
-
+                /* The subset rearranger receives from task i of the
+                 * subset communicator, the box rearranger from
+                 * iodesc->rfrom[i] of the union communicator. */
+                int from = iodesc->rearranger == PIO_REARR_SUBSET ? i : iodesc->rfrom[i];
+
+                /* No message from tasks that use shared memory. */
+                if (!plan->recvcounts[from])
+                    continue;
+
+                /*  Create an MPI derived data type from equally
+                 *  spaced blocks of the same size. The block size
+                 *  is 1, the stride here is the length of the
+                 *  collected array (llen). */
 #if PIO_USE_MPISERIAL
-                    if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
-                                                   iodesc->rtype[i], &recvtypes[iodesc->rfrom[i]])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+                if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
+                                               iodesc->rtype[i], &plan->recvtypes[from])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 #else
-                    if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
-                                                          iodesc->rtype[i], &recvtypes[iodesc->rfrom[i]])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+                if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
+                                                      iodesc->rtype[i], &plan->recvtypes[from])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 #endif /* PIO_USE_MPISERIAL */
-                    pioassert(recvtypes[iodesc->rfrom[i]] != PIO_DATATYPE_NULL,  "bad mpi type",
-                              __FILE__, __LINE__);
+                pioassert(plan->recvtypes[from] != PIO_DATATYPE_NULL, "bad mpi type", __FILE__, __LINE__);
 
-                    if ((mpierr = MPI_Type_commit(&recvtypes[iodesc->rfrom[i]])))
-                        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-
-                    rdispls[iodesc->rfrom[i]] = 0;
-                }
+                if ((mpierr = MPI_Type_commit(&plan->recvtypes[from])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
             }
         }
     }
 
     /* On compute tasks loop over iotasks and create a data type for
      * each exchange.  */
+    niotasks = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
     for (int i = 0; i < niotasks; i++)
     {
-        int io_comprank = ios->ioranks[i];
-        if (iodesc->rearranger == PIO_REARR_SUBSET)
-            io_comprank = 0;
+        int io_comprank = iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i];
 
-        LOG((3, "i = %d iodesc->scount[i] = %d", i, iodesc->scount[i]));
-        if (iodesc->scount[i] > 0 && sbuf)
+        if (plan->sendcounts[io_comprank] > 0)
         {
             LOG((3, "io task %d creating sendtypes[%d]", i, io_comprank));
-            sendcounts[io_comprank] = 1;
 #if PIO_USE_MPISERIAL
             if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->basetype_size,
-                                           iodesc->stype[i], &sendtypes[io_comprank])))
+                                           iodesc->stype[i], &plan->sendtypes[io_comprank])))
                 return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 #else
             if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->basetype_size,
-                                                  iodesc->stype[i], &sendtypes[io_comprank])))
+                                                  iodesc->stype[i], &plan->sendtypes[io_comprank])))
                 return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 #endif /* PIO_USE_MPISERIAL */
-            pioassert(sendtypes[io_comprank] != PIO_DATATYPE_NULL,  "bad mpi type", __FILE__, __LINE__);
+            pioassert(plan->sendtypes[io_comprank] != PIO_DATATYPE_NULL,  "bad mpi type",
+                      __FILE__, __LINE__);
 
-            if ((mpierr = MPI_Type_commit(&sendtypes[io_comprank])))
+            if ((mpierr = MPI_Type_commit(&plan->sendtypes[io_comprank])))
                 return check_mpi(NULL, mpierr, __FILE__, __LINE__);
         }
-        else
-        {
-            sendcounts[io_comprank] = 0;
-        }
-    }
-
-    /* Data in sbuf on the compute nodes is sent to rbuf on the ionodes */
-    LOG((2, "about to call pio_swapm for sbuf"));
-    if ((ret = pio_swapm(sbuf, sendcounts, sdispls, sendtypes,
-                         rbuf, recvcounts, rdispls, recvtypes, mycomm,
-                         &iodesc->rearr_opts.comp2io)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
-
-    /* Free the MPI types. */
-    for (int i = 0; i < ntasks; i++)
-    {
-        LOG((3, "freeing MPI types for task %d", i));
-        if (sendtypes[i] != PIO_DATATYPE_NULL)
-            if ((mpierr = MPI_Type_free(&sendtypes[i])))
-                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-
-        if (recvtypes[i] != PIO_DATATYPE_NULL)
-            if ((mpierr = MPI_Type_free(&recvtypes[i])))
-                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
     }
 
-#ifdef TIMING
-    GPTLstop("PIO:rearrange_comp2io");
-#endif
+    plan->nvars = nvars;
 
     return PIO_NOERR;
 }
 
 /**
- * Moves data from IO tasks to compute tasks. This function is used in
- * PIOc_read_darray().
+ * Build the communication plan used by rearrange_comp2io(). The
+ * counts only depend on the decomposition (and on whether this task
+ * has data to send), so they are computed once. The derived types
+ * depend on the number of variables and are created by
+ * set_comp2io_plan_types().
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
- * @param sbuf send buffer.
- * @param rbuf receive buffer.
+ * @param comm the communicator the data is transferred over.
+ * @param have_sbuf non-zero if the caller has a send buffer.
  * @returns 0 on success, error code otherwise.
  */
-int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
-                      void *rbuf)
+int create_comp2io_plan(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                        int have_sbuf)
 {
-    MPI_Comm mycomm;
+    rearr_comm_plan_t *plan;
     int ntasks;
     int niotasks;
     int mpierr; /* Return code from MPI calls. */
     int ret;
 
-    /* Check inputs. */
-    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+    pioassert(ios && iodesc && !iodesc->comp2io_plan, "invalid input", __FILE__, __LINE__);
 
-#ifdef TIMING
-    GPTLstart("PIO:rearrange_io2comp");
-#endif
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    LOG((2, "create_comp2io_plan ntasks = %d have_sbuf = %d", ntasks, have_sbuf));
 
-    /* Different rearrangers use different communicators and number of
-     * IO tasks. */
-    if (iodesc->rearranger == PIO_REARR_BOX)
+    if ((ret = alloc_rearr_comm_plan(ios, ntasks, &plan)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    plan->have_sbuf = have_sbuf;
+    plan->own_types = 1;
+
+    /* IO tasks receive one message from each compute task they
+     * exchange data with. */
+    if (ios->ioproc)
+        for (int i = 0; i < iodesc->nrecvs; i++)
+            if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
+                plan->recvcounts[iodesc->rearranger == PIO_REARR_SUBSET ? i : iodesc->rfrom[i]] = 1;
+
+    /* Compute tasks send one message to each IO task that gets some
+     * of their data. */
+    niotasks = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
+    for (int i = 0; i < niotasks; i++)
     {
-        mycomm = ios->union_comm;
-        niotasks = ios->num_iotasks;
+        int io_comprank = iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i];
+        if (iodesc->scount[i] > 0 && have_sbuf)
+            plan->sendcounts[io_comprank] = 1;
     }
-    else
+
+    /* Tasks on the same node move their data through shared memory
+     * instead. */
+    if (iodesc->shm && iodesc->shm->active)
     {
-        mycomm = iodesc->subset_comm;
-        niotasks = 1;
+        for (int p = 0; p < ntasks; p++)
+        {
+            if (iodesc->shm->node_rank[p] >= 0)
+            {
+                plan->sendcounts[p] = 0;
+                plan->recvcounts[p] = 0;
+            }
+        }
     }
-    LOG((3, "niotasks = %d", niotasks));
 
-    /* Get the size of this communicator. */
-    if ((mpierr = MPI_Comm_size(mycomm, &ntasks)))
-        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    iodesc->comp2io_plan = plan;
 
-    /* Define the MPI data types that will be used for this
-     * io_desc_t. */
-    if ((ret = define_iodesc_datatypes(ios, iodesc)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    return PIO_NOERR;
+}
 
-    /* Allocate arrays needed by the pio_swapm() function. */
-    int sendcounts[ntasks];
-    int recvcounts[ntasks];
-    int sdispls[ntasks];
-    int rdispls[ntasks];
-    MPI_Datatype sendtypes[ntasks];
-    MPI_Datatype recvtypes[ntasks];
+/**
+ * Set the send and receive types of an io2comp plan for nvars
+ * variables. For one variable the plan uses the types in
+ * iodesc->rtype and iodesc->stype directly and does not own them. For
+ * more than one variable it creates hvector types over them, so that
+ * all the variables are moved in one exchange. Types from an earlier
+ * number of variables are freed first.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param plan pointer to the io2comp plan.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int set_io2comp_plan_types(iosystem_desc_t *ios, io_desc_t *iodesc,
+                           rearr_comm_plan_t *plan, int nvars)
+{
+    int niotasks;
+    int mpierr; /* Return code from MPI calls. */
 
-    /* Initialize arrays. */
-    for (int i = 0; i < ntasks; i++)
+    pioassert(ios && iodesc && plan && nvars > 0, "invalid input", __FILE__, __LINE__);
+    LOG((2, "set_io2comp_plan_types nvars = %d plan->nvars = %d", nvars, plan->nvars));
+
+    for (int i = 0; i < plan->ntasks; i++)
     {
-        sendcounts[i] = 0;
-        recvcounts[i] = 0;
-        sdispls[i] = 0;
-        rdispls[i] = 0;
-        sendtypes[i] = PIO_DATATYPE_NULL;
-        recvtypes[i] = PIO_DATATYPE_NULL;
+        if (plan->own_types)
+        {
+            if (plan->sendtypes[i] != PIO_DATATYPE_NULL)
+                if ((mpierr = MPI_Type_free(&plan->sendtypes[i])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            if (plan->recvtypes[i] != PIO_DATATYPE_NULL)
+                if ((mpierr = MPI_Type_free(&plan->recvtypes[i])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        }
+        plan->sendtypes[i] = PIO_DATATYPE_NULL;
+        plan->recvtypes[i] = PIO_DATATYPE_NULL;
     }
+    plan->own_types = nvars > 1;
 
-    /* In IO tasks set up sendcounts/sendtypes for pio_swapm() call
-     * below. */
+    /* IO tasks send the data of all variables to each compute task
+     * in one message. */
     if (ios->ioproc)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
         {
-            if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
+            int to = iodesc->rearranger == PIO_REARR_SUBSET ? i : iodesc->rfrom[i];
+
+            if (iodesc->rtype[i] == PIO_DATATYPE_NULL || !plan->sendcounts[to])
+                continue;
+
+            if (nvars == 1)
             {
-                if (iodesc->rearranger == PIO_REARR_SUBSET)
-                {
-                    if (sbuf)
-                    {
-                        sendcounts[i] = 1;
-                        sendtypes[i] = iodesc->rtype[i];
-                    }
-                }
-                else
-                {
-                    sendcounts[iodesc->rfrom[i]] = 1;
-                    sendtypes[iodesc->rfrom[i]] = iodesc->rtype[i];
-                }
+                plan->sendtypes[to] = iodesc->rtype[i];
+                continue;
             }
+
+            /* The variables are llen elements apart in the IO
+             * buffer. */
+#if PIO_USE_MPISERIAL
+            if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
+                                           iodesc->rtype[i], &plan->sendtypes[to])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+#else
+            if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->llen * iodesc->basetype_size,
+                                                  iodesc->rtype[i], &plan->sendtypes[to])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+#endif /* PIO_USE_MPISERIAL */
+            if ((mpierr = MPI_Type_commit(&plan->sendtypes[to])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
         }
     }
 
-    /* In the box rearranger each comp task may communicate with
-     * multiple IO tasks here we are setting the count and data type
-     * of the communication of a given compute task with each io
-     * task. */
+    /* Compute tasks receive the data of all variables from each IO
+     * task in one message. */
+    niotasks = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
     for (int i = 0; i < niotasks; i++)
     {
-        int io_comprank = ios->ioranks[i];
+        int io_comprank = iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i];
 
-        if (iodesc->rearranger == PIO_REARR_SUBSET)
-            io_comprank = 0;
+        if (!plan->recvcounts[io_comprank])
+            continue;
 
-        if (iodesc->scount[i] > 0 && iodesc->stype[i] != PIO_DATATYPE_NULL)
+        if (nvars == 1)
         {
-            recvcounts[io_comprank] = 1;
-            recvtypes[io_comprank] = iodesc->stype[i];
+            plan->recvtypes[io_comprank] = iodesc->stype[i];
+            continue;
         }
-    }
 
-    /* Data in sbuf on the ionodes is sent to rbuf on the compute nodes */
-    if ((ret = pio_swapm(sbuf, sendcounts, sdispls, sendtypes, rbuf, recvcounts,
-                         rdispls, recvtypes, mycomm, &iodesc->rearr_opts.io2comp)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        /* The variables are ndof elements apart in the compute
+         * buffer. */
+#if PIO_USE_MPISERIAL
+        if ((mpierr = MPI_Type_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->basetype_size,
+                                       iodesc->stype[i], &plan->recvtypes[io_comprank])))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+#else
+        if ((mpierr = MPI_Type_create_hvector(nvars, 1, (MPI_Aint)iodesc->ndof * iodesc->basetype_size,
+                                              iodesc->stype[i], &plan->recvtypes[io_comprank])))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+#endif /* PIO_USE_MPISERIAL */
+        if ((mpierr = MPI_Type_commit(&plan->recvtypes[io_comprank])))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
 
-#ifdef TIMING
-    GPTLstop("PIO:rearrange_io2comp");
-#endif
+    plan->nvars = nvars;
 
     return PIO_NOERR;
 }
 
 /**
- * Determine whether fill values are needed. This function compares
- * how much data we have to how much data is in a record (or
- * non-record var). If we have enough data to completely fill the
- * variable, then fill is not needed.
+ * Build the communication plan used by rearrange_io2comp(). Only the
+ * counts are set here. The types depend on the number of variables
+ * and are set by set_io2comp_plan_types().
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
- * @param gdimlen pointer to an array length iodesc->ndims with the
- * global array sizes for one record (for record vars) or for the
- * entire var (for non-record vars).
- * @param compmap only used for the box communicator.
+ * @param comm the communicator the data is transferred over.
+ * @param have_sbuf non-zero if the caller has a send buffer.
  * @returns 0 on success, error code otherwise.
  */
-int determine_fill(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
-                   const PIO_Offset *compmap)
+int create_io2comp_plan(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm,
+                        int have_sbuf)
 {
-    PIO_Offset totalllen = 0;
-    PIO_Offset totalgridsize = 1;
-    int mpierr; /* Return code from MPI calls. */
+    rearr_comm_plan_t *plan;
+    int ntasks;
+    int niotasks;
+    int mpierr; /* Return code from MPI calls. */
+    int ret;
+
+    pioassert(ios && iodesc && !iodesc->io2comp_plan, "invalid input", __FILE__, __LINE__);
+
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    LOG((2, "create_io2comp_plan ntasks = %d have_sbuf = %d", ntasks, have_sbuf));
+
+    if ((ret = alloc_rearr_comm_plan(ios, ntasks, &plan)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    plan->have_sbuf = have_sbuf;
+
+    /* In IO tasks set up sendcounts. */
+    if (ios->ioproc)
+    {
+        for (int i = 0; i < iodesc->nrecvs; i++)
+        {
+            if (iodesc->rtype[i] != PIO_DATATYPE_NULL)
+            {
+                if (iodesc->rearranger == PIO_REARR_SUBSET)
+                {
+                    if (have_sbuf)
+                        plan->sendcounts[i] = 1;
+                }
+                else
+                    plan->sendcounts[iodesc->rfrom[i]] = 1;
+            }
+        }
+    }
+
+    /* In the box rearranger each comp task may communicate with
+     * multiple IO tasks here we are setting the count of the
+     * communication of a given compute task with each io task. */
+    niotasks = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
+    for (int i = 0; i < niotasks; i++)
+    {
+        int io_comprank = iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i];
+
+        if (iodesc->scount[i] > 0 && iodesc->stype[i] != PIO_DATATYPE_NULL)
+            plan->recvcounts[io_comprank] = 1;
+    }
+
+    iodesc->io2comp_plan = plan;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Move data according to a communication plan. The counts,
+ * displacements and types of the plan are reused on every call, and
+ * passed to pio_swapm() with the flow control options.
+ *
+ * The messages are posted again on every call, rather than with
+ * persistent requests: those are bound to the buffers, and the
+ * callers in pio_darray.c get new buffers on each call.
+ *
+ * @param plan pointer to the plan.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param comm the communicator the plan was built for.
+ * @param fc pointer to the flow control options.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_comm_plan_exchange(rearr_comm_plan_t *plan, void *sbuf, void *rbuf,
+                             MPI_Comm comm, rearr_comm_fc_opt_t *fc)
+{
+    pioassert(plan && fc, "invalid input", __FILE__, __LINE__);
+
+    return pio_swapm(sbuf, plan->sendcounts, plan->sdispls, plan->sendtypes,
+                     rbuf, plan->recvcounts, plan->rdispls, plan->recvtypes,
+                     comm, fc);
+}
+
+/**
+ * Create the distributed graph communicator used with
+ * PIO_REARR_COMM_NEIGHBOR. The neighbors of a task are the tasks it
+ * sends data to or receives data from in rearrange_comp2io(). The
+ * graph is symmetric, so the same communicator serves
+ * rearrange_io2comp(). Ranks are not reordered, so neighbor ranks are
+ * the same as in the communicator of the rearranger.
+ *
+ * This function is collective over the communicator of the
+ * rearranger (ios->union_comm for the box rearranger,
+ * iodesc->subset_comm for the subset rearranger).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int create_neighbor_comm(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+#ifdef MPI_SERIAL
+    return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+#else
+    MPI_Comm comm;
+    int ntasks;
+    int niotasks;
+    int nnbr = 0;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(ios && iodesc && !iodesc->neighbors, "invalid input", __FILE__, __LINE__);
+
+    if (iodesc->rearranger == PIO_REARR_BOX)
+    {
+        comm = ios->union_comm;
+        niotasks = ios->num_iotasks;
+    }
+    else
+    {
+        comm = iodesc->subset_comm;
+        niotasks = 1;
+    }
+
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Mark the tasks this task exchanges data with. */
+    int is_nbr[ntasks];
+    for (int i = 0; i < ntasks; i++)
+        is_nbr[i] = 0;
+
+    if (ios->ioproc)
+        for (int i = 0; i < iodesc->nrecvs; i++)
+            if (iodesc->rcount[i] > 0)
+                is_nbr[iodesc->rearranger == PIO_REARR_SUBSET ? i : iodesc->rfrom[i]] = 1;
+
+    for (int i = 0; i < niotasks; i++)
+        if (iodesc->scount[i] > 0)
+            is_nbr[iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i]] = 1;
+
+    for (int i = 0; i < ntasks; i++)
+        nnbr += is_nbr[i];
+
+    if (!(iodesc->neighbors = malloc(max(nnbr, 1) * sizeof(int))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    iodesc->num_neighbors = 0;
+    for (int i = 0; i < ntasks; i++)
+        if (is_nbr[i])
+            iodesc->neighbors[iodesc->num_neighbors++] = i;
+    LOG((2, "create_neighbor_comm ntasks = %d num_neighbors = %d", ntasks,
+         iodesc->num_neighbors));
+
+    /* All edges get the same weight. Real arrays are passed rather
+     * than MPI_UNWEIGHTED, which is not a valid array to read from
+     * when nnbr is 0. */
+    int weights[max(nnbr, 1)];
+    for (int i = 0; i < max(nnbr, 1); i++)
+        weights[i] = 1;
+
+    if ((mpierr = MPI_Dist_graph_create_adjacent(comm, nnbr, iodesc->neighbors, weights,
+                                                 nnbr, iodesc->neighbors, weights,
+                                                 MPI_INFO_NULL, 0, &iodesc->neighbor_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+#endif /* MPI_SERIAL */
+}
+
+/**
+ * Free the neighbor list and distributed graph communicator of an
+ * io_desc_t, if they exist.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int free_neighbor_comm(io_desc_t *iodesc)
+{
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc, "invalid input", __FILE__, __LINE__);
+
+    if (iodesc->neighbors)
+    {
+        free(iodesc->neighbors);
+        iodesc->neighbors = NULL;
+        iodesc->num_neighbors = 0;
+        if ((mpierr = MPI_Comm_free(&iodesc->neighbor_comm)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Move data according to a communication plan with
+ * MPI_Neighbor_alltoallw() on iodesc->neighbor_comm. Only the
+ * neighbors of this task are passed to MPI, so the argument arrays
+ * have length num_neighbors instead of the size of the communicator.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param plan pointer to the plan.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_neighbor_exchange(io_desc_t *iodesc, rearr_comm_plan_t *plan, void *sbuf,
+                            void *rbuf)
+{
+#ifdef MPI_SERIAL
+    return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+#else
+    int nnbr;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc && iodesc->neighbors && plan, "invalid input", __FILE__, __LINE__);
+
+    /* Arrays must have at least one element. */
+    nnbr = iodesc->num_neighbors;
+    int sendcounts[max(nnbr, 1)];
+    int recvcounts[max(nnbr, 1)];
+    MPI_Aint sdispls[max(nnbr, 1)];
+    MPI_Aint rdispls[max(nnbr, 1)];
+    MPI_Datatype sendtypes[max(nnbr, 1)];
+    MPI_Datatype recvtypes[max(nnbr, 1)];
+
+    for (int j = 0; j < nnbr; j++)
+    {
+        int p = iodesc->neighbors[j];
+
+        sendcounts[j] = plan->sendcounts[p];
+        sdispls[j] = plan->sdispls[p];
+        sendtypes[j] = plan->sendcounts[p] ? plan->sendtypes[p] : MPI_BYTE;
+        recvcounts[j] = plan->recvcounts[p];
+        rdispls[j] = plan->rdispls[p];
+        recvtypes[j] = plan->recvcounts[p] ? plan->recvtypes[p] : MPI_BYTE;
+    }
+    LOG((2, "rearr_neighbor_exchange num_neighbors = %d", nnbr));
+
+    if ((mpierr = MPI_Neighbor_alltoallw(sbuf, sendcounts, sdispls, sendtypes, rbuf,
+                                         recvcounts, rdispls, recvtypes, iodesc->neighbor_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+#endif /* MPI_SERIAL */
+}
+
+/**
+ * Set up the shared memory path of rearrange_comp2io(). Tasks of the
+ * rearranger communicator that share a node are put in a node
+ * communicator. Each compute task sends the part of its sindex for
+ * each IO task on its node to that IO task once, so that the IO task
+ * can later gather the data itself. The pairs set up here are left
+ * out of the message passing in the comp2io plan.
+ *
+ * The shared memory window is not allocated until the number of
+ * variables is known, in set_rearr_shm_window().
+ *
+ * This function is collective over the communicator of the
+ * rearranger (ios->union_comm for the box rearranger,
+ * iodesc->subset_comm for the subset rearranger).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param comm the communicator of the rearranger.
+ * @returns 0 on success, error code otherwise.
+ */
+int create_rearr_shm(iosystem_desc_t *ios, io_desc_t *iodesc, MPI_Comm comm)
+{
+    rearr_shm_t *shm;
+
+    pioassert(ios && iodesc && !iodesc->shm, "invalid input", __FILE__, __LINE__);
+
+    if (!(shm = calloc(1, sizeof(rearr_shm_t))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    shm->node_comm = MPI_COMM_NULL;
+    iodesc->shm = shm;
+
+#ifndef MPI_SERIAL
+    MPI_Group group, node_group;
+    MPI_Request *reqs;
+    int nreqs = 0;
+    int ntasks, node_size;
+    int niotasks;
+    int spos = 0;
+    int nelem = 0;
+    char *needed = NULL; /* Elements of this task read by IO tasks on its node. */
+    int active;
+    int mpierr; /* Return code from MPI calls. */
+
+    if ((mpierr = MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                                      &shm->node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(shm->node_comm, &node_size)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Find the rank in comm of each task on this node. */
+    int node_ranks[node_size];
+    int comm_ranks[node_size];
+    int node_ndof[node_size];
+
+    for (int i = 0; i < node_size; i++)
+        node_ranks[i] = i;
+    if ((mpierr = MPI_Comm_group(comm, &group)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_group(shm->node_comm, &node_group)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Group_translate_ranks(node_group, node_size, node_ranks, group,
+                                            comm_ranks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Group_free(&node_group)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Group_free(&group)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    if (!(shm->node_rank = malloc(ntasks * sizeof(int))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    for (int i = 0; i < ntasks; i++)
+        shm->node_rank[i] = -1;
+    for (int i = 0; i < node_size; i++)
+        shm->node_rank[comm_ranks[i]] = i;
+
+    /* IO tasks need the ndof of the compute tasks they gather from to
+     * find each variable in their segments. */
+    if ((mpierr = MPI_Allgather(&iodesc->ndof, 1, MPI_INT, node_ndof, 1, MPI_INT,
+                                shm->node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Count the on-node peers of this IO task, and the elements they
+     * send. */
+    if (ios->ioproc)
+    {
+        for (int k = 0; k < iodesc->nrecvs; k++)
+        {
+            int from = iodesc->rearranger == PIO_REARR_SUBSET ? k : iodesc->rfrom[k];
+
+            if (iodesc->rcount[k] > 0 && shm->node_rank[from] >= 0)
+            {
+                shm->npeers++;
+                nelem += iodesc->rcount[k];
+            }
+        }
+    }
+    LOG((2, "create_rearr_shm node_size = %d npeers = %d nelem = %d", node_size,
+         shm->npeers, nelem));
+
+    niotasks = iodesc->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
+    if (!(reqs = malloc((niotasks + shm->npeers) * sizeof(MPI_Request))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+    if (shm->npeers)
+    {
+        int peer_of[iodesc->nrecvs];
+        int fill[shm->npeers];
+        int p = 0;
+        int off = 0;
+
+        if (!(shm->peer = malloc(shm->npeers * sizeof(int))) ||
+            !(shm->peer_ndof = malloc(shm->npeers * sizeof(int))) ||
+            !(shm->peer_nruns = malloc(shm->npeers * sizeof(int))) ||
+            !(shm->peer_base = calloc(shm->npeers, sizeof(void *))) ||
+            !(shm->sidx = malloc(nelem * sizeof(PIO_Offset))) ||
+            !(shm->ridx = malloc(nelem * sizeof(PIO_Offset))))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+        /* The box rearranger keeps rindex in blocks, one per
+         * sender. The subset rearranger gives the sender of each
+         * run of its buffer in rfrom. */
+        for (int k = 0, roff = 0; k < iodesc->nrecvs; roff += iodesc->rcount[k], k++)
+        {
+            int from = iodesc->rearranger == PIO_REARR_SUBSET ? k : iodesc->rfrom[k];
+
+            peer_of[k] = -1;
+            if (iodesc->rcount[k] > 0 && shm->node_rank[from] >= 0)
+            {
+                shm->peer[p] = shm->node_rank[from];
+                shm->peer_ndof[p] = node_ndof[shm->node_rank[from]];
+                shm->peer_nruns[p] = iodesc->rcount[k];
+                fill[p] = off;
+                if (iodesc->rearranger == PIO_REARR_BOX)
+                    memcpy(shm->ridx + off, iodesc->rindex + roff,
+                           iodesc->rcount[k] * sizeof(PIO_Offset));
+                if ((mpierr = MPI_Irecv(shm->sidx + off, iodesc->rcount[k], PIO_OFFSET,
+                                        shm->peer[p], 0, shm->node_comm, &reqs[nreqs++])))
+                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+                peer_of[k] = p++;
+                off += iodesc->rcount[k];
+            }
+        }
+
+        if (iodesc->rearranger == PIO_REARR_SUBSET)
+            for (int r = 0, pos = 0; r < iodesc->nrfrom; pos += iodesc->rfromlen[r], r++)
+                if ((p = peer_of[iodesc->rfrom[r]]) >= 0)
+                    for (int j = 0; j < iodesc->rfromlen[r]; j++)
+                        shm->ridx[fill[p]++] = pos + j;
+    }
+
+    /* Send each IO task on this node the part of sindex that goes to
+     * it, and mark the elements it reads. */
+    for (int i = 0; i < niotasks; i++)
+    {
+        int io_comprank = iodesc->rearranger == PIO_REARR_SUBSET ? 0 : ios->ioranks[i];
+
+        if (iodesc->scount[i] > 0 && shm->node_rank[io_comprank] >= 0)
+        {
+            if (!shm->copy_out && !(needed = calloc(iodesc->ndof, 1)))
+                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+            shm->copy_out = 1;
+            for (int j = 0; j < iodesc->scount[i]; j++)
+                needed[iodesc->sindex[spos + j]] = 1;
+            if ((mpierr = MPI_Isend(iodesc->sindex + spos, iodesc->scount[i], PIO_OFFSET,
+                                    shm->node_rank[io_comprank], 0, shm->node_comm,
+                                    &reqs[nreqs++])))
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        }
+        spos += iodesc->scount[i];
+    }
+
+    /* Only the runs of marked elements are copied into the window. */
+    if (shm->copy_out)
+    {
+        for (int j = 0; j < iodesc->ndof; j++)
+            if (needed[j] && (!j || !needed[j - 1]))
+                shm->nput++;
+        if (!(shm->put_start = malloc(shm->nput * sizeof(PIO_Offset))) ||
+            !(shm->put_len = malloc(shm->nput * sizeof(PIO_Offset))))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        for (int j = 0, r = -1; j < iodesc->ndof; j++)
+            if (needed[j])
+            {
+                if (!j || !needed[j - 1])
+                {
+                    shm->put_start[++r] = j;
+                    shm->put_len[r] = 0;
+                }
+                shm->put_len[r]++;
+            }
+        free(needed);
+    }
+
+    if ((mpierr = MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    free(reqs);
+
+    /* Merge the elements each IO task gathers into runs that are
+     * contiguous on both sides, so each run is copied at once. */
+    if (shm->npeers)
+    {
+        int nruns = 0;
+
+        if (!(shm->rlen = malloc(nelem * sizeof(PIO_Offset))))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        for (int p = 0, off = 0; p < shm->npeers; p++)
+        {
+            int count = shm->peer_nruns[p];
+
+            shm->peer_nruns[p] = 0;
+            for (int j = off; j < off + count; j++)
+            {
+                if (shm->peer_nruns[p] && shm->sidx[j] == shm->sidx[nruns - 1] + shm->rlen[nruns - 1] &&
+                    shm->ridx[j] == shm->ridx[nruns - 1] + shm->rlen[nruns - 1])
+                {
+                    shm->rlen[nruns - 1]++;
+                    continue;
+                }
+                shm->sidx[nruns] = shm->sidx[j];
+                shm->ridx[nruns] = shm->ridx[j];
+                shm->rlen[nruns++] = 1;
+                shm->peer_nruns[p]++;
+            }
+            off += count;
+        }
+        LOG((2, "create_rearr_shm %d elements in %d runs", nelem, nruns));
+    }
+
+    /* The window and the barriers are only needed on nodes where some
+     * data moves through shared memory. */
+    active = shm->copy_out || shm->npeers;
+    if ((mpierr = MPI_Allreduce(&active, &shm->active, 1, MPI_INT, MPI_LOR, shm->node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (!shm->active)
+        if ((mpierr = MPI_Comm_free(&shm->node_comm)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+#endif /* MPI_SERIAL */
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free the shared memory state of a decomposition, including the
+ * window and the node communicator. It is not an error to call this
+ * when there is no shared memory state.
+ *
+ * This function is collective over the tasks of the node
+ * communicator.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int free_rearr_shm(io_desc_t *iodesc)
+{
+    rearr_shm_t *shm;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc, "invalid input", __FILE__, __LINE__);
+
+    if (!(shm = iodesc->shm))
+        return PIO_NOERR;
+
+    if (shm->nvars)
+    {
+        if ((mpierr = MPI_Win_unlock_all(shm->win)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Win_free(&shm->win)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
+    if (shm->node_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&shm->node_comm)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    free(shm->node_rank);
+    free(shm->peer);
+    free(shm->peer_ndof);
+    free(shm->peer_nruns);
+    free(shm->peer_base);
+    free(shm->put_start);
+    free(shm->put_len);
+    free(shm->sidx);
+    free(shm->ridx);
+    free(shm->rlen);
+    free(shm);
+    iodesc->shm = NULL;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Make sure the shared memory window has room for nvars
+ * variables. The segment of each compute task holds all of its data
+ * for nvars variables. The window only grows, and a new one is only
+ * allocated when more variables are moved than before.
+ *
+ * This function is collective over the tasks of the node
+ * communicator, so all of them must pass the same nvars.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int set_rearr_shm_window(io_desc_t *iodesc, int nvars)
+{
+#ifdef MPI_SERIAL
+    return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+#else
+    rearr_shm_t *shm;
+    MPI_Aint size;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc && iodesc->shm && iodesc->shm->active && nvars > 0, "invalid input",
+              __FILE__, __LINE__);
+    shm = iodesc->shm;
+
+    if (nvars <= shm->nvars)
+        return PIO_NOERR;
+    LOG((2, "set_rearr_shm_window nvars = %d shm->nvars = %d", nvars, shm->nvars));
+
+    if (shm->nvars)
+    {
+        if ((mpierr = MPI_Win_unlock_all(shm->win)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Win_free(&shm->win)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        shm->nvars = 0;
+    }
+
+    size = shm->copy_out ? (MPI_Aint)nvars * iodesc->ndof * iodesc->basetype_size : 0;
+    if ((mpierr = MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, shm->node_comm, &shm->base,
+                                          &shm->win)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* The window stays in a passive target epoch. Access is ordered
+     * with MPI_Win_sync() and barriers. */
+    if ((mpierr = MPI_Win_lock_all(MPI_MODE_NOCHECK, shm->win)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    for (int p = 0; p < shm->npeers; p++)
+    {
+        MPI_Aint peer_size;
+        int disp_unit;
+
+        if ((mpierr = MPI_Win_shared_query(shm->win, shm->peer[p], &peer_size, &disp_unit,
+                                           &shm->peer_base[p])))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
+    shm->nvars = nvars;
+
+    return PIO_NOERR;
+#endif /* MPI_SERIAL */
+}
+
+/**
+ * First half of the shared memory path of rearrange_comp2io(). Each
+ * compute task copies the runs of its data that IO tasks on its node
+ * read into its segment of the window, and waits for the other tasks
+ * on the node to do the same.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_shm_put(io_desc_t *iodesc, void *sbuf, int nvars)
+{
+#ifdef MPI_SERIAL
+    return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+#else
+    rearr_shm_t *shm;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc && iodesc->shm && iodesc->shm->nvars >= nvars, "invalid input",
+              __FILE__, __LINE__);
+    shm = iodesc->shm;
+
+    if (shm->copy_out && sbuf)
+    {
+        size_t bsize = iodesc->basetype_size;
+
+        for (int v = 0; v < nvars; v++)
+        {
+            size_t voff = (size_t)v * iodesc->ndof * bsize;
+
+            for (int r = 0; r < shm->nput; r++)
+                memcpy((char *)shm->base + voff + shm->put_start[r] * bsize,
+                       (char *)sbuf + voff + shm->put_start[r] * bsize,
+                       shm->put_len[r] * bsize);
+        }
+    }
+
+    if ((mpierr = MPI_Win_sync(shm->win)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Barrier(shm->node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Win_sync(shm->win)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+#endif /* MPI_SERIAL */
+}
+
+/**
+ * Second half of the shared memory path of rearrange_comp2io(). IO
+ * tasks gather the data of the compute tasks on their node directly
+ * from the window, one run of contiguous elements at a time. Compute tasks wait until this is done before
+ * their segments can be written again.
+ *
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearr_shm_get(io_desc_t *iodesc, void *rbuf, int nvars)
+{
+#ifdef MPI_SERIAL
+    return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+#else
+    rearr_shm_t *shm;
+    size_t bsize;
+    int off = 0;
+    int mpierr; /* Return code from MPI calls. */
+
+    pioassert(iodesc && iodesc->shm && iodesc->shm->nvars >= nvars, "invalid input",
+              __FILE__, __LINE__);
+    shm = iodesc->shm;
+    bsize = iodesc->basetype_size;
+
+    for (int p = 0; p < shm->npeers; p++)
+    {
+        for (int v = 0; v < nvars; v++)
+        {
+            char *dst = (char *)rbuf + (size_t)v * iodesc->llen * bsize;
+            char *src = (char *)shm->peer_base[p] + (size_t)v * shm->peer_ndof[p] * bsize;
+            const PIO_Offset *sidx = shm->sidx + off;
+            const PIO_Offset *ridx = shm->ridx + off;
+            const PIO_Offset *rlen = shm->rlen + off;
+
+            for (int r = 0; r < shm->peer_nruns[p]; r++)
+                memcpy(dst + ridx[r] * bsize, src + sidx[r] * bsize, rlen[r] * bsize);
+        }
+        off += shm->peer_nruns[p];
+    }
+
+    if ((mpierr = MPI_Barrier(shm->node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+#endif /* MPI_SERIAL */
+}
+
+/**
+ * Get ready to move data from compute tasks to IO tasks. This defines
+ * the MPI data types of the decomposition, sets up or frees the
+ * shared memory path, and builds the communication plan for nvars
+ * variables. Used by rearrange_comp2io() and
+ * rearrange_comp2io_start().
+ *
+ * The communication plan is built on the first call and kept in
+ * iodesc->comp2io_plan. Later calls only rebuild the derived types
+ * when the number of variables changes.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param nvars number of variables.
+ * @param comm pointer that gets the communicator the data is
+ * transferred over.
+ * @returns 0 on success, error code otherwise.
+ */
+int setup_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, int nvars,
+                  MPI_Comm *comm)
+{
+    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    int ret;
+
+    /* Caller must provide these. */
+    pioassert(ios && iodesc && nvars > 0 && comm, "invalid input", __FILE__, __LINE__);
+
+    /* Different rearraangers use different communicators. */
+    if (iodesc->rearranger == PIO_REARR_BOX)
+        mycomm = ios->union_comm;
+    else
+        mycomm = iodesc->subset_comm;
+    *comm = mycomm;
+
+    /* If it has not already been done, define the MPI data types that
+     * will be used for this io_desc_t. */
+    if ((ret = define_iodesc_datatypes(ios, iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The counts in the plan depend on whether there is a send
+     * buffer. If that has changed, start over. */
+    if (iodesc->comp2io_plan && iodesc->comp2io_plan->have_sbuf != (sbuf != NULL))
+        if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Pairs of tasks that use shared memory are left out of the
+     * plan, so it is built again when shared memory is turned on or
+     * off. */
+    if (ios->rearr_shm != (iodesc->shm != NULL))
+    {
+        if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if (ios->rearr_shm)
+            ret = create_rearr_shm(ios, iodesc, mycomm);
+        else
+            ret = free_rearr_shm(iodesc);
+        if (ret)
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+
+    if (!iodesc->comp2io_plan)
+        if ((ret = create_comp2io_plan(ios, iodesc, mycomm, sbuf != NULL)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The derived types depend on the number of variables. */
+    if (iodesc->comp2io_plan->nvars != nvars)
+        if ((ret = set_comp2io_plan_types(ios, iodesc, iodesc->comp2io_plan, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Make room for the data in shared memory. */
+    if (iodesc->shm && iodesc->shm->active)
+        if ((ret = set_rearr_shm_window(iodesc, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Moves data from compute tasks to IO tasks. This is called from
+ * PIOc_write_darray_multi().
+ *
+ * If ios->rearr_shm is set, compute tasks on the same node as an IO
+ * task they send to pass their data through shared memory instead of
+ * a message (see create_rearr_shm()).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                      void *rbuf, int nvars)
+{
+    MPI_Comm mycomm;  /* Communicator that data is transferred over. */
+    int ret;
+
+#ifdef TIMING
+    GPTLstart("PIO:rearrange_comp2io");
+#endif
+
+    /* Caller must provide these. */
+    pioassert(ios && iodesc && nvars > 0, "invalid input", __FILE__, __LINE__);
+
+    LOG((1, "rearrange_comp2io nvars = %d iodesc->rearranger = %d", nvars,
+         iodesc->rearranger));
+
+    if ((ret = setup_comp2io(ios, iodesc, sbuf, nvars, &mycomm)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Data in sbuf on the compute nodes is copied to shared memory
+     * for the IO tasks on the same node. */
+    if (iodesc->shm && iodesc->shm->active)
+        if ((ret = rearr_shm_put(iodesc, sbuf, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Data in sbuf on the compute nodes is sent to rbuf on the ionodes */
+    LOG((2, "about to exchange data for sbuf"));
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR)
+    {
+        if (!iodesc->neighbors)
+            if ((ret = create_neighbor_comm(ios, iodesc)))
+                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if ((ret = rearr_neighbor_exchange(iodesc, iodesc->comp2io_plan, sbuf, rbuf)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    else if ((ret = rearr_comm_plan_exchange(iodesc->comp2io_plan, sbuf, rbuf, mycomm,
+                                             &iodesc->rearr_opts.comp2io)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* IO tasks gather the data of the compute tasks on their node. */
+    if (iodesc->shm && iodesc->shm->active)
+        if ((ret = rearr_shm_get(iodesc, rbuf, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+#ifdef TIMING
+    GPTLstop("PIO:rearrange_comp2io");
+#endif
+
+    return PIO_NOERR;
+}
+
+/**
+ * Cancel the requests of rearrange_comp2io_start() after a failure,
+ * and wait for them, so that their buffers may be freed. The array
+ * of requests is freed.
+ *
+ * @param nreqs pointer to the number of requests, which gets 0.
+ * @param reqs pointer to the array of requests, which gets NULL.
+ */
+static void cancel_comp2io_start(int *nreqs, MPI_Request **reqs)
+{
+    for (int r = 0; r < *nreqs; r++)
+        if ((*reqs)[r] != MPI_REQUEST_NULL)
+            MPI_Cancel(&(*reqs)[r]);
+    MPI_Waitall(*nreqs, *reqs, MPI_STATUSES_IGNORE);
+    free(*reqs);
+    *reqs = NULL;
+    *nreqs = 0;
+}
+
+/**
+ * Start moving data from compute tasks to IO tasks without waiting
+ * for it to arrive. This is called from PIOc_iwrite_darray(). The
+ * caller must complete the returned requests (with MPI_Waitall())
+ * before using rbuf, and must not change sbuf until then.
+ *
+ * The data is moved with nonblocking point-to-point messages on
+ * iodesc->iwrite_comm, a duplicate of the communicator of the
+ * rearranger, whatever the comm type and flow control options of the
+ * decomposition. Only the communication plan is shared with
+ * rearrange_comp2io(). Data that goes through shared memory is moved
+ * before this function returns.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @param nreqs pointer that gets the number of requests.
+ * @param reqs pointer that gets an array (length nreqs) of
+ * requests. Must be freed by the caller. On error, no requests are
+ * left in flight, and this gets NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_comp2io_start(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                            void *rbuf, int nvars, int *nreqs, MPI_Request **reqs)
+{
+    rearr_comm_plan_t *plan;
+    MPI_Comm mycomm;  /* Communicator of the rearranger. */
+    int n = 0;
+    int mpierr; /* Return code from MPI calls. */
+    int ret;
+
+    pioassert(ios && iodesc && nvars > 0 && nreqs && reqs, "invalid input",
+              __FILE__, __LINE__);
+    LOG((1, "rearrange_comp2io_start nvars = %d iodesc->rearranger = %d", nvars,
+         iodesc->rearranger));
+
+    if ((ret = setup_comp2io(ios, iodesc, sbuf, nvars, &mycomm)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    plan = iodesc->comp2io_plan;
+
+    if (iodesc->iwrite_comm == MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_dup(mycomm, &iodesc->iwrite_comm)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    if (iodesc->shm && iodesc->shm->active)
+        if ((ret = rearr_shm_put(iodesc, sbuf, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    for (int p = 0; p < plan->ntasks; p++)
+        n += (plan->recvcounts[p] > 0) + (plan->sendcounts[p] > 0);
+    if (!(*reqs = malloc(max(n, 1) * sizeof(MPI_Request))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    *nreqs = 0;
+
+    /* Post the receives first. The derived types may be freed (when
+     * nvars changes) while the messages are in flight, which MPI
+     * allows. */
+    for (int p = 0; p < plan->ntasks; p++)
+        if (plan->recvcounts[p] > 0)
+            if ((mpierr = MPI_Irecv((char *)rbuf + plan->rdispls[p], plan->recvcounts[p],
+                                    plan->recvtypes[p], p, 0, iodesc->iwrite_comm,
+                                    &(*reqs)[(*nreqs)++])))
+            {
+                (*nreqs)--;
+                cancel_comp2io_start(nreqs, reqs);
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            }
+    for (int p = 0; p < plan->ntasks; p++)
+        if (plan->sendcounts[p] > 0)
+            if ((mpierr = MPI_Isend((char *)sbuf + plan->sdispls[p], plan->sendcounts[p],
+                                    plan->sendtypes[p], p, 0, iodesc->iwrite_comm,
+                                    &(*reqs)[(*nreqs)++])))
+            {
+                (*nreqs)--;
+                cancel_comp2io_start(nreqs, reqs);
+                return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+            }
+    LOG((2, "rearrange_comp2io_start posted %d requests", *nreqs));
+
+    /* IO tasks gather the data of the compute tasks on their node. */
+    if (iodesc->shm && iodesc->shm->active)
+        if ((ret = rearr_shm_get(iodesc, rbuf, nvars)))
+        {
+            cancel_comp2io_start(nreqs, reqs);
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Moves data from IO tasks to compute tasks. This function is used in
+ * PIOc_read_darray_multi().
+ *
+ * The communication plan is built on the first call and kept in
+ * iodesc->io2comp_plan. The data of all nvars variables is moved in
+ * one exchange.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer, nvars arrays of iodesc->llen elements.
+ * @param rbuf receive buffer, nvars arrays of iodesc->ndof elements.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_io2comp(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                      void *rbuf, int nvars)
+{
+    MPI_Comm mycomm;
+    int ret;
+
+    /* Check inputs. */
+    pioassert(ios && iodesc && nvars > 0, "invalid input", __FILE__, __LINE__);
+
+#ifdef TIMING
+    GPTLstart("PIO:rearrange_io2comp");
+#endif
+
+    /* Different rearrangers use different communicators. */
+    if (iodesc->rearranger == PIO_REARR_BOX)
+        mycomm = ios->union_comm;
+    else
+        mycomm = iodesc->subset_comm;
+
+    /* Define the MPI data types that will be used for this
+     * io_desc_t. */
+    if ((ret = define_iodesc_datatypes(ios, iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The subset rearranger only sends when there is a send
+     * buffer. If that has changed, start over. */
+    if (iodesc->io2comp_plan && iodesc->io2comp_plan->have_sbuf != (sbuf != NULL))
+        if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    if (!iodesc->io2comp_plan)
+        if ((ret = create_io2comp_plan(ios, iodesc, mycomm, sbuf != NULL)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The types depend on the number of variables. */
+    if (iodesc->io2comp_plan->nvars != nvars)
+        if ((ret = set_io2comp_plan_types(ios, iodesc, iodesc->io2comp_plan, nvars)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Data in sbuf on the ionodes is sent to rbuf on the compute nodes */
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR)
+    {
+        if (!iodesc->neighbors)
+            if ((ret = create_neighbor_comm(ios, iodesc)))
+                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if ((ret = rearr_neighbor_exchange(iodesc, iodesc->io2comp_plan, sbuf, rbuf)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    else if ((ret = rearr_comm_plan_exchange(iodesc->io2comp_plan, sbuf, rbuf, mycomm,
+                                             &iodesc->rearr_opts.io2comp)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+#ifdef TIMING
+    GPTLstop("PIO:rearrange_io2comp");
+#endif
+
+    return PIO_NOERR;
+}
+
+/**
+ * Determine whether fill values are needed. This function compares
+ * how much data we have to how much data is in a record (or
+ * non-record var). If we have enough data to completely fill the
+ * variable, then fill is not needed.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param gdimlen pointer to an array length iodesc->ndims with the
+ * global array sizes for one record (for record vars) or for the
+ * entire var (for non-record vars).
+ * @param compmap only used for the box communicator.
+ * @returns 0 on success, error code otherwise.
+ */
+int determine_fill(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
+                   const PIO_Offset *compmap)
+{
+    PIO_Offset totalllen = 0;
+    PIO_Offset totalgridsize = 1;
+    int mpierr; /* Return code from MPI calls. */
 
     /* Check inputs. */
     pioassert(ios && iodesc && gdimlen && compmap, "invalid input",
@@ -1117,6 +2301,84 @@ int determine_fill(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
     return PIO_NOERR;
 }
 
+/**
+ * Compare the start of two IO task boxes in the first dimension. This
+ * function is passed to qsort.
+ *
+ * @param a pointer to an iobox_index.
+ * @param b pointer to another iobox_index.
+ * @returns -1, 0 or 1 as the start of a is less, equal or greater.
+ */
+int compare_iobox(const void *a, const void *b)
+{
+    const iobox_index *x = a;
+    const iobox_index *y = b;
+
+    if (x->start0 < y->start0)
+        return -1;
+    if (x->start0 > y->start0)
+        return 1;
+    return x->ioproc - y->ioproc;
+}
+
+/**
+ * Is a point of the global array inside a box?
+ *
+ * @param ndims the number of dimensions.
+ * @param box array of length 2 * ndims, with the start followed by
+ * the count of the box.
+ * @param gcoord array of length ndims with the coordinates of the
+ * point.
+ * @returns true if the box contains the point.
+ */
+bool box_contains(int ndims, const PIO_Offset *box, const PIO_Offset *gcoord)
+{
+    for (int d = 0; d < ndims; d++)
+        if (gcoord[d] < box[d] || gcoord[d] >= box[d] + box[ndims + d])
+            return false;
+    return true;
+}
+
+/**
+ * Find the IO task whose box holds a point of the global array. The
+ * index is sorted by the start of the boxes in the first
+ * dimension. A binary search finds the last box starting at or before
+ * the point, then earlier boxes are checked until none of them can
+ * reach the point (maxend0 is the largest end of all boxes up to and
+ * including that one).
+ *
+ * @param ndims the number of dimensions.
+ * @param gcoord array of length ndims with the coordinates of the
+ * point.
+ * @param nboxes the number of entries in boxindex.
+ * @param boxindex the sorted index.
+ * @param ioboxes array with llen, start and count of each IO task,
+ * 1 + 2 * ndims values per IO task.
+ * @returns the IO task (index into ios->ioranks), or -1 if no box
+ * holds the point.
+ */
+int find_iobox(int ndims, const PIO_Offset *gcoord, int nboxes, const iobox_index *boxindex,
+               const PIO_Offset *ioboxes)
+{
+    int lo = 0, hi = nboxes;
+
+    /* Find the first box that starts after the point. */
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (boxindex[mid].start0 <= gcoord[0])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (int b = lo - 1; b >= 0 && boxindex[b].maxend0 > gcoord[0]; b--)
+        if (box_contains(ndims, &ioboxes[boxindex[b].ioproc * (1 + 2 * ndims) + 1], gcoord))
+            return boxindex[b].ioproc;
+
+    return -1;
+}
+
 /**
  * The box rearranger computes a mapping between IO tasks and compute
  * tasks such that the data on IO tasks can be written with a single
@@ -1137,9 +2399,10 @@ int determine_fill(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
  * <ul>
  * <li>For IO tasks, determines llen.
  * <li>Determine whether fill values will be needed.
- * <li>Do an allgether of llen values into array iomaplen.
- * <li>For each IO task, send starts/counts to all compute tasks.
- * <li>Find dest_ioindex and dest_ioproc for each element in the map.
+ * <li>Allgather the llen, start and count of all IO tasks.
+ * <li>Find dest_ioindex and dest_ioproc for each element in the map,
+ * using an index of the IO task boxes sorted by their start in the
+ * first dimension.
  * <li>Call compute_counts().
  * <li>On IO tasks, compute the max IO buffer size.
  * <li>Call compute_maxaggregate_bytes().
@@ -1171,12 +2434,15 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     /* Allocate arrays needed for this function. */
     int dest_ioproc[maplen]; /* Destination IO task for each data element on compute task. */
     PIO_Offset dest_ioindex[maplen];    /* Offset into IO task array for each data element. */
-    int sendcounts[ios->num_uniontasks]; /* Send counts for swapm call. */
-    int sdispls[ios->num_uniontasks];    /* Send displacements for swapm. */
-    int recvcounts[ios->num_uniontasks]; /* Receive counts for swapm. */
-    int rdispls[ios->num_uniontasks];    /* Receive displacements for swapm. */
-    MPI_Datatype dtypes[ios->num_uniontasks]; /* Array of MPI_OFFSET types for swapm. */
-    PIO_Offset iomaplen[ios->num_iotasks];   /* Gets the llen of all IO tasks. */
+    int recvcounts[ios->num_uniontasks]; /* Receive counts for allgatherv. */
+    int rdispls[ios->num_uniontasks];    /* Receive displacements for allgatherv. */
+    int boxlen = 1 + 2 * ndims;          /* Length of llen, start and count of a box. */
+    PIO_Offset mybox[boxlen];            /* Box of this IO task. */
+    PIO_Offset ioboxes[ios->num_iotasks * boxlen]; /* Boxes of all IO tasks. */
+    iobox_index boxindex[max(ios->num_iotasks, 1)]; /* Sorted IO tasks that hold data. */
+    int nboxes = 0;                      /* Number of IO tasks that hold data. */
+    int lastio = -1;                     /* IO task of the last element found. */
+    int mpierr; /* Return code from MPI calls. */
 
     /* This is the box rearranger. */
     iodesc->rearranger = PIO_REARR_BOX;
@@ -1191,32 +2457,20 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
         dest_ioindex[i] = -1;
     }
 
-    /* Initialize arrays used in swapm. */
+    /* Initialize arrays used in allgatherv. */
     for (int i = 0; i < ios->num_uniontasks; i++)
     {
-        sendcounts[i] = 0;
-        sdispls[i] = 0;
         recvcounts[i] = 0;
         rdispls[i] = 0;
-        dtypes[i] = MPI_OFFSET;
     }
 
     /* For IO tasks, determine llen, the length of the data array on
-     * the IO task. For computation tasks, llen will remain at 0. Also
-     * set up arrays for the allgather which will give every IO task a
-     * complete list of llens for each IO task. */
+     * the IO task. For computation tasks, llen will remain at 0. */
     LOG((3, "ios->ioproc = %d ios->num_uniontasks = %d", ios->ioproc,
          ios->num_uniontasks));
     pioassert(iodesc->llen == 0, "error", __FILE__, __LINE__);
     if (ios->ioproc)
     {
-        /* Set up send counts for sending llen in all to all
-         * gather. We are sending to all tasks, IO and computation. */
-        for (int i = 0; i < ios->num_comptasks; i++)
-            sendcounts[ios->compranks[i]] = 1;
-        for (int i = 0; i < ios->num_iotasks; i++)
-            sendcounts[ios->ioranks[i]] = 1;
-
         /* Determine llen, the lenght of the data array on this IO
          * node, by multipliying the counts in the
          * iodesc->firstregion. */
@@ -1236,196 +2490,638 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     LOG((2, "iodesc->needsfill = %d ios->num_iotasks = %d", iodesc->needsfill,
          ios->num_iotasks));
 
-    /* Set up receive counts and displacements to for an AllToAll
-     * gather of llen. */
+    /* Gather the llen, start and count of every IO task to all
+     * tasks in one collective. Only IO tasks contribute, and their
+     * boxes arrive in IO task order. */
+    for (int i = 0; i < ios->num_iotasks; i++)
+    {
+        recvcounts[ios->ioranks[i]] = boxlen;
+        rdispls[ios->ioranks[i]] = i * boxlen;
+    }
+    if (ios->ioproc)
+    {
+        mybox[0] = iodesc->llen;
+        for (int d = 0; d < ndims; d++)
+        {
+            mybox[1 + d] = iodesc->firstregion->start[d];
+            mybox[1 + ndims + d] = iodesc->firstregion->count[d];
+        }
+    }
+    LOG((3, "gathering IO task boxes, boxlen = %d", boxlen));
+    if ((mpierr = MPI_Allgatherv(mybox, ios->ioproc ? boxlen : 0, MPI_OFFSET, ioboxes,
+                                 recvcounts, rdispls, MPI_OFFSET, ios->union_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Index the IO tasks that hold data by the start of their box in
+     * the first dimension. */
     for (int i = 0; i < ios->num_iotasks; i++)
     {
-        recvcounts[ios->ioranks[i]] = 1;
-        rdispls[ios->ioranks[i]] = i * SIZEOF_MPI_OFFSET;
-        LOG((3, "i = %d ios->ioranks[%d] = %d recvcounts[%d] = %d rdispls[%d] = %d",
-             i, i, ios->ioranks[i], ios->ioranks[i], recvcounts[ios->ioranks[i]],
-             ios->ioranks[i], rdispls[ios->ioranks[i]]));
+        LOG((3, "iomaplen[%d] = %d", i, ioboxes[i * boxlen]));
+        if (ioboxes[i * boxlen] > 0)
+        {
+            boxindex[nboxes].ioproc = i;
+            boxindex[nboxes].start0 = ioboxes[i * boxlen + 1];
+            boxindex[nboxes].maxend0 = ioboxes[i * boxlen + 1] + ioboxes[i * boxlen + 1 + ndims];
+            nboxes++;
+        }
+    }
+    qsort(boxindex, nboxes, sizeof(iobox_index), compare_iobox);
+    for (int b = 1; b < nboxes; b++)
+        boxindex[b].maxend0 = max(boxindex[b].maxend0, boxindex[b - 1].maxend0);
+
+    /* For each element of the data array on the compute task, find
+     * the IO task to send the data element to, and its offset into
+     * the IO task data array. */
+    for (int k = 0; k < maplen; k++)
+    {
+        PIO_Offset gcoord[ndims], lcoord[ndims];
+        PIO_Offset *start, *count;
+
+        if (compmap[k] <= 0)
+            continue;
+
+        /* The compmap array is 1 based but calculations are 0 based */
+        idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord);
+
+        /* Neighboring elements usually go to the same IO task, so
+         * try the last one found before searching the index. */
+        if (lastio < 0 || !box_contains(ndims, &ioboxes[lastio * boxlen + 1], gcoord))
+            lastio = find_iobox(ndims, gcoord, nboxes, boxindex, ioboxes);
+
+        /* Did we find a destination IO task for this element of the
+         * computation task data array? If so, remember the
+         * destination IO task, and determine the index for that
+         * element in the IO task data. */
+        if (lastio >= 0)
+        {
+            start = &ioboxes[lastio * boxlen + 1];
+            count = &ioboxes[lastio * boxlen + 1 + ndims];
+            for (int d = 0; d < ndims; d++)
+                lcoord[d] = gcoord[d] - start[d];
+            dest_ioindex[k] = coord_to_lindex(ndims, lcoord, count);
+            dest_ioproc[k] = lastio;
+            LOG((3, "found dest_ioindex[%d] = %d dest_ioproc[%d] = %d", k, dest_ioindex[k],
+                 k, dest_ioproc[k]));
+        }
+    }
+
+    /* Check that a destination is found for each compmap entry. */
+    for (int k = 0; k < maplen; k++)
+        if (dest_ioproc[k] < 0 && compmap[k] > 0)
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Completes the mapping for the box rearranger. */
+    LOG((2, "calling compute_counts maplen = %d", maplen));
+    if ((ret = compute_counts(ios, iodesc, dest_ioproc, dest_ioindex)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Compute the max io buffer size needed for an iodesc. */
+    if (ios->ioproc)
+    {
+        if ((ret = compute_maxIObuffersize(ios->io_comm, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        LOG((3, "iodesc->maxiobuflen = %d", iodesc->maxiobuflen));
+    }
+
+    /* Using maxiobuflen compute the maximum number of bytes that the
+     * io task buffer can handle. */
+    if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    LOG((3, "iodesc->maxbytes = %d", iodesc->maxbytes));
+
+    /* The communication pattern is now known, so the graph
+     * communicator for neighborhood collectives can be built. */
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR)
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Compare offsets is used by the sort in the subset rearranger. This
+ * function is passed to qsort.
+ *
+ * @param a pointer to an offset.
+ * @param b pointer to another offset.
+ * @returns 0 if offsets are the same or either pointer is NULL.
+ */
+int compare_offsets(const void *a, const void *b)
+{
+    mapsort *x = (mapsort *)a;
+    mapsort *y = (mapsort *)b;
+    if (!x || !y)
+        return 0;
+    return (int)(x->iomap - y->iomap);
+}
+
+/**
+ * Compare two map runs by their offset in the file. This function
+ * is passed to qsort.
+ *
+ * @param a pointer to a maprun.
+ * @param b pointer to another maprun.
+ * @returns -1, 0 or 1 as a starts before, with, or after b.
+ */
+int compare_map_runs(const void *a, const void *b)
+{
+    const maprun *x = (const maprun *)a;
+    const maprun *y = (const maprun *)b;
+
+    if (x->iomap < y->iomap)
+        return -1;
+    return x->iomap > y->iomap;
+}
+
+/**
+ * Sort map runs by their offset in the file. Long lists get a least
+ * significant digit radix sort on the offset, one byte per pass, with
+ * passes skipped for the bytes that are the same in every key.
+ *
+ * @param nruns the number of runs.
+ * @param runs array (length nruns) of runs, sorted in place.
+ * @returns 0 on success, error code otherwise.
+ */
+int sort_map_runs(int nruns, maprun *runs)
+{
+    maprun *tmp;
+    maprun *src = runs;
+    maprun *dst;
+    PIO_Offset minkey, maxkey;
+    size_t count[256];
+
+    pioassert(nruns >= 0 && (runs || !nruns), "invalid input", __FILE__, __LINE__);
+
+    if (nruns < RADIX_SORT_MIN)
+    {
+        qsort(runs, nruns, sizeof(maprun), compare_map_runs);
+        return PIO_NOERR;
+    }
+
+    if (!(tmp = malloc(nruns * sizeof(maprun))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    dst = tmp;
+
+    minkey = maxkey = runs[0].iomap;
+    for (int i = 1; i < nruns; i++)
+    {
+        if (runs[i].iomap < minkey)
+            minkey = runs[i].iomap;
+        if (runs[i].iomap > maxkey)
+            maxkey = runs[i].iomap;
+    }
+
+    /* Sort on key - minkey, so only the bytes that vary are used. */
+    for (int shift = 0; shift < 64 && ((unsigned long long)(maxkey - minkey) >> shift);
+         shift += 8)
+    {
+        size_t pos = 0;
+
+        memset(count, 0, sizeof(count));
+        for (int i = 0; i < nruns; i++)
+            count[((unsigned long long)(src[i].iomap - minkey) >> shift) & 0xff]++;
+        for (int b = 0; b < 256; b++)
+        {
+            size_t c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (int i = 0; i < nruns; i++)
+            dst[count[((unsigned long long)(src[i].iomap - minkey) >> shift) & 0xff]++] = src[i];
+
+        maprun *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != runs)
+        memcpy(runs, src, nruns * sizeof(maprun));
+    free(tmp);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Compress the map of a compute task into runs for the subset
+ * rearranger. Holes (zeros) in the map are skipped. A run continues
+ * while both the local index and the file offset increase by one, so
+ * a task holding a slab of a structured grid sends one run per row
+ * instead of one offset per point.
+ *
+ * @param maplen the length of the map.
+ * @param compmap the 1-based map of this task.
+ * @param nruns pointer that gets the number of runs.
+ * @param runs pointer that gets an array of nruns runs, or NULL if
+ * there are none. Must be freed by caller.
+ * @returns 0 on success, error code otherwise.
+ */
+int get_map_runs(int maplen, const PIO_Offset *compmap, int *nruns, maprun **runs)
+{
+    int n = 0;
+    int prev = -1;
+
+    pioassert(maplen >= 0 && (compmap || !maplen) && nruns && runs, "invalid input",
+              __FILE__, __LINE__);
+
+    /* Count the runs. */
+    for (int i = 0; i < maplen; i++)
+    {
+        if (compmap[i] <= 0)
+            continue;
+        if (prev < 0 || prev != i - 1 || compmap[i] != compmap[prev] + 1)
+            n++;
+        prev = i;
+    }
+
+    *nruns = n;
+    *runs = NULL;
+    if (!n)
+        return PIO_NOERR;
+
+    if (!(*runs = malloc(n * sizeof(maprun))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+    /* Fill them in. */
+    n = -1;
+    prev = -1;
+    for (int i = 0; i < maplen; i++)
+    {
+        if (compmap[i] <= 0)
+            continue;
+        if (prev < 0 || prev != i - 1 || compmap[i] != compmap[prev] + 1)
+        {
+            n++;
+            (*runs)[n].soffset = i;
+            (*runs)[n].iomap = compmap[i];
+            (*runs)[n].len = 0;
+        }
+        (*runs)[n].len++;
+        prev = i;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Restore the heap property of a min-heap of tasks, keyed by the
+ * file offset of the next point of each task, from position i down.
+ *
+ * @param heap the heap of task numbers.
+ * @param nheap the number of tasks in the heap.
+ * @param key the file offset of the next point of each task.
+ * @param i the position to sift down from.
+ */
+static void sift_down_runs(int *heap, int nheap, const PIO_Offset *key, int i)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1;
+        int m = i;
+
+        if (l < nheap && key[heap[l]] < key[heap[m]])
+            m = l;
+        if (l + 1 < nheap && key[heap[l + 1]] < key[heap[m]])
+            m = l + 1;
+        if (m == i)
+            return;
+        int t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+/**
+ * Merge the map runs gathered from the tasks of a subset
+ * communicator into IO order. This replaces a sort of every map
+ * point: the runs of each task are sorted with sort_map_runs()
+ * (usually they already are in order), then merged with a heap of the
+ * next run of each task. A run is copied out in one piece unless a
+ * run of another task starts inside it, which only happens when maps
+ * repeat offsets.
+ *
+ * The output is a list of runs in IO order, which together cover the
+ * data of the IO task. Run k comes from task from[k], and its points
+ * are at out[k].soffset on that task and at out[k].iomap in the
+ * file.
+ *
+ * @param ntasks the number of tasks in the subset communicator.
+ * @param nruns array (length ntasks) of the number of runs from each
+ * task.
+ * @param runs the runs of all tasks, grouped by task. The runs of a
+ * task are sorted in place.
+ * @param noutp pointer that gets the number of runs in IO order.
+ * @param outp pointer that gets the array (length *noutp) of runs in
+ * IO order, or NULL if there are none. Must be freed by caller.
+ * @param fromp pointer that gets the array (length *noutp) of the
+ * task of each run, or NULL if there are none. Must be freed by
+ * caller.
+ * @returns 0 on success, error code otherwise.
+ */
+int merge_map_runs(int ntasks, const int *nruns, maprun *runs, int *noutp,
+                   maprun **outp, int **fromp)
+{
+    maprun *out = NULL;
+    int *from = NULL;
+    int nout = 0;
+    int size = 0;
+    int *heap;
+    int *next;       /* Next run of each task. */
+    int *end;        /* End of the runs of each task. */
+    PIO_Offset *pos; /* Points of the next run already copied out. */
+    PIO_Offset *key; /* File offset of the next point of each task. */
+    int nheap = 0;
+    int r = 0;
+    int nfail = 0;
+
+    pioassert(ntasks > 0 && nruns && noutp && outp && fromp, "invalid input",
+              __FILE__, __LINE__);
+
+    /* One allocation holds all the per-task arrays. */
+    if (!(pos = malloc(ntasks * (2 * sizeof(PIO_Offset) + 3 * sizeof(int)))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    key = pos + ntasks;
+    next = (int *)(key + ntasks);
+    end = next + ntasks;
+    heap = end + ntasks;
+
+    for (int t = 0; t < ntasks; t++)
+    {
+        next[t] = r;
+        r += nruns[t];
+        end[t] = r;
+    }
+
+    /* Sort the runs of each task. They are usually in order already.
+     * The tasks are independent, so they are shared among threads. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:nfail)
+#endif
+    for (int t = 0; t < ntasks; t++)
+    {
+        maprun *truns = runs + next[t];
+
+        for (int i = 1; i < nruns[t]; i++)
+            if (truns[i].iomap < truns[i - 1].iomap)
+            {
+                if (sort_map_runs(nruns[t], truns))
+                    nfail++;
+                break;
+            }
+    }
+    if (nfail)
+    {
+        free(pos);
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    }
+
+    for (int t = 0; t < ntasks; t++)
+    {
+        pos[t] = 0;
+        if (nruns[t])
+        {
+            key[t] = runs[next[t]].iomap;
+            heap[nheap++] = t;
+        }
+    }
+    for (int i = nheap / 2 - 1; i >= 0; i--)
+        sift_down_runs(heap, nheap, key, i);
+
+    while (nheap)
+    {
+        int t = heap[0];
+        maprun *run = &runs[next[t]];
+        PIO_Offset n = run->len - pos[t];
+
+        /* Copy up to where the next task starts, at least one point. */
+        if (nheap > 1)
+        {
+            PIO_Offset limit = key[heap[1]];
+
+            if (nheap > 2 && key[heap[2]] < limit)
+                limit = key[heap[2]];
+            if (limit - key[t] < n)
+                n = limit - key[t] > 0 ? limit - key[t] : 1;
+        }
+
+        /* Add the points to the last run out if they continue it,
+         * else start a new one. */
+        if (nout && from[nout - 1] == t &&
+            out[nout - 1].soffset + out[nout - 1].len == run->soffset + pos[t] &&
+            out[nout - 1].iomap + out[nout - 1].len == key[t])
+        {
+            out[nout - 1].len += n;
+        }
+        else
+        {
+            if (nout == size)
+            {
+                maprun *newout;
+                int *newfrom;
+
+                size = size ? 2 * size : r + ntasks;
+                newout = realloc(out, size * sizeof(maprun));
+                if (newout)
+                    out = newout;
+                newfrom = realloc(from, size * sizeof(int));
+                if (newfrom)
+                    from = newfrom;
+                if (!newout || !newfrom)
+                {
+                    free(out);
+                    free(from);
+                    free(pos);
+                    return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+                }
+            }
+            out[nout].soffset = run->soffset + pos[t];
+            out[nout].iomap = key[t];
+            out[nout].len = n;
+            from[nout++] = t;
+        }
+
+        /* Advance this task, and drop it when it has no runs left. */
+        pos[t] += n;
+        if (pos[t] == run->len)
+        {
+            pos[t] = 0;
+            if (++next[t] == end[t])
+            {
+                heap[0] = heap[--nheap];
+                sift_down_runs(heap, nheap, key, 0);
+                continue;
+            }
+        }
+        key[t] = runs[next[t]].iomap + pos[t];
+        sift_down_runs(heap, nheap, key, 0);
     }
 
-    /* All-gather the llen to all tasks into array iomaplen. */
-    LOG((3, "calling pio_swapm to allgather llen into array iomaplen, ndims = %d dtypes[0] = %d",
-         ndims, dtypes));
-    if ((ret = pio_swapm(&iodesc->llen, sendcounts, sdispls, dtypes, iomaplen, recvcounts,
-                         rdispls, dtypes, ios->union_comm, &iodesc->rearr_opts.io2comp)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
-    LOG((3, "iodesc->llen = %d", iodesc->llen));
-#if PIO_ENABLE_LOGGING
-    for (int i = 0; i < ios->num_iotasks; i++)
-        LOG((3, "iomaplen[%d] = %d", i, iomaplen[i]));
-#endif /* PIO_ENABLE_LOGGING */
+    free(pos);
+    *noutp = nout;
+    *outp = out;
+    *fromp = from;
 
-    /* For each IO task send starts/counts to all compute tasks. */
-    for (int i = 0; i < ios->num_iotasks; i++)
-    {
-        /* The ipmaplen contains the llen (number of data elements)
-         * for this IO task. */
-        LOG((2, "iomaplen[%d] = %d", i, iomaplen[i]));
+    return PIO_NOERR;
+}
 
-        /* If there is data for this IO task, send start/count to all
-         * compute tasks. */
-        if (iomaplen[i] > 0)
-        {
-            PIO_Offset start[ndims];
-            PIO_Offset count[ndims];
+/**
+ * Calculate start and count regions for the subset rearranger. This
+ * function is not used in the box rearranger.
+ *
+ * Each region is a block of output which can be represented in a
+ * single call to the underlying netcdf library.  This can be as small
+ * as a single data point, but we hope we've aggragated better than
+ * that.
+ *
+ * When the library is built with OpenMP, long maps are searched in
+ * chunks by all available threads, see get_regions_chunked().
+ *
+ * @param ndims the number of dimensions
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the length of the map
+ * @param map may be NULL (when ???).
+ * @param maxregions
+ * @param firstregion pointer to the first region.
+ * @returns 0 on success, error code otherwise.
+ */
+int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
+                int *maxregions, io_region *firstregion)
+{
+    int nchunks = 1;
 
-            /* Set up send/recv parameters for all to all gather of
-             * counts and starts. */
-            for (int j = 0; j < ios->num_uniontasks; j++)
-            {
-                sendcounts[j] = 0;
-                sdispls[j] = 0;
-                rdispls[j] = 0;
-                recvcounts[j] = 0;
-                if (ios->union_rank == ios->ioranks[i])
-                    sendcounts[j] = ndims;
-            }
-            recvcounts[ios->ioranks[i]] = ndims;
-
-            /* The count array from iotask i is sent to all compute tasks. */
-            LOG((3, "about to call pio_swapm with count from iotask %d ndims = %d",
-                 i, ndims));
-            if ((ret = pio_swapm(iodesc->firstregion->count, sendcounts, sdispls, dtypes, count,
-                                 recvcounts, rdispls, dtypes, ios->union_comm,
-                                 &iodesc->rearr_opts.io2comp)))
-                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+#ifdef _OPENMP
+    /* A few chunks per thread keeps the threads busy when some
+     * chunks hold larger regions than others. */
+    if (maplen >= REGION_CHUNK_MIN)
+        nchunks = 4 * omp_get_max_threads();
+#endif /* _OPENMP */
 
-            /* The start array from iotask i is sent to all compute tasks. */
-            LOG((3, "about to call pio_swapm with start from iotask %d ndims = %d",
-                 i, ndims));
-            if ((ret = pio_swapm(iodesc->firstregion->start,  sendcounts, sdispls, dtypes,
-                                 start, recvcounts, rdispls, dtypes, ios->union_comm,
-                                 &iodesc->rearr_opts.io2comp)))
-                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    return get_regions_chunked(ndims, gdimlen, maplen, map, nchunks, maxregions,
+                               firstregion);
+}
 
-#if PIO_ENABLE_LOGGING
-            for (int d = 0; d < ndims; d++)
-                LOG((3, "start[%d] = %lld count[%d] = %lld", d, start[d], d, count[d]));
-#endif /* PIO_ENABLE_LOGGING */
+/**
+ * Merge neighboring regions that together form one larger region of
+ * the file. Two regions in the list are merged when the second one
+ * follows the first in the IO buffer and in the file: they have the
+ * same start and count except in one dimension, where the second one
+ * starts where the first one ends, and all the dimensions outside of
+ * that one have a count of 1. Merged regions are freed.
+ *
+ * @param ndims the number of dimensions.
+ * @param firstregion pointer to the first region.
+ * @param nregions pointer to the number of regions in the list, which
+ * gets the number left after merging.
+ * @returns 0 on success, error code otherwise.
+ */
+int coalesce_regions(int ndims, io_region *firstregion, int *nregions)
+{
+    io_region *region = firstregion;
 
-            /* For each element of the data array on the compute task,
-             * find the IO task to send the data element to, and its
-             * offset into the global data array. */
-            for (int k = 0; k < maplen; k++)
-            {
-                PIO_Offset gcoord[ndims], lcoord[ndims];
-                bool found = true;
+    pioassert(ndims >= 0 && nregions, "invalid input", __FILE__, __LINE__);
 
-                /* The compmap array is 1 based but calculations are 0 based */
-                LOG((3, "about to call idx_to_dim_list ndims = %d ", ndims));
-                idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord);
-#if PIO_ENABLE_LOGGING
-                for (int d = 0; d < ndims; d++)
-                    LOG((3, "gcoord[%d] = %lld", d, gcoord[d]));
-#endif /* PIO_ENABLE_LOGGING */
+    while (ndims > 0 && region && region->next)
+    {
+        io_region *next = region->next;
+        PIO_Offset len = 1;
+        int d;
 
-                /* Find a destination for each entry in the compmap. */
-                for (int j = 0; j < ndims; j++)
-                {
-                    if (gcoord[j] >= start[j] && gcoord[j] < start[j] + count[j])
-                    {
-                        lcoord[j] = gcoord[j] - start[j];
-                    }
-                    else
-                    {
-                        found = false;
-                        break;
-                    }
-                }
+        for (int i = 0; i < ndims; i++)
+            len *= region->count[i];
 
-                /* Did we find a destination IO task for this element
-                 * of the computation task data array? If so, remember
-                 * the destination IO task, and determine the index
-                 * for that element in the IO task data. */
-                if (found)
-                {
-                    dest_ioindex[k] = coord_to_lindex(ndims, lcoord, count);
-                    dest_ioproc[k] = i;
-                    LOG((3, "found dest_ioindex[%d] = %d dest_ioproc[%d] = %d", k, dest_ioindex[k],
-                         k, dest_ioproc[k]));
-                }
-            }
-        }
-    }
+        /* Find the first dimension in which the regions differ. */
+        for (d = 0; d < ndims; d++)
+            if (region->start[d] != next->start[d] || region->count[d] != next->count[d])
+                break;
 
-    /* Check that a destination is found for each compmap entry. */
-    for (int k = 0; k < maplen; k++)
-        if (dest_ioproc[k] < 0 && compmap[k] > 0)
-            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+        /* Check that they can be merged along it. */
+        bool merge = d < ndims && next->loffset == region->loffset + len &&
+            next->start[d] == region->start[d] + region->count[d];
+        for (int i = 0; merge && i < ndims; i++)
+            if ((i < d && region->count[i] != 1) ||
+                (i > d && (region->start[i] != next->start[i] ||
+                           region->count[i] != next->count[i])))
+                merge = false;
 
-    /* Completes the mapping for the box rearranger. */
-    LOG((2, "calling compute_counts maplen = %d", maplen));
-    if ((ret = compute_counts(ios, iodesc, dest_ioproc, dest_ioindex)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if (!merge)
+        {
+            region = next;
+            continue;
+        }
 
-    /* Compute the max io buffer size needed for an iodesc. */
-    if (ios->ioproc)
-    {
-        if ((ret = compute_maxIObuffersize(ios->io_comm, iodesc)))
-            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
-        LOG((3, "iodesc->maxiobuflen = %d", iodesc->maxiobuflen));
+        /* Grow the region, and try the same one with the region after
+         * the merged one. */
+        region->count[d] += next->count[d];
+        region->next = next->next;
+        next->next = NULL;
+        free_region_list(next);
+        (*nregions)--;
     }
-
-    /* Using maxiobuflen compute the maximum number of bytes that the
-     * io task buffer can handle. */
-    if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
-    LOG((3, "iodesc->maxbytes = %d", iodesc->maxbytes));
+    LOG((2, "coalesce_regions nregions = %d", *nregions));
 
     return PIO_NOERR;
 }
 
 /**
- * Compare offsets is used by the sort in the subset rearranger. This
- * function is passed to qsort.
+ * Free the regions found in the chunks of a map.
  *
- * @param a pointer to an offset.
- * @param b pointer to another offset.
- * @returns 0 if offsets are the same or either pointer is NULL.
+ * @param nchunks the number of chunks.
+ * @param chunks array (length nchunks) of chunks, may be NULL.
  */
-int compare_offsets(const void *a, const void *b)
+static void free_region_chunks(int nchunks, region_chunk *chunks)
 {
-    mapsort *x = (mapsort *)a;
-    mapsort *y = (mapsort *)b;
-    if (!x || !y)
-        return 0;
-    return (int)(x->iomap - y->iomap);
+    if (!chunks)
+        return;
+    for (int c = 0; c < nchunks; c++)
+    {
+        free(chunks[c].pos);
+        free(chunks[c].count);
+    }
+    free(chunks);
 }
 
 /**
- * Calculate start and count regions for the subset rearranger. This
- * function is not used in the box rearranger.
+ * Calculate start and count regions for the subset rearranger,
+ * searching nchunks chunks of the map at once.
  *
- * Each region is a block of output which can be represented in a
- * single call to the underlying netcdf library.  This can be as small
- * as a single data point, but we hope we've aggragated better than
- * that.
+ * The regions are found greedily: each starts where the last one
+ * ended, and is as large as find_region() can make it. The region
+ * that starts at a given point of the map does not depend on anything
+ * before that point. So each chunk is searched from its own start
+ * (in parallel, with OpenMP), and the chunks are joined by following
+ * the regions from the start of the map. A region found in a chunk is
+ * used when it starts where the last region ended, otherwise the
+ * region is found again. Usually the regions of a chunk line up with
+ * the regions before it after the first region of the chunk, and the
+ * result is always the same as with a single chunk.
  *
  * @param ndims the number of dimensions
  * @param gdimlen an array length ndims with the sizes of the global
  * dimensions.
  * @param maplen the length of the map
  * @param map may be NULL (when ???).
+ * @param nchunks the number of chunks to search. With 1 the map is
+ * searched from start to end.
  * @param maxregions
  * @param firstregion pointer to the first region.
  * @returns 0 on success, error code otherwise.
  */
-int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
-                int *maxregions, io_region *firstregion)
+int get_regions_chunked(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
+                        int nchunks, int *maxregions, io_region *firstregion)
 {
     int nmaplen = 0;
-    int regionlen;
+    PIO_Offset regionlen;
     io_region *region;
+    region_chunk *chunks = NULL;
+    int nfail = 0;
     int ret;
 
     /* Check inputs. */
-    pioassert(ndims >= 0 && gdimlen && maplen >= 0 && maxregions && firstregion,
-              "invalid input", __FILE__, __LINE__);
-    LOG((1, "get_regions ndims = %d maplen = %d", ndims, maplen));
+    pioassert(ndims >= 0 && gdimlen && maplen >= 0 && nchunks > 0 && maxregions &&
+              firstregion, "invalid input", __FILE__, __LINE__);
+    LOG((1, "get_regions_chunked ndims = %d maplen = %d nchunks = %d", ndims, maplen,
+         nchunks));
 
     region = firstregion;
     if (map)
@@ -1442,8 +3138,84 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
 
     *maxregions = 1;
 
-    while (nmaplen < maplen)
+    /* Don't use more chunks than there are points. */
+    if (nchunks > maplen - nmaplen)
+        nchunks = 1;
+
+    int bound[nchunks + 1];
+    for (int c = 0; c <= nchunks; c++)
+        bound[c] = nmaplen + (int)((PIO_Offset)(maplen - nmaplen) * c / nchunks);
+
+    /* Search each chunk from its start. */
+    if (nchunks > 1)
+    {
+        if (!(chunks = calloc(nchunks, sizeof(region_chunk))))
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:nfail)
+#endif
+        for (int c = 0; c < nchunks; c++)
+        {
+            region_chunk *chunk = &chunks[c];
+            PIO_Offset start[ndims];
+
+            for (int pos = bound[c]; pos < bound[c + 1]; )
+            {
+                PIO_Offset *count;
+                PIO_Offset len = 1;
+
+                /* Make room for another region. */
+                if (chunk->nregions == chunk->size)
+                {
+                    int size = chunk->size ? 2 * chunk->size : 64;
+                    int *newpos;
+                    PIO_Offset *newcount;
+
+                    if (!(newpos = realloc(chunk->pos, size * sizeof(int))))
+                    {
+                        nfail++;
+                        break;
+                    }
+                    chunk->pos = newpos;
+                    if (!(newcount = realloc(chunk->count, size * ndims * sizeof(PIO_Offset))))
+                    {
+                        nfail++;
+                        break;
+                    }
+                    chunk->count = newcount;
+                    chunk->size = size;
+                }
+
+                count = &chunk->count[chunk->nregions * ndims];
+                for (int i = 0; i < ndims; i++)
+                    count[i] = 1;
+                len = find_region(ndims, gdimlen, maplen - pos, &map[pos], start, count);
+                chunk->pos[chunk->nregions++] = pos;
+                pos += len;
+            }
+        }
+        if (nfail)
+        {
+            free_region_chunks(nchunks, chunks);
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        }
+    }
+
+    /* Join the chunks, following the regions from the start. */
+    for (int c = 0; nmaplen < maplen; )
     {
+        region_chunk *chunk = NULL;
+
+        while (c < nchunks - 1 && nmaplen >= bound[c + 1])
+            c++;
+        if (chunks)
+        {
+            chunk = &chunks[c];
+            while (chunk->next < chunk->nregions && chunk->pos[chunk->next] < nmaplen)
+                chunk->next++;
+        }
+
         /* Here we find the largest region from the current offset
            into the iomap. regionlen is the size of that region and we
            step to that point in the map array until we reach the
@@ -1451,9 +3223,23 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
         for (int i = 0; i < ndims; i++)
             region->count[i] = 1;
 
-        /* Set start/count to describe first region in map. */
-        regionlen = find_region(ndims, gdimlen, maplen-nmaplen,
-                                &map[nmaplen], region->start, region->count);
+        if (chunk && chunk->next < chunk->nregions && chunk->pos[chunk->next] == nmaplen)
+        {
+            /* This region was already found in the chunk. */
+            regionlen = 1;
+            idx_to_dim_list(ndims, gdimlen, map[nmaplen] - 1, region->start);
+            for (int i = 0; i < ndims; i++)
+            {
+                region->count[i] = chunk->count[chunk->next * ndims + i];
+                regionlen *= region->count[i];
+            }
+        }
+        else
+        {
+            /* Set start/count to describe first region in map. */
+            regionlen = find_region(ndims, gdimlen, maplen - nmaplen, &map[nmaplen],
+                                    region->start, region->count);
+        }
         pioassert(region->start[0] >= 0, "failed to find region", __FILE__, __LINE__);
 
         nmaplen = nmaplen + regionlen;
@@ -1464,7 +3250,10 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
         {
             LOG((2, "allocating next region"));
             if ((ret = alloc_region2(NULL, ndims, &region->next)))
+            {
+                free_region_chunks(nchunks, chunks);
                 return ret;
+            }
 
             /* The offset into the local array buffer is the sum of
              * the sizes of all of the previous regions (loffset) */
@@ -1480,56 +3269,346 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
         }
     }
 
+    free_region_chunks(nchunks, chunks);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Create the MPI communicators needed by the subset rearranger.
+ *
+ * The subset rearranger needs a mapping from compute tasks to IO
+ * task, the only requirement is that each compute task map to one and
+ * only one IO task.  This mapping groups by mpi task id others are
+ * possible and may be better for certain decompositions
+ *
+ * The as yet unrealized vision here is that the user would be able to
+ * supply an alternative subset partitioning function. Requirements of
+ * this function are that there be exactly one io task per compute
+ * task group.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+    int color;
+    int key;
+    int mpierr; /* Return value from MPI functions. */
+
+    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+    LOG((1, "default_subset_partition ios->ioproc = %d ios->io_rank = %d "
+         "ios->comp_rank = %d", ios->ioproc, ios->io_rank, ios->comp_rank));
+
+    /* Create a new comm for each subset group with the io task in
+       rank 0 and only 1 io task per group */
+    if (ios->ioproc)
+    {
+        key = 0;
+        color= ios->io_rank;
+    }
+    else
+    {
+        int taskratio = ios->num_comptasks / ios->num_iotasks;
+        key = max(1, ios->comp_rank % taskratio + 1);
+        color = min(ios->num_iotasks - 1, ios->comp_rank / taskratio);
+    }
+    LOG((3, "key = %d color = %d", key, color));
+
+    /* Create new communicators. */
+    if ((mpierr = MPI_Comm_split(ios->comp_comm, color, key, &iodesc->subset_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Compare the amount of data on two tasks, for a sort from the most
+ * to the least data. This function is passed to qsort.
+ *
+ * @param a pointer to a task_weight.
+ * @param b pointer to another task_weight.
+ * @returns -1, 0 or 1 as a sorts before, with or after b.
+ */
+int compare_task_weight(const void *a, const void *b)
+{
+    const task_weight *x = a;
+    const task_weight *y = b;
+
+    if (x->weight > y->weight)
+        return -1;
+    if (x->weight < y->weight)
+        return 1;
+    return x->task - y->task;
+}
+
+/**
+ * Is IO task i a better destination than IO task j? The one with
+ * less data wins, then the one with fewer tasks, then the lower
+ * rank.
+ */
+#define LESS_LOADED(i, j) (ioload[i] < ioload[j] ||                     \
+                           (ioload[i] == ioload[j] && (iocount[i] < iocount[j] || \
+                                                       (iocount[i] == iocount[j] && (i) < (j)))))
+
+/**
+ * Assign compute tasks to IO tasks for the subset rearranger. Each IO
+ * task is in its own group. The other tasks are assigned from the
+ * most to the least data. Each task goes to the least loaded IO task
+ * on its own node. Tasks on nodes without an IO task then go to the
+ * least loaded IO task overall.
+ *
+ * All tasks call this with the same input, so they all get the same
+ * answer.
+ *
+ * @param ntasks the number of tasks.
+ * @param node array (length ntasks) with the node of each task. Nodes
+ * are numbered from 0 to ntasks - 1.
+ * @param io_rank array (length ntasks) with the rank in the IO
+ * communicator of each IO task, and -1 for the other tasks.
+ * @param weight array (length ntasks) with the amount of data on each
+ * task.
+ * @param num_iotasks the number of IO tasks.
+ * @param group array (length ntasks) that gets the IO rank of the IO
+ * task that each task is assigned to.
+ * @returns 0 on success, error code otherwise.
+ */
+int assign_subset_groups(int ntasks, const int *node, const int *io_rank,
+                         const PIO_Offset *weight, int num_iotasks, int *group)
+{
+    task_weight *order;           /* Tasks sorted by weight. */
+    PIO_Offset ioload[num_iotasks]; /* Data assigned to each IO task. */
+    int iocount[num_iotasks];     /* Tasks assigned to each IO task. */
+    int *nodefirst;               /* Start of each node in nodeio. */
+    int *nodenext;                /* Next free slot of each node in nodeio. */
+    int nodeio[num_iotasks];      /* IO tasks, grouped by node. */
+    int heap[num_iotasks];        /* Min-heap of IO tasks by load. */
+    int norder = 0;
+    int nleft = 0;
+
+    pioassert(ntasks > 0 && node && io_rank && weight && num_iotasks > 0 && group,
+              "invalid input", __FILE__, __LINE__);
+
+    /* There may be very many tasks, so these are not on the stack. */
+    if (!(order = malloc(ntasks * sizeof(task_weight))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    if (!(nodefirst = malloc((2 * ntasks + 1) * sizeof(int))))
+    {
+        free(order);
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    }
+    nodenext = nodefirst + ntasks + 1;
+
+    /* IO tasks start out with their own data. Group the IO tasks by
+     * node, with a counting sort. */
+    for (int n = 0; n <= ntasks; n++)
+        nodefirst[n] = 0;
+    for (int t = 0; t < ntasks; t++)
+    {
+        if (io_rank[t] >= 0)
+        {
+            pioassert(io_rank[t] < num_iotasks, "bad io rank", __FILE__, __LINE__);
+            ioload[io_rank[t]] = weight[t];
+            iocount[io_rank[t]] = 0;
+            group[t] = io_rank[t];
+            nodefirst[node[t] + 1]++;
+        }
+        else
+        {
+            order[norder].task = t;
+            order[norder++].weight = weight[t];
+        }
+    }
+    for (int n = 0; n < ntasks; n++)
+    {
+        nodefirst[n + 1] += nodefirst[n];
+        nodenext[n] = nodefirst[n];
+    }
+    for (int t = 0; t < ntasks; t++)
+        if (io_rank[t] >= 0)
+            nodeio[nodenext[node[t]]++] = io_rank[t];
+
+    /* Largest tasks first, so that the small ones even out the
+     * load. */
+    qsort(order, norder, sizeof(task_weight), compare_task_weight);
+
+    /* Assign tasks to the least loaded IO task on their node. Keep
+     * the tasks on nodes without IO tasks, in order, for later. */
+    for (int o = 0; o < norder; o++)
+    {
+        int t = order[o].task;
+        int best = -1;
+
+        for (int i = nodefirst[node[t]]; i < nodefirst[node[t] + 1]; i++)
+            if (best < 0 || LESS_LOADED(nodeio[i], best))
+                best = nodeio[i];
+
+        if (best < 0)
+            order[nleft++] = order[o];
+        else
+        {
+            group[t] = best;
+            ioload[best] += weight[t];
+            iocount[best]++;
+        }
+    }
+
+    /* Assign the rest to the least loaded IO task overall, using a
+     * binary min-heap of the IO tasks. */
+    if (nleft)
+    {
+        for (int i = 0; i < num_iotasks; i++)
+        {
+            /* Sift up. */
+            int c = i;
+            heap[c] = i;
+            while (c > 0 && LESS_LOADED(heap[c], heap[(c - 1) / 2]))
+            {
+                int tmp = heap[c];
+                heap[c] = heap[(c - 1) / 2];
+                heap[(c - 1) / 2] = tmp;
+                c = (c - 1) / 2;
+            }
+        }
+
+        for (int o = 0; o < nleft; o++)
+        {
+            int t = order[o].task;
+            int c = 0;
+
+            group[t] = heap[0];
+            ioload[heap[0]] += weight[t];
+            iocount[heap[0]]++;
+
+            /* Sift down. */
+            while (2 * c + 1 < num_iotasks)
+            {
+                int s = 2 * c + 1;
+                if (s + 1 < num_iotasks && LESS_LOADED(heap[s + 1], heap[s]))
+                    s++;
+                if (!LESS_LOADED(heap[s], heap[c]))
+                    break;
+                int tmp = heap[c];
+                heap[c] = heap[s];
+                heap[s] = tmp;
+                c = s;
+            }
+        }
+    }
+
+#if PIO_ENABLE_LOGGING
+    for (int i = 0; i < num_iotasks; i++)
+        LOG((3, "assign_subset_groups io_rank %d ntasks %d load %lld", i, iocount[i],
+             ioload[i]));
+#endif /* PIO_ENABLE_LOGGING */
+
+    free(nodefirst);
+    free(order);
+
     return PIO_NOERR;
 }
+#undef LESS_LOADED
 
 /**
- * Create the MPI communicators needed by the subset rearranger.
+ * Create the MPI communicators needed by the subset rearranger,
+ * taking into account which node each task is on. This is an
+ * alternative to default_subset_partition(), selected with
+ * PIOc_set_subset_partition(). Compute tasks are assigned to IO tasks
+ * on the same node when there are any, so that subset traffic stays
+ * on the node. The number of data elements (iodesc->ndof) of each
+ * task is used to balance the data of the IO tasks, rather than the
+ * number of tasks. See assign_subset_groups().
  *
- * The subset rearranger needs a mapping from compute tasks to IO
- * task, the only requirement is that each compute task map to one and
- * only one IO task.  This mapping groups by mpi task id others are
- * possible and may be better for certain decompositions
- *
- * The as yet unrealized vision here is that the user would be able to
- * supply an alternative subset partitioning function. Requirements of
- * this function are that there be exactly one io task per compute
- * task group.
+ * This function is collective over ios->comp_comm.
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
  * @returns 0 on success, error code otherwise.
  */
-int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
+int node_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
 {
+#ifdef MPI_SERIAL
+    return default_subset_partition(ios, iodesc);
+#else
+    MPI_Comm node_comm;
+    PIO_Offset *info;   /* Node, IO rank and weight of every task. */
+    int *node;          /* Node of every task. */
+    int *io_rank;       /* IO rank of every task, -1 if not an IO task. */
+    int *group;         /* IO task that each task is assigned to. */
+    PIO_Offset *weight; /* Data elements of every task. */
+    int comp_rank;
+    int ntasks;
+    int nodeid;
     int color;
     int key;
+    int ret;
     int mpierr; /* Return value from MPI functions. */
 
     pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
-    LOG((1, "default_subset_partition ios->ioproc = %d ios->io_rank = %d "
-         "ios->comp_rank = %d", ios->ioproc, ios->io_rank, ios->comp_rank));
+    LOG((1, "node_subset_partition ios->ioproc = %d ios->io_rank = %d ndof = %d",
+         ios->ioproc, ios->io_rank, iodesc->ndof));
 
-    /* Create a new comm for each subset group with the io task in
-       rank 0 and only 1 io task per group */
-    if (ios->ioproc)
+    if ((mpierr = MPI_Comm_rank(ios->comp_comm, &comp_rank)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(ios->comp_comm, &ntasks)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* A node is identified by the lowest rank on it. */
+    if ((mpierr = MPI_Comm_split_type(ios->comp_comm, MPI_COMM_TYPE_SHARED, comp_rank,
+                                      MPI_INFO_NULL, &node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Allreduce(&comp_rank, &nodeid, 1, MPI_INT, MPI_MIN, node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_free(&node_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Share the node, IO rank and weight of all tasks. */
+    if (!(info = malloc(3 * ntasks * sizeof(PIO_Offset))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    info[3 * comp_rank] = nodeid;
+    info[3 * comp_rank + 1] = ios->ioproc ? ios->io_rank : -1;
+    info[3 * comp_rank + 2] = iodesc->ndof;
+    if ((mpierr = MPI_Allgather(MPI_IN_PLACE, 3, MPI_OFFSET, info, 3, MPI_OFFSET,
+                                ios->comp_comm)))
     {
-        key = 0;
-        color= ios->io_rank;
+        free(info);
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
     }
-    else
+
+    /* There may be very many tasks, so these are not on the stack. */
+    if (!(node = malloc(3 * ntasks * sizeof(int))))
     {
-        int taskratio = ios->num_comptasks / ios->num_iotasks;
-        key = max(1, ios->comp_rank % taskratio + 1);
-        color = min(ios->num_iotasks - 1, ios->comp_rank / taskratio);
+        free(info);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    }
+    io_rank = node + ntasks;
+    group = node + 2 * ntasks;
+    weight = info;  /* weight[t] only overwrites parts of info already read. */
+    for (int t = 0; t < ntasks; t++)
+    {
+        node[t] = info[3 * t];
+        io_rank[t] = info[3 * t + 1];
+        weight[t] = info[3 * t + 2];
     }
-    LOG((3, "key = %d color = %d", key, color));
 
-    /* Create new communicators. */
+    ret = assign_subset_groups(ntasks, node, io_rank, weight, ios->num_iotasks, group);
+    color = group[comp_rank];
+    free(node);
+    free(info);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The IO task is rank 0 of each subset_comm. The other tasks
+     * keep their order. */
+    key = ios->ioproc ? 0 : comp_rank + 1;
+    LOG((3, "key = %d color = %d nodeid = %d", key, color, nodeid));
+
     if ((mpierr = MPI_Comm_split(ios->comp_comm, color, key, &iodesc->subset_comm)))
         return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 
     return PIO_NOERR;
+#endif /* MPI_SERIAL */
 }
 
 /**
@@ -1543,27 +3622,26 @@ int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
  *
  * This function:
  * <ul>
- * <li>Calls default_subset_partition() to create subset_comm.
+ * <li>Calls default_subset_partition() or node_subset_partition() to
+ * create subset_comm.
  * <li>For IO tasks, allocates iodesc->rcount array (length ntasks).
  * <li>Allocates iodesc->scount array (length 1)
  * <li>Determins value of iodesc->scount[0], the number of data
  * elements on this compute task which are read/written.
- * <li>Allocated and inits iodesc->sindex (length iodesc->scount[0]),
- * init it to contain indicies to data.
+ * <li>Allocates iodesc->sindex (length iodesc->scount[0]).
  * <li>Pass the reduced maplen (without holes) from each compute task
  * to its associated IO task.
  * <li>On IO tasks, determine llen.
  * <li>Determine whether fill values will be needed.
- * <li>Pass iodesc->sindex from each compute task to its associated IO
- * task.
- * <li>Create shrtmap, which is compmap without the holes.
- * <li>Gather shrtmaps from each task into iomap.
- * <li>On IO tasks, sort the mapping, this will transpose the data
- * into IO order.
- * <li>On IO tasks, allocate and init iodesc->rindex and iodesc->rfrom
- * (length iodesc->llen).
+ * <li>Compress compmap into runs with get_map_runs() and gather the
+ * runs from each task to its associated IO task.
+ * <li>On IO tasks, merge the runs with merge_map_runs(), this will
+ * transpose the data into IO order. Set iodesc->rfrom and
+ * iodesc->rfromlen (length iodesc->nrfrom) to the task and length of
+ * each run.
  * <li>On IO tasks, handle fill values, if needed.
- * <li>On IO tasks, scatter values of srcindex to subset communicator.
+ * <li>On IO tasks, scatter the runs of each task to the subset
+ * communicator, where they are expanded into iodesc->sindex.
  * <li>On IO tasks, call get_regions() and distribute the max
  * maxregions to all tasks in IO communicator.
  * <li>On IO tasks, call compute_maxIObuffersize().
@@ -1586,9 +3664,13 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 {
     int i, j;
     PIO_Offset *iomap = NULL;
-    mapsort *map = NULL;
+    maprun *runs;             /* Runs of the map on this task. */
+    maprun *allruns = NULL;   /* Runs of all tasks, on IO tasks. */
+    maprun *ioruns = NULL;    /* Runs in IO order, on IO tasks. */
+    maprun *taskruns = NULL;  /* Runs in IO order grouped by task, on IO tasks. */
+    int nruns;
+    MPI_Datatype runtype;
     PIO_Offset totalgridsize;
-    PIO_Offset *srcindex = NULL;
     PIO_Offset *myfillgrid = NULL;
     int maxregions;
     int rank, ntasks;
@@ -1602,11 +3684,21 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     LOG((2, "subset_rearrange_create maplen = %d ndims = %d", maplen, ndims));
 
+    /* Remember the maplen for this computation task. */
+    iodesc->ndof = maplen;
+
     /* subset partitions each have exactly 1 io task which is task 0
      * of that subset_comm */
-    /* TODO: introduce a mechanism for users to define partitions */
-    if ((ret = default_subset_partition(ios, iodesc)))
+    if (ios->subset_partition == PIO_SUBSET_PARTITION_NODE)
+    {
+        if ((ret = node_subset_partition(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+    else
+    {
+        if ((ret = default_subset_partition(ios, iodesc)))
             return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
     iodesc->rearranger = PIO_REARR_SUBSET;
 
     /* Get size of this subset communicator and rank of this task in it. */
@@ -1622,9 +3714,6 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         pioassert(rank > 0 && rank < ntasks, "Bad comp rank in subset create",
                   __FILE__, __LINE__);
 
-    /* Remember the maplen for this computation task. */
-    iodesc->ndof = maplen;
-
     if (ios->ioproc)
     {
         /* Allocate space to hold count of data to be received in pio_swapm(). */
@@ -1658,16 +3747,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     }
 
     /* Allocate an array for indicies on the computation tasks (the
-     * send side when writing). */
+     * send side when writing). It is filled in IO order by the IO
+     * task once the map has been merged. */
     if (iodesc->scount[0] > 0)
         if (!(iodesc->sindex = calloc(iodesc->scount[0], sizeof(PIO_Offset))))
             return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
 
-    j = 0;
-    for (i = 0; i < maplen; i++)
-        if (compmap[i] > 0)
-            iodesc->sindex[j++] = i;
-
     /* Pass the reduced maplen (without holes) from each compute task
      * to its associated IO task. */
     if ((mpierr = MPI_Gather(iodesc->scount, 1, MPI_INT, iodesc->rcount, rcnt,
@@ -1678,129 +3763,84 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     int rdispls[ntasks];
     int recvcounts[ntasks];
+    int tnruns[ntasks];
+    int fill[ntasks];
 
     /* On IO tasks determine llen. */
     if (ios->ioproc)
-    {
         for (i = 0; i < ntasks; i++)
-        {
             iodesc->llen += iodesc->rcount[i];
-            rdispls[i] = 0;
-            recvcounts[i] = iodesc->rcount[i];
-            if (i > 0)
-                rdispls[i] = rdispls[i - 1] + iodesc->rcount[i - 1];
-        }
-
-        if (iodesc->llen > 0)
-        {
-            if (!(srcindex = calloc(iodesc->llen, sizeof(PIO_Offset))))
-                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
 
-            for (i = 0; i < iodesc->llen; i++)
-                srcindex[i] = 0;
-        }
-    }
-    else
+    for (i = 0; i < ntasks; i++)
     {
-        for (i = 0; i < ntasks; i++)
-        {
-            recvcounts[i] = 0;
-            rdispls[i] = 0;
-        }
+        recvcounts[i] = 0;
+        rdispls[i] = 0;
     }
 
     /* Determine whether fill values will be needed. */
     if ((ret = determine_fill(ios, iodesc, gdimlen, compmap)))
         return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
-    /* Pass the sindex from each compute task to its associated IO task. */
-    if ((mpierr = MPI_Gatherv(iodesc->sindex, iodesc->scount[0], PIO_OFFSET,
-                              srcindex, recvcounts, rdispls, PIO_OFFSET, 0,
-                              iodesc->subset_comm)))
+    /* Compress the map into runs. Holes are left out. */
+    if ((ret = get_map_runs(maplen, compmap, &nruns, &runs)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Pass the number of runs from each compute task to its
+     * associated IO task. */
+    if ((mpierr = MPI_Gather(&nruns, 1, MPI_INT, tnruns, rcnt, MPI_INT, 0,
+                             iodesc->subset_comm)))
         return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 
-    /* On IO tasks which need it, allocate memory for the map and the
-     * iomap. */
-    if (ios->ioproc && iodesc->llen > 0)
+    int rundispls[ntasks];
+    int totalruns = 0;
+    for (i = 0; i < ntasks; i++)
     {
-        if (!(map = calloc(iodesc->llen, sizeof(mapsort))))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
-
-        if (!(iomap = calloc(iodesc->llen, sizeof(PIO_Offset))))
-            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        rundispls[i] = totalruns;
+        if (ios->ioproc)
+            totalruns += tnruns[i];
     }
 
-    /* Now pass the compmap, skipping the holes. */
-    PIO_Offset *shrtmap;
-    if (maplen > iodesc->scount[0] && iodesc->scount[0] > 0)
-    {
-        if (!(shrtmap = calloc(iodesc->scount[0], sizeof(PIO_Offset))))
+    if (totalruns > 0)
+        if (!(allruns = malloc(totalruns * sizeof(maprun))))
             return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
 
-        j = 0;
-        for (int i = 0; i < maplen; i++)
-            if (compmap[i] > 0)
-                shrtmap[j++] = compmap[i];
-    }
-    else
-    {
-        shrtmap = compmap;
-    }
-
-    /* Gather shrtmap from each task in the subset communicator, and
-     * put gathered results into iomap. */
-    if ((mpierr = MPI_Gatherv(shrtmap, iodesc->scount[0], PIO_OFFSET, iomap, recvcounts,
-                              rdispls, PIO_OFFSET, 0, iodesc->subset_comm)))
+    /* Gather the runs from each task in the subset communicator. */
+    if ((mpierr = MPI_Type_contiguous(3, PIO_OFFSET, &runtype)))
         return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Type_commit(&runtype)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Gatherv(runs, nruns, runtype, allruns, tnruns, rundispls, runtype, 0,
+                              iodesc->subset_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    free(runs);
 
-    if (shrtmap != compmap)
-        free(shrtmap);
-
-    /* On IO tasks that have data in the local array ??? */
+    /* On IO tasks with data, merge the runs into IO order. This
+     * transposes the data and gives runs of file offsets (iomap)
+     * and of local offsets on each compute task (soffset). */
     if (ios->ioproc && iodesc->llen > 0)
     {
-        int pos = 0;
-        int k = 0;
-        mapsort *mptr;
-        for (i = 0; i < ntasks; i++)
-        {
-            for (j = 0; j < iodesc->rcount[i]; j++)
-            {
-                mptr = &map[k];
-                mptr->rfrom = i;
-                mptr->soffset = srcindex[pos + j];
-                mptr->iomap = iomap[pos + j];
-                k++;
-            }
-            pos += iodesc->rcount[i];
-        }
-
-        /* sort the mapping, this will transpose the data into IO order */
-        qsort(map, iodesc->llen, sizeof(mapsort), compare_offsets);
+        if ((ret = merge_map_runs(ntasks, tnruns, allruns, &iodesc->nrfrom, &ioruns,
+                                  &iodesc->rfrom)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
-        if (!(iodesc->rindex = calloc(1, iodesc->llen * sizeof(PIO_Offset))))
+        if (!(iodesc->rfromlen = malloc(iodesc->nrfrom * sizeof(int))))
             return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        for (i = 0; i < iodesc->nrfrom; i++)
+            iodesc->rfromlen[i] = ioruns[i].len;
 
-        if (!(iodesc->rfrom = calloc(1, iodesc->llen * sizeof(int))))
+        /* Group the runs by task, in IO order, to scatter them. */
+        if (!(taskruns = malloc(iodesc->nrfrom * sizeof(maprun))))
             return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        for (i = 0; i < iodesc->nrfrom; i++)
+            recvcounts[iodesc->rfrom[i]]++;
+        for (i = 1; i < ntasks; i++)
+            rdispls[i] = rdispls[i - 1] + recvcounts[i - 1];
+        for (i = 0; i < ntasks; i++)
+            fill[i] = rdispls[i];
+        for (i = 0; i < iodesc->nrfrom; i++)
+            taskruns[fill[iodesc->rfrom[i]]++] = ioruns[i];
     }
-
-    int cnt[ntasks];
-    for (i = 0; i < ntasks; i++)
-    {
-        cnt[i] = rdispls[i];
-    }
-
-    /* For IO tasks init rfrom and rindex arrays (compute tasks have
-     * llen of 0). */
-    for (i = 0; i < iodesc->llen; i++)
-    {
-        mapsort *mptr = &map[i];
-        iodesc->rfrom[i] = mptr->rfrom;
-        iodesc->rindex[i] = i;
-        iomap[i] = mptr->iomap;
-        srcindex[(cnt[iodesc->rfrom[i]])++] = mptr->soffset;
-    }
+    free(allruns);
 
     /* Handle fill values if needed. */
     if (ios->ioproc && iodesc->needsfill)
@@ -1809,10 +3849,17 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         PIO_Offset thisgridsize[ios->num_iotasks];
         PIO_Offset thisgridmin[ios->num_iotasks], thisgridmax[ios->num_iotasks];
         int nio;
-        PIO_Offset *myusegrid = NULL;
+        maprun *clipruns = NULL; /* Runs of iomap in one part of the grid. */
+        maprun *useruns = NULL;  /* Runs of all IO tasks in this part of the grid. */
+        int nuseruns = 0;
+        int rnext = 0;
         int gcnt[ios->num_iotasks];
         int displs[ios->num_iotasks];
 
+        if (iodesc->nrfrom > 0)
+            if (!(clipruns = malloc(iodesc->nrfrom * sizeof(maprun))))
+                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
         thisgridmin[0] = 1;
         thisgridsize[0] =  totalgridsize / ios->num_iotasks;
         thisgridmax[0] = thisgridsize[0];
@@ -1821,7 +3868,6 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         for (nio = 0; nio < ios->num_iotasks; nio++)
         {
             int cnt = 0;
-            int imin = 0;
             if (nio > 0)
             {
                 thisgridsize[nio] =  totalgridsize / ios->num_iotasks;
@@ -1830,13 +3876,23 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
                 thisgridmin[nio] = thisgridmax[nio - 1] + 1;
                 thisgridmax[nio]= thisgridmin[nio] + thisgridsize[nio] - 1;
             }
-            for (int i = 0; i < iodesc->llen; i++)
+
+            /* The runs are sorted by their start in the file, so
+             * those that end before this part of the grid can be
+             * skipped for good. Clip the rest to this part. */
+            while (rnext < iodesc->nrfrom &&
+                   ioruns[rnext].iomap + ioruns[rnext].len <= thisgridmin[nio])
+                rnext++;
+            for (i = rnext; i < iodesc->nrfrom && ioruns[i].iomap <= thisgridmax[nio]; i++)
             {
-                if (iomap[i] >= thisgridmin[nio] && iomap[i] <= thisgridmax[nio])
+                PIO_Offset start = max(ioruns[i].iomap, thisgridmin[nio]);
+                PIO_Offset end = min(ioruns[i].iomap + ioruns[i].len - 1, thisgridmax[nio]);
+
+                if (start <= end)
                 {
-                    cnt++;
-                    if (cnt == 1)
-                        imin = i;
+                    clipruns[cnt].soffset = 0;
+                    clipruns[cnt].iomap = start;
+                    clipruns[cnt++].len = end - start + 1;
                 }
             }
 
@@ -1849,40 +3905,44 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
                 displs[0] = 0;
                 for (i = 1; i < ios->num_iotasks; i++)
                     displs[i] = displs[i - 1] + gcnt[i - 1];
+                nuseruns = displs[ios->num_iotasks - 1] + gcnt[ios->num_iotasks - 1];
 
-                /* Allocate storage for the grid. */
-                if (!(myusegrid = malloc(thisgridsize[nio] * sizeof(PIO_Offset))))
+                /* Allocate storage for the runs in this part of the grid. */
+                if (!(useruns = malloc(max(1, nuseruns) * sizeof(maprun))))
                     return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
-
-                /* Initialize the grid to all -1. */
-                for (i = 0; i < thisgridsize[nio]; i++)
-                    myusegrid[i] = -1;
             }
 
-            if ((mpierr = MPI_Gatherv(&iomap[imin], cnt, PIO_OFFSET, myusegrid, gcnt,
-                                      displs, PIO_OFFSET, nio, ios->io_comm)))
+            if ((mpierr = MPI_Gatherv(clipruns, cnt, runtype, useruns, gcnt,
+                                      displs, runtype, nio, ios->io_comm)))
                 return check_mpi(NULL, mpierr, __FILE__, __LINE__);
         }
+        if (clipruns)
+            free(clipruns);
 
         /* Allocate and initialize a grid to fill in missing values. ??? */
         PIO_Offset grid[thisgridsize[ios->io_rank]];
         for (i = 0; i < thisgridsize[ios->io_rank]; i++)
             grid[i] = 0;
 
+        /* Mark the points written by any IO task, counting each only
+         * once. */
         int cnt = 0;
-        for (i = 0; i < thisgridsize[ios->io_rank]; i++)
+        for (i = 0; i < nuseruns; i++)
         {
-            int j = myusegrid[i] - thisgridmin[ios->io_rank];
-            pioassert(j < thisgridsize[ios->io_rank], "out of bounds array index",
-                      __FILE__, __LINE__);
-            if (j >= 0)
+            for (PIO_Offset k = 0; k < useruns[i].len; k++)
             {
-                grid[j] = 1;
-                cnt++;
+                PIO_Offset j = useruns[i].iomap + k - thisgridmin[ios->io_rank];
+                pioassert(j >= 0 && j < thisgridsize[ios->io_rank], "out of bounds array index",
+                          __FILE__, __LINE__);
+                if (!grid[j])
+                {
+                    grid[j] = 1;
+                    cnt++;
+                }
             }
         }
-        if (myusegrid)
-            free(myusegrid);
+        if (useruns)
+            free(useruns);
 
         iodesc->holegridsize = thisgridsize[ios->io_rank] - cnt;
         if (iodesc->holegridsize > 0)
@@ -1917,6 +3977,9 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
             if ((ret = get_regions(iodesc->ndims, gdimlen, iodesc->holegridsize, myfillgrid,
                                    &iodesc->maxfillregions, iodesc->fillregion)))
                 return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+            if ((ret = coalesce_regions(iodesc->ndims, iodesc->fillregion,
+                                        &iodesc->maxfillregions)))
+                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
             free(myfillgrid);
             maxregions = iodesc->maxfillregions;
         }
@@ -1936,18 +3999,57 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
             return check_mpi(NULL, mpierr, __FILE__, __LINE__);
     }
 
-    /* Scatter values of srcindex to subset communicator. ??? */
-    if ((mpierr = MPI_Scatterv((void *)srcindex, recvcounts, rdispls, PIO_OFFSET,
-                               (void *)iodesc->sindex, iodesc->scount[0],  PIO_OFFSET,
-                               0, iodesc->subset_comm)))
+    /* Scatter the runs of each task to the subset communicator,
+     * and expand them into the local offsets in IO order. */
+    if ((mpierr = MPI_Scatter(recvcounts, 1, MPI_INT, &nruns, 1, MPI_INT, 0,
+                              iodesc->subset_comm)))
         return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (!(runs = malloc(max(1, nruns) * sizeof(maprun))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    if ((mpierr = MPI_Scatterv(taskruns, recvcounts, rdispls, runtype, runs, nruns,
+                               runtype, 0, iodesc->subset_comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Type_free(&runtype)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    j = 0;
+    for (i = 0; i < nruns; i++)
+        for (PIO_Offset k = 0; k < runs[i].len; k++)
+            iodesc->sindex[j++] = runs[i].soffset + k;
+    pioassert(j == iodesc->scount[0], "wrong number of local offsets", __FILE__, __LINE__);
+    free(runs);
+    if (taskruns)
+        free(taskruns);
 
     if (ios->ioproc)
     {
+        /* get_regions() grows its regions point by point, so it gets
+         * the file offsets expanded from the runs for the call. */
+        j = 0;
+        if (iodesc->llen > 0)
+        {
+            if (!(iomap = calloc(iodesc->llen, sizeof(PIO_Offset))))
+                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+            for (i = 0; i < iodesc->nrfrom; i++)
+                for (PIO_Offset k = 0; k < ioruns[i].len; k++)
+                    iomap[j++] = ioruns[i].iomap + k;
+        }
+        pioassert(j == iodesc->llen, "wrong number of file offsets", __FILE__, __LINE__);
+
         iodesc->maxregions = 0;
-        if ((ret = get_regions(iodesc->ndims, gdimlen, iodesc->llen, iomap,
+        if ((ret = get_regions(iodesc->ndims, gdimlen, j, iomap,
                                &iodesc->maxregions, iodesc->firstregion)))
             return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if (iomap)
+            free(iomap);
+
+        /* Fewer, larger regions mean fewer calls to the netCDF
+         * libraries. */
+        iodesc->nregions_found = iodesc->maxregions;
+        if ((ret = coalesce_regions(iodesc->ndims, iodesc->firstregion, &iodesc->maxregions)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        iodesc->nregions = iodesc->maxregions;
+        LOG((2, "subset_rearrange_create regions found = %d after merging = %d",
+             iodesc->nregions_found, iodesc->nregions));
         maxregions = iodesc->maxregions;
 
         /* Get the max maxregions, and distribute it to all tasks in
@@ -1957,14 +4059,8 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         iodesc->maxregions = maxregions;
 
         /* Free resources. */
-        if (iomap)
-            free(iomap);
-
-        if (map)
-            free(map);
-
-        if (srcindex)
-            free(srcindex);
+        if (ioruns)
+            free(ioruns);
 
         /* Compute the max io buffer size needed for an iodesc. */
         if ((ret = compute_maxIObuffersize(ios->io_comm, iodesc)))
@@ -1978,126 +4074,243 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
         return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
+    /* The communication pattern is now known, so the graph
+     * communicator for neighborhood collectives can be built. */
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR)
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
     return PIO_NOERR;
 }
 
 /**
- * Performance tuning rearranger.
+ * Time TUNE_NREPS round trips of one variable from the compute tasks
+ * to the IO tasks and back, using the current rearranger options of
+ * the decomposition. A round trip takes as long as its slowest task,
+ * and the fastest round trip is returned on all tasks, so that they
+ * all make the same choice.
  *
  * @param ios pointer to the iosystem description struct.
  * @param iodesc pointer to the IO description struct.
+ * @param cbuf buffer of length ndof on the compute tasks.
+ * @param ibuf buffer of length llen on the IO tasks.
+ * @param comm communicator used by the rearranger.
+ * @param wtime pointer that gets the wall time in seconds.
  * @returns 0 on success, error code otherwise.
  */
-void performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc)
+int time_rearr_round_trip(iosystem_desc_t *ios, io_desc_t *iodesc, void *cbuf,
+                          void *ibuf, MPI_Comm comm, double *wtime)
 {
-#ifdef TIMING
-#ifdef PERFTUNE
-    double *wall, usr[2], sys[2];
-    void *cbuf, *ibuf;
-    int tsize;
-    int myrank;
-    int mpierr; /* Return code for MPI calls. */
-
-    assert(iodesc);
+    double wtimes[TUNE_NREPS];
+    double start;
+    int ret;
+    int mpierr; /* Return code from MPI calls. */
 
-    if ((mpierr = MPI_Type_size(iodesc->basetype, &tsize)))
-        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-    cbuf = NULL;
-    ibuf = NULL;
-    if (iodesc->ndof > 0)
-        if (!(cbuf = bget(iodesc->ndof * tsize)))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+    for (int r = 0; r < TUNE_NREPS; r++)
+    {
+        if ((mpierr = MPI_Barrier(comm)))
+            return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        start = MPI_Wtime();
 
-    if (iodesc->llen > 0)
-        if (!(ibuf = bget(iodesc->llen * tsize)))
-            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
+        if ((ret = rearrange_comp2io(ios, iodesc, cbuf, ibuf, 1)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if ((ret = rearrange_io2comp(ios, iodesc, ibuf, cbuf, 1)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
-    if (iodesc->rearranger == PIO_REARR_BOX)
-        mycomm = ios->union_comm;
-    else
-        mycomm = iodesc->subset_comm;
+        wtimes[r] = MPI_Wtime() - start;
+    }
 
-    if ((mpierr = MPI_Comm_size(mycomm, &nprocs)))
-        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-    if ((mpierr = MPI_Comm_rank(mycomm, &myrank)))
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, wtimes, TUNE_NREPS, MPI_DOUBLE, MPI_MAX, comm)))
         return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    *wtime = wtimes[0];
+    for (int r = 1; r < TUNE_NREPS; r++)
+        if (wtimes[r] < *wtime)
+            *wtime = wtimes[r];
 
-    int log2 = log(nprocs) / log(2) + 1;
-    if (!(wall = bget(2 * 4 * log2 * sizeof(double))))
-        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__);
-    double mintime;
-    int k = 0;
+    return PIO_NOERR;
+}
 
-    if ((mpierr = MPI_Barrier(mycomm)))
-        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-    GPTLstamp(&wall[0], &usr[0], &sys[0]);
-    rearrange_comp2io(ios, iodesc, cbuf, ibuf, 1);
-    rearrange_io2comp(ios, iodesc, ibuf, cbuf);
-    GPTLstamp(&wall[1], &usr[1], &sys[1]);
-    mintime = wall[1]-wall[0];
-    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &mintime, 1, MPI_DOUBLE, MPI_MAX, mycomm)))
-        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+/**
+ * Time the current rearranger options of the decomposition, and keep
+ * them as the best ones if they are more than 5% faster than the best
+ * ones so far.
+ *
+ * @param ios pointer to the iosystem description struct.
+ * @param iodesc pointer to the IO description struct.
+ * @param cbuf buffer of length ndof on the compute tasks.
+ * @param ibuf buffer of length llen on the IO tasks.
+ * @param comm communicator used by the rearranger.
+ * @param best pointer to the best options so far.
+ * @param mintime pointer to the time of the best options so far.
+ * @param wtime pointer that gets the time of the current options.
+ * @returns 0 on success, error code otherwise.
+ */
+static int try_rearr_opts(iosystem_desc_t *ios, io_desc_t *iodesc, void *cbuf, void *ibuf,
+                          MPI_Comm comm, rearr_opt_t *best, double *mintime, double *wtime)
+{
+    int ret;
 
-    handshake = iodesc->rearr_opts.comp2io.hs;
-    isend = iodesc->isend;
-    maxreqs = iodesc->max_requests;
+    if ((ret = time_rearr_round_trip(ios, iodesc, cbuf, ibuf, comm, wtime)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    LOG((2, "comm_type = %d hs = %d isend = %d max_pend_req = %d time = %f",
+         iodesc->rearr_opts.comm_type, iodesc->rearr_opts.comp2io.hs,
+         iodesc->rearr_opts.comp2io.isend, iodesc->rearr_opts.comp2io.max_pend_req, *wtime));
 
-    for (int i = 0; i < 2; i++)
+    if (*wtime < *mintime * 0.95)
     {
-        if (i == 0)
-            iodesc->rearr_opts.comp2io.hs = false;
-        else
-            iodesc->rearr_opts.comp2io.hs = true;
+        *best = iodesc->rearr_opts;
+        *mintime = *wtime;
+    }
 
-        for (int j = 0; j < 2; j++)
-        {
-            if (j == 0)
-                iodesc->isend = false;
-            else
-                iodesc->isend = true;
+    return PIO_NOERR;
+}
+
+/**
+ * Try the rearranger options of performance_tune_rearranger(), and
+ * keep the fastest ones in iodesc->rearr_opts.
+ *
+ * @param ios pointer to the iosystem description struct.
+ * @param iodesc pointer to the IO description struct.
+ * @param cbuf buffer of length ndof on the compute tasks.
+ * @param ibuf buffer of length llen on the IO tasks.
+ * @param comm communicator used by the rearranger.
+ * @returns 0 on success, error code otherwise.
+ */
+static int tune_rearr_opts(iosystem_desc_t *ios, io_desc_t *iodesc, void *cbuf, void *ibuf,
+                           MPI_Comm comm)
+{
+    int nprocs;
+    rearr_opt_t best;   /* Fastest options found so far. */
+    double mintime;     /* Time of the fastest options. */
+    double wtime;
+    int ret;
+    int mpierr; /* Return code for MPI calls. */
 
-            iodesc->max_requests = 0;
+    if ((mpierr = MPI_Comm_size(comm, &nprocs)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
 
-            for (nreqs = nprocs; nreqs >= 2; nreqs /= 2)
-            {
-                iodesc->max_requests = nreqs;
-                if ((mpierr = MPI_Barrier(mycomm)))
-                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
-                GPTLstamp(wall, usr, sys);
-                rearrange_comp2io(ios, iodesc, cbuf, ibuf, 1);
-                rearrange_io2comp(ios, iodesc, ibuf, cbuf);
-                GPTLstamp(wall+1, usr, sys);
-                wall[1] -= wall[0];
-                if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, wall + 1, 1, MPI_DOUBLE, MPI_MAX,
-                                            mycomm)))
-                    return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    /* The first round trips build the communication plans, so they
+     * are not timed. Then time the current options. */
+    if ((ret = time_rearr_round_trip(ios, iodesc, cbuf, ibuf, comm, &wtime)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = time_rearr_round_trip(ios, iodesc, cbuf, ibuf, comm, &mintime)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    best = iodesc->rearr_opts;
+    LOG((2, "performance_tune_rearranger comm_type = %d time = %f",
+         best.comm_type, mintime));
+
+    /* Collective communication (MPI_Alltoallw). */
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_COLL;
+    iodesc->rearr_opts.comp2io.hs = false;
+    iodesc->rearr_opts.comp2io.isend = false;
+    iodesc->rearr_opts.comp2io.max_pend_req = 0;
+    iodesc->rearr_opts.io2comp = iodesc->rearr_opts.comp2io;
+    if ((ret = try_rearr_opts(ios, iodesc, cbuf, ibuf, comm, &best, &mintime, &wtime)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
 
-                if (wall[1] < mintime * 0.95)
-                {
-                    handshake = iodesc->rearr_opts.comp2io.hs;
-                    isend = iodesc->isend;
-                    maxreqs = nreqs;
-                    mintime = wall[1];
-                }
-                else if (wall[1] > mintime * 1.05)
-                {
-                    exit;
-                }
-            }
+#ifndef MPI_SERIAL
+    /* Neighborhood collectives (MPI_Neighbor_alltoallw). The graph
+     * communicator is built before the timing starts. */
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_NEIGHBOR;
+    if (!iodesc->neighbors)
+        if ((ret = create_neighbor_comm(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = try_rearr_opts(ios, iodesc, cbuf, ibuf, comm, &best, &mintime, &wtime)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+#endif /* MPI_SERIAL */
+
+    /* Point-to-point communication. */
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_P2P;
+    for (int i = 0; i < 4; i++)
+    {
+        iodesc->rearr_opts.comp2io.hs = i & 1;
+        iodesc->rearr_opts.comp2io.isend = i & 2;
+
+        /* Start with no limit on pending requests (nreqs ==
+         * nprocs), then halve the limit. Stop once it gets clearly
+         * slower than the best limit of this hs/isend combination. */
+        double combtime = 0; /* Best time of this combination. */
+        for (int nreqs = nprocs; nreqs >= 2; nreqs /= 2)
+        {
+            iodesc->rearr_opts.comp2io.max_pend_req =
+                nreqs == nprocs ? PIO_REARR_COMM_UNLIMITED_PEND_REQ : nreqs;
+            iodesc->rearr_opts.io2comp = iodesc->rearr_opts.comp2io;
+
+            if ((ret = try_rearr_opts(ios, iodesc, cbuf, ibuf, comm, &best, &mintime, &wtime)))
+                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+            if (nreqs == nprocs || wtime < combtime)
+                combtime = wtime;
+            else if (wtime > combtime * 1.05)
+                break;
         }
     }
 
-    iodesc->rearr_opts.comp2io.hs = handshake;
-    iodesc->isend = isend;
-    iodesc->max_requests = maxreqs;
+    iodesc->rearr_opts = best;
+    LOG((1, "performance_tune_rearranger comm_type = %d hs = %d isend = %d "
+         "max_pend_req = %d mintime = %f", best.comm_type, best.comp2io.hs,
+         best.comp2io.isend, best.comp2io.max_pend_req, mintime));
+
+    /* Keep the graph communicator only if it is used. */
+    if (best.comm_type != PIO_REARR_COMM_NEIGHBOR)
+        if ((ret = free_neighbor_comm(iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Performance tuning rearranger. This is called on the first write of
+ * a decomposition if tuning has been turned on for the iosystem with
+ * PIOc_set_rearr_tune(). Round trips of data through the rearranger
+ * are timed with the current options, with collective communication,
+ * with neighborhood collectives, and with point-to-point
+ * communication for every combination of handshake and isend, halving
+ * max_pend_req from unlimited down to 2. Each set of options is timed
+ * TUNE_NREPS times, and its fastest round trip counts. The fastest
+ * options are kept in iodesc->rearr_opts and used for all later reads
+ * and writes of the decomposition.
+ *
+ * This function is collective over the communicator of the
+ * rearranger.
+ *
+ * @param ios pointer to the iosystem description struct.
+ * @param iodesc pointer to the IO description struct.
+ * @returns 0 on success, error code otherwise.
+ */
+int performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+    void *cbuf = NULL;
+    void *ibuf = NULL;
+    MPI_Comm mycomm;
+    int ret;
+
+    pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
+
+    if (iodesc->rearranger == PIO_REARR_BOX)
+        mycomm = ios->union_comm;
+    else
+        mycomm = iodesc->subset_comm;
+
+    /* Scratch buffers. Their contents do not matter. */
+    if (iodesc->ndof > 0)
+        if (!(cbuf = calloc(iodesc->ndof, iodesc->basetype_size)))
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    if (iodesc->llen > 0)
+        if (!(ibuf = calloc(iodesc->llen, iodesc->basetype_size)))
+        {
+            free(cbuf);
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        }
 
-    LOG((1, "spmd optimization: maxreqs: %d handshake:%d isend:%d mintime=%f\n",
-         maxreqs,handshake,isend,mintime));
+    ret = tune_rearr_opts(ios, iodesc, cbuf, ibuf, mycomm);
 
     /* Free memory. */
-    brel(wall);
-    brel(cbuf);
-    brel(ibuf);
-#endif
-#endif
+    free(cbuf);
+    free(ibuf);
+    if (ret)
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    iodesc->rearr_tuned = true;
+
+    return PIO_NOERR;
 }
@@ -16,6 +16,8 @@ int PIOc_put_varm (int ncid, int varid, const PIO_Offset start[], const PIO_Offs
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -48,7 +50,8 @@ int PIOc_put_varm (int ncid, int varid, const PIO_Offset start[], const PIO_Offs
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -62,6 +65,9 @@ int PIOc_put_varm (int ncid, int varid, const PIO_Offset start[], const PIO_Offs
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -89,6 +95,8 @@ int PIOc_put_varm_uchar (int ncid, int varid, const PIO_Offset start[], const PI
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -117,7 +125,8 @@ int PIOc_put_varm_uchar (int ncid, int varid, const PIO_Offset start[], const PI
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -131,6 +140,9 @@ int PIOc_put_varm_uchar (int ncid, int varid, const PIO_Offset start[], const PI
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -158,6 +170,8 @@ int PIOc_put_varm_short (int ncid, int varid, const PIO_Offset start[], const PI
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -186,7 +200,8 @@ int PIOc_put_varm_short (int ncid, int varid, const PIO_Offset start[], const PI
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -200,6 +215,9 @@ int PIOc_put_varm_short (int ncid, int varid, const PIO_Offset start[], const PI
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -226,6 +244,8 @@ int PIOc_put_varm_text (int ncid, int varid, const PIO_Offset start[], const PIO
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -256,7 +276,8 @@ int PIOc_put_varm_text (int ncid, int varid, const PIO_Offset start[], const PIO
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -270,6 +291,9 @@ int PIOc_put_varm_text (int ncid, int varid, const PIO_Offset start[], const PIO
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -297,6 +321,8 @@ int PIOc_put_varm_ushort (int ncid, int varid, const PIO_Offset start[], const P
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -327,7 +353,8 @@ int PIOc_put_varm_ushort (int ncid, int varid, const PIO_Offset start[], const P
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -341,6 +368,9 @@ int PIOc_put_varm_ushort (int ncid, int varid, const PIO_Offset start[], const P
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -368,6 +398,8 @@ int PIOc_put_varm_ulonglong (int ncid, int varid, const PIO_Offset start[], cons
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -398,7 +430,8 @@ int PIOc_put_varm_ulonglong (int ncid, int varid, const PIO_Offset start[], cons
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -412,6 +445,9 @@ int PIOc_put_varm_ulonglong (int ncid, int varid, const PIO_Offset start[], cons
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -438,6 +474,8 @@ int PIOc_put_varm_int (int ncid, int varid, const PIO_Offset start[], const PIO_
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -468,7 +506,8 @@ int PIOc_put_varm_int (int ncid, int varid, const PIO_Offset start[], const PIO_
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -482,6 +521,9 @@ int PIOc_put_varm_int (int ncid, int varid, const PIO_Offset start[], const PIO_
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -509,6 +551,8 @@ int PIOc_put_varm_float (int ncid, int varid, const PIO_Offset start[], const PI
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -539,7 +583,8 @@ int PIOc_put_varm_float (int ncid, int varid, const PIO_Offset start[], const PI
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -553,6 +598,9 @@ int PIOc_put_varm_float (int ncid, int varid, const PIO_Offset start[], const PI
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -579,6 +627,8 @@ int PIOc_put_varm_long (int ncid, int varid, const PIO_Offset start[], const PIO
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -609,7 +659,8 @@ int PIOc_put_varm_long (int ncid, int varid, const PIO_Offset start[], const PIO
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -623,6 +674,9 @@ int PIOc_put_varm_long (int ncid, int varid, const PIO_Offset start[], const PIO
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -650,6 +704,8 @@ int PIOc_put_varm_uint (int ncid, int varid, const PIO_Offset start[], const PIO
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -681,7 +737,8 @@ int PIOc_put_varm_uint (int ncid, int varid, const PIO_Offset start[], const PIO
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -695,6 +752,9 @@ int PIOc_put_varm_uint (int ncid, int varid, const PIO_Offset start[], const PIO
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -722,6 +782,8 @@ int PIOc_put_varm_double (int ncid, int varid, const PIO_Offset start[], const P
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -752,7 +814,8 @@ int PIOc_put_varm_double (int ncid, int varid, const PIO_Offset start[], const P
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -766,6 +829,9 @@ int PIOc_put_varm_double (int ncid, int varid, const PIO_Offset start[], const P
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -792,6 +858,8 @@ int PIOc_put_varm_schar (int ncid, int varid, const PIO_Offset start[], const PI
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -822,7 +890,8 @@ int PIOc_put_varm_schar (int ncid, int varid, const PIO_Offset start[], const PI
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -836,6 +905,9 @@ int PIOc_put_varm_schar (int ncid, int varid, const PIO_Offset start[], const PI
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -863,6 +935,8 @@ int PIOc_put_varm_longlong (int ncid, int varid, const PIO_Offset start[], const
     file_desc_t *file;
     var_desc_t *vdesc;
     int *request;
+    PIO_Offset putbytes;
+    int ret;
 
     ierr = PIO_NOERR;
 
@@ -891,7 +965,8 @@ int PIOc_put_varm_longlong (int ncid, int varid, const PIO_Offset start[], const
             break;
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            vdesc = file->varlist + varid;
+            if ((ret = get_var_desc(varid, file, &vdesc)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
 
             if (vdesc->nreqs%PIO_REQUEST_ALLOC_CHUNK == 0 ){
                 vdesc->request = realloc(vdesc->request,
@@ -905,6 +980,9 @@ int PIOc_put_varm_longlong (int ncid, int varid, const PIO_Offset start[], const
                 *request = PIO_REQ_NULL;
             }
             vdesc->nreqs++;
+            if ((ret = pnetcdf_put_bytes(file, varid, count, &putbytes)) ||
+                (ret = add_pending_var(file, varid, putbytes, true)))
+                return pio_err(ios, file, ret, __FILE__, __LINE__);
             flush_output_buffer(file, false, 0);
             break;
 #endif
@@ -109,6 +109,7 @@ int PIOc_Set_File_Error_Handling(int ncid, int method)
 int PIOc_advanceframe(int ncid, int varid)
 {
     file_desc_t *file;
+    var_desc_t *vdesc;
     int ret;
 
     /* Get the file info. */
@@ -119,7 +120,11 @@ int PIOc_advanceframe(int ncid, int varid)
     if (varid < 0 || varid >= PIO_MAX_VARS)
         return pio_err(NULL, file, PIO_EINVAL, __FILE__, __LINE__);
 
-    file->varlist[varid].record++;
+    /* Get the var info. */
+    if ((ret = get_var_desc(varid, file, &vdesc)))
+        return pio_err(NULL, file, ret, __FILE__, __LINE__);
+
+    vdesc->record++;
 
     return PIO_NOERR;
 }
@@ -137,6 +142,7 @@ int PIOc_advanceframe(int ncid, int varid)
 int PIOc_setframe(int ncid, int varid, int frame)
 {
     file_desc_t *file;
+    var_desc_t *vdesc;
     int ret;
 
     /* Get file info. */
@@ -147,7 +153,11 @@ int PIOc_setframe(int ncid, int varid, int frame)
     if (varid < 0 || varid >= PIO_MAX_VARS)
         return pio_err(NULL, file, PIO_EINVAL, __FILE__, __LINE__);
 
-    file->varlist[varid].record = frame;
+    /* Get the var info. */
+    if ((ret = get_var_desc(varid, file, &vdesc)))
+        return pio_err(NULL, file, ret, __FILE__, __LINE__);
+
+    vdesc->record = frame;
 
     return PIO_NOERR;
 }
@@ -189,6 +199,34 @@ int PIOc_get_local_array_size(int ioid)
     return iodesc->ndof;
 }
 
+/**
+ * Get the number of data regions this task writes and reads for a
+ * decomposition. Each region is one hyperslab in the calls to the
+ * netCDF libraries. Neighboring regions that form one hyperslab are
+ * merged when the decomposition is created.
+ *
+ * @param ioid IO descrption ID.
+ * @param nfoundp pointer that gets the number of regions before
+ * merging. Ignored if NULL.
+ * @param nregionsp pointer that gets the number of regions after
+ * merging. Ignored if NULL.
+ * @returns 0 for success, error code otherwise.
+ */
+int PIOc_get_region_stats(int ioid, int *nfoundp, int *nregionsp)
+{
+    io_desc_t *iodesc;
+
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    if (nfoundp)
+        *nfoundp = iodesc->nregions_found;
+    if (nregionsp)
+        *nregionsp = iodesc->nregions;
+
+    return PIO_NOERR;
+}
+
 /**
  * Set the error handling method used for subsequent calls. This
  * function is deprecated. New code should use
@@ -256,8 +294,7 @@ int PIOc_set_iosystem_error_handling(int iosysid, int method, int *old_method)
                 int msg = PIO_MSG_SETERRORHANDLING;
                 char old_method_present = old_method ? true : false;
 
-                if (ios->compmaster == MPI_ROOT)
-                    mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+                mpierr = send_msg(ios, msg);
 
                 if (!mpierr)
                     mpierr = MPI_Bcast(&method, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -292,9 +329,16 @@ int PIOc_set_iosystem_error_handling(int iosysid, int method, int *old_method)
  *
  * Internally, this function will:
  * <ul>
+ * <li>Unless iostart and iocount are given, look for an existing
+ * decomposition of the same map with find_cached_iodesc(). If one of
+ * the same type is found, increment its reference count and return
+ * its ioid. PIOc_freedecomp() must then be called once for each time
+ * it was returned.
  * <li>Allocate and initialize an iodesc struct for this
  * decomposition. (This also allocates an io_region struct for the
  * first region.)
+ * <li>If a decomposition of the same map but another type was found,
+ * copy its rearrangement with copy_iodesc_layout().
  * <li>(Box rearranger only) If iostart or iocount are NULL, call
  * CalcStartandCount() to determine starts/counts. Then call
  * compute_maxIObuffersize() to compute the max IO buffer size needed.
@@ -333,6 +377,9 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     io_desc_t *iodesc;     /* The IO description. */
+    io_desc_t *cached = NULL; /* Existing decomposition of the same map and type. */
+    io_desc_t *layout = NULL; /* Existing decomposition of the same map. */
+    unsigned long long maphash = 0;
     int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function calls. */
     int ierr;              /* Return code. */
 
@@ -357,43 +404,32 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
     {
         if (!ios->ioproc)
         {
-            int msg = PIO_MSG_INITDECOMP_DOF; /* Message for async notification. */
             char rearranger_present = rearranger ? true : false;
             char iostart_present = iostart ? true : false;
             char iocount_present = iocount ? true : false;
-
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&iosysid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&pio_type, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ndims, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((int *)gdimlen, ndims, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&maplen, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((PIO_Offset *)compmap, maplen, MPI_OFFSET, ios->compmaster, ios->intercomm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&rearranger_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (rearranger_present && !mpierr)
-                mpierr = MPI_Bcast((int *)rearranger, 1, MPI_INT, ios->compmaster, ios->intercomm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&iostart_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (iostart_present && !mpierr)
-                mpierr = MPI_Bcast((PIO_Offset *)iostart, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&iocount_present, 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (iocount_present && !mpierr)
-                mpierr = MPI_Bcast((PIO_Offset *)iocount, ndims, MPI_OFFSET, ios->compmaster, ios->intercomm);
-            LOG((2, "PIOc_InitDecomp iosysid = %d pio_type = %d ndims = %d maplen = %d rearranger_present = %d iostart_present = %d "
-                 "iocount_present = %d ", iosysid, pio_type, ndims, maplen, rearranger_present, iostart_present, iocount_present));
+            msg_buf_t mb;
+
+            /* The IO tasks hold no data of the decomposition, so the
+             * map is not sent. */
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &iosysid, sizeof(int));
+            msg_pack(&mb, &pio_type, sizeof(int));
+            msg_pack(&mb, &ndims, sizeof(int));
+            msg_pack(&mb, gdimlen, ndims * sizeof(int));
+            msg_pack(&mb, &rearranger_present, 1);
+            if (rearranger_present)
+                msg_pack(&mb, rearranger, sizeof(int));
+            msg_pack(&mb, &iostart_present, 1);
+            if (iostart_present)
+                msg_pack(&mb, iostart, ndims * sizeof(PIO_Offset));
+            msg_pack(&mb, &iocount_present, 1);
+            if (iocount_present)
+                msg_pack(&mb, iocount, ndims * sizeof(PIO_Offset));
+            mpierr = send_packed_msg(ios, PIO_MSG_INITDECOMP_DOF, &mb);
+            msg_buf_free(&mb);
+            LOG((2, "PIOc_InitDecomp iosysid = %d pio_type = %d ndims = %d rearranger_present = %d "
+                 "iostart_present = %d iocount_present = %d ", iosysid, pio_type, ndims,
+                 rearranger_present, iostart_present, iocount_present));
         }
 
         /* Handle MPI errors. */
@@ -403,11 +439,33 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
             return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
     }
 
+    /* Look for a decomposition of the same map. If there is one of
+     * the same type, return it. Decompositions with user-provided IO
+     * start and count are not reused. */
+    if (!(iostart && iocount))
+    {
+        if ((ierr = find_cached_iodesc(ios, pio_type,
+                                       rearranger ? *rearranger : ios->default_rearranger,
+                                       ndims, gdimlen, maplen, compmap, &maphash, &cached,
+                                       &layout)))
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__);
+        if (cached)
+        {
+            cached->refcount++;
+            *ioidp = cached->ioid;
+            LOG((2, "reusing decomposition ioid = %d refcount = %d", cached->ioid,
+                 cached->refcount));
+            return PIO_NOERR;
+        }
+    }
+
     /* Allocate space for the iodesc info. This also allocates the
      * first region and copies the rearranger opts into this
      * iodesc. */
     if ((ierr = malloc_iodesc(ios, pio_type, ndims, &iodesc)))
         return pio_err(ios, NULL, ierr, __FILE__, __LINE__);
+    iodesc->maphash = maphash;
+    iodesc->decomp_seq = ios->num_decomps++;
 
     /* Remember the maplen. */
     iodesc->maplen = maplen;
@@ -431,8 +489,14 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
         iodesc->rearranger = *rearranger;
     LOG((2, "iodesc->rearranger = %d", iodesc->rearranger));
 
-    /* Is this the subset rearranger? */
-    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    /* If there is a decomposition of the same map for another type,
+     * copy its rearrangement. Is this the subset rearranger? */
+    if (layout)
+    {
+        if ((ierr = copy_iodesc_layout(ios, layout, iodesc)))
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__);
+    }
+    else if (iodesc->rearranger == PIO_REARR_SUBSET)
     {
         iodesc->num_aiotasks = ios->num_iotasks;
         LOG((2, "creating subset rearranger iodesc->num_aiotasks = %d",
@@ -461,9 +525,9 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
             {
                 /* Compute start and count values for each io task. */
                 LOG((2, "about to call CalcStartandCount pio_type = %d ndims = %d", pio_type, ndims));
-                if ((ierr = CalcStartandCount(pio_type, ndims, gdimlen, ios->num_iotasks,
-                                             ios->io_rank, iodesc->firstregion->start,
-                                             iodesc->firstregion->count, &iodesc->num_aiotasks)))
+                if ((ierr = calc_box_layout(ios, pio_type, ndims, gdimlen,
+                                            iodesc->firstregion->start,
+                                            iodesc->firstregion->count, &iodesc->num_aiotasks)))
                     return pio_err(ios, NULL, ierr, __FILE__, __LINE__);
             }
 
@@ -497,14 +561,11 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
          iodesc->ioid, iodesc->nrecvs, iodesc->ndof, iodesc->ndims, iodesc->num_aiotasks,
          iodesc->rearranger, iodesc->maxregions, iodesc->needsfill, iodesc->llen,
          iodesc->maxiobuflen));
-    for (int j = 0; j < iodesc->llen; j++)
-        LOG((3, "rindex[%d] = %lld", j, iodesc->rindex[j]));
+    if (iodesc->rindex)
+        for (int j = 0; j < iodesc->llen; j++)
+            LOG((3, "rindex[%d] = %lld", j, iodesc->rindex[j]));
 #endif /* PIO_ENABLE_LOGGING */            
 
-    /* This function only does something if pre-processor macro
-     * PERFTUNE is set. */
-    performance_tune_rearranger(ios, iodesc);
-
     return PIO_NOERR;
 }
 
@@ -926,8 +987,7 @@ int PIOc_finalize(int iosysid)
                  ios->ioroot, ios->union_comm));
 
             /* Send the message to the message handler. */
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             /* Send the parameters of the function call. */
             if (!mpierr)
@@ -950,6 +1010,7 @@ int PIOc_finalize(int iosysid)
     if (ios->compranks)
         free(ios->compranks);
     LOG((3, "Freed compranks."));
+    msg_buf_free(&ios->batch);
 
     /* Free the buffer pool. */
     int niosysid;
@@ -1480,6 +1541,12 @@ int PIOc_init_async(MPI_Comm world, int num_io_procs, int *io_proc_list,
         LOG((2, "new iosys ID added to iosystem_list iosysid = %d", iosysidp[cmp]));
     } /* next computational component */
 
+    /* Allocate buffer space for compute nodes. PIOc_write_darray()
+     * on the computation tasks buffers data here before it is sent
+     * to the IO tasks. */
+    if ((ret = compute_buffer_init(iosys[0])))
+        return ret;
+
     /* Now call the function from which the IO tasks will not return
      * until the PIO_MSG_EXIT message is sent. This will handle all
      * components. */
@@ -0,0 +1,600 @@
+/** @file
+ * Decomposition replay benchmark for the PIO C library.
+ *
+ * Reads decompositions saved with PIOc_write_decomp() or
+ * PIOc_writemap() (or with PIOc_writemap_bin(), with -b), and replays
+ * write and read cycles with them for every combination of iotype,
+ * rearranger, number of IO tasks, stride and rearranger options given
+ * on the command line. For each combination task 0 prints one line of
+ * comma separated values with the setup time, the write and read
+ * throughput, and the bytes in use and held by the compute buffer
+ * pool of the largest task once all writes of the combination are
+ * buffered.
+ *
+ * <pre>
+ * mpiexec -n 16 pioc_perf [options] decomp_file ...
+ *   -v nvars        number of variables written (1)
+ *   -f nframes      number of records written (1)
+ *   -t iotypes      pnetcdf,netcdf,netcdf4c,netcdf4p (all available)
+ *   -r rearrangers  box,subset (box,subset)
+ *   -n num_iotasks  list of IO task counts (powers of 2, up to ntasks)
+ *   -s strides      list of strides, 0 spreads the IO tasks (0)
+ *   -c comm_types   p2p,coll,neighbor (coll)
+ *   -d fcds         2d,comp2io,io2comp,none (none)
+ *   -H handshakes   list of 0/1 (0)
+ *   -I isends       list of 0/1 (0)
+ *   -p pend_reqs    list of max pending requests, -1 for no limit (-1)
+ *   -o file         name of the data file (pioc_perf.nc)
+ *   -b              the decomp files are binary decomp files
+ * </pre>
+ *
+ * The rearranger options are used in both directions. Lists are comma
+ * separated.
+ */
+#include <config.h>
+#include <getopt.h>
+#include <pio.h>
+
+/** Maximum number of entries of an option list. */
+#define MAX_LIST 32
+
+/** Default name of the data file. */
+#define DEFAULT_FILE "pioc_perf.nc"
+
+/** Return code when the data read do not match the data written. */
+#define ERR_PERF_DATA 1001
+
+/** The option lists, in the order of the loops over them. The last
+ * list changes fastest. */
+enum perf_lists
+{
+    LIST_IOTYPE, LIST_REARR, LIST_NIOTASKS, LIST_STRIDE, LIST_COMM_TYPE, LIST_FCD, LIST_HS,
+    LIST_ISEND, LIST_PEND_REQ, NUM_LISTS
+};
+
+/** An option list. */
+typedef struct perf_list
+{
+    int n;
+    int v[MAX_LIST];
+} perf_list_t;
+
+/** The names of the values of the option lists. */
+typedef struct perf_name
+{
+    const char *name;
+    int value;
+} perf_name_t;
+
+static const perf_name_t iotype_names[] = {
+    {"pnetcdf", PIO_IOTYPE_PNETCDF}, {"netcdf", PIO_IOTYPE_NETCDF},
+    {"netcdf4c", PIO_IOTYPE_NETCDF4C}, {"netcdf4p", PIO_IOTYPE_NETCDF4P}, {NULL, 0}};
+static const perf_name_t rearr_names[] = {
+    {"box", PIO_REARR_BOX}, {"subset", PIO_REARR_SUBSET}, {NULL, 0}};
+static const perf_name_t comm_type_names[] = {
+    {"p2p", PIO_REARR_COMM_P2P}, {"coll", PIO_REARR_COMM_COLL},
+    {"neighbor", PIO_REARR_COMM_NEIGHBOR}, {NULL, 0}};
+static const perf_name_t fcd_names[] = {
+    {"2d", PIO_REARR_COMM_FC_2D_ENABLE}, {"comp2io", PIO_REARR_COMM_FC_1D_COMP2IO},
+    {"io2comp", PIO_REARR_COMM_FC_1D_IO2COMP}, {"none", PIO_REARR_COMM_FC_2D_DISABLE},
+    {NULL, 0}};
+
+/** A decomposition read from a decomp file. */
+typedef struct perf_decomp
+{
+    const char *file;
+    int ndims;
+    int *gdims;
+    PIO_Offset maplen;
+    PIO_Offset *map;
+
+    /** Number of elements in the global array that are written,
+     * holes in the map are not counted. */
+    PIO_Offset nelems;
+} perf_decomp_t;
+
+/** One configuration to run. */
+typedef struct perf_config
+{
+    int iotype;
+    int rearr;
+    int num_iotasks;
+    int stride;
+    rearr_opt_t opts;
+    int nvars;
+    int nframes;
+    const char *filename;
+} perf_config_t;
+
+/** The results of one configuration, on task 0. */
+typedef struct perf_result
+{
+    int status;
+    double setup;
+    double write;
+    double read;
+    PIO_Offset pool_inuse;
+    PIO_Offset pool_footprint;
+} perf_result_t;
+
+/**
+ * Get the name of a value of an option.
+ *
+ * @param names the names of the option values.
+ * @param value the value.
+ * @returns the name, or "?" if the value has no name.
+ */
+static const char *perf_name(const perf_name_t *names, int value)
+{
+    for (int i = 0; names[i].name; i++)
+        if (names[i].value == value)
+            return names[i].name;
+    return "?";
+}
+
+/**
+ * Parse a comma separated option list.
+ *
+ * @param arg the option argument, which is changed.
+ * @param names the names of the values, or NULL if the list has
+ * numbers.
+ * @param list pointer to the list that gets the values.
+ * @returns 0 for success, PIO_EINVAL if the list is invalid.
+ */
+static int parse_list(char *arg, const perf_name_t *names, perf_list_t *list)
+{
+    list->n = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ","))
+    {
+        int i;
+
+        if (list->n == MAX_LIST)
+            return PIO_EINVAL;
+        if (!names)
+        {
+            list->v[list->n++] = atoi(tok);
+            continue;
+        }
+        for (i = 0; names[i].name; i++)
+            if (!strcmp(tok, names[i].name))
+                break;
+        if (!names[i].name)
+            return PIO_EINVAL;
+        list->v[list->n++] = names[i].value;
+    }
+
+    return list->n ? PIO_NOERR : PIO_EINVAL;
+}
+
+/**
+ * Read a decomposition from a decomp file.
+ *
+ * @param comm the communicator of all tasks.
+ * @param binary non-zero if the file is a binary decomp file.
+ * @param decomp pointer to the decomposition, file must be set. The
+ * caller frees gdims and map, also after an error.
+ * @returns 0 for success, error code otherwise.
+ */
+static int read_decomp(MPI_Comm comm, int binary, perf_decomp_t *decomp)
+{
+    PIO_Offset nelems = 0;
+    int ret;
+
+    if (binary)
+        ret = PIOc_readmap_bin(decomp->file, &decomp->ndims, &decomp->gdims, &decomp->maplen,
+                               &decomp->map, comm);
+    else
+        ret = PIOc_readmap(decomp->file, &decomp->ndims, &decomp->gdims, &decomp->maplen,
+                           &decomp->map, comm);
+    if (ret)
+        return ret;
+
+    for (PIO_Offset i = 0; i < decomp->maplen; i++)
+        if (decomp->map[i] > 0)
+            nelems++;
+    if (MPI_Allreduce(&nelems, &decomp->nelems, 1, MPI_OFFSET, MPI_SUM, comm))
+        return PIO_EIO;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Time a collective operation: wait for all tasks, and get the time of
+ * the slowest task since start.
+ *
+ * @param comm the communicator of all tasks.
+ * @param start the value of MPI_Wtime() at the start.
+ * @returns the time in seconds.
+ */
+static double elapsed(MPI_Comm comm, double start)
+{
+    double t = MPI_Wtime() - start;
+
+    MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return t;
+}
+
+/**
+ * Define one record variable in the data file for each of the
+ * variables of the configuration.
+ *
+ * @param ncid the ncid of the data file, in define mode.
+ * @param decomp the decomposition.
+ * @param config the configuration.
+ * @param varids array that gets the IDs of the variables.
+ * @returns 0 for success, error code otherwise.
+ */
+static int define_data_vars(int ncid, const perf_decomp_t *decomp, const perf_config_t *config,
+                            int *varids)
+{
+    int dimids[decomp->ndims + 1];
+    int ret;
+
+    if ((ret = PIOc_def_dim(ncid, "time", PIO_UNLIMITED, &dimids[0])))
+        return ret;
+    for (int d = 0; d < decomp->ndims; d++)
+    {
+        char name[PIO_MAX_NAME + 1];
+
+        sprintf(name, "dim%d", d);
+        if ((ret = PIOc_def_dim(ncid, name, decomp->gdims[d], &dimids[d + 1])))
+            return ret;
+    }
+    for (int v = 0; v < config->nvars; v++)
+    {
+        char name[PIO_MAX_NAME + 1];
+
+        sprintf(name, "var%04d", v);
+        if ((ret = PIOc_def_var(ncid, name, PIO_INT, decomp->ndims + 1, dimids, &varids[v])))
+            return ret;
+    }
+
+    return PIOc_enddef(ncid);
+}
+
+/**
+ * Write the records of all variables, then read them back and check
+ * them. The files are closed on all return paths.
+ *
+ * @param comm the communicator of all tasks.
+ * @param config the configuration.
+ * @param iosysid the IO system ID.
+ * @param ioid the decomposition ID.
+ * @param decomp the decomposition.
+ * @param arraylen the local length of the data.
+ * @param data the data to write.
+ * @param data_in buffer for the data read.
+ * @param res pointer that gets the write and read times, and the
+ * buffer pool use.
+ * @returns 0 for success, error code otherwise.
+ */
+static int replay(MPI_Comm comm, const perf_config_t *config, int iosysid, int ioid,
+                  const perf_decomp_t *decomp, PIO_Offset arraylen, int *data, int *data_in,
+                  perf_result_t *res)
+{
+    int iotype = config->iotype;
+    int varids[config->nvars];
+    int ncid;
+    PIO_Offset pool[2];  /* Bytes in use and held by the buffer pool. */
+    int bad = 0;
+    double start;
+    int ret, ret2;
+
+    /* Write the records. Closing the file flushes the data. */
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, config->filename, PIO_CLOBBER)))
+        return ret;
+    ret = define_data_vars(ncid, decomp, config, varids);
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for (int f = 0; f < config->nframes && !ret; f++)
+        for (int v = 0; v < config->nvars && !ret; v++)
+            if (!(ret = PIOc_setframe(ncid, varids[v], f)))
+                ret = PIOc_write_darray(ncid, varids[v], ioid, arraylen, data, NULL);
+
+    /* The buffered writes are in the buffer pool until the file is
+     * closed. Once they are flushed, bget returns the pool, and it
+     * has nothing to report. */
+    PIOc_get_buffer_pool_stats(NULL, &pool[0], &pool[1], NULL);
+    MPI_Allreduce(MPI_IN_PLACE, pool, 2, MPI_OFFSET, MPI_MAX, comm);
+    res->pool_inuse = pool[0];
+    res->pool_footprint = pool[1];
+
+    if ((ret2 = PIOc_closefile(ncid)) && !ret)
+        ret = ret2;
+    if (ret)
+        return ret;
+    res->write = elapsed(comm, start);
+
+    /* Read the records back, and check them. */
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, config->filename, PIO_NOWRITE)))
+        return ret;
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for (int f = 0; f < config->nframes && !ret; f++)
+        for (int v = 0; v < config->nvars && !ret; v++)
+            if (!(ret = PIOc_setframe(ncid, varids[v], f)) &&
+                !(ret = PIOc_read_darray(ncid, varids[v], ioid, arraylen, data_in)))
+                for (PIO_Offset i = 0; i < arraylen; i++)
+                    if (decomp->map[i] > 0 && data_in[i] != data[i])
+                        bad = 1;
+    if ((ret2 = PIOc_closefile(ncid)) && !ret)
+        ret = ret2;
+    if (ret)
+        return ret;
+    res->read = elapsed(comm, start);
+
+    MPI_Allreduce(MPI_IN_PLACE, &bad, 1, MPI_INT, MPI_MAX, comm);
+
+    return bad ? ERR_PERF_DATA : PIO_NOERR;
+}
+
+/**
+ * Replay one write and read cycle of a decomposition with one
+ * configuration. The IO system, the decomposition and the buffers
+ * are freed on all return paths.
+ *
+ * @param comm the communicator of all tasks.
+ * @param decomp the decomposition.
+ * @param config the configuration.
+ * @param res pointer that gets the results.
+ * @returns 0 for success, error code otherwise.
+ */
+static int run_config(MPI_Comm comm, const perf_decomp_t *decomp, const perf_config_t *config,
+                      perf_result_t *res)
+{
+    int iosysid, ioid;
+    int rearr = config->rearr;
+    PIO_Offset arraylen;
+    int *data, *data_in;
+    double start;
+    int ret, ret2;
+
+    /* Set up the IO system and the decomposition. */
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    if ((ret = PIOc_Init_Intracomm(comm, config->num_iotasks, config->stride, 0, rearr,
+                                   &iosysid)))
+        return ret;
+    if ((ret = PIOc_set_iosystem_error_handling(iosysid, PIO_BCAST_ERROR, NULL)) ||
+        (ret = PIOc_set_rearr_opts(iosysid, config->opts.comm_type, config->opts.fcd,
+                                   config->opts.comp2io.hs, config->opts.comp2io.isend,
+                                   config->opts.comp2io.max_pend_req,
+                                   config->opts.io2comp.hs, config->opts.io2comp.isend,
+                                   config->opts.io2comp.max_pend_req)) ||
+        (ret = PIOc_InitDecomp(iosysid, PIO_INT, decomp->ndims, decomp->gdims, decomp->maplen,
+                               decomp->map, &ioid, &rearr, NULL, NULL)))
+    {
+        PIOc_finalize(iosysid);
+        return ret;
+    }
+    res->setup = elapsed(comm, start);
+
+    /* The data are the global index of each element. */
+    arraylen = PIOc_get_local_array_size(ioid);
+    data = malloc((arraylen + 1) * sizeof(int));
+    data_in = malloc((arraylen + 1) * sizeof(int));
+    if (data && data_in)
+    {
+        for (PIO_Offset i = 0; i < arraylen; i++)
+            data[i] = decomp->map[i];
+        ret = replay(comm, config, iosysid, ioid, decomp, arraylen, data, data_in, res);
+    }
+    else
+        ret = PIO_ENOMEM;
+    free(data);
+    free(data_in);
+
+    if ((ret2 = PIOc_freedecomp(iosysid, ioid)) && !ret)
+        ret = ret2;
+    if ((ret2 = PIOc_finalize(iosysid)) && !ret)
+        ret = ret2;
+
+    return ret;
+}
+
+/**
+ * Set up the configuration with one combination of the option
+ * lists.
+ *
+ * @param lists the option lists.
+ * @param k the number of the combination.
+ * @param ntasks the number of tasks.
+ * @param config pointer to the configuration.
+ * @returns non-zero if the IO tasks of the configuration fit on the
+ * tasks.
+ */
+static int set_config(perf_list_t *const *lists, int k, int ntasks, perf_config_t *config)
+{
+    int val[NUM_LISTS];
+
+    for (int l = NUM_LISTS - 1; l >= 0; l--)
+    {
+        val[l] = lists[l]->v[k % lists[l]->n];
+        k /= lists[l]->n;
+    }
+
+    config->iotype = val[LIST_IOTYPE];
+    config->rearr = val[LIST_REARR];
+    config->num_iotasks = val[LIST_NIOTASKS];
+    config->stride = val[LIST_STRIDE];
+    if (!config->stride && config->num_iotasks > 0)
+        config->stride = ntasks / config->num_iotasks;
+    config->opts.comm_type = val[LIST_COMM_TYPE];
+    config->opts.fcd = val[LIST_FCD];
+    config->opts.comp2io.hs = val[LIST_HS];
+    config->opts.comp2io.isend = val[LIST_ISEND];
+    config->opts.comp2io.max_pend_req = val[LIST_PEND_REQ];
+    config->opts.io2comp = config->opts.comp2io;
+
+    return config->num_iotasks > 0 && config->stride > 0 &&
+        (config->num_iotasks - 1) * config->stride < ntasks;
+}
+
+/**
+ * Print one line of results.
+ *
+ * @param decomp the decomposition.
+ * @param config the configuration.
+ * @param res the results.
+ */
+static void print_result(const perf_decomp_t *decomp, const perf_config_t *config,
+                         const perf_result_t *res)
+{
+    PIO_Offset bytes = decomp->nelems * sizeof(int) * config->nvars * config->nframes;
+    double mb = bytes / (1024.0 * 1024.0);
+
+    printf("%s,%s,%s,%d,%d,%s,%s,%d,%d,%d,%d,%d,%lld,%d,%.6f,%.6f,%.3f,%.6f,%.3f,%lld,%lld\n",
+           decomp->file, perf_name(iotype_names, config->iotype),
+           perf_name(rearr_names, config->rearr), config->num_iotasks, config->stride,
+           perf_name(comm_type_names, config->opts.comm_type),
+           perf_name(fcd_names, config->opts.fcd), config->opts.comp2io.hs,
+           config->opts.comp2io.isend, config->opts.comp2io.max_pend_req, config->nvars,
+           config->nframes, bytes, res->status, res->setup, res->write,
+           res->write > 0 ? mb / res->write : 0, res->read, res->read > 0 ? mb / res->read : 0,
+           res->pool_inuse, res->pool_footprint);
+    fflush(stdout);
+}
+
+/** Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank, ntasks;
+    int binary = 0;
+    perf_config_t config = {0};
+    perf_list_t iotypes = {0}, rearrs = {2, {PIO_REARR_BOX, PIO_REARR_SUBSET}};
+    perf_list_t niotasks = {0}, strides = {1, {0}};
+    perf_list_t comm_types = {1, {PIO_REARR_COMM_COLL}};
+    perf_list_t fcds = {1, {PIO_REARR_COMM_FC_2D_DISABLE}};
+    perf_list_t hss = {1, {0}}, isends = {1, {0}};
+    perf_list_t pend_reqs = {1, {PIO_REARR_COMM_UNLIMITED_PEND_REQ}};
+    perf_list_t *const lists[NUM_LISTS] = {&iotypes, &rearrs, &niotasks, &strides, &comm_types,
+                                           &fcds, &hss, &isends, &pend_reqs};
+    int ncombos = 1;
+    int c;
+    int ret = PIO_NOERR;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+
+    config.nvars = 1;
+    config.nframes = 1;
+    config.filename = DEFAULT_FILE;
+    while ((c = getopt(argc, argv, "v:f:t:r:n:s:c:d:H:I:p:o:b")) != -1)
+    {
+        switch (c)
+        {
+        case 'v':
+            config.nvars = atoi(optarg);
+            break;
+        case 'f':
+            config.nframes = atoi(optarg);
+            break;
+        case 't':
+            ret = parse_list(optarg, iotype_names, &iotypes);
+            break;
+        case 'r':
+            ret = parse_list(optarg, rearr_names, &rearrs);
+            break;
+        case 'n':
+            ret = parse_list(optarg, NULL, &niotasks);
+            break;
+        case 's':
+            ret = parse_list(optarg, NULL, &strides);
+            break;
+        case 'c':
+            ret = parse_list(optarg, comm_type_names, &comm_types);
+            break;
+        case 'd':
+            ret = parse_list(optarg, fcd_names, &fcds);
+            break;
+        case 'H':
+            ret = parse_list(optarg, NULL, &hss);
+            break;
+        case 'I':
+            ret = parse_list(optarg, NULL, &isends);
+            break;
+        case 'p':
+            ret = parse_list(optarg, NULL, &pend_reqs);
+            break;
+        case 'o':
+            config.filename = optarg;
+            break;
+        case 'b':
+            binary = 1;
+            break;
+        default:
+            ret = PIO_EINVAL;
+        }
+        if (ret)
+            break;
+    }
+    if (ret || optind == argc || config.nvars < 1 || config.nframes < 1)
+    {
+        if (!my_rank)
+            fprintf(stderr, "usage: %s [-v nvars] [-f nframes] [-t iotypes] [-r rearrangers] "
+                    "[-n num_iotasks] [-s strides] [-c comm_types] [-d fcds] [-H handshakes] "
+                    "[-I isends] [-p pend_reqs] [-o file] [-b] decomp_file ...\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* By default use all available iotypes, and from one IO task to
+     * all tasks. */
+    if (!iotypes.n)
+        for (int i = 0; iotype_names[i].name; i++)
+            if (PIOc_iotype_available(iotype_names[i].value))
+                iotypes.v[iotypes.n++] = iotype_names[i].value;
+    if (!niotasks.n)
+    {
+        for (int n = 1; n < ntasks && niotasks.n < MAX_LIST - 1; n *= 2)
+            niotasks.v[niotasks.n++] = n;
+        niotasks.v[niotasks.n++] = ntasks;
+    }
+
+    for (int l = 0; l < NUM_LISTS; l++)
+        ncombos *= lists[l]->n;
+
+    if (!my_rank)
+        printf("decomp,iotype,rearranger,num_iotasks,stride,comm_type,fcd,hs,isend,"
+               "max_pend_req,nvars,nframes,bytes,status,setup_s,write_s,write_MBps,"
+               "read_s,read_MBps,pool_inuse_B,pool_footprint_B\n");
+
+    for (int fi = optind; fi < argc; fi++)
+    {
+        perf_decomp_t decomp = {0};
+
+        decomp.file = argv[fi];
+
+        if ((ret = read_decomp(MPI_COMM_WORLD, binary, &decomp)))
+        {
+            if (!my_rank)
+                fprintf(stderr, "cannot read decomp file %s: error %d\n", decomp.file, ret);
+            free(decomp.gdims);
+            free(decomp.map);
+            break;
+        }
+
+        for (int k = 0; k < ncombos; k++)
+        {
+            perf_result_t res = {0};
+
+            /* Skip IO task layouts that do not fit on the tasks. */
+            if (!set_config(lists, k, ntasks, &config))
+                continue;
+
+            res.status = run_config(MPI_COMM_WORLD, &decomp, &config, &res);
+            if (!my_rank)
+                print_result(&decomp, &config, &res);
+            if (res.status && !ret)
+                ret = res.status;
+        }
+
+        free(decomp.gdims);
+        free(decomp.map);
+    }
+
+    MPI_Finalize();
+
+    return ret ? 1 : 0;
+}
@@ -438,3 +438,72 @@ int CalcStartandCount(int pio_type, int ndims, const int *gdims, int num_io_proc
     
     return PIO_NOERR;
 }
+
+/**
+ * Compute the start and count values of this IO task for a box
+ * decomposition.
+ *
+ * By default all IO tasks are used, as far as the blocksize allows
+ * (see CalcStartandCount()). If a target size per IO task is set with
+ * PIOc_set_iotask_target(), the number of active IO tasks is the size
+ * of the data over the target. When that is more than the number of
+ * nodes, it is rounded down to a multiple of the number of nodes, so
+ * every node does the same amount of IO. The active tasks are spread
+ * over the IO tasks with an even stride. The choice is logged.
+ *
+ * @param ios pointer to the IO system info.
+ * @param pio_type the PIO data type used in this decompotion.
+ * @param ndims the number of dimensions in the variable, not
+ * including the unlimited dimension.
+ * @param gdims an array of global size of each dimension.
+ * @param start array of length ndims that gets the data start values.
+ * @param count array of length ndims that gets the data count values.
+ * @param num_aiotasks pointer that gets the number of active IO tasks.
+ * @returns 0 for success, error code otherwise.
+ */
+int calc_box_layout(iosystem_desc_t *ios, int pio_type, int ndims, const int *gdims,
+                    PIO_Offset *start, PIO_Offset *count, int *num_aiotasks)
+{
+    PIO_Offset bytes;
+    int basesize;
+    int nodes;
+    int use_io_procs;
+    int stride;
+    int iorank;
+    int ret;
+
+    pioassert(ios && ios->ioproc, "invalid input", __FILE__, __LINE__);
+
+    if (ios->iotask_target <= 0)
+        return CalcStartandCount(pio_type, ndims, gdims, ios->num_iotasks, ios->io_rank,
+                                 start, count, num_aiotasks);
+
+    /* Find the total size of the data. */
+    if ((ret = find_mpi_type(pio_type, NULL, &basesize)))
+        return ret;
+    bytes = basesize;
+    for (int i = 0; i < ndims; i++)
+        bytes *= gdims[i];
+
+    /* Enough IO tasks to have the target size on each, in equal
+     * numbers on each node. */
+    nodes = min((ios->num_comptasks + ios->ranks_per_node - 1) / ios->ranks_per_node,
+                ios->num_iotasks);
+    use_io_procs = (bytes + ios->iotask_target - 1) / ios->iotask_target;
+    use_io_procs = max(1, min(use_io_procs, ios->num_iotasks));
+    if (use_io_procs > nodes)
+        use_io_procs -= use_io_procs % nodes;
+    stride = ios->num_iotasks / use_io_procs;
+    LOG((1, "calc_box_layout bytes = %lld iotask_target = %lld ranks_per_node = %d nodes = %d "
+         "use_io_procs = %d stride = %d", bytes, ios->iotask_target, ios->ranks_per_node, nodes,
+         use_io_procs, stride));
+
+    /* Tasks between the strided ones get an empty box. */
+    if (ios->io_rank % stride || ios->io_rank / stride >= use_io_procs)
+        iorank = use_io_procs;
+    else
+        iorank = ios->io_rank / stride;
+
+    return CalcStartandCount(pio_type, ndims, gdims, use_io_procs, iorank, start, count,
+                             num_aiotasks);
+}
@@ -13,6 +13,36 @@
 
 #define VERSNO 2001
 
+/* Magic string and version at the start of a binary decomp file. */
+#define BIN_MAP_MAGIC "PIOBMAP"
+#define BIN_MAP_MAGIC_LEN 8
+#define BIN_MAP_VERSNO 1
+
+/* Entries of the fixed header of a binary decomp file, after the
+ * magic string. */
+#define BIN_MAP_HDR_VERSNO 0
+#define BIN_MAP_HDR_NPES 1
+#define BIN_MAP_HDR_NDIMS 2
+#define BIN_MAP_HDR_SIZE 3
+
+/* Number of entries of one run (start, count, stride) of a map. */
+#define BIN_MAP_RUN_LEN 3
+
+/* Largest att value, in bytes, kept in the metadata cache of a
+ * file. */
+#define META_ATT_MAX_SIZE 256
+
+/* Entries of the header broadcast with the metadata of a file. */
+#define META_HDR_ERR 0
+#define META_HDR_LEN 1
+#define META_HDR_NDIMS 2
+#define META_HDR_NVARS 3
+#define META_HDR_NGATTS 4
+#define META_HDR_UNLIMDIMID 5
+#define META_HDR_NATTS 6
+#define META_HDR_NDIMIDS 7
+#define META_HDR_SIZE 8
+
 /* Some logging constants. */
 #if PIO_ENABLE_LOGGING
 #define MAX_LOG_MSG 1024
@@ -676,8 +706,13 @@ int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims,
 
     /* Initialize some values in the struct. */
     (*iodesc)->maxregions = 1;
+    (*iodesc)->nregions_found = 1;
+    (*iodesc)->nregions = 1;
     (*iodesc)->ioid = -1;
     (*iodesc)->ndims = ndims;
+    (*iodesc)->iwrite_comm = MPI_COMM_NULL;
+    (*iodesc)->piotype = piotype;
+    (*iodesc)->refcount = 1;
 
     /* Allocate space for, and initialize, the first region. */
     if ((ret = alloc_region2(ios, ndims, &((*iodesc)->firstregion))))
@@ -689,6 +724,218 @@ int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims,
     return PIO_NOERR;
 }
 
+/**
+ * Find a decomposition of the same map that PIOc_InitDecomp() can
+ * reuse. This is collective over the union communicator of the IO
+ * system: a decomposition is only reused if every task finds the
+ * same one (by its decomp_seq, since ioids may differ between
+ * tasks).
+ *
+ * A decomposition of the same piotype is returned in exact. Failing
+ * that, one of another piotype is returned in layout; its
+ * rearrangement can be copied with copy_iodesc_layout(). For the box
+ * rearranger the IO task boxes depend on the type size, so layout is
+ * only used when they come out the same.
+ *
+ * @param ios pointer to the IO system info.
+ * @param piotype the PIO type of the data.
+ * @param rearranger the rearranger.
+ * @param ndims the number of dimensions.
+ * @param gdimlen array (length ndims) of the global dimension sizes.
+ * @param maplen the length of the map.
+ * @param compmap the 1-based map of this task.
+ * @param hash pointer that gets the hash of the decomposition.
+ * @param exact pointer that gets the decomposition to reuse as is, or
+ * NULL.
+ * @param layout pointer that gets the decomposition to copy, or NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+int find_cached_iodesc(iosystem_desc_t *ios, int piotype, int rearranger, int ndims,
+                       const int *gdimlen, int maplen, const PIO_Offset *compmap,
+                       unsigned long long *hash, io_desc_t **exact, io_desc_t **layout)
+{
+    io_desc_t *e, *l;
+    int seq[4];   /* min and -max of the decomp_seq of e and l. */
+    int mpierr;
+    int ret;
+
+    pioassert(ios && gdimlen && compmap && hash && exact && layout, "invalid input",
+              __FILE__, __LINE__);
+
+    *hash = pio_decomp_hash(ios, rearranger, ndims, gdimlen, maplen, compmap);
+    e = pio_find_iodesc_by_hash(*hash, rearranger, ndims, gdimlen, maplen, compmap, piotype,
+                                &l);
+
+    /* The box of each IO task depends on the size of the type. */
+    if (l && rearranger == PIO_REARR_BOX && ios->ioproc)
+    {
+        PIO_Offset start[ndims], count[ndims];
+        int num_aiotasks;
+
+        if ((ret = calc_box_layout(ios, piotype, ndims, gdimlen, start, count,
+                                   &num_aiotasks)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if (num_aiotasks != l->num_aiotasks)
+            l = NULL;
+        for (int d = 0; l && d < ndims; d++)
+            if (start[d] != l->firstregion->start[d] || count[d] != l->firstregion->count[d])
+                l = NULL;
+    }
+
+    /* All tasks must agree. */
+    seq[0] = e ? e->decomp_seq : -1;
+    seq[1] = e ? -e->decomp_seq : 1;
+    seq[2] = l ? l->decomp_seq : -1;
+    seq[3] = l ? -l->decomp_seq : 1;
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, seq, 4, MPI_INT, MPI_MIN, ios->union_comm)))
+        return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    *exact = seq[0] >= 0 && seq[0] == -seq[1] ? e : NULL;
+    *layout = !*exact && seq[2] >= 0 && seq[2] == -seq[3] ? l : NULL;
+    LOG((2, "find_cached_iodesc hash = %llx exact = %d layout = %d", *hash,
+         *exact ? (*exact)->ioid : -1, *layout ? (*layout)->ioid : -1));
+
+    return PIO_NOERR;
+}
+
+/**
+ * Copy an array, if there is one.
+ *
+ * @param dst pointer that gets the copy, or NULL if src is NULL.
+ * @param src the array to copy, may be NULL.
+ * @param size the size of the array in bytes.
+ * @returns 0 on success, error code otherwise.
+ */
+static int copy_array(void **dst, const void *src, size_t size)
+{
+    *dst = NULL;
+    if (!src)
+        return PIO_NOERR;
+    if (!(*dst = malloc(size ? size : 1)))
+        return PIO_ENOMEM;
+    memcpy(*dst, src, size);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Copy a region list into the region list starting at dst, adding
+ * regions to dst as needed.
+ *
+ * @param ios pointer to the IO system info.
+ * @param ndims the number of dimensions.
+ * @param src the first region to copy.
+ * @param dst the first region of the copy.
+ * @returns 0 on success, error code otherwise.
+ */
+static int copy_region_list(iosystem_desc_t *ios, int ndims, const io_region *src,
+                            io_region *dst)
+{
+    int ret;
+
+    for (; src; src = src->next, dst = dst->next)
+    {
+        dst->loffset = src->loffset;
+        for (int d = 0; d < ndims; d++)
+        {
+            dst->start[d] = src->start[d];
+            dst->count[d] = src->count[d];
+        }
+        if (src->next && !dst->next)
+            if ((ret = alloc_region2(ios, ndims, &dst->next)))
+                return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set up a decomposition by copying the rearrangement of another one
+ * of the same map, found by find_cached_iodesc(). Only what depends on
+ * the type of the data is computed again. This is collective over the
+ * tasks of the rearranger.
+ *
+ * @param ios pointer to the IO system info.
+ * @param src the decomposition to copy.
+ * @param dst the new decomposition, from malloc_iodesc(), with its
+ * map, dimensions and rearranger set.
+ * @returns 0 on success, error code otherwise.
+ */
+int copy_iodesc_layout(iosystem_desc_t *ios, io_desc_t *src, io_desc_t *dst)
+{
+    int nscount;
+    int mpierr;
+    int ret;
+
+    pioassert(ios && src && dst && src->ndims == dst->ndims &&
+              src->rearranger == dst->rearranger, "invalid input", __FILE__, __LINE__);
+    LOG((2, "copy_iodesc_layout src ioid = %d", src->ioid));
+
+    dst->nrecvs = src->nrecvs;
+    dst->ndof = src->ndof;
+    dst->num_aiotasks = src->num_aiotasks;
+    dst->maxregions = src->maxregions;
+    dst->nregions_found = src->nregions_found;
+    dst->nregions = src->nregions;
+    dst->needsfill = src->needsfill;
+    dst->llen = src->llen;
+    dst->nrfrom = src->nrfrom;
+    dst->maxiobuflen = src->maxiobuflen;
+    dst->holegridsize = src->holegridsize;
+    dst->maxholegridsize = src->maxholegridsize;
+    dst->maxfillregions = src->maxfillregions;
+    dst->rearr_opts = src->rearr_opts;
+
+    /* The index arrays have the same lengths as when they were made in
+     * box_rearrange_create() or subset_rearrange_create(). */
+    nscount = dst->rearranger == PIO_REARR_BOX ? ios->num_iotasks : 1;
+    if ((ret = copy_array((void **)&dst->scount, src->scount, nscount * sizeof(int))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = copy_array((void **)&dst->rcount, src->rcount,
+                          max(1, src->nrecvs) * sizeof(int))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = copy_array((void **)&dst->rfrom, src->rfrom,
+                          (dst->rearranger == PIO_REARR_BOX ? max(1, src->nrecvs) : src->nrfrom) *
+                          sizeof(int))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = copy_array((void **)&dst->rfromlen, src->rfromlen, src->nrfrom * sizeof(int))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = copy_array((void **)&dst->sindex, src->sindex,
+                          (dst->rearranger == PIO_REARR_BOX ? src->ndof : src->scount[0]) *
+                          sizeof(PIO_Offset))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = copy_array((void **)&dst->rindex, src->rindex, src->llen * sizeof(PIO_Offset))))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Copy the regions. */
+    if ((ret = copy_region_list(ios, dst->ndims, src->firstregion, dst->firstregion)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if (src->fillregion)
+    {
+        if ((ret = alloc_region2(ios, dst->ndims, &dst->fillregion)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+        if ((ret = copy_region_list(ios, dst->ndims, src->fillregion, dst->fillregion)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    }
+
+    /* Each decomposition frees its own subset communicator. */
+    if (dst->rearranger == PIO_REARR_SUBSET)
+        if ((mpierr = MPI_Comm_dup(src->subset_comm, &dst->subset_comm)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* The buffer limit is in bytes, so depends on the type. */
+    if ((ret = compute_maxaggregate_bytes(ios, dst)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* The MPI datatypes, communication plans and shared memory are
+     * made on first use, as for a new decomposition. */
+    if (dst->rearr_opts.comm_type == PIO_REARR_COMM_NEIGHBOR)
+        if ((ret = create_neighbor_comm(ios, dst)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
 /**
  * Free a region list.
  *
@@ -712,7 +959,8 @@ void free_region_list(io_region *top)
 }
 
 /**
- * Free a decomposition map.
+ * Free a decomposition map. If PIOc_InitDecomp() returned the same
+ * decomposition more than once, only the last call frees it.
  *
  * @param iosysid the IO system ID.
  * @param ioid the ID of the decomposition map to free.
@@ -723,6 +971,7 @@ int PIOc_freedecomp(int iosysid, int ioid)
     iosystem_desc_t *ios;
     io_desc_t *iodesc;
     int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function calls. */
+    int ret;
 
     if (!(ios = pio_get_iosystem_from_id(iosysid)))
         return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
@@ -737,8 +986,7 @@ int PIOc_freedecomp(int iosysid, int ioid)
         {
             int msg = PIO_MSG_FREEDECOMP; /* Message for async notification. */
 
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             if (!mpierr)
                 mpierr = MPI_Bcast(&iosysid, 1, MPI_INT, ios->compmaster, ios->intercomm);
@@ -754,6 +1002,33 @@ int PIOc_freedecomp(int iosysid, int ioid)
             return check_mpi(NULL, mpierr, __FILE__, __LINE__);
     }
 
+    /* PIOc_InitDecomp() may have returned this decomposition more
+     * than once. It is freed when the last of those is freed. */
+    if (--iodesc->refcount > 0)
+    {
+        LOG((2, "PIOc_freedecomp ioid = %d refcount = %d", ioid, iodesc->refcount));
+        return PIO_NOERR;
+    }
+
+    /* Free the cached communication plans. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Free the neighborhood collective communicator. */
+    if ((ret = free_neighbor_comm(iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Free the shared memory window of the rearranger. */
+    if ((ret = free_rearr_shm(iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__);
+
+    /* Free the communicator of PIOc_iwrite_darray(). */
+    if (iodesc->iwrite_comm != MPI_COMM_NULL)
+        if ((mpierr = MPI_Comm_free(&iodesc->iwrite_comm)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+
     /* Free the map. */
     free(iodesc->map);
 
@@ -763,6 +1038,9 @@ int PIOc_freedecomp(int iosysid, int ioid)
     if (iodesc->rfrom)
         free(iodesc->rfrom);
 
+    if (iodesc->rfromlen)
+        free(iodesc->rfromlen);
+
     if (iodesc->rtype)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
@@ -1667,256 +1945,549 @@ int PIOc_writemap_from_f90(const char *file, int ndims, const int *gdims,
 }
 
 /**
- * Create a new file using pio. This is an internal function that is
- * called by both PIOc_create() and PIOc_createfile(). Input
- * parameters are read on comp task 0 and ignored elsewhere.
+ * Run-length encode a decomposition map. Each run is a sequence of
+ * map entries with a constant stride, stored as (start, count,
+ * stride). A record with the map length, the number of runs and the
+ * runs is returned.
  *
- * @param iosysid A defined pio system ID, obtained from
- * PIOc_InitIntercomm() or PIOc_InitAsync().
- * @param ncidp A pointer that gets the ncid of the newly created
- * file.
- * @param iotype A pointer to a pio output format. Must be one of
- * PIO_IOTYPE_PNETCDF, PIO_IOTYPE_NETCDF, PIO_IOTYPE_NETCDF4C, or
- * PIO_IOTYPE_NETCDF4P.
- * @param filename The filename to create.
- * @param mode The netcdf mode for the create operation.
+ * @param maplen the length of the map.
+ * @param map the map array.
+ * @param recp pointer that gets the record, which must be freed by
+ * the caller.
+ * @param reclenp pointer that gets the number of entries of the
+ * record.
  * @returns 0 for success, error code otherwise.
- * @ingroup PIO_createfile
  */
-int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filename,
-                        int mode)
+static int bin_map_encode(PIO_Offset maplen, const PIO_Offset *map, PIO_Offset **recp,
+                          PIO_Offset *reclenp)
 {
-    iosystem_desc_t *ios;  /* Pointer to io system information. */
-    file_desc_t *file;     /* Pointer to file information. */
-    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
-    int ierr;              /* Return code from function calls. */
-
-    /* Get the IO system info from the iosysid. */
-    if (!(ios = pio_get_iosystem_from_id(iosysid)))
-        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+    PIO_Offset nruns = 0;
+    PIO_Offset *rec;
+    PIO_Offset *run;
 
-    /* User must provide valid input for these parameters. */
-    if (!ncidp || !iotype || !filename || strlen(filename) > NC_MAX_NAME)
-        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
-
-    /* A valid iotype must be specified. */
-    if (!iotype_is_valid(*iotype))
-        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+    /* Count the runs. */
+    for (PIO_Offset i = 0; i < maplen; nruns++)
+    {
+        PIO_Offset j = i + 1;
 
-    LOG((1, "PIOc_createfile iosysid = %d iotype = %d filename = %s mode = %d",
-         iosysid, *iotype, filename, mode));
+        if (j < maplen)
+            while (j + 1 < maplen && map[j + 1] - map[j] == map[i + 1] - map[i])
+                j++;
+        i = j < maplen ? j + 1 : j;
+    }
 
-    /* Allocate space for the file info. */
-    if (!(file = calloc(sizeof(file_desc_t), 1)))
-        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    if (!(rec = malloc((2 + BIN_MAP_RUN_LEN * nruns) * sizeof(PIO_Offset))))
+        return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    rec[0] = maplen;
+    rec[1] = nruns;
 
-    /* Fill in some file values. */
-    file->fh = -1;
-    file->iosystem = ios;
-    file->iotype = *iotype;
-    file->buffer.ioid = -1;
-    for (int i = 0; i < PIO_MAX_VARS; i++)
+    /* Fill in the runs. */
+    run = rec + 2;
+    for (PIO_Offset i = 0; i < maplen; run += BIN_MAP_RUN_LEN)
     {
-        file->varlist[i].record = -1;
-        file->varlist[i].ndims = -1;
-	file->varlist[i].iobuf = NULL;
-	file->varlist[i].fillbuf = NULL;
-    }
-    file->mode = mode;
+        PIO_Offset j = i + 1;
 
-    /* Set to true if this task should participate in IO (only true for
-     * one task with netcdf serial files. */
-    if (file->iotype == PIO_IOTYPE_NETCDF4P || file->iotype == PIO_IOTYPE_PNETCDF ||
-        ios->io_rank == 0)
-        file->do_io = 1;
+        run[0] = map[i];
+        run[1] = 1;
+        run[2] = 0;
+        if (j < maplen)
+        {
+            run[2] = map[j] - map[i];
+            while (j + 1 < maplen && map[j + 1] - map[j] == run[2])
+                j++;
+            run[1] = j - i + 1;
+        }
+        i += run[1];
+    }
 
-    LOG((2, "file->do_io = %d ios->async = %d", file->do_io, ios->async));
+    *recp = rec;
+    *reclenp = 2 + BIN_MAP_RUN_LEN * nruns;
 
-    /* If async is in use, and this is not an IO task, bcast the
-     * parameters. */
-    if (ios->async)
-    {
-        int msg = PIO_MSG_CREATE_FILE;
-        size_t len = strlen(filename);
+    return PIO_NOERR;
+}
 
-        if (!ios->ioproc)
-        {
-            /* Send the message to the message handler. */
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+/**
+ * Decode a record of a binary decomposition file, written by
+ * bin_map_encode().
+ *
+ * @param rec the record.
+ * @param reclen the number of entries of the record.
+ * @param maplenp pointer that gets the length of the map.
+ * @param mapp pointer that gets the map array, which must be freed
+ * by the caller. NULL if the map is empty.
+ * @returns 0 for success, error code otherwise.
+ */
+static int bin_map_decode(const PIO_Offset *rec, PIO_Offset reclen, PIO_Offset *maplenp,
+                          PIO_Offset **mapp)
+{
+    PIO_Offset maplen;
+    PIO_Offset nruns;
+    PIO_Offset e = 0;
+    PIO_Offset *map = NULL;
 
-            /* Send the parameters of the function call. */
-            if (!mpierr)
-                mpierr = MPI_Bcast(&len, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast((void *)filename, len + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&file->iotype, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            if (!mpierr)
-                mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            LOG((2, "len = %d filename = %s iotype = %d mode = %d", len, filename,
-                 file->iotype, file->mode));
-        }
+    /* Check the record. */
+    if (reclen < 2)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+    maplen = rec[0];
+    nruns = rec[1];
+    if (maplen < 0 || nruns < 0 || nruns > maplen || reclen != 2 + BIN_MAP_RUN_LEN * nruns)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
 
-        /* Handle MPI errors. */
-        LOG((2, "handling mpi errors mpierr = %d", mpierr));
-        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
-            return check_mpi(file, mpierr2, __FILE__, __LINE__);
-        if (mpierr)
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
-    }
+    if (maplen)
+        if (!(map = malloc(maplen * sizeof(PIO_Offset))))
+            return pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
 
-    /* If this task is in the IO component, do the IO. */
-    if (ios->ioproc)
+    /* Expand the runs. */
+    for (PIO_Offset r = 0; r < nruns; r++)
     {
-        switch (file->iotype)
+        const PIO_Offset *run = rec + 2 + BIN_MAP_RUN_LEN * r;
+
+        if (run[1] < 1 || run[1] > maplen - e)
         {
-#ifdef _NETCDF4
-        case PIO_IOTYPE_NETCDF4P:
-            file->mode = file->mode |  NC_MPIIO | NC_NETCDF4;
-            LOG((2, "Calling nc_create_par io_comm = %d mode = %d fh = %d",
-                 ios->io_comm, file->mode, file->fh));
-            ierr = nc_create_par(filename, file->mode, ios->io_comm, ios->info, &file->fh);
-            LOG((2, "nc_create_par returned %d file->fh = %d", ierr, file->fh));
-            break;
-        case PIO_IOTYPE_NETCDF4C:
-            file->mode = file->mode | NC_NETCDF4;
-#endif
-        case PIO_IOTYPE_NETCDF:
-            if (!ios->io_rank)
-            {
-                LOG((2, "Calling nc_create mode = %d", file->mode));
-                ierr = nc_create(filename, file->mode, &file->fh);
-            }
-            break;
-#ifdef _PNETCDF
-        case PIO_IOTYPE_PNETCDF:
-            LOG((2, "Calling ncmpi_create mode = %d", file->mode));
-            ierr = ncmpi_create(ios->io_comm, filename, file->mode, ios->info, &file->fh);
-            if (!ierr)
-                ierr = ncmpi_buffer_attach(file->fh, pio_buffer_size_limit);
-            break;
-#endif
+            free(map);
+            return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
         }
+        for (PIO_Offset i = 0; i < run[1]; i++)
+            map[e++] = run[0] + i * run[2];
     }
 
-    /* Broadcast and check the return code. */
-    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
-        return check_mpi(file, mpierr, __FILE__, __LINE__);
-
-    /* If there was an error, free the memory we allocated and handle error. */
-    if (ierr)
+    if (e != maplen)
     {
-        free(file);
-        return check_netcdf2(ios, NULL, ierr, __FILE__, __LINE__);
+        free(map);
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
     }
 
-    /* Broadcast mode to all tasks. */
-    if ((mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->ioroot, ios->union_comm)))
-        return check_mpi(file, mpierr, __FILE__, __LINE__);
-
-    /* This flag is implied by netcdf create functions but we need
-       to know if its set. */
-    file->mode = file->mode | PIO_WRITE;
-
-    /* Assign the PIO ncid, necessary because files may be opened
-     * on mutilple iosystems, causing the underlying library to
-     * reuse ncids. Hilarious confusion ensues. */
-    file->pio_ncid = pio_next_ncid++;
-    LOG((2, "file->fh = %d file->pio_ncid = %d", file->fh, file->pio_ncid));
-
-    /* Return the ncid to the caller. */
-    *ncidp = file->pio_ncid;
-
-    /* Add the struct with this files info to the global list of
-     * open files. */
-    pio_add_to_file_list(file);
-
-    LOG((2, "Created file %s file->fh = %d file->pio_ncid = %d", filename,
-         file->fh, file->pio_ncid));
+    *maplenp = maplen;
+    *mapp = map;
 
-    return ierr;
+    return PIO_NOERR;
 }
 
 /**
- * Open an existing file using PIO library. This is an internal
- * function. Depending on the value of the retry parameter, a failed
- * open operation will be handled differently. If retry is non-zero,
- * then a failed attempt to open a file with netCDF-4 (serial or
- * parallel), or parallel-netcdf will be followed by an attempt to
- * open the file as a serial classic netCDF file. This is an important
- * feature to some NCAR users. The functionality is exposed to the
- * user as PIOc_openfile() (which does the retry), and PIOc_open()
- * (which does not do the retry).
+ * Write the decomposition map to a binary file. The file is written
+ * collectively with MPI-IO, each task writes its own part of the map.
  *
- * Input parameters are read on comp task 0 and ignored elsewhere.
+ * The file starts with the string "PIOBMAP" padded to 8 bytes,
+ * followed by the version, the number of tasks and the number of
+ * dimensions, the global dimension lengths and an index of npes + 1
+ * byte offsets of the record of each task. The record of a task holds
+ * its map length, the number of runs, and the runs of its map as
+ * (start, count, stride). All numbers are stored as PIO_Offset in the
+ * byte order of the machine.
  *
- * @param iosysid: A defined pio system descriptor (input)
- * @param ncidp: A pio file descriptor (output)
- * @param iotype: A pio output format (input)
- * @param filename: The filename to open
- * @param mode: The netcdf mode for the open operation
- * @param retry: non-zero to automatically retry with netCDF serial
- * classic.
+ * The maps are the same as the ones of PIOc_writemap(), so the
+ * text, netCDF and binary decomp files convert to each other without
+ * loss.
  *
- * @return 0 for success, error code otherwise.
- * @ingroup PIO_openfile
+ * @param file the filename
+ * @param ndims the number of dimensions
+ * @param gdims an array of the global dimension lengths
+ * @param maplen the length of the map
+ * @param map the map array
+ * @param comm an MPI communicator.
+ * @returns 0 for success, error code otherwise.
  */
-int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filename,
-                        int mode, int retry)
+int PIOc_writemap_bin(const char *file, int ndims, const int *gdims, PIO_Offset maplen,
+                      const PIO_Offset *map, MPI_Comm comm)
 {
-    iosystem_desc_t *ios;  /** Pointer to io system information. */
-    file_desc_t *file;     /** Pointer to file information. */
-    int imode;  /** internal mode val for netcdf4 file open */
-    int mpierr = MPI_SUCCESS, mpierr2;  /** Return code from MPI function codes. */
-    int ierr = PIO_NOERR;  /** Return code from function calls. */
+    int npes, myrank;
+    PIO_Offset *rec = NULL; /* Record of this task. */
+    PIO_Offset reclen = 0;  /* Number of entries of the record. */
+    PIO_Offset loc[2];      /* Offset and size in bytes of the record. */
+    PIO_Offset *locs = NULL; /* Offsets and sizes of all records, on task 0. */
+    char *hdr = NULL;       /* Header, on task 0. */
+    MPI_Offset hdrlen;      /* Length of the header in bytes. */
+    MPI_File fh;
+    MPI_Status status;
+    int mpierr; /* Return code for MPI calls. */
+    int ret;
+
+    /* Check inputs. */
+    if (!file || ndims < 0 || (ndims && !gdims) || maplen < 0 || (maplen && !map))
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    LOG((1, "PIOc_writemap_bin file = %s ndims = %d maplen = %lld", file, ndims, maplen));
+
+    if ((mpierr = MPI_Comm_size(comm, &npes)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_rank(comm, &myrank)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Encode the map of this task. Task 0 also needs the header, and
+     * room to gather the offsets and sizes of all records. */
+    hdrlen = BIN_MAP_MAGIC_LEN + (BIN_MAP_HDR_SIZE + ndims + npes + 1) * sizeof(PIO_Offset);
+    ret = bin_map_encode(maplen, map, &rec, &reclen);
+    if (!ret && !myrank)
+        if (!(locs = malloc(2 * npes * sizeof(PIO_Offset))) || !(hdr = calloc(hdrlen, 1)))
+            ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+    /* Stop on all tasks if any task is out of memory. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MIN, comm)))
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (ret)
+    {
+        free(rec);
+        free(locs);
+        free(hdr);
+        return pio_err(NULL, NULL, ret, __FILE__, __LINE__);
+    }
+    LOG((2, "npes = %d myrank = %d nruns = %lld", npes, myrank, rec[1]));
+
+    /* Find where the record of this task goes, and let task 0
+     * gather the offsets and sizes of the records. */
+    loc[0] = 0;
+    loc[1] = reclen * sizeof(PIO_Offset);
+    if ((mpierr = MPI_Exscan(&loc[1], &loc[0], 1, PIO_OFFSET, MPI_SUM, comm)))
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (!myrank)
+        loc[0] = 0;
+    loc[0] += hdrlen;
+    if (!ret && (mpierr = MPI_Gather(loc, 2, PIO_OFFSET, locs, 2, PIO_OFFSET, 0, comm)))
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Open the file and throw away any old contents. */
+    if (!ret && (mpierr = MPI_File_open(comm, (char *)file, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                        MPI_INFO_NULL, &fh)))
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (!ret)
+    {
+        if ((mpierr = MPI_File_set_size(fh, 0)))
+            ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+        /* Task 0 writes the header. */
+        if (!ret && !myrank)
+        {
+            PIO_Offset *fixed;
+
+            strncpy(hdr, BIN_MAP_MAGIC, BIN_MAP_MAGIC_LEN);
+            fixed = (PIO_Offset *)(hdr + BIN_MAP_MAGIC_LEN);
+            fixed[BIN_MAP_HDR_VERSNO] = BIN_MAP_VERSNO;
+            fixed[BIN_MAP_HDR_NPES] = npes;
+            fixed[BIN_MAP_HDR_NDIMS] = ndims;
+            for (int d = 0; d < ndims; d++)
+                fixed[BIN_MAP_HDR_SIZE + d] = gdims[d];
+            for (int i = 0; i < npes; i++)
+                fixed[BIN_MAP_HDR_SIZE + ndims + i] = locs[2 * i];
+            fixed[BIN_MAP_HDR_SIZE + ndims + npes] = locs[2 * (npes - 1)] + locs[2 * npes - 1];
+
+            if ((mpierr = MPI_File_write_at(fh, 0, hdr, hdrlen, MPI_BYTE, &status)))
+                ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        }
+
+        /* Every task writes its own record. The collective calls are
+         * made even after an error, so no task is left waiting. */
+        if ((mpierr = MPI_File_write_at_all(fh, loc[0], rec, reclen, PIO_OFFSET, &status)) && !ret)
+            ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_File_close(&fh)) && !ret)
+            ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
+    free(rec);
+    free(locs);
+    free(hdr);
+
+    /* All tasks fail if any task failed. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MIN, comm)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (ret)
+        return pio_err(NULL, NULL, ret, __FILE__, __LINE__);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Read a decomposition map from a binary file written by
+ * PIOc_writemap_bin(). The file is read collectively with MPI-IO,
+ * each task reads only the index entries and the record of its own
+ * part of the map. Tasks beyond the number of tasks in the file get
+ * an empty map.
+ *
+ * @param file the filename
+ * @param ndims pointer to an int that gets the number of dims.
+ * @param gdims pointer that gets an array of the global dimension
+ * lengths, which must be freed by the caller.
+ * @param fmaplen pointer that gets the length of the map.
+ * @param map pointer that gets the map array, which must be freed by
+ * the caller. NULL if the map is empty.
+ * @param comm an MPI communicator.
+ * @returns 0 for success, error code otherwise.
+ */
+int PIOc_readmap_bin(const char *file, int *ndims, int **gdims, PIO_Offset *fmaplen,
+                     PIO_Offset **map, MPI_Comm comm)
+{
+    int npes, myrank;
+    PIO_Offset hdr[BIN_MAP_HDR_SIZE + 1]; /* Error code and fixed header. */
+    PIO_Offset rnpes, rndims;
+    PIO_Offset *dims;       /* Global dimension lengths. */
+    PIO_Offset index[2] = {0, 0}; /* Start and end of the record of this task. */
+    PIO_Offset *rec = NULL; /* Record of this task. */
+    PIO_Offset reclen = 0;  /* Number of entries of the record. */
+    MPI_Offset hdrlen;      /* Length of the fixed header in bytes. */
+    MPI_File fh;
+    MPI_Status status;
+    int mpierr; /* Return code for MPI calls. */
+    int ret = PIO_NOERR;
+
+    /* Check inputs. */
+    if (!file || !ndims || !gdims || !fmaplen || !map)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    LOG((1, "PIOc_readmap_bin file = %s", file));
+
+    if ((mpierr = MPI_Comm_size(comm, &npes)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_rank(comm, &myrank)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    if ((mpierr = MPI_File_open(comm, (char *)file, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)))
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Task 0 reads and checks the fixed header, and shares it. */
+    hdrlen = BIN_MAP_MAGIC_LEN + BIN_MAP_HDR_SIZE * sizeof(PIO_Offset);
+    if (!myrank)
+    {
+        char buf[hdrlen];
+        int count;
+
+        hdr[0] = PIO_NOERR;
+        if ((mpierr = MPI_File_read_at(fh, 0, buf, hdrlen, MPI_BYTE, &status)))
+            hdr[0] = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        else if ((mpierr = MPI_Get_count(&status, MPI_BYTE, &count)))
+            hdr[0] = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        else if (count != hdrlen || strncmp(buf, BIN_MAP_MAGIC, BIN_MAP_MAGIC_LEN))
+            hdr[0] = PIO_EINVAL;
+        else
+            memcpy(&hdr[1], buf + BIN_MAP_MAGIC_LEN, BIN_MAP_HDR_SIZE * sizeof(PIO_Offset));
+        if (!hdr[0] && (hdr[1 + BIN_MAP_HDR_VERSNO] != BIN_MAP_VERSNO ||
+                        hdr[1 + BIN_MAP_HDR_NPES] < 1 || hdr[1 + BIN_MAP_HDR_NPES] > npes ||
+                        hdr[1 + BIN_MAP_HDR_NDIMS] < 0 || hdr[1 + BIN_MAP_HDR_NDIMS] > PIO_MAX_DIMS))
+            hdr[0] = PIO_EINVAL;
+    }
+    if ((mpierr = MPI_Bcast(hdr, BIN_MAP_HDR_SIZE + 1, PIO_OFFSET, 0, comm)))
+    {
+        MPI_File_close(&fh);
+        return check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    }
+    if (hdr[0])
+    {
+        MPI_File_close(&fh);
+        return pio_err(NULL, NULL, hdr[0], __FILE__, __LINE__);
+    }
+    rnpes = hdr[1 + BIN_MAP_HDR_NPES];
+    rndims = hdr[1 + BIN_MAP_HDR_NDIMS];
+    LOG((2, "rnpes = %lld rndims = %lld", rnpes, rndims));
+
+    /* All tasks read the dims, and the index entries of their own
+     * record. A task that fails still takes part in the collective
+     * reads, reading nothing, so no task is left waiting. */
+    if (!(dims = malloc((rndims + 1) * sizeof(PIO_Offset))))
+        ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+    if ((mpierr = MPI_File_read_at_all(fh, hdrlen, dims, dims ? rndims : 0, PIO_OFFSET,
+                                       &status)) && !ret)
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_File_read_at_all(fh, hdrlen + (rndims + myrank) * sizeof(PIO_Offset),
+                                       index, myrank < rnpes && !ret ? 2 : 0, PIO_OFFSET,
+                                       &status)) && !ret)
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Read the record of this task. */
+    if (myrank < rnpes && !ret)
+    {
+        if (index[1] < index[0] || (index[1] - index[0]) % sizeof(PIO_Offset))
+            ret = pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+        else
+            reclen = (index[1] - index[0]) / sizeof(PIO_Offset);
+        if (reclen && !(rec = malloc(reclen * sizeof(PIO_Offset))))
+        {
+            reclen = 0;
+            ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+        }
+    }
+    if ((mpierr = MPI_File_read_at_all(fh, index[0], rec, reclen, PIO_OFFSET, &status)) && !ret)
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (reclen && !ret)
+    {
+        int count;
+
+        if ((mpierr = MPI_Get_count(&status, PIO_OFFSET, &count)))
+            ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+        else if (count != reclen)
+            ret = pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+    }
+    if ((mpierr = MPI_File_close(&fh)) && !ret)
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+
+    /* Decode the map, and make room for the dims. */
+    *fmaplen = 0;
+    *map = NULL;
+    *gdims = NULL;
+    if (myrank < rnpes && !ret)
+        ret = bin_map_decode(rec, reclen, fmaplen, map);
+    free(rec);
+    if (!ret && !(*gdims = malloc((rndims + 1) * sizeof(int))))
+        ret = pio_err(NULL, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+    /* All tasks fail if any task failed. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MIN, comm)))
+        ret = check_mpi(NULL, mpierr, __FILE__, __LINE__);
+    if (ret)
+    {
+        free(dims);
+        free(*map);
+        free(*gdims);
+        *map = NULL;
+        *gdims = NULL;
+        return pio_err(NULL, NULL, ret, __FILE__, __LINE__);
+    }
+
+    *ndims = rndims;
+    for (int d = 0; d < rndims; d++)
+        (*gdims)[d] = dims[d];
+    free(dims);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write the decomposition map to a binary file. See
+ * PIOc_writemap_bin() for the format.
+ *
+ * @param file the filename to be used.
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the IO description.
+ * @param comm an MPI communicator.
+ * @returns 0 for success, error code otherwise.
+ */
+int PIOc_write_decomp_bin(const char *file, int iosysid, int ioid, MPI_Comm comm)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+
+    LOG((1, "PIOc_write_decomp_bin file = %s iosysid = %d ioid = %d", file, iosysid, ioid));
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return pio_err(ios, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    return PIOc_writemap_bin(file, iodesc->ndims, iodesc->dimlen, iodesc->maplen, iodesc->map,
+                             comm);
+}
+
+/**
+ * Read a binary decomposition file written by PIOc_write_decomp_bin()
+ * or PIOc_writemap_bin(), and initialize a decomposition from it.
+ *
+ * @param iosysid the IO system ID.
+ * @param file the name of the decomp file.
+ * @param ioidp pointer that will get the newly-assigned ID of the IO
+ * description. The ioid is needed to later free the decomposition.
+ * @param comm an MPI communicator.
+ * @param pio_type the PIO type to be used as the type for the data.
+ * @returns 0 for success, error code otherwise.
+ */
+int PIOc_read_decomp_bin(int iosysid, const char *file, int *ioidp, MPI_Comm comm,
+                         int pio_type)
+{
+    iosystem_desc_t *ios;
+    int ndims;
+    int *gdims;
+    PIO_Offset maplen;
+    PIO_Offset *map;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    /* Check inputs. */
+    if (!file || !ioidp)
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    LOG((1, "PIOc_read_decomp_bin file = %s iosysid = %d pio_type = %d", file, iosysid,
+         pio_type));
+
+    if ((ret = PIOc_readmap_bin(file, &ndims, &gdims, &maplen, &map, comm)))
+        return ret;
+
+    ret = PIOc_InitDecomp(iosysid, pio_type, ndims, gdims, maplen, map, ioidp, NULL, NULL,
+                          NULL);
+
+    free(gdims);
+    free(map);
+
+    return ret;
+}
+
+/**
+ * Create a new file using pio. This is an internal function that is
+ * called by both PIOc_create() and PIOc_createfile(). Input
+ * parameters are read on comp task 0 and ignored elsewhere.
+ *
+ * @param iosysid A defined pio system ID, obtained from
+ * PIOc_InitIntercomm() or PIOc_InitAsync().
+ * @param ncidp A pointer that gets the ncid of the newly created
+ * file.
+ * @param iotype A pointer to a pio output format. Must be one of
+ * PIO_IOTYPE_PNETCDF, PIO_IOTYPE_NETCDF, PIO_IOTYPE_NETCDF4C, or
+ * PIO_IOTYPE_NETCDF4P.
+ * @param filename The filename to create.
+ * @param mode The netcdf mode for the create operation.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_createfile
+ */
+int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filename,
+                        int mode)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Pointer to file information. */
+    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
+    int ierr;              /* Return code from function calls. */
 
     /* Get the IO system info from the iosysid. */
     if (!(ios = pio_get_iosystem_from_id(iosysid)))
         return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
 
     /* User must provide valid input for these parameters. */
-    if (!ncidp || !iotype || !filename)
+    if (!ncidp || !iotype || !filename || strlen(filename) > NC_MAX_NAME)
         return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
-    if (*iotype < PIO_IOTYPE_PNETCDF || *iotype > PIO_IOTYPE_NETCDF4P)
+
+    /* A valid iotype must be specified. */
+    if (!iotype_is_valid(*iotype))
         return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
 
-    LOG((2, "PIOc_openfile_retry iosysid = %d iotype = %d filename = %s mode = %d retry = %d",
-         iosysid, *iotype, filename, mode, retry));
+    LOG((1, "PIOc_createfile iosysid = %d iotype = %d filename = %s mode = %d",
+         iosysid, *iotype, filename, mode));
 
     /* Allocate space for the file info. */
-    if (!(file = calloc(sizeof(*file), 1)))
+    if (!(file = calloc(sizeof(file_desc_t), 1)))
         return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
 
     /* Fill in some file values. */
     file->fh = -1;
-    file->iotype = *iotype;
     file->iosystem = ios;
+    file->iotype = *iotype;
+    file->buffer.ioid = -1;
     file->mode = mode;
 
-    for (int i = 0; i < PIO_MAX_VARS; i++)
-    {
-        file->varlist[i].record = -1;
-        file->varlist[i].ndims = -1;
-    }
-
-    /* Set to true if this task should participate in IO (only true
-     * for one task with netcdf serial files. */
+    /* Set to true if this task should participate in IO (only true for
+     * one task with netcdf serial files. */
     if (file->iotype == PIO_IOTYPE_NETCDF4P || file->iotype == PIO_IOTYPE_PNETCDF ||
         ios->io_rank == 0)
         file->do_io = 1;
 
-    /* If async is in use, and this is not an IO task, bcast the parameters. */
+    LOG((2, "file->do_io = %d ios->async = %d", file->do_io, ios->async));
+
+    /* If async is in use, and this is not an IO task, bcast the
+     * parameters. */
     if (ios->async)
     {
-        int msg = PIO_MSG_OPEN_FILE;
+        int msg = PIO_MSG_CREATE_FILE;
         size_t len = strlen(filename);
 
         if (!ios->ioproc)
         {
             /* Send the message to the message handler. */
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
+            mpierr = send_msg(ios, msg);
 
             /* Send the parameters of the function call. */
             if (!mpierr)
@@ -1927,55 +2498,224 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
                 mpierr = MPI_Bcast(&file->iotype, 1, MPI_INT, ios->compmaster, ios->intercomm);
             if (!mpierr)
                 mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->compmaster, ios->intercomm);
+            LOG((2, "len = %d filename = %s iotype = %d mode = %d", len, filename,
+                 file->iotype, file->mode));
         }
 
         /* Handle MPI errors. */
+        LOG((2, "handling mpi errors mpierr = %d", mpierr));
         if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
             return check_mpi(file, mpierr2, __FILE__, __LINE__);
         if (mpierr)
             return check_mpi(file, mpierr, __FILE__, __LINE__);
     }
 
-    /* If this is an IO task, then call the netCDF function. */
+    /* If this task is in the IO component, do the IO. */
     if (ios->ioproc)
     {
         switch (file->iotype)
         {
 #ifdef _NETCDF4
-
         case PIO_IOTYPE_NETCDF4P:
-#ifdef _MPISERIAL
-            ierr = nc_open(filename, file->mode, &file->fh);
-#else
-            imode = file->mode |  NC_MPIIO;
-            ierr = nc_open_par(filename, imode, ios->io_comm, ios->info, &file->fh);
-            if (ierr == PIO_NOERR)
-                file->mode = imode;
-            LOG((2, "PIOc_openfile_retry:nc_open_par filename = %s mode = %d imode = %d ierr = %d",
-                 filename, file->mode, imode, ierr));
-#endif
+            file->mode = file->mode |  NC_MPIIO | NC_NETCDF4;
+            LOG((2, "Calling nc_create_par io_comm = %d mode = %d fh = %d",
+                 ios->io_comm, file->mode, file->fh));
+            ierr = nc_create_par(filename, file->mode, ios->io_comm, ios->info, &file->fh);
+            LOG((2, "nc_create_par returned %d file->fh = %d", ierr, file->fh));
             break;
-
         case PIO_IOTYPE_NETCDF4C:
-            if (ios->io_rank == 0)
-            {
-                imode = file->mode | NC_NETCDF4;
-                ierr = nc_open(filename, imode, &file->fh);
-                if (ierr == PIO_NOERR)
-                    file->mode = imode;
-            }
-            break;
-
+            file->mode = file->mode | NC_NETCDF4;
 #endif
-
         case PIO_IOTYPE_NETCDF:
-            if (ios->io_rank == 0)
-                ierr = nc_open(filename, file->mode, &file->fh);
+            if (!ios->io_rank)
+            {
+                LOG((2, "Calling nc_create mode = %d", file->mode));
+                ierr = nc_create(filename, file->mode, &file->fh);
+            }
             break;
-
 #ifdef _PNETCDF
         case PIO_IOTYPE_PNETCDF:
-            ierr = ncmpi_open(ios->io_comm, filename, file->mode, ios->info, &file->fh);
+            LOG((2, "Calling ncmpi_create mode = %d", file->mode));
+            ierr = ncmpi_create(ios->io_comm, filename, file->mode, ios->info, &file->fh);
+            if (!ierr)
+                ierr = ncmpi_buffer_attach(file->fh, pio_buffer_size_limit);
+            break;
+#endif
+        }
+    }
+
+    /* Broadcast and check the return code. */
+    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+
+    /* If there was an error, free the memory we allocated and handle error. */
+    if (ierr)
+    {
+        free(file);
+        return check_netcdf2(ios, NULL, ierr, __FILE__, __LINE__);
+    }
+
+    /* Broadcast mode to all tasks. */
+    if ((mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->ioroot, ios->union_comm)))
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+
+    /* This flag is implied by netcdf create functions but we need
+       to know if its set. */
+    file->mode = file->mode | PIO_WRITE;
+
+    /* A new file starts in define mode. */
+    file->indefine = true;
+
+    /* Assign the PIO ncid, necessary because files may be opened
+     * on mutilple iosystems, causing the underlying library to
+     * reuse ncids. Hilarious confusion ensues. */
+    file->pio_ncid = pio_next_ncid++;
+    LOG((2, "file->fh = %d file->pio_ncid = %d", file->fh, file->pio_ncid));
+
+    /* Return the ncid to the caller. */
+    *ncidp = file->pio_ncid;
+
+    /* Add the struct with this files info to the global list of
+     * open files. */
+    pio_add_to_file_list(file);
+
+    LOG((2, "Created file %s file->fh = %d file->pio_ncid = %d", filename,
+         file->fh, file->pio_ncid));
+
+    return ierr;
+}
+
+/**
+ * Open an existing file using PIO library. This is an internal
+ * function. Depending on the value of the retry parameter, a failed
+ * open operation will be handled differently. If retry is non-zero,
+ * then a failed attempt to open a file with netCDF-4 (serial or
+ * parallel), or parallel-netcdf will be followed by an attempt to
+ * open the file as a serial classic netCDF file. This is an important
+ * feature to some NCAR users. The functionality is exposed to the
+ * user as PIOc_openfile() (which does the retry), and PIOc_open()
+ * (which does not do the retry).
+ *
+ * Input parameters are read on comp task 0 and ignored elsewhere.
+ *
+ * @param iosysid: A defined pio system descriptor (input)
+ * @param ncidp: A pio file descriptor (output)
+ * @param iotype: A pio output format (input)
+ * @param filename: The filename to open
+ * @param mode: The netcdf mode for the open operation
+ * @param retry: non-zero to automatically retry with netCDF serial
+ * classic.
+ *
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_openfile
+ */
+int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filename,
+                        int mode, int retry)
+{
+    iosystem_desc_t *ios;  /** Pointer to io system information. */
+    file_desc_t *file;     /** Pointer to file information. */
+    int imode;  /** internal mode val for netcdf4 file open */
+    int mpierr = MPI_SUCCESS, mpierr2;  /** Return code from MPI function codes. */
+    int ierr = PIO_NOERR;  /** Return code from function calls. */
+
+    /* Get the IO system info from the iosysid. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    /* User must provide valid input for these parameters. */
+    if (!ncidp || !iotype || !filename)
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+    if (*iotype < PIO_IOTYPE_PNETCDF || *iotype > PIO_IOTYPE_NETCDF4P)
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    LOG((2, "PIOc_openfile_retry iosysid = %d iotype = %d filename = %s mode = %d retry = %d",
+         iosysid, *iotype, filename, mode, retry));
+
+    /* Allocate space for the file info. */
+    if (!(file = calloc(sizeof(*file), 1)))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__);
+
+    /* Fill in some file values. */
+    file->fh = -1;
+    file->iotype = *iotype;
+    file->iosystem = ios;
+    file->mode = mode;
+
+    /* Set to true if this task should participate in IO (only true
+     * for one task with netcdf serial files. */
+    if (file->iotype == PIO_IOTYPE_NETCDF4P || file->iotype == PIO_IOTYPE_PNETCDF ||
+        ios->io_rank == 0)
+        file->do_io = 1;
+
+    /* If async is in use, and this is not an IO task, bcast the parameters. */
+    if (ios->async)
+    {
+        int msg = PIO_MSG_OPEN_FILE;
+        size_t len = strlen(filename);
+
+        if (!ios->ioproc)
+        {
+            /* Send the message to the message handler. */
+            mpierr = send_msg(ios, msg);
+
+            /* Send the parameters of the function call. */
+            if (!mpierr)
+                mpierr = MPI_Bcast(&len, 1, MPI_INT, ios->compmaster, ios->intercomm);
+            if (!mpierr)
+                mpierr = MPI_Bcast((void *)filename, len + 1, MPI_CHAR, ios->compmaster, ios->intercomm);
+            if (!mpierr)
+                mpierr = MPI_Bcast(&file->iotype, 1, MPI_INT, ios->compmaster, ios->intercomm);
+            if (!mpierr)
+                mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->compmaster, ios->intercomm);
+        }
+
+        /* Handle MPI errors. */
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            return check_mpi(file, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* If this is an IO task, then call the netCDF function. */
+    if (ios->ioproc)
+    {
+        switch (file->iotype)
+        {
+#ifdef _NETCDF4
+
+        case PIO_IOTYPE_NETCDF4P:
+#ifdef _MPISERIAL
+            ierr = nc_open(filename, file->mode, &file->fh);
+#else
+            imode = file->mode |  NC_MPIIO;
+            ierr = nc_open_par(filename, imode, ios->io_comm, ios->info, &file->fh);
+            if (ierr == PIO_NOERR)
+                file->mode = imode;
+            LOG((2, "PIOc_openfile_retry:nc_open_par filename = %s mode = %d imode = %d ierr = %d",
+                 filename, file->mode, imode, ierr));
+#endif
+            break;
+
+        case PIO_IOTYPE_NETCDF4C:
+            if (ios->io_rank == 0)
+            {
+                imode = file->mode | NC_NETCDF4;
+                ierr = nc_open(filename, imode, &file->fh);
+                if (ierr == PIO_NOERR)
+                    file->mode = imode;
+            }
+            break;
+
+#endif
+
+        case PIO_IOTYPE_NETCDF:
+            if (ios->io_rank == 0)
+                ierr = nc_open(filename, file->mode, &file->fh);
+            break;
+
+#ifdef _PNETCDF
+        case PIO_IOTYPE_PNETCDF:
+            ierr = ncmpi_open(ios->io_comm, filename, file->mode, ios->info, &file->fh);
 
             // This should only be done with a file opened to append
             if (ierr == PIO_NOERR && (file->mode & PIO_WRITE))
@@ -2052,138 +2792,720 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
     LOG((2, "Opened file %s file->pio_ncid = %d file->fh = %d ierr = %d",
          filename, file->pio_ncid, file->fh, ierr));
 
-    return ierr;
+    /* Cache the metadata of the file on all tasks. */
+    if ((ierr = file_meta_build(file)))
+        return ierr;
+
+    return ierr;
+}
+
+/**
+ * Internal function to provide inq_type function for pnetcdf.
+ *
+ * @param ncid ignored because pnetcdf does not have user-defined
+ * types.
+ * @param xtype type to learn about.
+ * @param name pointer that gets name of type. Ignored if NULL.
+ * @param sizep pointer that gets size of type. Ignored if NULL.
+ * @returns 0 on success, error code otherwise.
+ */
+int pioc_pnetcdf_inq_type(int ncid, nc_type xtype, char *name,
+                          PIO_Offset *sizep)
+{
+    int typelen;
+
+    switch (xtype)
+    {
+    case NC_UBYTE:
+    case NC_BYTE:
+    case NC_CHAR:
+        typelen = 1;
+        break;
+    case NC_SHORT:
+    case NC_USHORT:
+        typelen = 2;
+        break;
+    case NC_UINT:
+    case NC_INT:
+    case NC_FLOAT:
+        typelen = 4;
+        break;
+    case NC_UINT64:
+    case NC_INT64:
+    case NC_DOUBLE:
+        typelen = 8;
+        break;
+    default:
+        return PIO_EBADTYPE;
+    }
+
+    /* If pointers were supplied, copy results. */
+    if (sizep)
+        *sizep = typelen;
+    if (name)
+        strcpy(name, "some type");
+
+    return PIO_NOERR;
+}
+
+/**
+ * This is an internal function that handles both PIOc_enddef and
+ * PIOc_redef.
+ *
+ * @param ncid the ncid of the file to enddef or redef
+ * @param is_enddef set to non-zero for enddef, 0 for redef.
+ * @returns PIO_NOERR on success, error code on failure. */
+int pioc_change_def(int ncid, int is_enddef)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Pointer to file information. */
+    int ierr = PIO_NOERR;  /* Return code from function calls. */
+    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI functions. */
+
+    LOG((2, "pioc_change_def ncid = %d is_enddef = %d", ncid, is_enddef));
+
+    /* Find the info about this file. When I check the return code
+     * here, some tests fail. ???*/
+    if ((ierr = pio_get_file(ncid, &file)))
+        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
+    ios = file->iosystem;
+
+    file_meta_invalidate(file);
+
+    /* If async is in use, and this is not an IO task, bcast the parameters. */
+    if (ios->async)
+    {
+        if (!ios->ioproc)
+        {
+            int msg = is_enddef ? PIO_MSG_ENDDEF : PIO_MSG_REDEF;
+            mpierr = send_msg(ios, msg);
+
+            if (!mpierr)
+                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
+            LOG((3, "pioc_change_def ncid = %d mpierr = %d", ncid, mpierr));
+        }
+
+        /* Handle MPI errors. */
+        LOG((3, "pioc_change_def handling MPI errors"));
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            check_mpi(file, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* If this is an IO task, then call the netCDF function. */
+    LOG((3, "pioc_change_def ios->ioproc = %d", ios->ioproc));
+    if (ios->ioproc)
+    {
+        LOG((3, "pioc_change_def calling netcdf function file->fh = %d file->do_io = %d iotype = %d",
+             file->fh, file->do_io, file->iotype));
+#ifdef _PNETCDF
+        if (file->iotype == PIO_IOTYPE_PNETCDF)
+        {
+            if (is_enddef)
+                ierr = ncmpi_enddef(file->fh);
+            else
+                ierr = ncmpi_redef(file->fh);
+        }
+#endif /* _PNETCDF */
+        if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
+        {
+            if (is_enddef)
+            {
+                LOG((3, "pioc_change_def calling nc_enddef file->fh = %d", file->fh));
+                ierr = nc_enddef(file->fh);
+            }
+            else
+                ierr = nc_redef(file->fh);
+        }
+
+        /* With async, errors of the calls sent to the IO tasks in a
+         * batch are returned here. */
+        if (!ierr)
+            ierr = file->batch_err;
+        file->batch_err = PIO_NOERR;
+    }
+
+    /* Broadcast and check the return code. */
+    LOG((3, "pioc_change_def bcasting return code ierr = %d", ierr));
+    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    if (ierr)
+        return check_netcdf(file, ierr, __FILE__, __LINE__);
+    file->indefine = !is_enddef;
+    if (is_enddef && (ierr = file_meta_build(file)))
+        return ierr;
+    LOG((3, "pioc_change_def succeeded"));
+
+    return ierr;
+}
+
+/**
+ * Get the number of dims and vars of a file, for its metadata cache.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_inq(file_desc_t *file, int *ndimsp, int *nvarsp, int *ngattsp,
+                    int *unlimdimidp)
+{
+#ifdef _PNETCDF
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+        return ncmpi_inq(file->fh, ndimsp, nvarsp, ngattsp, unlimdimidp);
+#endif /* _PNETCDF */
+    return nc_inq(file->fh, ndimsp, nvarsp, ngattsp, unlimdimidp);
+}
+
+/**
+ * Get the name and length of a dim, for the metadata cache of a file.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_inq_dim(file_desc_t *file, int dimid, char *name, PIO_Offset *lenp)
+{
+#ifdef _PNETCDF
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+        return ncmpi_inq_dim(file->fh, dimid, name, lenp);
+#endif /* _PNETCDF */
+    return nc_inq_dim(file->fh, dimid, name, (size_t *)lenp);
+}
+
+/**
+ * Get the info about a var, for the metadata cache of a file.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_inq_var(file_desc_t *file, int varid, char *name, nc_type *xtypep,
+                        int *ndimsp, int *dimidsp, int *nattsp)
+{
+#ifdef _PNETCDF
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+        return ncmpi_inq_var(file->fh, varid, name, xtypep, ndimsp, dimidsp, nattsp);
+#endif /* _PNETCDF */
+    return nc_inq_var(file->fh, varid, name, xtypep, ndimsp, dimidsp, nattsp);
+}
+
+/**
+ * Get the name, type and length of an att, for the metadata cache of
+ * a file.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_inq_att(file_desc_t *file, int varid, int attnum, char *name,
+                        nc_type *xtypep, PIO_Offset *lenp)
+{
+    int ierr;
+
+#ifdef _PNETCDF
+    if (file->iotype == PIO_IOTYPE_PNETCDF)
+    {
+        if (!(ierr = ncmpi_inq_attname(file->fh, varid, attnum, name)))
+            ierr = ncmpi_inq_att(file->fh, varid, name, xtypep, lenp);
+        return ierr;
+    }
+#endif /* _PNETCDF */
+    if (!(ierr = nc_inq_attname(file->fh, varid, attnum, name)))
+        ierr = nc_inq_att(file->fh, varid, name, xtypep, (size_t *)lenp);
+    return ierr;
+}
+
+/**
+ * Can get_att_nc() read the values of an att of this type, as they
+ * are in the file?
+ *
+ * @param file pointer to the file info.
+ * @param xtype the type of the att.
+ * @returns true if it can.
+ */
+static bool meta_att_type_ok(file_desc_t *file, nc_type xtype)
+{
+    switch (xtype)
+    {
+    case NC_BYTE:
+    case NC_CHAR:
+    case NC_SHORT:
+    case NC_INT:
+    case NC_FLOAT:
+    case NC_DOUBLE:
+        return true;
+#ifdef _NETCDF4
+    case NC_UBYTE:
+    case NC_USHORT:
+    case NC_UINT:
+    case NC_INT64:
+    case NC_UINT64:
+        return file->iotype != PIO_IOTYPE_PNETCDF;
+#endif /* _NETCDF4 */
+    default:
+        return false;
+    }
+}
+
+/**
+ * Append a name to the packed metadata of a file. Unlike
+ * msg_pack_str(), the null terminator is packed too, so the cache can
+ * point to the name in the buffer.
+ *
+ * @param mb pointer to the buffer.
+ * @param name the name.
+ */
+static void meta_pack_name(msg_buf_t *mb, const char *name)
+{
+    int len = strlen(name) + 1;
+
+    msg_pack(mb, &len, sizeof(int));
+    msg_pack(mb, name, len);
+}
+
+/**
+ * Get a name from the packed metadata of a file.
+ *
+ * @param mb pointer to the buffer.
+ * @param namep pointer that gets a pointer to the name in the buffer.
+ * @returns 0 for success, PIO_EINVAL if the buffer is too short.
+ */
+static int meta_unpack_name(msg_buf_t *mb, const char **namep)
+{
+    int len;
+    char *name;
+    int ret;
+
+    if ((ret = msg_unpack(mb, &len, sizeof(int))))
+        return ret;
+    if (len < 1 || !(name = msg_unpack_ptr(mb, len)) || name[len - 1])
+        return PIO_EINVAL;
+    *namep = name;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Pack the atts of a var, or the global atts, for the metadata cache
+ * of a file. The values of atts up to META_ATT_MAX_SIZE bytes are
+ * packed too.
+ *
+ * @param file pointer to the file info.
+ * @param mb pointer to the buffer.
+ * @param varid the var ID, or NC_GLOBAL.
+ * @param natts the number of atts.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_pack_atts(file_desc_t *file, msg_buf_t *mb, int varid, int natts)
+{
+    char name[PIO_MAX_NAME + 1];
+    char value[META_ATT_MAX_SIZE];
+    nc_type xtype;
+    PIO_Offset len;
+    PIO_Offset typelen = 0;
+    char has_value;
+    int ierr;
+
+    for (int a = 0; a < natts; a++)
+    {
+        if ((ierr = meta_inq_att(file, varid, a, name, &xtype, &len)))
+            return ierr;
+
+        /* pioc_pnetcdf_inq_type() knows the sizes of the atomic
+         * types, without asking the library. */
+        has_value = meta_att_type_ok(file, xtype) &&
+            !pioc_pnetcdf_inq_type(file->fh, xtype, NULL, &typelen) &&
+            len * typelen <= META_ATT_MAX_SIZE;
+        if (has_value && (ierr = get_att_nc(file, varid, name, xtype, value)))
+            return ierr;
+
+        meta_pack_name(mb, name);
+        msg_pack(mb, &xtype, sizeof(nc_type));
+        msg_pack(mb, &len, sizeof(PIO_Offset));
+        msg_pack(mb, &has_value, 1);
+        if (has_value)
+            msg_pack(mb, value, len * typelen);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Read all the metadata of a file, and pack it for the metadata
+ * cache. This is only called on the IO root.
+ *
+ * @param file pointer to the file info.
+ * @param mb pointer to the buffer.
+ * @param hdr array that gets the numbers of dims, vars, global atts,
+ * the unlimited dim, and the total numbers of atts and var dims, from
+ * META_HDR_NDIMS on.
+ * @returns 0 for success, error code otherwise.
+ */
+static int meta_pack_file(file_desc_t *file, msg_buf_t *mb, PIO_Offset *hdr)
+{
+    char name[PIO_MAX_NAME + 1];
+    int ndims, nvars, ngatts, unlimdimid;
+    PIO_Offset natts_total, ndimids_total;
+    int ierr;
+
+    if ((ierr = meta_inq(file, &ndims, &nvars, &ngatts, &unlimdimid)))
+        return ierr;
+
+    /* Netcdf-4 files may have more than one unlimited dim. */
+    char unlim[ndims + 1];
+    memset(unlim, 0, ndims + 1);
+    if (unlimdimid >= 0 && unlimdimid < ndims)
+        unlim[unlimdimid] = 1;
+#ifdef _NETCDF4
+    if (file->iotype == PIO_IOTYPE_NETCDF4C || file->iotype == PIO_IOTYPE_NETCDF4P)
+    {
+        int nunlim;
+        int unlimids[ndims + 1];
+
+        if ((ierr = nc_inq_unlimdims(file->fh, &nunlim, unlimids)))
+            return ierr;
+        for (int u = 0; u < nunlim; u++)
+            if (unlimids[u] >= 0 && unlimids[u] < ndims)
+                unlim[unlimids[u]] = 1;
+    }
+#endif /* _NETCDF4 */
+
+    for (int d = 0; d < ndims; d++)
+    {
+        PIO_Offset len;
+
+        if ((ierr = meta_inq_dim(file, d, name, &len)))
+            return ierr;
+        meta_pack_name(mb, name);
+        msg_pack(mb, &len, sizeof(PIO_Offset));
+        msg_pack(mb, &unlim[d], 1);
+    }
+
+    if ((ierr = meta_pack_atts(file, mb, NC_GLOBAL, ngatts)))
+        return ierr;
+    natts_total = ngatts;
+    ndimids_total = 0;
+
+    for (int v = 0; v < nvars; v++)
+    {
+        nc_type xtype;
+        int vndims, natts;
+        int dimids[PIO_MAX_DIMS];
+
+        if ((ierr = meta_inq_var(file, v, name, &xtype, &vndims, NULL, &natts)))
+            return ierr;
+        if (vndims > PIO_MAX_DIMS)
+            return PIO_EMAXDIMS;
+        if ((ierr = meta_inq_var(file, v, NULL, NULL, NULL, dimids, NULL)))
+            return ierr;
+        meta_pack_name(mb, name);
+        msg_pack(mb, &xtype, sizeof(nc_type));
+        msg_pack(mb, &vndims, sizeof(int));
+        msg_pack(mb, dimids, vndims * sizeof(int));
+        msg_pack(mb, &natts, sizeof(int));
+        if ((ierr = meta_pack_atts(file, mb, v, natts)))
+            return ierr;
+        natts_total += natts;
+        ndimids_total += vndims;
+    }
+
+    hdr[META_HDR_NDIMS] = ndims;
+    hdr[META_HDR_NVARS] = nvars;
+    hdr[META_HDR_NGATTS] = ngatts;
+    hdr[META_HDR_UNLIMDIMID] = unlimdimid;
+    hdr[META_HDR_NATTS] = natts_total;
+    hdr[META_HDR_NDIMIDS] = ndimids_total;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get the atts of a var, or the global atts, from the packed
+ * metadata of a file.
+ *
+ * @param mb pointer to the buffer.
+ * @param atts array that gets the atts.
+ * @param natts the number of atts.
+ * @returns 0 for success, PIO_EINVAL if the buffer is too short.
+ */
+static int meta_unpack_atts(msg_buf_t *mb, att_meta_t *atts, int natts)
+{
+    int ret;
+
+    for (int a = 0; a < natts; a++)
+    {
+        PIO_Offset typelen = 0;
+        char has_value;
+
+        if ((ret = meta_unpack_name(mb, &atts[a].name)) ||
+            (ret = msg_unpack(mb, &atts[a].xtype, sizeof(nc_type))) ||
+            (ret = msg_unpack(mb, &atts[a].len, sizeof(PIO_Offset))) ||
+            (ret = msg_unpack(mb, &has_value, 1)))
+            return ret;
+        atts[a].value = NULL;
+        if (has_value)
+        {
+            pioc_pnetcdf_inq_type(0, atts[a].xtype, NULL, &typelen);
+            if (!(atts[a].value = msg_unpack_ptr(mb, atts[a].len * typelen)))
+                return PIO_EINVAL;
+        }
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Fill the metadata cache of a file from the packed metadata in
+ * meta->buf.
+ *
+ * @param meta pointer to the cache, with the arrays allocated.
+ * @param hdr the header of the packed metadata.
+ * @returns 0 for success, PIO_EINVAL if the metadata do not match
+ * the header.
+ */
+static int meta_unpack_file(file_meta_t *meta, const PIO_Offset *hdr)
+{
+    msg_buf_t mb;
+    PIO_Offset natts, ndimids;
+    int ret;
+
+    /* The buffer belongs to the cache, so mb is not freed. */
+    memset(&mb, 0, sizeof(msg_buf_t));
+    mb.buf = meta->buf;
+    mb.len = hdr[META_HDR_LEN];
+
+    for (int d = 0; d < meta->ndims; d++)
+        if ((ret = meta_unpack_name(&mb, &meta->dims[d].name)) ||
+            (ret = msg_unpack(&mb, &meta->dims[d].len, sizeof(PIO_Offset))) ||
+            (ret = msg_unpack(&mb, &meta->dims[d].unlim, 1)))
+            return ret;
+
+    if ((ret = meta_unpack_atts(&mb, meta->atts, meta->ngatts)))
+        return ret;
+    natts = meta->ngatts;
+    ndimids = 0;
+
+    for (int v = 0; v < meta->nvars; v++)
+    {
+        var_meta_t *var = &meta->vars[v];
+
+        if ((ret = meta_unpack_name(&mb, &var->name)) ||
+            (ret = msg_unpack(&mb, &var->xtype, sizeof(nc_type))) ||
+            (ret = msg_unpack(&mb, &var->ndims, sizeof(int))))
+            return ret;
+        if (var->ndims < 0 || ndimids + var->ndims > hdr[META_HDR_NDIMIDS])
+            return PIO_EINVAL;
+        var->dimids = meta->dimids + ndimids;
+        ndimids += var->ndims;
+        if ((ret = msg_unpack(&mb, var->dimids, var->ndims * sizeof(int))) ||
+            (ret = msg_unpack(&mb, &var->natts, sizeof(int))))
+            return ret;
+        if (var->natts < 0 || natts + var->natts > hdr[META_HDR_NATTS])
+            return PIO_EINVAL;
+        var->atts = meta->atts + natts;
+        natts += var->natts;
+        if ((ret = meta_unpack_atts(&mb, var->atts, var->natts)))
+            return ret;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Free the metadata cache of a file. This must be called on all
+ * tasks of the iosystem, so they agree on whether the cache is
+ * valid.
+ *
+ * @param file pointer to the file info.
+ */
+void file_meta_free(file_desc_t *file)
+{
+    file_meta_t *meta = file->meta;
+
+    if (!meta)
+        return;
+    LOG((3, "file_meta_free ncid = %d", file->pio_ncid));
+
+    free(meta->buf);
+    free(meta->dims);
+    free(meta->vars);
+    free(meta->atts);
+    free(meta->dimids);
+    free(meta);
+    file->meta = NULL;
+}
+
+/**
+ * Invalidate the metadata cache of a file. This is called on all
+ * tasks by the functions that change the metadata of a file, and by
+ * redef and enddef. The cache is filled again after enddef.
+ *
+ * @param file pointer to the file info.
+ */
+void file_meta_invalidate(file_desc_t *file)
+{
+    LOG((3, "file_meta_invalidate ncid = %d", file->pio_ncid));
+    file_meta_free(file);
+}
+
+/**
+ * Fill the metadata cache of a file. The IO root reads the dims, vars
+ * and atts of the file, and broadcasts them to all tasks in one
+ * message, so that the PIOc_inq_* functions can then answer without
+ * communication. This is called on all tasks, when the file is opened
+ * and after enddef.
+ *
+ * The cache is only an optimization. If it cannot be filled, the
+ * PIOc_inq_* functions ask the IO tasks as usual, and no error is
+ * returned.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+int file_meta_build(file_desc_t *file)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    PIO_Offset hdr[META_HDR_SIZE] = {0};
+    msg_buf_t mb;
+    file_meta_t *meta;
+    int ok;
+    int ret;
+    int mpierr;
+
+    file_meta_free(file);
+    msg_buf_init(NULL, &mb);
+
+    /* The IO root reads the metadata. */
+    if (ios->iomaster == MPI_ROOT)
+    {
+        hdr[META_HDR_ERR] = meta_pack_file(file, &mb, hdr);
+        if (!hdr[META_HDR_ERR] && mb.nomem)
+            hdr[META_HDR_ERR] = PIO_ENOMEM;
+        hdr[META_HDR_LEN] = mb.len;
+    }
+    if ((mpierr = MPI_Bcast(hdr, META_HDR_SIZE, MPI_OFFSET, ios->ioroot, ios->my_comm)))
+    {
+        msg_buf_free(&mb);
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+    LOG((2, "file_meta_build ncid = %d err = %d len = %lld ndims = %d nvars = %d natts = %d",
+         file->pio_ncid, hdr[META_HDR_ERR], hdr[META_HDR_LEN], hdr[META_HDR_NDIMS],
+         hdr[META_HDR_NVARS], hdr[META_HDR_NATTS]));
+    if (hdr[META_HDR_ERR] || hdr[META_HDR_LEN] > INT_MAX)
+    {
+        msg_buf_free(&mb);
+        return PIO_NOERR;
+    }
+
+    /* Allocate the cache on all tasks. The IO root keeps its buffer. */
+    if ((meta = calloc(1, sizeof(file_meta_t))))
+    {
+        meta->ndims = hdr[META_HDR_NDIMS];
+        meta->nvars = hdr[META_HDR_NVARS];
+        meta->ngatts = hdr[META_HDR_NGATTS];
+        meta->unlimdimid = hdr[META_HDR_UNLIMDIMID];
+        if (ios->iomaster == MPI_ROOT)
+        {
+            meta->buf = mb.buf;
+            mb.buf = NULL;
+        }
+        else
+            meta->buf = malloc(max(hdr[META_HDR_LEN], 1));
+        meta->dims = calloc(max(meta->ndims, 1), sizeof(dim_meta_t));
+        meta->vars = calloc(max(meta->nvars, 1), sizeof(var_meta_t));
+        meta->atts = calloc(max(hdr[META_HDR_NATTS], 1), sizeof(att_meta_t));
+        meta->dimids = calloc(max(hdr[META_HDR_NDIMIDS], 1), sizeof(int));
+    }
+    msg_buf_free(&mb);
+    ok = meta && meta->buf && meta->dims && meta->vars && meta->atts && meta->dimids;
+
+    /* All tasks must have the cache, or none. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ios->my_comm)))
+    {
+        file->meta = meta;
+        file_meta_free(file);
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+    file->meta = meta;
+    if (!ok)
+    {
+        LOG((2, "file_meta_build out of memory, no metadata cache"));
+        file_meta_free(file);
+        return PIO_NOERR;
+    }
+
+    if ((mpierr = MPI_Bcast(meta->buf, hdr[META_HDR_LEN], MPI_BYTE, ios->ioroot, ios->my_comm)))
+    {
+        file_meta_free(file);
+        return check_mpi(file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* All tasks unpack the same buffer, so they agree on the result. */
+    if ((ret = meta_unpack_file(meta, hdr)))
+    {
+        LOG((2, "file_meta_build bad metadata ret = %d, no metadata cache", ret));
+        file_meta_free(file);
+    }
+
+    return PIO_NOERR;
 }
 
 /**
- * Internal function to provide inq_type function for pnetcdf.
+ * Find the atts of a var, or the global atts, in the metadata cache
+ * of a file.
  *
- * @param ncid ignored because pnetcdf does not have user-defined
- * types.
- * @param xtype type to learn about.
- * @param name pointer that gets name of type. Ignored if NULL.
- * @param sizep pointer that gets size of type. Ignored if NULL.
- * @returns 0 on success, error code otherwise.
+ * @param meta pointer to the metadata cache.
+ * @param varid the var ID, or NC_GLOBAL.
+ * @param attsp pointer that gets the array of atts.
+ * @param nattsp pointer that gets the number of atts.
+ * @returns 0 for success, NC_ENOTVAR if there is no such var.
  */
-int pioc_pnetcdf_inq_type(int ncid, nc_type xtype, char *name,
-                          PIO_Offset *sizep)
+int file_meta_atts(file_meta_t *meta, int varid, att_meta_t **attsp, int *nattsp)
 {
-    int typelen;
-
-    switch (xtype)
+    if (varid == NC_GLOBAL)
     {
-    case NC_UBYTE:
-    case NC_BYTE:
-    case NC_CHAR:
-        typelen = 1;
-        break;
-    case NC_SHORT:
-    case NC_USHORT:
-        typelen = 2;
-        break;
-    case NC_UINT:
-    case NC_INT:
-    case NC_FLOAT:
-        typelen = 4;
-        break;
-    case NC_UINT64:
-    case NC_INT64:
-    case NC_DOUBLE:
-        typelen = 8;
-        break;
-    default:
-        return PIO_EBADTYPE;
+        *attsp = meta->atts;
+        *nattsp = meta->ngatts;
     }
-
-    /* If pointers were supplied, copy results. */
-    if (sizep)
-        *sizep = typelen;
-    if (name)
-        strcpy(name, "some type");
+    else if (varid >= 0 && varid < meta->nvars)
+    {
+        *attsp = meta->vars[varid].atts;
+        *nattsp = meta->vars[varid].natts;
+    }
+    else
+        return NC_ENOTVAR;
 
     return PIO_NOERR;
 }
 
 /**
- * This is an internal function that handles both PIOc_enddef and
- * PIOc_redef.
+ * Find an att in the metadata cache of a file.
  *
- * @param ncid the ncid of the file to enddef or redef
- * @param is_enddef set to non-zero for enddef, 0 for redef.
- * @returns PIO_NOERR on success, error code on failure. */
-int pioc_change_def(int ncid, int is_enddef)
+ * @param meta pointer to the metadata cache.
+ * @param varid the var ID, or NC_GLOBAL.
+ * @param name the name of the att.
+ * @param attp pointer that gets a pointer to the att.
+ * @param attnump pointer that gets the number of the att. Ignored if
+ * NULL.
+ * @returns 0 for success, NC_ENOTVAR if there is no such var,
+ * NC_ENOTATT if there is no such att.
+ */
+int file_meta_att(file_meta_t *meta, int varid, const char *name, att_meta_t **attp,
+                  int *attnump)
 {
-    iosystem_desc_t *ios;  /* Pointer to io system information. */
-    file_desc_t *file;     /* Pointer to file information. */
-    int ierr = PIO_NOERR;  /* Return code from function calls. */
-    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI functions. */
-
-    LOG((2, "pioc_change_def ncid = %d is_enddef = %d", ncid, is_enddef));
-
-    /* Find the info about this file. When I check the return code
-     * here, some tests fail. ???*/
-    if ((ierr = pio_get_file(ncid, &file)))
-        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__);
-    ios = file->iosystem;
-
-    /* If async is in use, and this is not an IO task, bcast the parameters. */
-    if (ios->async)
-    {
-        if (!ios->ioproc)
-        {
-            int msg = is_enddef ? PIO_MSG_ENDDEF : PIO_MSG_REDEF;
-            if (ios->compmaster == MPI_ROOT)
-                mpierr = MPI_Send(&msg, 1, MPI_INT, ios->ioroot, 1, ios->union_comm);
-
-            if (!mpierr)
-                mpierr = MPI_Bcast(&ncid, 1, MPI_INT, ios->compmaster, ios->intercomm);
-            LOG((3, "pioc_change_def ncid = %d mpierr = %d", ncid, mpierr));
-        }
-
-        /* Handle MPI errors. */
-        LOG((3, "pioc_change_def handling MPI errors"));
-        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
-            check_mpi(file, mpierr2, __FILE__, __LINE__);
-        if (mpierr)
-            return check_mpi(file, mpierr, __FILE__, __LINE__);
-    }
+    att_meta_t *atts;
+    int natts;
+    int ret;
 
-    /* If this is an IO task, then call the netCDF function. */
-    LOG((3, "pioc_change_def ios->ioproc = %d", ios->ioproc));
-    if (ios->ioproc)
-    {
-        LOG((3, "pioc_change_def calling netcdf function file->fh = %d file->do_io = %d iotype = %d",
-             file->fh, file->do_io, file->iotype));
-#ifdef _PNETCDF
-        if (file->iotype == PIO_IOTYPE_PNETCDF)
-        {
-            if (is_enddef)
-                ierr = ncmpi_enddef(file->fh);
-            else
-                ierr = ncmpi_redef(file->fh);
-        }
-#endif /* _PNETCDF */
-        if (file->iotype != PIO_IOTYPE_PNETCDF && file->do_io)
+    if ((ret = file_meta_atts(meta, varid, &atts, &natts)))
+        return ret;
+    for (int a = 0; a < natts; a++)
+        if (!strcmp(atts[a].name, name))
         {
-            if (is_enddef)
-            {
-                LOG((3, "pioc_change_def calling nc_enddef file->fh = %d", file->fh));
-                ierr = nc_enddef(file->fh);
-            }
-            else
-                ierr = nc_redef(file->fh);
+            *attp = &atts[a];
+            if (attnump)
+                *attnump = a;
+            return PIO_NOERR;
         }
-    }
-
-    /* Broadcast and check the return code. */
-    LOG((3, "pioc_change_def bcasting return code ierr = %d", ierr));
-    if ((mpierr = MPI_Bcast(&ierr, 1, MPI_INT, ios->ioroot, ios->my_comm)))
-        return check_mpi(file, mpierr, __FILE__, __LINE__);
-    if (ierr)
-        return check_netcdf(file, ierr, __FILE__, __LINE__);
-    LOG((3, "pioc_change_def succeeded"));
 
-    return ierr;
+    return NC_ENOTATT;
 }
 
 /**
@@ -2224,6 +3546,8 @@ int iotype_is_valid(int iotype)
  * Possible values are :
  * PIO_REARR_COMM_P2P (Point to point communication)
  * PIO_REARR_COMM_COLL (Collective communication)
+ * PIO_REARR_COMM_NEIGHBOR (Neighborhood collectives on a
+ * distributed graph communicator built for each decomposition)
  * @param fcd Flow control direction for the rearranger.
  * See PIO_REARR_COMM_FC_DIR for more detail.
  * Possible values are :
@@ -2263,7 +3587,8 @@ int PIOc_set_rearr_opts(int iosysid, int comm_type, int fcd, bool enable_hs_c2i,
     };
 
     /* Check inputs. */
-    if ((comm_type != PIO_REARR_COMM_P2P && comm_type != PIO_REARR_COMM_FC_1D_COMP2IO) ||
+    if ((comm_type != PIO_REARR_COMM_P2P && comm_type != PIO_REARR_COMM_COLL &&
+         comm_type != PIO_REARR_COMM_NEIGHBOR) ||
         (fcd < 0 || fcd > PIO_REARR_COMM_FC_2D_DISABLE) ||
         (max_pend_req_c2i != PIO_REARR_COMM_UNLIMITED_PEND_REQ && max_pend_req_c2i < 0) ||
         (max_pend_req_i2c != PIO_REARR_COMM_UNLIMITED_PEND_REQ && max_pend_req_i2c < 0))
@@ -2278,3 +3603,240 @@ int PIOc_set_rearr_opts(int iosysid, int comm_type, int fcd, bool enable_hs_c2i,
 
     return PIO_NOERR;
 }
+
+/**
+ * Turn tuning of the rearranger options on or off for an
+ * iosystem. When on, the first write with each decomposition times
+ * data movement through the rearranger with a range of communication
+ * options, and keeps the fastest in the decomposition. This makes the
+ * first write of each decomposition slower. Options set with
+ * PIOc_set_rearr_opts() are used as the starting point.
+ *
+ * @param iosysid the IO system ID.
+ * @param enable true to tune the rearranger options.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_rearr_tune(int iosysid, bool enable)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    ios->rearr_tune = enable;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Set when pending pnetcdf writes of the files of an iosystem are
+ * completed. Buffered (bput) writes are always completed when the
+ * attached buffer (see PIOc_set_buffer_size_limit()) would
+ * overflow. Darray writes are sent to pnetcdf with iput, and by
+ * default are only completed when the file is synced, closed, or the
+ * write is flushed to disk. A budget completes them once the data
+ * in pending iput requests reaches that many bytes, to bound the
+ * memory held by the IO buffers.
+ *
+ * When pending requests are completed, they are waited for in chunks
+ * of about the chunk size in bytes, so that each collective write is
+ * about one stripe of the file system. If chunk is 0, the stripe
+ * width is taken from the striping_unit and striping_factor hints of
+ * the iosystem, if set (see PIOc_set_hint()), otherwise all requests
+ * are waited for at once.
+ *
+ * @param iosysid the IO system ID.
+ * @param budget bytes of pending iput data at which the writes are
+ * completed, or 0 for no budget.
+ * @param chunk bytes of pending data to wait for at once, or 0 to
+ * use the striping hints.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_flush_policy(int iosysid, PIO_Offset budget, PIO_Offset chunk)
+{
+    iosystem_desc_t *ios;
+
+    /* Check inputs. */
+    if (budget < 0 || chunk < 0)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    ios->flush_budget = budget;
+    ios->flush_chunk = chunk;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Turn the shared memory path of the rearranger on or off for an
+ * iosystem. When on, compute tasks that send data to an IO task on
+ * the same node copy it into an MPI-3 shared memory window, and the
+ * IO task gathers it from there, instead of receiving it in a
+ * message. This is used when moving data from compute tasks to IO
+ * tasks. The first write with each decomposition after this is
+ * changed sets up (or frees) the shared memory, so all tasks must
+ * make the same call.
+ *
+ * @param iosysid the IO system ID.
+ * @param enable true to use shared memory between tasks on the same
+ * node.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_rearr_shm(int iosysid, bool enable)
+{
+    iosystem_desc_t *ios;
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    ios->rearr_shm = enable;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Choose how the subset rearranger assigns compute tasks to IO tasks
+ * for the decompositions created after this call.
+ *
+ * @param iosysid the IO system ID.
+ * @param partition PIO_SUBSET_PARTITION_RANK (the default) assigns
+ * contiguous blocks of compute ranks to each IO task.
+ * PIO_SUBSET_PARTITION_NODE assigns compute tasks to IO tasks on the
+ * same node, balancing the amount of data on each IO task.
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_subset_partition(int iosysid, int partition)
+{
+    iosystem_desc_t *ios;
+
+    /* Check inputs. */
+    if (partition != PIO_SUBSET_PARTITION_RANK && partition != PIO_SUBSET_PARTITION_NODE)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    ios->subset_partition = partition;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Queue define mode calls with async. When the batch size is not 0,
+ * PIOc_put_att() calls made on the computation tasks while a file is
+ * in define mode are not sent to the IO tasks one by one, but are
+ * packed into a batch. The batch is sent as one message when it
+ * reaches batch_size bytes, or before any other message is sent to
+ * the IO tasks, so at the latest by PIOc_enddef(). Errors of the
+ * queued calls are returned by the next PIOc_enddef() or
+ * PIOc_closefile() of the file. Without async this has no effect.
+ *
+ * @param iosysid the IO system ID.
+ * @param batch_size bytes of queued calls at which the batch is
+ * sent, or 0 to send each call when it is made (the default).
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_msg_batch(int iosysid, PIO_Offset batch_size)
+{
+    iosystem_desc_t *ios;
+
+    /* Check inputs. */
+    if (batch_size < 0)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    ios->batch_limit = batch_size;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Let the box rearranger pick the IO tasks of each decomposition
+ * created after this call from the size of its data, instead of
+ * using all IO tasks. Enough IO tasks are used to have about target
+ * bytes on each, in equal numbers on each node, spread over the IO
+ * tasks with an even stride. The choice is written to the log (see
+ * calc_box_layout()). All tasks must make the same call.
+ *
+ * @param iosysid the IO system ID.
+ * @param target the number of bytes of data per active IO task, or
+ * 0 to use all IO tasks (the default).
+ * @param ranks_per_node the number of computation tasks on each
+ * node, or 0 to find it from MPI (then this call is collective over
+ * the computation tasks). With async, the computation tasks send the
+ * setting to the IO tasks, which run calc_box_layout().
+ * @return 0 on success, otherwise a PIO error code.
+ */
+int PIOc_set_iotask_target(int iosysid, PIO_Offset target, int ranks_per_node)
+{
+    iosystem_desc_t *ios;
+    int mpierr = MPI_SUCCESS, mpierr2;  /* Return code from MPI function codes. */
+
+    /* Check inputs. */
+    if (target < 0 || ranks_per_node < 0)
+        return pio_err(NULL, NULL, PIO_EINVAL, __FILE__, __LINE__);
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__);
+
+    /* The largest number of tasks on a node. With async, the IO
+     * tasks get it from the computation tasks. */
+    if (!ranks_per_node && !(ios->async && ios->ioproc))
+    {
+#ifdef MPI_SERIAL
+        ranks_per_node = 1;
+#else
+        MPI_Comm node_comm;
+
+        if ((mpierr = MPI_Comm_split_type(ios->comp_comm, MPI_COMM_TYPE_SHARED, 0,
+                                          MPI_INFO_NULL, &node_comm)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_size(node_comm, &ranks_per_node)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_free(&node_comm)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ranks_per_node, 1, MPI_INT, MPI_MAX,
+                                    ios->comp_comm)))
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+#endif /* MPI_SERIAL */
+    }
+
+    /* If async is in use, and this is not an IO task, send the
+     * parameters. */
+    if (ios->async)
+    {
+        if (!ios->ioproc)
+        {
+            msg_buf_t mb;
+
+            msg_buf_init(ios, &mb);
+            msg_pack(&mb, &target, sizeof(PIO_Offset));
+            msg_pack(&mb, &ranks_per_node, sizeof(int));
+            mpierr = send_packed_msg(ios, PIO_MSG_SET_IOTASK_TARGET, &mb);
+            msg_buf_free(&mb);
+        }
+
+        /* Handle MPI errors. */
+        if ((mpierr2 = MPI_Bcast(&mpierr, 1, MPI_INT, ios->comproot, ios->my_comm)))
+            return check_mpi2(ios, NULL, mpierr2, __FILE__, __LINE__);
+        if (mpierr)
+            return check_mpi2(ios, NULL, mpierr, __FILE__, __LINE__);
+    }
+    LOG((1, "PIOc_set_iotask_target target = %lld ranks_per_node = %d", target,
+         ranks_per_node));
+
+    ios->iotask_target = target;
+    ios->ranks_per_node = ranks_per_node;
+
+    return PIO_NOERR;
+}
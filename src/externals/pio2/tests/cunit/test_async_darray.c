@@ -0,0 +1,266 @@
+/*
+ * Tests for distributed arrays with async I/O. One task is used for
+ * IO, the others for computation. The computation tasks write records
+ * of a distributed array, which the IO task writes to the file, then
+ * read them back. The time the computation tasks spend in
+ * PIOc_write_darray() is reported, since with async they only hand
+ * the data to the IO task. Attributes are put with message batching
+ * on.
+ */
+#include <pio.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_async_darray"
+
+/* Number of processors that will do IO. */
+#define NUM_IO_PROCS 1
+
+/* Number of computational components to create. */
+#define COMPONENT_COUNT 1
+
+/* Number of elements of the distributed array on each computation
+ * task. */
+#define ELEM_PER_PE 10
+
+/* The number of dimensions of the var in the file. */
+#define NDIM2 2
+
+/* Number of records written. */
+#define NUM_RECORDS 5
+
+/* Names of the dimensions and the var. */
+#define DIM_NAME_UNLIM "time"
+#define DIM_NAME_X "x"
+#define VAR_NAME "foo"
+
+/* Number of attributes put in define mode. With message batching on
+ * they travel to the IO task together at enddef. */
+#define NUM_ATTS 8
+#define ATT_NAME_LEN 16
+
+/* Limit on the size of a batch of messages, in bytes. Small enough
+ * that the attributes fill more than one batch. */
+#define MSG_BATCH_SIZE 128
+
+/* Value of an element of a record. */
+#define TEST_VALUE(r, i) ((r) * 1000 + (i))
+
+/* Create a file with one record var, and write NUM_RECORDS records of
+ * it.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param iotype the iotype to use.
+ * @param filename the name of the file.
+ * @param comp_rank rank of this task in the computation component.
+ * @param wtime pointer that gets the time spent in
+ * PIOc_write_darray() on this task, in seconds.
+ * @returns 0 for success, error code otherwise.
+ */
+int write_darray_file(int iosysid, int ioid, int iotype, const char *filename, int comp_rank,
+                      double *wtime)
+{
+    int ncid;
+    int dimid[NDIM2];
+    int varid;
+    int data[ELEM_PER_PE];
+    double t0;
+    int ret;
+
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, DIM_NAME_UNLIM, NC_UNLIMITED, &dimid[0])))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, DIM_NAME_X, (TARGET_NTASKS - NUM_IO_PROCS) * ELEM_PER_PE,
+                            &dimid[1])))
+        return ret;
+    if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM2, dimid, &varid)))
+        return ret;
+    for (int a = 0; a < NUM_ATTS; a++)
+    {
+        char att_name[ATT_NAME_LEN];
+        int att_data[2] = {a, -a};
+
+        sprintf(att_name, "att_%d", a);
+        if ((ret = PIOc_put_att_int(ncid, varid, att_name, PIO_INT, 2, att_data)))
+            return ret;
+    }
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+
+    *wtime = 0;
+    for (int r = 0; r < NUM_RECORDS; r++)
+    {
+        for (int i = 0; i < ELEM_PER_PE; i++)
+            data[i] = TEST_VALUE(r, comp_rank * ELEM_PER_PE + i);
+        if ((ret = PIOc_setframe(ncid, varid, r)))
+            return ret;
+        t0 = MPI_Wtime();
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, ELEM_PER_PE, data, NULL)))
+            return ret;
+        *wtime += MPI_Wtime() - t0;
+    }
+
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/* Read the records back, and check them.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param iotype the iotype to use.
+ * @param filename the name of the file.
+ * @param comp_rank rank of this task in the computation component.
+ * @returns 0 for success, error code otherwise.
+ */
+int check_darray_file(int iosysid, int ioid, int iotype, const char *filename, int comp_rank)
+{
+    int ncid;
+    int varid;
+    int data[ELEM_PER_PE];
+    int ret;
+
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        return ret;
+    if ((ret = PIOc_inq_varid(ncid, VAR_NAME, &varid)))
+        return ret;
+
+    /* Check the attributes. */
+    for (int a = 0; a < NUM_ATTS; a++)
+    {
+        char att_name[ATT_NAME_LEN];
+        int att_data[2];
+
+        sprintf(att_name, "att_%d", a);
+        if ((ret = PIOc_get_att_int(ncid, varid, att_name, att_data)))
+            return ret;
+        if (att_data[0] != a || att_data[1] != -a)
+            return ERR_WRONG;
+    }
+
+    for (int r = 0; r < NUM_RECORDS; r++)
+    {
+        if ((ret = PIOc_setframe(ncid, varid, r)))
+            return ret;
+        if ((ret = PIOc_read_darray(ncid, varid, ioid, ELEM_PER_PE, data)))
+            return ret;
+        for (int i = 0; i < ELEM_PER_PE; i++)
+            if (data[i] != TEST_VALUE(r, comp_rank * ELEM_PER_PE + i))
+                return ERR_WRONG;
+    }
+
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/* Run async darray tests. */
+int main(int argc, char **argv)
+{
+    int my_rank; /* Zero-based rank of processor. */
+    int ntasks; /* Number of processors involved in current execution. */
+    int iosysid[COMPONENT_COUNT]; /* The ID for the parallel I/O system. */
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    int num_procs[COMPONENT_COUNT] = {TARGET_NTASKS - NUM_IO_PROCS}; /* Num procs for computation. */
+    MPI_Comm comp_comm[COMPONENT_COUNT]; /* Communicators of the computation components. */
+    MPI_Comm test_comm;
+    int ret; /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, TARGET_NTASKS, TARGET_NTASKS,
+                              0, &test_comm)))
+        ERR(ERR_INIT);
+
+    /* Only do something on TARGET_NTASKS tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        /* Is the current process a computation task? */
+        int comp_task = my_rank < NUM_IO_PROCS ? 0 : 1;
+
+        /* Initialize the IO system. The IO task does not return until
+         * the computation tasks finalize. */
+        if ((ret = PIOc_init_async(test_comm, NUM_IO_PROCS, NULL, COMPONENT_COUNT,
+                                   num_procs, NULL, NULL, comp_comm, PIO_REARR_BOX, iosysid)))
+            ERR(ERR_INIT);
+
+        if (comp_task)
+        {
+            int comp_rank = my_rank - NUM_IO_PROCS;
+            int gdimlen = (TARGET_NTASKS - NUM_IO_PROCS) * ELEM_PER_PE;
+            PIO_Offset compdof[ELEM_PER_PE];
+            int ioid;
+
+            /* Each computation task has a contiguous block of x. */
+            for (int i = 0; i < ELEM_PER_PE; i++)
+                compdof[i] = comp_rank * ELEM_PER_PE + i + 1;
+            if ((ret = PIOc_InitDecomp(iosysid[0], PIO_INT, 1, &gdimlen, ELEM_PER_PE, compdof,
+                                       &ioid, NULL, NULL, NULL)))
+                ERR(ret);
+
+            /* Batch the attribute messages. */
+            if ((ret = PIOc_set_msg_batch(iosysid[0], MSG_BATCH_SIZE)))
+                ERR(ret);
+            if (PIOc_set_msg_batch(iosysid[0], -1) != PIO_EINVAL)
+                ERR(ERR_WRONG);
+
+            for (int flv = 0; flv < num_flavors; flv++)
+            {
+                char filename[NC_MAX_NAME + 1];
+                char iotype_name[NC_MAX_NAME + 1];
+                double wtime, max_wtime;
+
+                if ((ret = get_iotype_name(flavor[flv], iotype_name)))
+                    ERR(ret);
+                sprintf(filename, "%s_%s.nc", TEST_NAME, iotype_name);
+
+                if ((ret = write_darray_file(iosysid[0], ioid, flavor[flv], filename, comp_rank,
+                                             &wtime)))
+                    ERR(ret);
+
+                /* Report the slowest computation task. */
+                if ((ret = MPI_Reduce(&wtime, &max_wtime, 1, MPI_DOUBLE, MPI_MAX, 0,
+                                      comp_comm[0])))
+                    MPIERR(ret);
+                if (!comp_rank)
+                    printf("%d %s %s compute time in PIOc_write_darray() for %d records: "
+                           "%.3f ms\n", my_rank, TEST_NAME, iotype_name, NUM_RECORDS,
+                           max_wtime * 1e3);
+
+                if ((ret = check_darray_file(iosysid[0], ioid, flavor[flv], filename,
+                                             comp_rank)))
+                    ERR(ret);
+            }
+
+            if ((ret = PIOc_freedecomp(iosysid[0], ioid)))
+                ERR(ret);
+
+            /* Finalize the IO system. Only call this from the
+             * computation tasks. */
+            if ((ret = PIOc_finalize(iosysid[0])))
+                ERR(ret);
+            MPI_Comm_free(&comp_comm[0]);
+        }
+    }
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+
+    return 0;
+}
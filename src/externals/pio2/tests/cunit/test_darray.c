@@ -40,12 +40,24 @@
 #define VAR_NAME "foo"
 
 /* Test cases relating to PIOc_write_darray_multi(). */
-#define NUM_TEST_CASES_WRT_MULTI 3
+#define NUM_TEST_CASES_WRT_MULTI 4
+
+/* The last test case writes with PIOc_iwrite_darray(). */
+#define TEST_CASE_IWRITE 3
 
 /* Test with and without specifying a fill value to
  * PIOc_write_darray(). */
 #define NUM_TEST_CASES_FILLVALUE 2
 
+/* The length of the data of test_darray_serial(). The sizes are not
+ * multiples of the number of tasks, so the tasks have different
+ * amounts of data. */
+#define SERIAL_X_DIM_LEN 7
+#define SERIAL_Y_DIM_LEN 9
+
+/* The number of vars written at once in test_darray_serial(). */
+#define SERIAL_NVARS 3
+
 /* The dimension names. */
 char dim_name[NDIM][PIO_MAX_NAME + 1] = {"timestep", "x", "y"};
 
@@ -174,6 +186,39 @@ int test_darray(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank
                     if ((ret = PIOc_write_darray(ncid, varid, ioid, arraylen, test_data, fillvalue)))
                         ERR(ret);
                 }
+                else if (test_multi == TEST_CASE_IWRITE)
+                {
+                    int request;
+
+                    /* These should not work. */
+                    if (PIOc_iwrite_darray(ncid + TEST_VAL_42, varid, ioid, arraylen, test_data, fillvalue,
+                                           &request) != PIO_EBADID)
+                        ERR(ERR_WRONG);
+                    if (PIOc_iwrite_darray(ncid, varid, ioid + TEST_VAL_42, arraylen, test_data, fillvalue,
+                                           &request) != PIO_EBADID)
+                        ERR(ERR_WRONG);
+                    if (PIOc_iwrite_darray(ncid, varid, ioid, arraylen - 1, test_data, fillvalue,
+                                           &request) != PIO_EINVAL)
+                        ERR(ERR_WRONG);
+                    if (PIOc_iwrite_darray(ncid, varid, ioid, arraylen, test_data, fillvalue,
+                                           NULL) != PIO_EINVAL)
+                        ERR(ERR_WRONG);
+
+                    /* Start writing the data, then wait for it. */
+                    if ((ret = PIOc_iwrite_darray(ncid, varid, ioid, arraylen, test_data, fillvalue,
+                                                  &request)))
+                        ERR(ret);
+                    if (PIOc_wait(ncid + TEST_VAL_42, request) != PIO_EBADID)
+                        ERR(ERR_WRONG);
+                    if (PIOc_wait(ncid, request + TEST_VAL_42) != PIO_EINVAL)
+                        ERR(ERR_WRONG);
+                    if ((ret = PIOc_wait(ncid, request)))
+                        ERR(ret);
+
+                    /* The request is gone. */
+                    if (PIOc_wait(ncid, request) != PIO_EINVAL)
+                        ERR(ERR_WRONG);
+                }
                 else
                 {
                     int varid_big = NC_MAX_VARS + TEST_VAL_42;
@@ -252,6 +297,14 @@ int test_darray(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank
                     if (PIOc_write_darray(ncid2, varid, ioid, arraylen, test_data, fillvalue) != PIO_EPERM)
                         ERR(ERR_WRONG);
                 }
+                else if (test_multi == TEST_CASE_IWRITE)
+                {
+                    int request;
+
+                    if (PIOc_iwrite_darray(ncid2, varid, ioid, arraylen, test_data, fillvalue,
+                                           &request) != PIO_EPERM)
+                        ERR(ERR_WRONG);
+                }
                 else
                 {
                     if (PIOc_write_darray_multi(ncid2, &varid, ioid, 1, arraylen, test_data, &frame,
@@ -270,6 +323,99 @@ int test_darray(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank
     return PIO_NOERR;
 }
 
+/**
+ * Test writing with the serial netCDF iotypes from several IO
+ * tasks. IO task 0 receives the data of each of the other IO tasks
+ * while it writes the data of the one before. Several vars are
+ * written at once, then read back and checked.
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_serial(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dim_len_2d[NDIM2] = {SERIAL_X_DIM_LEN, SERIAL_Y_DIM_LEN};
+    int gsize = SERIAL_X_DIM_LEN * SERIAL_Y_DIM_LEN; /* Global size of a var. */
+    int per_pe = (gsize + TARGET_NTASKS - 1) / TARGET_NTASKS;
+    int start = my_rank * per_pe;  /* First element of this task. */
+    int maplen = start + per_pe > gsize ? gsize - start : per_pe;
+    PIO_Offset compdof[per_pe];    /* The decomposition map. */
+    int data[SERIAL_NVARS * per_pe]; /* The data of this task for all vars. */
+    int data_in[gsize];            /* A var read back. */
+    int dimids[NDIM2];             /* The dimension IDs. */
+    int varids[SERIAL_NVARS];      /* The variable IDs. */
+    int ioid;                      /* The decomposition ID. */
+    int ncid;                      /* The ncid of the netCDF file. */
+    int ret;                       /* Return code. */
+
+    /* Each task has a contiguous part of the vars. */
+    for (int i = 0; i < maplen; i++)
+    {
+        compdof[i] = start + i + 1;
+        for (int v = 0; v < SERIAL_NVARS; v++)
+            data[v * maplen + i] = 1000 * v + start + i;
+    }
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, dim_len_2d, maplen, compdof, &ioid,
+                               NULL, NULL, NULL)))
+        ERR(ret);
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Only the serial iotypes send the data to IO task 0. */
+        if (flavor[fmt] != PIO_IOTYPE_NETCDF && flavor[fmt] != PIO_IOTYPE_NETCDF4C)
+            continue;
+
+        /* Create the file with the vars. */
+        sprintf(filename, "%s_serial_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        for (int d = 0; d < NDIM2; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d + 1], dim_len_2d[d], &dimids[d])))
+                ERR(ret);
+        for (int v = 0; v < SERIAL_NVARS; v++)
+        {
+            char var_name[PIO_MAX_NAME + 1];
+
+            sprintf(var_name, "%s_%d", VAR_NAME, v);
+            if ((ret = PIOc_def_var(ncid, var_name, PIO_INT, NDIM2, dimids, &varids[v])))
+                ERR(ret);
+        }
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write all vars at once, so each task sends the data of
+         * several vars to IO task 0. */
+        if ((ret = PIOc_write_darray_multi(ncid, varids, ioid, SERIAL_NVARS, maplen, data,
+                                           NULL, NULL, 0)))
+            ERR(ret);
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Read the whole vars back, and check the data of all tasks. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+        for (int v = 0; v < SERIAL_NVARS; v++)
+        {
+            if ((ret = PIOc_get_var_int(ncid, varids[v], data_in)))
+                ERR(ret);
+            for (int i = 0; i < gsize; i++)
+                if (data_in[i] != 1000 * v + i)
+                    ERR(ERR_WRONG);
+        }
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    }
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
 /**
  * Run all the tests. 
  *
@@ -310,6 +456,10 @@ int test_all_darray(int iosysid, int num_flavors, int *flavor, int my_rank,
             ERR(ret);
     }
 
+    /* Write from several IO tasks with the serial iotypes. */
+    if ((ret = test_darray_serial(iosysid, num_flavors, flavor, my_rank)))
+        return ret;
+
     return PIO_NOERR;
 }
 
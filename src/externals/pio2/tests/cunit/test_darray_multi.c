@@ -351,6 +351,21 @@ int test_darray(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank
                     }
                 }
 
+                /* Now read all the vars in one call. */
+                {
+                    PIO_Offset type_size;
+
+                    if ((ret = PIOc_inq_type(ncid2, pio_type, NULL, &type_size)))
+                        ERR(ret);
+
+                    char multi_in[arraylen * NVAR * type_size];
+
+                    if ((ret = PIOc_read_darray_multi(ncid2, varid, ioid, NVAR, arraylen, multi_in)))
+                        ERR(ret);
+                    if (memcmp(multi_in, test_data, arraylen * NVAR * type_size))
+                        return ERR_WRONG;
+                }
+
                 /* Close the netCDF file. */
                 printf("%d Closing the sample data file...\n", my_rank);
                 if ((ret = PIOc_closefile(ncid2)))
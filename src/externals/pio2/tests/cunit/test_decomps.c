@@ -33,6 +33,11 @@
 /* Files of decompositions. */
 #define DECOMP_FILE "decomp.txt"
 #define DECOMP_BC_FILE "decomp.txt"
+#define DECOMP_BIN_FILE "decomp.bin"
+#define DECOMP_BIN_TXT_FILE "decomp_bin.txt"
+
+/* Length of the map used to test the binary decomp files. */
+#define BIN_MAPLEN 7
 
 /* Used when initializing PIO. */
 #define STRIDE1 1
@@ -333,6 +338,108 @@ int test_decomp_read_write(int iosysid, int ioid, int num_flavors, int *flavor,
     return PIO_NOERR;
 }
 
+/**
+ * Test the binary decomp files, and their conversion to and from the
+ * text decomp files.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param my_rank rank of this task.
+ * @param test_comm the MPI communicator for this test.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_decomp_bin(int iosysid, int ioid, int my_rank, MPI_Comm test_comm)
+{
+    int gdims[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    PIO_Offset map[BIN_MAPLEN];
+    int ndims, ndims2;
+    int *gdims_in, *gdims_in2;
+    PIO_Offset maplen_in, maplen_in2;
+    PIO_Offset *map_in, *map_in2;
+    int ioid2;
+    int ret;
+
+    /* A map with a run, a hole, single entries and a strided run. The
+     * last task has an empty map. */
+    map[0] = my_rank + 1;
+    map[1] = my_rank + 2;
+    map[2] = 0;
+    map[3] = 11;
+    map[4] = 3;
+    map[5] = 9;
+    map[6] = 13;
+
+    /* These should not work. */
+    if (PIOc_writemap_bin(NULL, NDIM2, gdims, BIN_MAPLEN, map, test_comm) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_writemap_bin(DECOMP_BIN_FILE, NDIM2, NULL, BIN_MAPLEN, map, test_comm) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_readmap_bin(DECOMP_BIN_FILE, NULL, &gdims_in, &maplen_in, &map_in,
+                         test_comm) != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* Write the map as binary and as text. */
+    maplen_in = my_rank == TARGET_NTASKS - 1 ? 0 : BIN_MAPLEN;
+    if ((ret = PIOc_writemap_bin(DECOMP_BIN_FILE, NDIM2, gdims, maplen_in, map, test_comm)))
+        return ret;
+    if ((ret = PIOc_writemap(DECOMP_BIN_TXT_FILE, NDIM2, gdims, maplen_in, map, test_comm)))
+        return ret;
+
+    /* The text file is not a binary decomp file. */
+    if (PIOc_readmap_bin(DECOMP_BIN_TXT_FILE, &ndims, &gdims_in, &maplen_in, &map_in,
+                         test_comm) != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* Read both files, they must hold the same map. */
+    if ((ret = PIOc_readmap_bin(DECOMP_BIN_FILE, &ndims, &gdims_in, &maplen_in, &map_in,
+                                test_comm)))
+        return ret;
+    if ((ret = PIOc_readmap(DECOMP_BIN_TXT_FILE, &ndims2, &gdims_in2, &maplen_in2, &map_in2,
+                            test_comm)))
+        return ret;
+    if (ndims != NDIM2 || ndims2 != NDIM2 || maplen_in != maplen_in2 ||
+        maplen_in != (my_rank == TARGET_NTASKS - 1 ? 0 : BIN_MAPLEN))
+        return ERR_WRONG;
+    for (int d = 0; d < ndims; d++)
+        if (gdims_in[d] != gdims[d] || gdims_in2[d] != gdims[d])
+            return ERR_WRONG;
+    for (int m = 0; m < maplen_in; m++)
+        if (map_in[m] != map[m] || map_in2[m] != map[m])
+            return ERR_WRONG;
+    free(gdims_in);
+    free(gdims_in2);
+    free(map_in);
+    free(map_in2);
+
+    /* Convert a decomposition to binary and back. */
+    if ((ret = PIOc_write_decomp_bin(DECOMP_BIN_FILE, iosysid, ioid + TEST_VAL_42,
+                                     test_comm)) != PIO_EBADID)
+        return ERR_WRONG;
+    if ((ret = PIOc_write_decomp_bin(DECOMP_BIN_FILE, iosysid, ioid, test_comm)))
+        return ret;
+    if ((ret = PIOc_read_decomp_bin(iosysid, DECOMP_BIN_FILE, &ioid2, test_comm, PIO_INT)))
+        return ret;
+    {
+        io_desc_t *iodesc, *iodesc2;
+
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)) || !(iodesc2 = pio_get_iodesc_from_id(ioid2)))
+            return ERR_WRONG;
+        if (iodesc2->ndims != iodesc->ndims || iodesc2->maplen != iodesc->maplen ||
+            iodesc2->basetype != MPI_INT)
+            return ERR_WRONG;
+        for (int d = 0; d < iodesc->ndims; d++)
+            if (iodesc2->dimlen[d] != iodesc->dimlen[d])
+                return ERR_WRONG;
+        for (int m = 0; m < iodesc->maplen; m++)
+            if (iodesc2->map[m] != iodesc->map[m])
+                return ERR_WRONG;
+    }
+    if ((ret = PIOc_freedecomp(iosysid, ioid2)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
 /* Run decomp tests. */
 int main(int argc, char **argv)
 {
@@ -393,6 +500,10 @@ int main(int argc, char **argv)
         /* Test decomposition read/write. */
         if ((ret = test_decomp_read_write(iosysid, ioid, num_flavors, flavor, my_rank, test_comm)))
             return ret;
+
+        /* Test binary decomp files. */
+        if ((ret = test_decomp_bin(iosysid, ioid, my_rank, test_comm)))
+            return ret;
     
         /* Free the PIO decomposition. */
         if ((ret = PIOc_freedecomp(iosysid, ioid)))
@@ -0,0 +1,188 @@
+/*
+ * Benchmark for the lookup of files by ncid. This opens many files,
+ * and times PIOc_put_vara_int() writing to them in turn, so each
+ * call looks up a different file than the last one. It also times
+ * the lookups alone, and reports the times per call on task 0.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_lookup"
+
+/* Number of files open at once. */
+#define NUM_FILES 100
+
+/* Length of the dimension of the var in each file. */
+#define DIM_LEN 4
+
+/* Names of the dimension and var. */
+#define DIM_NAME "dim"
+#define VAR_NAME "var"
+
+/* Number of passes over all the open files. */
+#define NUM_PASSES 20
+
+/* Number of lookups of each file in the lookup-only timing. */
+#define NUM_LOOKUPS 10000
+
+/* Time lookups of the open files by ncid, without any IO.
+ *
+ * @param ncid array of NUM_FILES ncids.
+ * @param wtime pointer that gets the time per lookup, in seconds.
+ * @returns 0 for success, error code otherwise.
+ */
+int time_lookups(const int *ncid, double *wtime)
+{
+    file_desc_t *file;
+    double start;
+    int ret;
+
+    start = MPI_Wtime();
+    for (int l = 0; l < NUM_LOOKUPS; l++)
+        for (int f = 0; f < NUM_FILES; f++)
+            if ((ret = pio_get_file(ncid[f], &file)))
+                return ret;
+    *wtime = (MPI_Wtime() - start) / ((double)NUM_LOOKUPS * NUM_FILES);
+
+    return PIO_NOERR;
+}
+
+/* Time writes of a small slab to each of the open files in turn, and
+ * to one file over and over.
+ *
+ * @param comm the test communicator.
+ * @param ncid array of NUM_FILES ncids.
+ * @param varid array of NUM_FILES varids.
+ * @param my_rank rank of this task.
+ * @param round_robin pointer that gets the time per write when
+ * changing files on each write, in seconds.
+ * @param same_file pointer that gets the time per write when writing
+ * to the same file, in seconds.
+ * @returns 0 for success, error code otherwise.
+ */
+int time_puts(MPI_Comm comm, const int *ncid, const int *varid, int my_rank,
+              double *round_robin, double *same_file)
+{
+    PIO_Offset start[1] = {my_rank % DIM_LEN};
+    PIO_Offset count[1] = {1};
+    double t0;
+    int mpierr;
+    int ret;
+
+    if ((mpierr = MPI_Barrier(comm)))
+        MPIERR(mpierr);
+    t0 = MPI_Wtime();
+    for (int p = 0; p < NUM_PASSES; p++)
+        for (int f = 0; f < NUM_FILES; f++)
+            if ((ret = PIOc_put_vara_int(ncid[f], varid[f], start, count, &p)))
+                return ret;
+    *round_robin = (MPI_Wtime() - t0) / ((double)NUM_PASSES * NUM_FILES);
+
+    if ((mpierr = MPI_Barrier(comm)))
+        MPIERR(mpierr);
+    t0 = MPI_Wtime();
+    for (int p = 0; p < NUM_PASSES; p++)
+        for (int f = 0; f < NUM_FILES; f++)
+            if ((ret = PIOc_put_vara_int(ncid[0], varid[0], start, count, &p)))
+                return ret;
+    *same_file = (MPI_Wtime() - t0) / ((double)NUM_PASSES * NUM_FILES);
+
+    /* Report the slowest task. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, round_robin, 1, MPI_DOUBLE, MPI_MAX, comm)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, same_file, 1, MPI_DOUBLE, MPI_MAX, comm)))
+        MPIERR(mpierr);
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    int num_flavors;
+    int flavor[NUM_FLAVORS];
+    int iosysid;
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;     /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, TARGET_NTASKS,
+                              TARGET_NTASKS, 0, &test_comm)))
+        ERR(ERR_INIT);
+
+    /* Only do something on TARGET_NTASKS tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, 1, 0, PIO_REARR_BOX,
+                                       &iosysid)))
+            ERR(ret);
+
+        if (!my_rank)
+            printf("%10s %8s %14s %14s %14s\n", "iotype", "nfiles", "lookup(us)",
+                   "put_rr(us)", "put_same(us)");
+
+        for (int fmt = 0; fmt < num_flavors; fmt++)
+        {
+            int ncid[NUM_FILES];
+            int varid[NUM_FILES];
+            char iotype_name[NC_MAX_NAME + 1];
+            double lookup, round_robin, same_file;
+
+            if ((ret = get_iotype_name(flavor[fmt], iotype_name)))
+                ERR(ret);
+
+            /* Create the files, each with one var. */
+            for (int f = 0; f < NUM_FILES; f++)
+            {
+                /* Room for the test name, the iotype name, the file
+                 * number and the suffix. */
+                char filename[sizeof(TEST_NAME) + NC_MAX_NAME + 16];
+                int dimid;
+
+                sprintf(filename, "%s_%s_%d.nc", TEST_NAME, iotype_name, f);
+                if ((ret = PIOc_createfile(iosysid, &ncid[f], &flavor[fmt], filename,
+                                           PIO_CLOBBER)))
+                    ERR(ret);
+                if ((ret = PIOc_def_dim(ncid[f], DIM_NAME, DIM_LEN, &dimid)))
+                    ERR(ret);
+                if ((ret = PIOc_def_var(ncid[f], VAR_NAME, PIO_INT, 1, &dimid, &varid[f])))
+                    ERR(ret);
+                if ((ret = PIOc_enddef(ncid[f])))
+                    ERR(ret);
+            }
+
+            if ((ret = time_lookups(ncid, &lookup)))
+                ERR(ret);
+            if ((ret = time_puts(test_comm, ncid, varid, my_rank, &round_robin, &same_file)))
+                ERR(ret);
+            if (!my_rank)
+                printf("%10s %8d %14.3f %14.3f %14.3f\n", iotype_name, NUM_FILES,
+                       lookup * 1e6, round_robin * 1e6, same_file * 1e6);
+
+            for (int f = 0; f < NUM_FILES; f++)
+                if ((ret = PIOc_closefile(ncid[f])))
+                    ERR(ret);
+        }
+
+        if ((ret = PIOc_finalize(iosysid)))
+            ERR(ret);
+    }
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
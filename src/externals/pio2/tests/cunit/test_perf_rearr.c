@@ -0,0 +1,163 @@
+/*
+ * Benchmark for the setup of the box rearranger. This times
+ * PIOc_InitDecomp() for a range of task and IO task counts, and
+ * reports the time on task 0.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_rearr"
+
+/* Number of dimensions of the decomposition. */
+#define NDIM3 3
+
+/* Sizes of the slow dimensions. The fast dimension grows with the
+ * number of tasks. */
+#define NLEV 4
+#define NLAT 32
+
+/* Width of the slab of the fast dimension on each task. */
+#define NLON_PER_TASK 8
+
+/* Number of times each decomposition is created. */
+#define NUM_TRIALS 3
+
+/* Time the creation of a box decomposition on a number of tasks. Each
+ * task holds a slab of the fast dimension through all levels and
+ * latitudes, so its data is spread over many IO tasks.
+ *
+ * @param comm communicator with the tasks to use.
+ * @param num_iotasks the number of IO tasks.
+ * @param wtime pointer that gets the average time of the slowest
+ * task, in seconds.
+ * @returns 0 for success, error code otherwise.
+ */
+int time_box_decomp(MPI_Comm comm, int num_iotasks, double *wtime)
+{
+    int iosysid;
+    int ioid;
+    int rearranger = PIO_REARR_BOX;
+    int my_rank, ntasks;
+    int gdimlen[NDIM3];
+    PIO_Offset maplen = NLEV * NLAT * NLON_PER_TASK;
+    PIO_Offset compmap[NLEV * NLAT * NLON_PER_TASK];
+    PIO_Offset totalllen;
+    double start, elapsed;
+    int mpierr;
+    int ret;
+
+    if ((mpierr = MPI_Comm_rank(comm, &my_rank)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        MPIERR(mpierr);
+
+    gdimlen[0] = NLEV;
+    gdimlen[1] = NLAT;
+    gdimlen[2] = NLON_PER_TASK * ntasks;
+
+    /* The map is 1-based. */
+    for (int k = 0, m = 0; k < NLEV; k++)
+        for (int j = 0; j < NLAT; j++)
+            for (int i = 0; i < NLON_PER_TASK; i++)
+                compmap[m++] = ((PIO_Offset)k * NLAT + j) * gdimlen[2] +
+                    my_rank * NLON_PER_TASK + i + 1;
+
+    if ((ret = PIOc_Init_Intracomm(comm, num_iotasks, ntasks / num_iotasks, 0,
+                                   PIO_REARR_BOX, &iosysid)))
+        return ret;
+
+    *wtime = 0;
+    for (int t = 0; t < NUM_TRIALS; t++)
+    {
+        io_desc_t *iodesc;
+
+        if ((mpierr = MPI_Barrier(comm)))
+            MPIERR(mpierr);
+        start = MPI_Wtime();
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM3, gdimlen, maplen, compmap, &ioid,
+                                   &rearranger, NULL, NULL)))
+            return ret;
+        elapsed = MPI_Wtime() - start;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm)))
+            MPIERR(mpierr);
+        *wtime += elapsed / NUM_TRIALS;
+
+        /* Every element of the global array must land on exactly
+         * one IO task. */
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return ERR_WRONG;
+        totalllen = iodesc->llen;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &totalllen, 1, MPI_OFFSET, MPI_SUM, comm)))
+            MPIERR(mpierr);
+        if (totalllen != (PIO_Offset)gdimlen[0] * gdimlen[1] * gdimlen[2])
+            return ERR_WRONG;
+
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    if ((ret = PIOc_finalize(iosysid)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int mpierr;
+    int ret;     /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              INT_MAX, 0, &test_comm)))
+        ERR(ERR_INIT);
+
+    if (!my_rank)
+        printf("%8s %12s %10s %14s\n", "ntasks", "num_iotasks", "maplen",
+               "InitDecomp(s)");
+
+    /* Double the number of tasks up to all that are available. */
+    for (int n = MIN_NTASKS; n <= ntasks; n *= 2)
+    {
+        MPI_Comm comm;
+
+        if ((mpierr = MPI_Comm_split(test_comm, my_rank < n ? 0 : MPI_UNDEFINED, my_rank,
+                                     &comm)))
+            MPIERR(mpierr);
+
+        if (my_rank < n)
+        {
+            /* Try a single IO task up to every task doing IO. */
+            for (int num_iotasks = 1; num_iotasks <= n; num_iotasks *= 2)
+            {
+                double wtime;
+
+                if ((ret = time_box_decomp(comm, num_iotasks, &wtime)))
+                    ERR(ret);
+                if (!my_rank)
+                    printf("%8d %12d %10d %14.6f\n", n, num_iotasks,
+                           NLEV * NLAT * NLON_PER_TASK, wtime);
+            }
+
+            if ((mpierr = MPI_Comm_free(&comm)))
+                MPIERR(mpierr);
+        }
+    }
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Benchmark for the setup of the subset rearranger. This times
+ * PIOc_InitDecomp() for a range of map sizes and, when the library
+ * is built with OpenMP, thread counts, and reports the time on task
+ * 0.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_subset"
+
+/* Number of dimensions of the decomposition. */
+#define NDIM2 2
+
+/* Size of the slow dimension. The fast dimension grows with the
+ * number of tasks and the map size. */
+#define NROWS 64
+
+/* Smallest and largest map size on each task. */
+#define MIN_MAPLEN (NROWS * 16)
+#define MAX_MAPLEN (NROWS * 4096)
+
+/* Number of times each decomposition is created. */
+#define NUM_TRIALS 3
+
+/* The kinds of map that are timed. */
+#define NUM_MAP_TYPES 2
+#define MAP_SLAB 0
+#define MAP_RANDOM 1
+
+/* Names of the kinds of map. */
+char map_name[NUM_MAP_TYPES][NC_MAX_NAME + 1] = {"slab", "random"};
+
+/* Fill the map of this task. A slab map holds a block of columns
+ * through all rows, a random map holds points scattered over the
+ * whole array, the same permutation on every task.
+ *
+ * @param map_type MAP_SLAB or MAP_RANDOM.
+ * @param my_rank rank of this task.
+ * @param ntasks number of tasks.
+ * @param maplen length of the map of each task.
+ * @param compmap array (length maplen) that gets the 1-based map.
+ * @returns 0 for success, error code otherwise.
+ */
+int fill_map(int map_type, int my_rank, int ntasks, int maplen, PIO_Offset *compmap)
+{
+    int ncols = maplen / NROWS;
+
+    if (map_type == MAP_SLAB)
+    {
+        for (int j = 0, m = 0; j < NROWS; j++)
+            for (int i = 0; i < ncols; i++)
+                compmap[m++] = (PIO_Offset)j * ncols * ntasks + my_rank * ncols + i + 1;
+    }
+    else
+    {
+        PIO_Offset gsize = (PIO_Offset)maplen * ntasks;
+        PIO_Offset *perm;
+        unsigned long long seed = 1;
+
+        if (!(perm = malloc(gsize * sizeof(PIO_Offset))))
+            return PIO_ENOMEM;
+        for (PIO_Offset i = 0; i < gsize; i++)
+            perm[i] = i;
+        for (PIO_Offset i = gsize - 1; i > 0; i--)
+        {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            PIO_Offset j = (PIO_Offset)((seed >> 33) % (i + 1));
+            PIO_Offset t = perm[i];
+            perm[i] = perm[j];
+            perm[j] = t;
+        }
+        for (int i = 0; i < maplen; i++)
+            compmap[i] = perm[(PIO_Offset)my_rank * maplen + i] + 1;
+        free(perm);
+    }
+
+    return PIO_NOERR;
+}
+
+/* Time the creation of a subset decomposition.
+ *
+ * @param iosysid the IO system.
+ * @param comm communicator with the tasks to use.
+ * @param map_type MAP_SLAB or MAP_RANDOM.
+ * @param maplen length of the map of each task.
+ * @param wtime pointer that gets the average time of the slowest
+ * task, in seconds.
+ * @returns 0 for success, error code otherwise.
+ */
+int time_subset_decomp(int iosysid, MPI_Comm comm, int map_type, int maplen, double *wtime)
+{
+    int ioid;
+    int rearranger = PIO_REARR_SUBSET;
+    int my_rank, ntasks;
+    int gdimlen[NDIM2];
+    PIO_Offset *compmap;
+    double start, elapsed;
+    int mpierr;
+    int ret;
+
+    if ((mpierr = MPI_Comm_rank(comm, &my_rank)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_size(comm, &ntasks)))
+        MPIERR(mpierr);
+
+    gdimlen[0] = NROWS;
+    gdimlen[1] = maplen / NROWS * ntasks;
+
+    if (!(compmap = malloc(maplen * sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+    if ((ret = fill_map(map_type, my_rank, ntasks, maplen, compmap)))
+        return ret;
+
+    *wtime = 0;
+    for (int t = 0; t < NUM_TRIALS; t++)
+    {
+        if ((mpierr = MPI_Barrier(comm)))
+            MPIERR(mpierr);
+        start = MPI_Wtime();
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, gdimlen, maplen, compmap, &ioid,
+                                   &rearranger, NULL, NULL)))
+            return ret;
+        elapsed = MPI_Wtime() - start;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm)))
+            MPIERR(mpierr);
+        *wtime += elapsed / NUM_TRIALS;
+
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    free(compmap);
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    int num_iotasks;
+    int iosysid;
+    int max_threads = 1;
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;     /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              INT_MAX, 0, &test_comm)))
+        ERR(ERR_INIT);
+
+    /* One IO task for every four tasks. */
+    num_iotasks = (ntasks + 3) / 4;
+    if ((ret = PIOc_Init_Intracomm(test_comm, num_iotasks, ntasks / num_iotasks, 0,
+                                   PIO_REARR_SUBSET, &iosysid)))
+        ERR(ret);
+
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif /* _OPENMP */
+
+    if (!my_rank)
+        printf("%8s %12s %10s %8s %8s %14s\n", "ntasks", "num_iotasks", "maplen", "map",
+               "threads", "InitDecomp(s)");
+
+    for (int maplen = MIN_MAPLEN; maplen <= MAX_MAPLEN; maplen *= 4)
+        for (int m = 0; m < NUM_MAP_TYPES; m++)
+        {
+            /* Double the number of threads up to all that are
+             * available. Without OpenMP there is one. */
+            for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+            {
+                double wtime;
+
+#ifdef _OPENMP
+                omp_set_num_threads(nthreads);
+#endif /* _OPENMP */
+                if ((ret = time_subset_decomp(iosysid, test_comm, m, maplen, &wtime)))
+                    ERR(ret);
+                if (!my_rank)
+                    printf("%8d %12d %10d %8s %8d %14.6f\n", ntasks, num_iotasks, maplen,
+                           map_name[m], nthreads, wtime);
+            }
+        }
+
+    if ((ret = PIOc_finalize(iosysid)))
+        ERR(ret);
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Tests for the metadata cache of files. The PIOc_inq_* functions
+ * answer from a cache filled at open and enddef. This test checks the
+ * answers, and that the cache follows changes of the metadata made in
+ * define mode.
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_pioc_meta"
+
+/* Number of processors that will do IO. */
+#define NUM_IO_PROCS 1
+
+/* Number of computational components to create. */
+#define COMPONENT_COUNT 1
+
+/* The number of dimensions of the var. */
+#define NDIM2 2
+
+/* The length of the x dimension. */
+#define X_DIM_LEN 4
+
+/* The number of records written. */
+#define NUM_RECORDS 2
+
+/* Names in the file. */
+#define DIM_NAME_UNLIM "time"
+#define DIM_NAME_X "x"
+#define DIM_NAME_Y "y"
+#define VAR_NAME "Abbott"
+#define GATT_NAME "title"
+#define GATT_VALUE "Who's on first"
+#define ATT_NAME_SMALL "small"
+#define ATT_NAME_BIG "big"
+#define ATT_NAME_ADDED "added"
+
+/* Length of the big att. Its values are too large to be cached. */
+#define BIG_ATT_LEN 64
+
+/* Length of the dimensions for run_test_main(). */
+int dim_len[NDIM2 + 1] = {NC_UNLIMITED, X_DIM_LEN, X_DIM_LEN};
+
+/* Values of the atts. */
+int small_att[X_DIM_LEN] = {1, -2, 3, -4};
+double big_att[BIG_ATT_LEN];
+
+/* Check the metadata of the test file.
+ *
+ * @param ncid the ncid of the open file.
+ * @param ndims the number of dims expected.
+ * @param nrecs the number of records expected.
+ * @returns 0 for success, error code otherwise.
+ */
+int check_meta(int ncid, int ndims, PIO_Offset nrecs)
+{
+    char name[PIO_MAX_NAME + 1];
+    int my_ndims, nvars, ngatts, unlimdimid;
+    int varid, dimid, attid;
+    nc_type xtype;
+    int var_ndims, dimids[NDIM2], natts;
+    PIO_Offset len;
+    int small_in[X_DIM_LEN];
+    double small_double_in[X_DIM_LEN];
+    double big_in[BIG_ATT_LEN];
+    int ret;
+
+    if ((ret = PIOc_inq(ncid, &my_ndims, &nvars, &ngatts, &unlimdimid)))
+        return ret;
+    if (my_ndims != ndims || nvars != 1 || ngatts != 1 || unlimdimid != 0)
+        return ERR_WRONG;
+
+    /* Check the dims. The length of the unlimited dim changes as
+     * records are written. */
+    if ((ret = PIOc_inq_dim(ncid, 0, name, &len)))
+        return ret;
+    if (strcmp(name, DIM_NAME_UNLIM) || len != nrecs)
+        return ERR_WRONG;
+    if ((ret = PIOc_inq_dim(ncid, 1, name, &len)))
+        return ret;
+    if (strcmp(name, DIM_NAME_X) || len != X_DIM_LEN)
+        return ERR_WRONG;
+    if ((ret = PIOc_inq_dimid(ncid, DIM_NAME_X, &dimid)))
+        return ret;
+    if (dimid != 1)
+        return ERR_WRONG;
+    if (PIOc_inq_dimid(ncid, "no_such_dim", &dimid) != PIO_EBADDIM)
+        return ERR_WRONG;
+    if (PIOc_inq_dimlen(ncid, ndims, &len) != PIO_EBADDIM)
+        return ERR_WRONG;
+
+    /* Check the var. */
+    if ((ret = PIOc_inq_varid(ncid, VAR_NAME, &varid)))
+        return ret;
+    if (varid != 0)
+        return ERR_WRONG;
+    if (PIOc_inq_varid(ncid, "no_such_var", &varid) != PIO_ENOTVAR)
+        return ERR_WRONG;
+    if ((ret = PIOc_inq_var(ncid, 0, name, &xtype, &var_ndims, dimids, &natts)))
+        return ret;
+    if (strcmp(name, VAR_NAME) || xtype != PIO_INT || var_ndims != NDIM2 ||
+        dimids[0] != 0 || dimids[1] != 1 || natts != 2)
+        return ERR_WRONG;
+    if (PIOc_inq_varndims(ncid, 1, &var_ndims) != PIO_ENOTVAR)
+        return ERR_WRONG;
+
+    /* Check the atts. */
+    if ((ret = PIOc_inq_att(ncid, NC_GLOBAL, GATT_NAME, &xtype, &len)))
+        return ret;
+    if (xtype != PIO_CHAR || len != strlen(GATT_VALUE))
+        return ERR_WRONG;
+    if ((ret = PIOc_get_att_text(ncid, NC_GLOBAL, GATT_NAME, name)))
+        return ret;
+    if (strncmp(name, GATT_VALUE, strlen(GATT_VALUE)))
+        return ERR_WRONG;
+    if ((ret = PIOc_inq_attname(ncid, 0, 1, name)))
+        return ret;
+    if (strcmp(name, ATT_NAME_BIG))
+        return ERR_WRONG;
+    if (PIOc_inq_attname(ncid, 0, 2, name) != PIO_ENOTATT)
+        return ERR_WRONG;
+    if ((ret = PIOc_inq_attid(ncid, 0, ATT_NAME_SMALL, &attid)))
+        return ret;
+    if (attid != 0)
+        return ERR_WRONG;
+    if (PIOc_inq_att(ncid, 0, "no_such_att", &xtype, &len) != PIO_ENOTATT)
+        return ERR_WRONG;
+
+    /* Values of the small att are cached, the big one is read from
+     * the file, as are values that need conversion. */
+    if ((ret = PIOc_get_att_int(ncid, 0, ATT_NAME_SMALL, small_in)))
+        return ret;
+    if ((ret = PIOc_get_att_double(ncid, 0, ATT_NAME_SMALL, small_double_in)))
+        return ret;
+    for (int i = 0; i < X_DIM_LEN; i++)
+        if (small_in[i] != small_att[i] || small_double_in[i] != small_att[i])
+            return ERR_WRONG;
+    if ((ret = PIOc_get_att_double(ncid, 0, ATT_NAME_BIG, big_in)))
+        return ret;
+    for (int i = 0; i < BIG_ATT_LEN; i++)
+        if (big_in[i] != big_att[i])
+            return ERR_WRONG;
+
+    return PIO_NOERR;
+}
+
+/* Create a file, and check its metadata as it changes.
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of iotypes.
+ * @param flavor the iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_meta(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        char filename[PIO_MAX_NAME + 1];
+        int ncid;
+        int dimids[NDIM2];
+        int varid;
+        int dimid_y;
+        int ndims;
+        int attid;
+        int natts;
+        PIO_Offset len;
+        int data[X_DIM_LEN];
+        PIO_Offset start[NDIM2] = {0, 0}, count[NDIM2] = {1, X_DIM_LEN};
+        int ret;
+
+        sprintf(filename, "%s_%d.nc", TEST_NAME, flavor[fmt]);
+
+        /* Create the file. */
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            return ret;
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME_UNLIM, NC_UNLIMITED, &dimids[0])))
+            return ret;
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME_X, X_DIM_LEN, &dimids[1])))
+            return ret;
+        if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM2, dimids, &varid)))
+            return ret;
+        if ((ret = PIOc_put_att_text(ncid, NC_GLOBAL, GATT_NAME, strlen(GATT_VALUE),
+                                     GATT_VALUE)))
+            return ret;
+        if ((ret = PIOc_put_att_int(ncid, varid, ATT_NAME_SMALL, PIO_INT, X_DIM_LEN, small_att)))
+            return ret;
+        if ((ret = PIOc_put_att_double(ncid, varid, ATT_NAME_BIG, PIO_DOUBLE, BIG_ATT_LEN,
+                                       big_att)))
+            return ret;
+        if ((ret = PIOc_enddef(ncid)))
+            return ret;
+        if ((ret = check_meta(ncid, NDIM2, 0)))
+            return ret;
+
+        /* Write records, then the unlimited dim must have grown. */
+        for (int r = 0; r < NUM_RECORDS; r++)
+        {
+            for (int i = 0; i < X_DIM_LEN; i++)
+                data[i] = r * X_DIM_LEN + i;
+            start[0] = r;
+            if ((ret = PIOc_put_vara_int(ncid, varid, start, count, data)))
+                return ret;
+        }
+        if ((ret = check_meta(ncid, NDIM2, NUM_RECORDS)))
+            return ret;
+
+        /* Change the metadata, the cache must follow. */
+        if ((ret = PIOc_redef(ncid)))
+            return ret;
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME_Y, X_DIM_LEN, &dimid_y)))
+            return ret;
+        if ((ret = PIOc_inq_ndims(ncid, &ndims)))
+            return ret;
+        if (ndims != NDIM2 + 1)
+            return ERR_WRONG;
+        if ((ret = PIOc_put_att_int(ncid, NC_GLOBAL, ATT_NAME_ADDED, PIO_INT, 1, small_att)))
+            return ret;
+        if ((ret = PIOc_enddef(ncid)))
+            return ret;
+        if ((ret = PIOc_inq_dimid(ncid, DIM_NAME_Y, &dimid_y)))
+            return ret;
+        if (dimid_y != NDIM2)
+            return ERR_WRONG;
+        if ((ret = PIOc_inq_attid(ncid, NC_GLOBAL, ATT_NAME_ADDED, &attid)))
+            return ret;
+        if (attid != 1)
+            return ERR_WRONG;
+        if ((ret = PIOc_closefile(ncid)))
+            return ret;
+
+        /* Reopen the file read-only, and check again. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            return ret;
+        if ((ret = PIOc_inq_dimlen(ncid, dimids[0], &len)))
+            return ret;
+        if (len != NUM_RECORDS)
+            return ERR_WRONG;
+        if ((ret = PIOc_inq_natts(ncid, &natts)))
+            return ret;
+        if (natts != 2)
+            return ERR_WRONG;
+        if ((ret = PIOc_get_att_int(ncid, NC_GLOBAL, ATT_NAME_ADDED, data)))
+            return ret;
+        if (data[0] != small_att[0])
+            return ERR_WRONG;
+        if ((ret = PIOc_closefile(ncid)))
+            return ret;
+    }
+
+    return PIO_NOERR;
+}
+
+/* Run all the tests. */
+int test_all(int iosysid, int num_flavors, int *flavor, int my_rank, MPI_Comm test_comm,
+             int async)
+{
+    int ret; /* Return code. */
+
+    if ((ret = test_meta(iosysid, num_flavors, flavor, my_rank)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
+/* Run metadata cache tests. */
+int main(int argc, char **argv)
+{
+    int ret;
+
+    for (int i = 0; i < BIG_ATT_LEN; i++)
+        big_att[i] = i * 0.5;
+
+    /* Change the 5th arg to 3 to turn on logging. */
+    if ((ret = run_test_main(argc, argv, MIN_NTASKS, TARGET_NTASKS, 0,
+                             TEST_NAME, dim_len, COMPONENT_COUNT, NUM_IO_PROCS)))
+        return ret;
+
+    return 0;
+}
@@ -71,6 +71,44 @@ int test_rearranger_opts1(int iosysid)
         ios->rearr_opts.io2comp.max_pend_req != TEST_VAL_42 + 1)
         return ERR_WRONG;
 
+    /* Turn tuning of the rearranger on and off again. */
+    if (PIOc_set_rearr_tune(TEST_VAL_42, true) != PIO_EBADID)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_rearr_tune(iosysid, true)))
+        return ret;
+    if (!ios->rearr_tune)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_rearr_tune(iosysid, false)))
+        return ret;
+    if (ios->rearr_tune)
+        return ERR_WRONG;
+
+    /* Turn the shared memory path on and off again. */
+    if (PIOc_set_rearr_shm(TEST_VAL_42, true) != PIO_EBADID)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_rearr_shm(iosysid, true)))
+        return ret;
+    if (!ios->rearr_shm)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_rearr_shm(iosysid, false)))
+        return ret;
+    if (ios->rearr_shm)
+        return ERR_WRONG;
+
+    /* Choose the subset partition. */
+    if (PIOc_set_subset_partition(TEST_VAL_42, PIO_SUBSET_PARTITION_NODE) != PIO_EBADID)
+        return ERR_WRONG;
+    if (PIOc_set_subset_partition(iosysid, TEST_VAL_42) != PIO_EINVAL)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_subset_partition(iosysid, PIO_SUBSET_PARTITION_NODE)))
+        return ret;
+    if (ios->subset_partition != PIO_SUBSET_PARTITION_NODE)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_subset_partition(iosysid, PIO_SUBSET_PARTITION_RANK)))
+        return ret;
+    if (ios->subset_partition != PIO_SUBSET_PARTITION_RANK)
+        return ERR_WRONG;
+
     return 0;
 }
 
@@ -107,6 +145,61 @@ int test_compare_offsets()
     return 0;
 }
 
+/* Test the get_map_runs() and merge_map_runs() functions. */
+int test_map_runs()
+{
+#define MAPLEN6 6
+#define NRUNTASKS 3
+#define NIORUNS 5
+    /* Two rows of three with a hole, as a task of a slab decomp has. */
+    PIO_Offset compmap[MAPLEN6] = {11, 12, 0, 21, 22, 23};
+    maprun *runs;
+    int nruns;
+    int ret;
+
+    /* No points, no runs. */
+    if ((ret = get_map_runs(0, NULL, &nruns, &runs)))
+        return ret;
+    if (nruns || runs)
+        return ERR_WRONG;
+
+    if ((ret = get_map_runs(MAPLEN6, compmap, &nruns, &runs)))
+        return ret;
+    if (nruns != 2)
+        return ERR_WRONG;
+    if (runs[0].soffset != 0 || runs[0].iomap != 11 || runs[0].len != 2 ||
+        runs[1].soffset != 3 || runs[1].iomap != 21 || runs[1].len != 3)
+        return ERR_WRONG;
+    free(runs);
+
+    /* Task 0 has 5..6 and 1..2 (out of order), task 1 has 3..4 and
+     * 7..9, task 2 has 10. */
+    {
+        int tnruns[NRUNTASKS] = {2, 2, 1};
+        maprun allruns[5] = {{10, 5, 2}, {0, 1, 2}, {4, 3, 2}, {6, 7, 3}, {0, 10, 1}};
+        int nout;
+        maprun *out;
+        int *from;
+        int exp_from[NIORUNS] = {0, 1, 0, 1, 2};
+        PIO_Offset exp_soffset[NIORUNS] = {0, 4, 10, 6, 0};
+        PIO_Offset exp_iomap[NIORUNS] = {1, 3, 5, 7, 10};
+        PIO_Offset exp_len[NIORUNS] = {2, 2, 2, 3, 1};
+
+        if ((ret = merge_map_runs(NRUNTASKS, tnruns, allruns, &nout, &out, &from)))
+            return ret;
+        if (nout != NIORUNS)
+            return ERR_WRONG;
+        for (int i = 0; i < NIORUNS; i++)
+            if (from[i] != exp_from[i] || out[i].soffset != exp_soffset[i] ||
+                out[i].iomap != exp_iomap[i] || out[i].len != exp_len[i])
+                return ERR_WRONG;
+        free(out);
+        free(from);
+    }
+
+    return 0;
+}
+
 /* Test the ceil2() and pair() functions. */
 int test_ceil2_pair()
 {
@@ -441,6 +534,149 @@ int test_get_regions(int my_rank)
     return 0;
 }
 
+/* Test that get_regions_chunked() finds the same regions with any
+ * number of chunks. */
+int test_get_regions_chunked()
+{
+#define NDIM2 2
+#define CHUNK_NY 6
+#define CHUNK_NX 10
+#define MAX_CHUNKS 9
+    const int gdimlen[NDIM2] = {CHUNK_NY, CHUNK_NX};
+    PIO_Offset map[CHUNK_NY * CHUNK_NX];
+    int maplen = 0;
+    io_region *ref;
+    int refmax;
+    int ret;
+
+    /* Rows 0 and 1 whole, part of row 2, a point and the end of row 3,
+     * then the same columns of rows 4 and 5. Map is 1-based. */
+    for (int y = 0; y < CHUNK_NY; y++)
+        for (int x = 0; x < CHUNK_NX; x++)
+            if (y < 2 || (y == 2 && x < 5) || (y == 3 && (x == 0 || x > 3)) ||
+                (y > 3 && x >= 2 && x < 6))
+                map[maplen++] = y * CHUNK_NX + x + 1;
+
+    if ((ret = alloc_region2(NULL, NDIM2, &ref)))
+        return ret;
+    if ((ret = get_regions_chunked(NDIM2, gdimlen, maplen, map, 1, &refmax, ref)))
+        return ret;
+    if (refmax != 5)
+        return ERR_WRONG;
+
+    for (int nchunks = 2; nchunks <= MAX_CHUNKS; nchunks++)
+    {
+        io_region *first, *r1, *r2;
+        int maxregions;
+
+        if ((ret = alloc_region2(NULL, NDIM2, &first)))
+            return ret;
+        if ((ret = get_regions_chunked(NDIM2, gdimlen, maplen, map, nchunks, &maxregions,
+                                       first)))
+            return ret;
+        if (maxregions != refmax)
+            return ERR_WRONG;
+        for (r1 = ref, r2 = first; r1; r1 = r1->next, r2 = r2->next)
+        {
+            if (!r2 || r1->loffset != r2->loffset)
+                return ERR_WRONG;
+            for (int d = 0; d < NDIM2; d++)
+                if (r1->start[d] != r2->start[d] || r1->count[d] != r2->count[d])
+                    return ERR_WRONG;
+        }
+        free_region_list(first);
+    }
+    free_region_list(ref);
+
+    return 0;
+}
+
+/* Test the coalesce_regions() function. */
+int test_coalesce_regions()
+{
+#define NCOALESCE 8
+    /* Start, count and loffset of each region. Regions 0 and 1 merge
+     * along the first dimension, 2 and 3 along the second. Region 5
+     * does not follow region 4 in the buffer, and regions 6 and 7
+     * have more than one row. */
+    const PIO_Offset start[NCOALESCE][NDIM2] = {{0, 2}, {1, 2}, {3, 5}, {3, 7},
+                                                {4, 0}, {5, 0}, {6, 0}, {6, 3}};
+    const PIO_Offset count[NCOALESCE][NDIM2] = {{1, 3}, {2, 3}, {1, 2}, {1, 3},
+                                                {1, 2}, {1, 2}, {2, 3}, {2, 3}};
+    const PIO_Offset loffset[NCOALESCE] = {0, 3, 12, 14, 20, 30, 32, 38};
+    const PIO_Offset expstart[NCOALESCE - 2][NDIM2] = {{0, 2}, {3, 5}, {4, 0}, {5, 0},
+                                                       {6, 0}, {6, 3}};
+    const PIO_Offset expcount[NCOALESCE - 2][NDIM2] = {{3, 3}, {1, 5}, {1, 2}, {1, 2},
+                                                       {2, 3}, {2, 3}};
+    io_region *first = NULL, **next = &first;
+    io_region *region;
+    int nregions = NCOALESCE;
+    int r = 0;
+    int ret;
+
+    for (int i = 0; i < NCOALESCE; i++)
+    {
+        if ((ret = alloc_region2(NULL, NDIM2, next)))
+            return ret;
+        for (int d = 0; d < NDIM2; d++)
+        {
+            (*next)->start[d] = start[i][d];
+            (*next)->count[d] = count[i][d];
+        }
+        (*next)->loffset = loffset[i];
+        next = &(*next)->next;
+    }
+
+    if ((ret = coalesce_regions(NDIM2, first, &nregions)))
+        return ret;
+    if (nregions != NCOALESCE - 2)
+        return ERR_WRONG;
+    for (region = first; region; region = region->next, r++)
+        for (int d = 0; d < NDIM2; d++)
+            if (region->start[d] != expstart[r][d] || region->count[d] != expcount[r][d])
+                return ERR_WRONG;
+    if (r != nregions)
+        return ERR_WRONG;
+
+    free_region_list(first);
+
+    return 0;
+}
+
+/* Test the sort_map_runs() function with enough runs for a radix
+ * sort. */
+int test_sort_map_runs()
+{
+#define NSORTRUNS 1000
+    maprun runs[NSORTRUNS];
+    int ret;
+
+    /* Keys are scattered over several bytes, with some repeats. */
+    for (int i = 0; i < NSORTRUNS; i++)
+    {
+        runs[i].iomap = ((PIO_Offset)i * 7919 % 613) * 100003 + 1;
+        runs[i].soffset = i;
+        runs[i].len = 1;
+    }
+
+    if ((ret = sort_map_runs(NSORTRUNS, runs)))
+        return ret;
+
+    for (int i = 0; i < NSORTRUNS; i++)
+    {
+        /* Each run must keep its own key. */
+        if (runs[i].iomap != (runs[i].soffset * 7919 % 613) * 100003 + 1)
+            return ERR_WRONG;
+
+        /* The sort is stable. */
+        if (i && (runs[i].iomap < runs[i - 1].iomap ||
+                  (runs[i].iomap == runs[i - 1].iomap && runs[i].soffset < runs[i - 1].soffset)))
+            return ERR_WRONG;
+    }
+
+    return 0;
+}
+
 /* Run tests for find_region() function. */
 int test_find_region()
 {
@@ -513,9 +749,16 @@ int test_define_iodesc_datatypes()
             return PIO_ENOMEM;
         if (!(iodesc.rindex = malloc(1 * sizeof(PIO_Offset))))
             return PIO_ENOMEM;
+        if (!(iodesc.rfromlen = malloc(1 * sizeof(int))))
+            return PIO_ENOMEM;
         iodesc.rindex[0] = 0;
         iodesc.rcount[0] = 1;
 
+        /* The subset rearranger gets its one point as one run. */
+        iodesc.nrfrom = 1;
+        iodesc.rfrom[0] = 0;
+        iodesc.rfromlen[0] = 1;
+
         iodesc.rearranger = rearranger[r];
 
         /* The two rearrangers create a different number of send types. */
@@ -551,6 +794,7 @@ int test_define_iodesc_datatypes()
         free(iodesc.stype);
         free(iodesc.rcount);
         free(iodesc.rfrom);
+        free(iodesc.rfromlen);
         free(iodesc.rindex);
     }
 
@@ -639,6 +883,18 @@ int test_init_decomp(int iosysid, MPI_Comm test_comm, int my_rank)
                                 compmap, &ioid, PIO_REARR_BOX, NULL, NULL)))
         return ret;
 
+    /* The box rearranger has one region on each task. */
+    {
+        int nfound, nregions;
+
+        if ((ret = PIOc_get_region_stats(ioid, &nfound, &nregions)))
+            return ret;
+        if (nfound != 1 || nregions != 1)
+            return ERR_WRONG;
+        if (PIOc_get_region_stats(ioid + TEST_VAL_42, NULL, NULL) != PIO_EBADID)
+            return ERR_WRONG;
+    }
+
     /* Free it. */
     if ((ret = PIOc_freedecomp(iosysid, ioid)))
         return ret;
@@ -646,6 +902,101 @@ int test_init_decomp(int iosysid, MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
+/* Test that PIOc_InitDecomp() reuses decompositions of the same
+ * map. */
+int test_decomp_cache(int iosysid, MPI_Comm test_comm, int my_rank)
+{
+    int rearranger[NUM_REARRANGERS] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int ntasks;
+    int mpierr;
+    int ret;
+
+    if ((mpierr = MPI_Comm_size(test_comm, &ntasks)))
+        MPIERR(mpierr);
+
+    for (int r = 0; r < NUM_REARRANGERS; r++)
+    {
+        PIO_Offset compmap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+        PIO_Offset othermap[MAPLEN2] = {my_rank * 2 + 1, my_rank * 2 + 2};
+        int gdimlen[NDIM1] = {MAPLEN2 * ntasks};
+        io_desc_t *iodesc, *iodesc3;
+        int ioid1, ioid2, ioid3, ioid4;
+
+        /* The same map and type gives the same decomposition. */
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2, compmap, &ioid1,
+                                   &rearranger[r], NULL, NULL)))
+            return ret;
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2, compmap, &ioid2,
+                                   &rearranger[r], NULL, NULL)))
+            return ret;
+        if (ioid2 != ioid1)
+            return ERR_WRONG;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid1)))
+            return ERR_WRONG;
+        if (iodesc->refcount != 2)
+            return ERR_WRONG;
+
+        /* Another type gives a new decomposition with the same
+         * rearrangement. */
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_DOUBLE, NDIM1, gdimlen, MAPLEN2, compmap,
+                                   &ioid3, &rearranger[r], NULL, NULL)))
+            return ret;
+        if (ioid3 == ioid1)
+            return ERR_WRONG;
+        if (!(iodesc3 = pio_get_iodesc_from_id(ioid3)))
+            return ERR_WRONG;
+        if (iodesc3->basetype != MPI_DOUBLE || iodesc3->refcount != 1 ||
+            iodesc3->llen != iodesc->llen || iodesc3->nrecvs != iodesc->nrecvs ||
+            iodesc3->ndof != iodesc->ndof || iodesc3->maxregions != iodesc->maxregions)
+            return ERR_WRONG;
+        if (r == 0)
+            for (int i = 0; i < iodesc->llen; i++)
+                if (iodesc3->rindex[i] != iodesc->rindex[i])
+                    return ERR_WRONG;
+        if (r == 1)
+        {
+            if (iodesc3->rindex || iodesc3->nrfrom != iodesc->nrfrom)
+                return ERR_WRONG;
+            for (int i = 0; i < iodesc->nrfrom; i++)
+                if (iodesc3->rfrom[i] != iodesc->rfrom[i] ||
+                    iodesc3->rfromlen[i] != iodesc->rfromlen[i])
+                    return ERR_WRONG;
+            for (int i = 0; i < iodesc->scount[0]; i++)
+                if (iodesc3->sindex[i] != iodesc->sindex[i])
+                    return ERR_WRONG;
+        }
+
+        /* A map that differs on one task only is not reused on any
+         * task. */
+        if (!my_rank)
+        {
+            othermap[0] = compmap[1];
+            othermap[1] = compmap[0];
+        }
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM1, gdimlen, MAPLEN2, othermap, &ioid4,
+                                   &rearranger[r], NULL, NULL)))
+            return ret;
+        if (ioid4 == ioid1 || ioid4 == ioid3)
+            return ERR_WRONG;
+
+        /* The first decomposition is freed by the second free. */
+        if ((ret = PIOc_freedecomp(iosysid, ioid1)))
+            return ret;
+        if (!pio_get_iodesc_from_id(ioid1))
+            return ERR_WRONG;
+        if ((ret = PIOc_freedecomp(iosysid, ioid2)))
+            return ret;
+        if (pio_get_iodesc_from_id(ioid1))
+            return ERR_WRONG;
+        if ((ret = PIOc_freedecomp(iosysid, ioid3)))
+            return ret;
+        if ((ret = PIOc_freedecomp(iosysid, ioid4)))
+            return ret;
+    }
+
+    return 0;
+}
+
 /* Test for the box_rearrange_create() function. */
 int test_box_rearrange_create(MPI_Comm test_comm, int my_rank)
 {
@@ -910,6 +1261,84 @@ int test_default_subset_partition(MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
+/* Test function assign_subset_groups. */
+int test_assign_subset_groups()
+{
+#define NTASKS8 8
+#define NIOTASKS3 3
+    /* Three nodes, the last one without an IO task. */
+    int node[NTASKS8] = {0, 0, 0, 0, 4, 4, 6, 6};
+    int io_rank[NTASKS8] = {0, 1, -1, -1, 2, -1, -1, -1};
+    PIO_Offset weight[NTASKS8] = {1, 1, 10, 4, 2, 3, 5, 6};
+    int expected[NTASKS8] = {0, 1, 0, 1, 2, 2, 2, 1};
+    int group[NTASKS8];
+    int ret;
+
+    if ((ret = assign_subset_groups(NTASKS8, node, io_rank, weight, NIOTASKS3, group)))
+        return ret;
+    for (int t = 0; t < NTASKS8; t++)
+        if (group[t] != expected[t])
+            return ERR_WRONG;
+
+    return 0;
+}
+
+/* Test function node_subset_partition. */
+int test_node_subset_partition(MPI_Comm test_comm, int my_rank)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int subset_rank, subset_size;
+    int iotask;
+    int mpierr;
+    int ret;
+
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Tasks 0 and 2 are IO tasks. Each task holds one more element
+     * than the one before. */
+    ios->ioproc = !(my_rank % 2);
+    ios->io_rank = my_rank / 2;
+    ios->num_iotasks = TARGET_NTASKS / 2;
+    ios->comp_comm = test_comm;
+    iodesc->ndof = my_rank + 1;
+
+    /* Run the function to test. */
+    if ((ret = node_subset_partition(ios, iodesc)))
+        return ret;
+
+    /* All tasks are on one node. Task 3 (4 elements) goes to task 0,
+     * which then has 5 elements, and task 1 (2 elements) goes to task
+     * 2, which then has 5 too. */
+    if ((mpierr = MPI_Comm_rank(iodesc->subset_comm, &subset_rank)))
+        MPIERR(mpierr);
+    if ((mpierr = MPI_Comm_size(iodesc->subset_comm, &subset_size)))
+        MPIERR(mpierr);
+    if (subset_size != 2 || subset_rank != (ios->ioproc ? 0 : 1))
+        return ERR_WRONG;
+    iotask = my_rank;
+    if ((mpierr = MPI_Bcast(&iotask, 1, MPI_INT, 0, iodesc->subset_comm)))
+        MPIERR(mpierr);
+    if (iotask != (my_rank == 1 ? 2 : my_rank == 3 ? 0 : my_rank))
+        return ERR_WRONG;
+
+    /* Free the created communicator. */
+    if ((mpierr = MPI_Comm_free(&iodesc->subset_comm)))
+        MPIERR(mpierr);
+
+    /* Free resources from test. */
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
 /* Test function rearrange_comp2io. */
 int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
 {
@@ -1000,6 +1429,12 @@ int test_rearrange_comp2io(MPI_Comm test_comm, int my_rank)
         return ret;
     printf("returned from rearrange_comp2io\n");
 
+    /* Free the cached communication plans. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return ret;
+
     /* We created send types, so free them. */
     for (int st = 0; st < num_send_types; st++)
         if (iodesc->stype[st] != PIO_DATATYPE_NULL)
@@ -1125,10 +1560,16 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
         return ret;
 
     /* Run the function to test. */
-    if ((ret = rearrange_io2comp(ios, iodesc, sbuf, rbuf)))
+    if ((ret = rearrange_io2comp(ios, iodesc, sbuf, rbuf, 1)))
         return ret;
     printf("returned from rearrange_comp2io\n");
 
+    /* Free the cached communication plans. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return ret;
+
     /* We created send types, so free them. */
     for (int st = 0; st < num_send_types; st++)
         if (iodesc->stype[st] != PIO_DATATYPE_NULL)
@@ -1165,51 +1606,769 @@ int test_rearrange_io2comp(MPI_Comm test_comm, int my_rank)
     return 0;
 }
 
-/* These tests do not need an iosysid. */
-int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
+/* Test that the communication plans of rearrange_comp2io() and
+ * rearrange_io2comp() are cached and reused. */
+int test_rearr_comm_plan(MPI_Comm test_comm, int my_rank)
 {
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    rearr_comm_plan_t *plan;
+    io_region *ior1;
+    int sbuf[2 * MAPLEN2];
+    int rbuf[2 * MAPLEN2];
+    int cbuf[2 * MAPLEN2];
+    PIO_Offset compmap[MAPLEN2];
+    const int gdimlen[NDIM1] = {8};
+    int dest = (my_rank + 1) % TARGET_NTASKS;
+    int mpierr;
     int ret;
 
-    printf("%d running idx_to_dim_list tests\n", my_rank);
-    if ((ret = test_idx_to_dim_list()))
-        return ret;
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
 
-    printf("%d running coord_to_lindex tests\n", my_rank);
-    if ((ret = test_coord_to_lindex()))
-        return ret;
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
 
-    printf("%d running compute_maxIObuffersize tests\n", my_rank);
-    if ((ret = test_compute_maxIObuffersize(test_comm, my_rank)))
-        return ret;
+    /* Every task is an IO task, and holds the data that belongs on
+     * the next IO task. */
+    ios->ioproc = 1;
+    ios->compproc = 1;
+    ios->io_rank = my_rank;
+    ios->union_rank = my_rank;
+    ios->union_comm = test_comm;
+    ios->io_comm = test_comm;
+    ios->num_iotasks = TARGET_NTASKS;
+    ios->num_comptasks = TARGET_NTASKS;
+    ios->num_uniontasks = TARGET_NTASKS;
+    if (!(ios->ioranks = calloc(ios->num_iotasks, sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(ios->compranks = calloc(ios->num_comptasks, sizeof(int))))
+        return PIO_ENOMEM;
+    for (int i = 0; i < TARGET_NTASKS; i++)
+        ios->ioranks[i] = ios->compranks[i] = i;
 
-    printf("%d running determine_fill\n", my_rank);
-    if ((ret = test_determine_fill(test_comm)))
-        return ret;
+    iodesc->basetype = MPI_INT;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->ndims = NDIM1;
 
-    printf("%d running tests for expand_region()\n", my_rank);
-    if ((ret = test_expand_region()))
-        return ret;
+    /* Point-to-point exchange with no flow control. */
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_P2P;
+    iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
+    iodesc->rearr_opts.comp2io.max_pend_req = PIO_REARR_COMM_UNLIMITED_PEND_REQ;
+    iodesc->rearr_opts.io2comp.max_pend_req = PIO_REARR_COMM_UNLIMITED_PEND_REQ;
 
-    printf("%d running tests for find_region()\n", my_rank);
-    if ((ret = test_find_region()))
+    /* Each IO task gets two elements of the global array. */
+    if ((ret = alloc_region2(NULL, NDIM1, &ior1)))
         return ret;
+    ior1->start[0] = my_rank * MAPLEN2;
+    ior1->count[0] = MAPLEN2;
+    iodesc->firstregion = ior1;
 
-    printf("%d running tests for get_regions()\n", my_rank);
-    if ((ret = test_get_regions(my_rank)))
-        return ret;
+    for (int k = 0; k < MAPLEN2; k++)
+        compmap[k] = dest * MAPLEN2 + k + 1;
 
-    printf("%d running create_mpi_datatypes tests\n", my_rank);
-    if ((ret = test_create_mpi_datatypes()))
+    /* Create the box rearranger. */
+    if ((ret = box_rearrange_create(ios, MAPLEN2, compmap, gdimlen, NDIM1, iodesc)))
         return ret;
 
-    printf("%d running define_iodesc_datatypes tests\n", my_rank);
-    if ((ret = test_define_iodesc_datatypes()))
-        return ret;
+    /* Two vars of data. */
+    for (int v = 0; v < 2; v++)
+        for (int k = 0; k < MAPLEN2; k++)
+            sbuf[v * MAPLEN2 + k] = 100 * v + compmap[k] - 1;
 
-    printf("%d running compare_offsets tests\n", my_rank);
+    /* Move the data twice. The plan must be built once and kept. */
+    for (int t = 0; t < 2; t++)
+    {
+        memset(rbuf, 0, sizeof(rbuf));
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 2)))
+            return ret;
+        if (!iodesc->comp2io_plan || iodesc->comp2io_plan->nvars != 2)
+            return ERR_WRONG;
+        if (t == 0)
+            plan = iodesc->comp2io_plan;
+        else if (iodesc->comp2io_plan != plan)
+            return ERR_WRONG;
+        for (int v = 0; v < 2; v++)
+            for (int k = 0; k < MAPLEN2; k++)
+                if (rbuf[v * MAPLEN2 + k] != 100 * v + my_rank * MAPLEN2 + k)
+                    return ERR_WRONG;
+    }
+
+    /* Changing the number of vars keeps the plan but rebuilds the
+     * types. */
+    memset(rbuf, 0, sizeof(rbuf));
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 1)))
+        return ret;
+    if (iodesc->comp2io_plan != plan || plan->nvars != 1)
+        return ERR_WRONG;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (rbuf[k] != my_rank * MAPLEN2 + k || rbuf[MAPLEN2 + k])
+            return ERR_WRONG;
+
+    /* Move the data back, with and without flow control. */
+    for (int t = 0; t < 2; t++)
+    {
+        if (t)
+        {
+            iodesc->rearr_opts.io2comp.hs = true;
+            iodesc->rearr_opts.io2comp.max_pend_req = 1;
+        }
+        memset(cbuf, 0, sizeof(cbuf));
+        if ((ret = rearrange_io2comp(ios, iodesc, rbuf, cbuf, 1)))
+            return ret;
+        if (!iodesc->io2comp_plan)
+            return ERR_WRONG;
+        for (int k = 0; k < MAPLEN2; k++)
+            if (cbuf[k] != compmap[k] - 1)
+                return ERR_WRONG;
+    }
+
+    /* Move two vars back in one exchange. The plan then owns the
+     * types it made for them. */
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 2)))
+        return ret;
+    memset(cbuf, 0, sizeof(cbuf));
+    if ((ret = rearrange_io2comp(ios, iodesc, rbuf, cbuf, 2)))
+        return ret;
+    if (iodesc->io2comp_plan->nvars != 2 || !iodesc->io2comp_plan->own_types)
+        return ERR_WRONG;
+    for (int v = 0; v < 2; v++)
+        for (int k = 0; k < MAPLEN2; k++)
+            if (cbuf[v * MAPLEN2 + k] != 100 * v + compmap[k] - 1)
+                return ERR_WRONG;
+
+    /* Going back to one var uses the iodesc types again. */
+    memset(cbuf, 0, sizeof(cbuf));
+    if ((ret = rearrange_io2comp(ios, iodesc, rbuf, cbuf, 1)))
+        return ret;
+    if (iodesc->io2comp_plan->nvars != 1 || iodesc->io2comp_plan->own_types)
+        return ERR_WRONG;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (cbuf[k] != compmap[k] - 1 || cbuf[MAPLEN2 + k])
+            return ERR_WRONG;
+
+    /* Free the plans. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return ret;
+    if (iodesc->comp2io_plan || iodesc->io2comp_plan)
+        return ERR_WRONG;
+
+    /* Free resources allocated in library code. */
+    for (int st = 0; st < iodesc->num_stypes; st++)
+        if (iodesc->stype[st] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->stype[st])))
+                MPIERR(mpierr);
+    for (int r = 0; r < iodesc->nrecvs; r++)
+        if (iodesc->rtype[r] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->rtype[r])))
+                MPIERR(mpierr);
+    free(iodesc->rtype);
+    free(iodesc->sindex);
+    free(iodesc->scount);
+    free(iodesc->stype);
+    free(iodesc->rcount);
+    free(iodesc->rfrom);
+    free(iodesc->rindex);
+
+    /* Free resources from test. */
+    free(ior1->start);
+    free(ior1->count);
+    free(ior1);
+    free(ios->ioranks);
+    free(ios->compranks);
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
+/* Test the box rearranger with neighborhood collectives. */
+int test_rearr_neighbor(MPI_Comm test_comm, int my_rank)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    io_region *ior1;
+    int sbuf[MAPLEN2];
+    int rbuf[MAPLEN2];
+    int cbuf[MAPLEN2];
+    PIO_Offset compmap[MAPLEN2];
+    const int gdimlen[NDIM1] = {8};
+    int dest = (my_rank + 1) % TARGET_NTASKS;
+    int src = (my_rank + TARGET_NTASKS - 1) % TARGET_NTASKS;
+    int mpierr;
+    int ret;
+
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Every task is an IO task, and holds the data that belongs on
+     * the next IO task. */
+    ios->ioproc = 1;
+    ios->compproc = 1;
+    ios->io_rank = my_rank;
+    ios->union_rank = my_rank;
+    ios->union_comm = test_comm;
+    ios->io_comm = test_comm;
+    ios->num_iotasks = TARGET_NTASKS;
+    ios->num_comptasks = TARGET_NTASKS;
+    ios->num_uniontasks = TARGET_NTASKS;
+    if (!(ios->ioranks = calloc(ios->num_iotasks, sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(ios->compranks = calloc(ios->num_comptasks, sizeof(int))))
+        return PIO_ENOMEM;
+    for (int i = 0; i < TARGET_NTASKS; i++)
+        ios->ioranks[i] = ios->compranks[i] = i;
+
+    iodesc->basetype = MPI_INT;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->ndims = NDIM1;
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_NEIGHBOR;
+    iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
+
+    /* Each IO task gets two elements of the global array. */
+    if ((ret = alloc_region2(NULL, NDIM1, &ior1)))
+        return ret;
+    ior1->start[0] = my_rank * MAPLEN2;
+    ior1->count[0] = MAPLEN2;
+    iodesc->firstregion = ior1;
+
+    for (int k = 0; k < MAPLEN2; k++)
+        compmap[k] = dest * MAPLEN2 + k + 1;
+
+    /* Create the box rearranger. This also creates the graph
+     * communicator. */
+    if ((ret = box_rearrange_create(ios, MAPLEN2, compmap, gdimlen, NDIM1, iodesc)))
+        return ret;
+
+    /* Each task sends to the next task and receives from the
+     * previous one. */
+    if (!iodesc->neighbors || iodesc->num_neighbors != 2)
+        return ERR_WRONG;
+    if (iodesc->neighbors[0] != (src < dest ? src : dest) ||
+        iodesc->neighbors[1] != (src < dest ? dest : src))
+        return ERR_WRONG;
+
+    /* Move the data to the IO tasks and back. */
+    for (int k = 0; k < MAPLEN2; k++)
+        sbuf[k] = compmap[k] - 1;
+    memset(rbuf, 0, sizeof(rbuf));
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 1)))
+        return ret;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (rbuf[k] != my_rank * MAPLEN2 + k)
+            return ERR_WRONG;
+
+    memset(cbuf, 0, sizeof(cbuf));
+    if ((ret = rearrange_io2comp(ios, iodesc, rbuf, cbuf, 1)))
+        return ret;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (cbuf[k] != compmap[k] - 1)
+            return ERR_WRONG;
+
+    /* Free the graph communicator. */
+    if ((ret = free_neighbor_comm(iodesc)))
+        return ret;
+    if (iodesc->neighbors || iodesc->num_neighbors)
+        return ERR_WRONG;
+
+    /* Free resources allocated in library code. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return ret;
+    for (int st = 0; st < iodesc->num_stypes; st++)
+        if (iodesc->stype[st] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->stype[st])))
+                MPIERR(mpierr);
+    for (int r = 0; r < iodesc->nrecvs; r++)
+        if (iodesc->rtype[r] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->rtype[r])))
+                MPIERR(mpierr);
+    free(iodesc->rtype);
+    free(iodesc->sindex);
+    free(iodesc->scount);
+    free(iodesc->stype);
+    free(iodesc->rcount);
+    free(iodesc->rfrom);
+    free(iodesc->rindex);
+
+    /* Free resources from test. */
+    free(ior1->start);
+    free(ior1->count);
+    free(ior1);
+    free(ios->ioranks);
+    free(ios->compranks);
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
+/* Test the box rearranger moving two variables through shared
+ * memory. All tasks of the test are on one node. */
+int test_rearr_shm(MPI_Comm test_comm, int my_rank)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    io_region *ior1;
+    int sbuf[2 * MAPLEN2];
+    int rbuf[2 * MAPLEN2];
+    PIO_Offset compmap[MAPLEN2];
+    const int gdimlen[NDIM1] = {8};
+    int dest = (my_rank + 1) % TARGET_NTASKS;
+    int mpierr;
+    int ret;
+
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Every task is an IO task, and holds the data that belongs on
+     * the next IO task. */
+    ios->ioproc = 1;
+    ios->compproc = 1;
+    ios->io_rank = my_rank;
+    ios->union_rank = my_rank;
+    ios->union_comm = test_comm;
+    ios->io_comm = test_comm;
+    ios->num_iotasks = TARGET_NTASKS;
+    ios->num_comptasks = TARGET_NTASKS;
+    ios->num_uniontasks = TARGET_NTASKS;
+    ios->rearr_shm = true;
+    if (!(ios->ioranks = calloc(ios->num_iotasks, sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(ios->compranks = calloc(ios->num_comptasks, sizeof(int))))
+        return PIO_ENOMEM;
+    for (int i = 0; i < TARGET_NTASKS; i++)
+        ios->ioranks[i] = ios->compranks[i] = i;
+
+    iodesc->basetype = MPI_INT;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->ndims = NDIM1;
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_P2P;
+    iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
+    iodesc->rearr_opts.comp2io.max_pend_req = PIO_REARR_COMM_UNLIMITED_PEND_REQ;
+
+    /* Each IO task gets two elements of the global array. */
+    if ((ret = alloc_region2(NULL, NDIM1, &ior1)))
+        return ret;
+    ior1->start[0] = my_rank * MAPLEN2;
+    ior1->count[0] = MAPLEN2;
+    iodesc->firstregion = ior1;
+
+    for (int k = 0; k < MAPLEN2; k++)
+        compmap[k] = dest * MAPLEN2 + k + 1;
+
+    if ((ret = box_rearrange_create(ios, MAPLEN2, compmap, gdimlen, NDIM1, iodesc)))
+        return ret;
+
+    /* Move two variables with shared memory, then again with
+     * messages. */
+    for (int use_shm = 1; use_shm >= 0; use_shm--)
+    {
+        ios->rearr_shm = use_shm;
+        for (int v = 0; v < 2; v++)
+            for (int k = 0; k < MAPLEN2; k++)
+                sbuf[v * MAPLEN2 + k] = v * 100 + compmap[k] - 1;
+        memset(rbuf, 0, sizeof(rbuf));
+        if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 2)))
+            return ret;
+        for (int v = 0; v < 2; v++)
+            for (int k = 0; k < MAPLEN2; k++)
+                if (rbuf[v * MAPLEN2 + k] != v * 100 + my_rank * MAPLEN2 + k)
+                    return ERR_WRONG;
+
+        /* With shared memory each task gathers from the previous one,
+         * and sends no messages. The data is contiguous on both
+         * sides, so it is copied in one run. */
+        if (use_shm)
+        {
+            if (!iodesc->shm || !iodesc->shm->active || iodesc->shm->npeers != 1 ||
+                !iodesc->shm->copy_out || iodesc->shm->nvars != 2)
+                return ERR_WRONG;
+            if (iodesc->shm->nput != 1 || iodesc->shm->put_len[0] != MAPLEN2 ||
+                iodesc->shm->peer_nruns[0] != 1 || iodesc->shm->rlen[0] != MAPLEN2)
+                return ERR_WRONG;
+            for (int p = 0; p < TARGET_NTASKS; p++)
+                if (iodesc->comp2io_plan->sendcounts[p] || iodesc->comp2io_plan->recvcounts[p])
+                    return ERR_WRONG;
+        }
+        else if (iodesc->shm)
+            return ERR_WRONG;
+    }
+
+    /* Free resources allocated in library code. */
+    if ((ret = free_rearr_shm(iodesc)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    for (int st = 0; st < iodesc->num_stypes; st++)
+        if (iodesc->stype[st] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->stype[st])))
+                MPIERR(mpierr);
+    for (int r = 0; r < iodesc->nrecvs; r++)
+        if (iodesc->rtype[r] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->rtype[r])))
+                MPIERR(mpierr);
+    free(iodesc->rtype);
+    free(iodesc->sindex);
+    free(iodesc->scount);
+    free(iodesc->stype);
+    free(iodesc->rcount);
+    free(iodesc->rfrom);
+    free(iodesc->rindex);
+
+    /* Free resources from test. */
+    free(ior1->start);
+    free(ior1->count);
+    free(ior1);
+    free(ios->ioranks);
+    free(ios->compranks);
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
+/* Test starting to move two variables to the IO tasks with
+ * nonblocking messages, and completing the transfer later. */
+int test_rearrange_comp2io_start(MPI_Comm test_comm, int my_rank)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    io_region *ior1;
+    int sbuf[2 * MAPLEN2];
+    int rbuf[2 * MAPLEN2];
+    PIO_Offset compmap[MAPLEN2];
+    const int gdimlen[NDIM1] = {8};
+    int dest = (my_rank + 1) % TARGET_NTASKS;
+    MPI_Request *reqs, *reqs2;
+    int nreqs, nreqs2;
+    int mpierr;
+    int ret;
+
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Every task is an IO task, and holds the data that belongs on
+     * the next IO task. */
+    ios->ioproc = 1;
+    ios->compproc = 1;
+    ios->io_rank = my_rank;
+    ios->union_rank = my_rank;
+    ios->union_comm = test_comm;
+    ios->io_comm = test_comm;
+    ios->num_iotasks = TARGET_NTASKS;
+    ios->num_comptasks = TARGET_NTASKS;
+    ios->num_uniontasks = TARGET_NTASKS;
+    if (!(ios->ioranks = calloc(ios->num_iotasks, sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(ios->compranks = calloc(ios->num_comptasks, sizeof(int))))
+        return PIO_ENOMEM;
+    for (int i = 0; i < TARGET_NTASKS; i++)
+        ios->ioranks[i] = ios->compranks[i] = i;
+
+    iodesc->basetype = MPI_INT;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->ndims = NDIM1;
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_P2P;
+    iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
+    iodesc->rearr_opts.comp2io.max_pend_req = PIO_REARR_COMM_UNLIMITED_PEND_REQ;
+    iodesc->iwrite_comm = MPI_COMM_NULL;
+
+    /* Each IO task gets two elements of the global array. */
+    if ((ret = alloc_region2(NULL, NDIM1, &ior1)))
+        return ret;
+    ior1->start[0] = my_rank * MAPLEN2;
+    ior1->count[0] = MAPLEN2;
+    iodesc->firstregion = ior1;
+
+    for (int k = 0; k < MAPLEN2; k++)
+        compmap[k] = dest * MAPLEN2 + k + 1;
+
+    if ((ret = box_rearrange_create(ios, MAPLEN2, compmap, gdimlen, NDIM1, iodesc)))
+        return ret;
+
+    /* Start moving the data twice, then complete both transfers in
+     * reverse order. */
+    for (int v = 0; v < 2; v++)
+        for (int k = 0; k < MAPLEN2; k++)
+            sbuf[v * MAPLEN2 + k] = v * 100 + compmap[k] - 1;
+    memset(rbuf, 0, sizeof(rbuf));
+    if ((ret = rearrange_comp2io_start(ios, iodesc, sbuf, rbuf, 1, &nreqs, &reqs)))
+        return ret;
+    if ((ret = rearrange_comp2io_start(ios, iodesc, sbuf + MAPLEN2, rbuf + MAPLEN2, 1,
+                                       &nreqs2, &reqs2)))
+        return ret;
+
+    /* Each task sends to the next one and receives from the previous
+     * one. */
+    if (nreqs != 2 || nreqs2 != 2 || iodesc->iwrite_comm == MPI_COMM_NULL)
+        return ERR_WRONG;
+    if ((mpierr = MPI_Waitall(nreqs2, reqs2, MPI_STATUSES_IGNORE)))
+        MPIERR(mpierr);
+    free(reqs2);
+    if ((mpierr = MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE)))
+        MPIERR(mpierr);
+    free(reqs);
+    for (int v = 0; v < 2; v++)
+        for (int k = 0; k < MAPLEN2; k++)
+            if (rbuf[v * MAPLEN2 + k] != v * 100 + my_rank * MAPLEN2 + k)
+                return ERR_WRONG;
+
+    /* Free resources allocated in library code. */
+    if ((mpierr = MPI_Comm_free(&iodesc->iwrite_comm)))
+        MPIERR(mpierr);
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    for (int st = 0; st < iodesc->num_stypes; st++)
+        if (iodesc->stype[st] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->stype[st])))
+                MPIERR(mpierr);
+    for (int r = 0; r < iodesc->nrecvs; r++)
+        if (iodesc->rtype[r] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->rtype[r])))
+                MPIERR(mpierr);
+    free(iodesc->rtype);
+    free(iodesc->sindex);
+    free(iodesc->scount);
+    free(iodesc->stype);
+    free(iodesc->rcount);
+    free(iodesc->rfrom);
+    free(iodesc->rindex);
+
+    /* Free resources from test. */
+    free(ior1->start);
+    free(ior1->count);
+    free(ior1);
+    free(ios->ioranks);
+    free(ios->compranks);
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
+/* Test tuning of the rearranger options. */
+int test_performance_tune_rearranger(MPI_Comm test_comm, int my_rank)
+{
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    io_region *ior1;
+    rearr_opt_t opts0;
+    int sbuf[MAPLEN2];
+    int rbuf[MAPLEN2];
+    int cbuf[MAPLEN2];
+    PIO_Offset compmap[MAPLEN2];
+    const int gdimlen[NDIM1] = {8};
+    int dest = (my_rank + 1) % TARGET_NTASKS;
+    int mpierr;
+    int ret;
+
+    /* Allocate IO system info struct for this test. */
+    if (!(ios = calloc(1, sizeof(iosystem_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Allocate IO desc struct for this test. */
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Every task is an IO task, and holds the data that belongs on
+     * the next IO task. */
+    ios->ioproc = 1;
+    ios->compproc = 1;
+    ios->io_rank = my_rank;
+    ios->union_rank = my_rank;
+    ios->union_comm = test_comm;
+    ios->io_comm = test_comm;
+    ios->num_iotasks = TARGET_NTASKS;
+    ios->num_comptasks = TARGET_NTASKS;
+    ios->num_uniontasks = TARGET_NTASKS;
+    if (!(ios->ioranks = calloc(ios->num_iotasks, sizeof(int))))
+        return PIO_ENOMEM;
+    if (!(ios->compranks = calloc(ios->num_comptasks, sizeof(int))))
+        return PIO_ENOMEM;
+    for (int i = 0; i < TARGET_NTASKS; i++)
+        ios->ioranks[i] = ios->compranks[i] = i;
+
+    iodesc->basetype = MPI_INT;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->ndims = NDIM1;
+    iodesc->rearr_opts.comm_type = PIO_REARR_COMM_COLL;
+    iodesc->rearr_opts.fcd = PIO_REARR_COMM_FC_2D_DISABLE;
+
+    /* Each IO task gets two elements of the global array. */
+    if ((ret = alloc_region2(NULL, NDIM1, &ior1)))
+        return ret;
+    ior1->start[0] = my_rank * MAPLEN2;
+    ior1->count[0] = MAPLEN2;
+    iodesc->firstregion = ior1;
+
+    for (int k = 0; k < MAPLEN2; k++)
+        compmap[k] = dest * MAPLEN2 + k + 1;
+
+    /* Create the box rearranger. */
+    if ((ret = box_rearrange_create(ios, MAPLEN2, compmap, gdimlen, NDIM1, iodesc)))
+        return ret;
+
+    /* Tune the rearranger. */
+    if ((ret = performance_tune_rearranger(ios, iodesc)))
+        return ret;
+    if (!iodesc->rearr_tuned)
+        return ERR_WRONG;
+    if (iodesc->rearr_opts.comm_type != PIO_REARR_COMM_COLL &&
+        iodesc->rearr_opts.comm_type != PIO_REARR_COMM_NEIGHBOR &&
+        iodesc->rearr_opts.comm_type != PIO_REARR_COMM_P2P)
+        return ERR_WRONG;
+    if (iodesc->rearr_opts.comm_type == PIO_REARR_COMM_COLL &&
+        iodesc->rearr_opts.comp2io.max_pend_req != 0)
+        return ERR_WRONG;
+
+    /* All tasks must have made the same choice. */
+    opts0 = iodesc->rearr_opts;
+    if ((mpierr = MPI_Bcast(&opts0, sizeof(rearr_opt_t), MPI_BYTE, 0, test_comm)))
+        MPIERR(mpierr);
+    if (opts0.comm_type != iodesc->rearr_opts.comm_type ||
+        opts0.comp2io.hs != iodesc->rearr_opts.comp2io.hs ||
+        opts0.comp2io.isend != iodesc->rearr_opts.comp2io.isend ||
+        opts0.comp2io.max_pend_req != iodesc->rearr_opts.comp2io.max_pend_req)
+        return ERR_WRONG;
+
+    /* The plans built while tuning are kept. */
+    if (!iodesc->comp2io_plan || !iodesc->io2comp_plan)
+        return ERR_WRONG;
+
+    /* Data still arrives with the chosen options. */
+    for (int k = 0; k < MAPLEN2; k++)
+        sbuf[k] = compmap[k] - 1;
+    memset(rbuf, 0, sizeof(rbuf));
+    if ((ret = rearrange_comp2io(ios, iodesc, sbuf, rbuf, 1)))
+        return ret;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (rbuf[k] != my_rank * MAPLEN2 + k)
+            return ERR_WRONG;
+
+    memset(cbuf, 0, sizeof(cbuf));
+    if ((ret = rearrange_io2comp(ios, iodesc, rbuf, cbuf, 1)))
+        return ret;
+    for (int k = 0; k < MAPLEN2; k++)
+        if (cbuf[k] != compmap[k] - 1)
+            return ERR_WRONG;
+
+    /* Free resources allocated in library code. */
+    if ((ret = free_rearr_comm_plan(&iodesc->comp2io_plan)))
+        return ret;
+    if ((ret = free_rearr_comm_plan(&iodesc->io2comp_plan)))
+        return ret;
+    if ((ret = free_neighbor_comm(iodesc)))
+        return ret;
+    for (int st = 0; st < iodesc->num_stypes; st++)
+        if (iodesc->stype[st] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->stype[st])))
+                MPIERR(mpierr);
+    for (int r = 0; r < iodesc->nrecvs; r++)
+        if (iodesc->rtype[r] != PIO_DATATYPE_NULL)
+            if ((mpierr = MPI_Type_free(&iodesc->rtype[r])))
+                MPIERR(mpierr);
+    free(iodesc->rtype);
+    free(iodesc->sindex);
+    free(iodesc->scount);
+    free(iodesc->stype);
+    free(iodesc->rcount);
+    free(iodesc->rfrom);
+    free(iodesc->rindex);
+
+    /* Free resources from test. */
+    free(ior1->start);
+    free(ior1->count);
+    free(ior1);
+    free(ios->ioranks);
+    free(ios->compranks);
+    free(iodesc);
+    free(ios);
+
+    return 0;
+}
+
+/* These tests do not need an iosysid. */
+int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
+{
+    int ret;
+
+    printf("%d running idx_to_dim_list tests\n", my_rank);
+    if ((ret = test_idx_to_dim_list()))
+        return ret;
+
+    printf("%d running coord_to_lindex tests\n", my_rank);
+    if ((ret = test_coord_to_lindex()))
+        return ret;
+
+    printf("%d running compute_maxIObuffersize tests\n", my_rank);
+    if ((ret = test_compute_maxIObuffersize(test_comm, my_rank)))
+        return ret;
+
+    printf("%d running determine_fill\n", my_rank);
+    if ((ret = test_determine_fill(test_comm)))
+        return ret;
+
+    printf("%d running tests for expand_region()\n", my_rank);
+    if ((ret = test_expand_region()))
+        return ret;
+
+    printf("%d running tests for find_region()\n", my_rank);
+    if ((ret = test_find_region()))
+        return ret;
+
+    printf("%d running tests for get_regions()\n", my_rank);
+    if ((ret = test_get_regions(my_rank)))
+        return ret;
+
+    printf("%d running create_mpi_datatypes tests\n", my_rank);
+    if ((ret = test_create_mpi_datatypes()))
+        return ret;
+
+    printf("%d running define_iodesc_datatypes tests\n", my_rank);
+    if ((ret = test_define_iodesc_datatypes()))
+        return ret;
+
+    printf("%d running compare_offsets tests\n", my_rank);
     if ((ret = test_compare_offsets()))
         return ret;
 
+    printf("%d running map run tests\n", my_rank);
+    if ((ret = test_map_runs()))
+        return ret;
+
+    printf("%d running sort_map_runs tests\n", my_rank);
+    if ((ret = test_sort_map_runs()))
+        return ret;
+
+    printf("%d running get_regions_chunked tests\n", my_rank);
+    if ((ret = test_get_regions_chunked()))
+        return ret;
+
+    printf("%d running coalesce_regions tests\n", my_rank);
+    if ((ret = test_coalesce_regions()))
+        return ret;
+
     printf("%d running compute_counts tests for box rearranger\n", my_rank);
     if ((ret = test_compute_counts(test_comm, my_rank)))
         return ret;
@@ -1226,6 +2385,14 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_default_subset_partition(test_comm, my_rank)))
         return ret;
 
+    printf("%d running tests for assign_subset_groups\n", my_rank);
+    if ((ret = test_assign_subset_groups()))
+        return ret;
+
+    printf("%d running tests for node_subset_partition\n", my_rank);
+    if ((ret = test_node_subset_partition(test_comm, my_rank)))
+        return ret;
+
     printf("%d running tests for rearrange_comp2io\n", my_rank);
     if ((ret = test_rearrange_comp2io(test_comm, my_rank)))
         return ret;
@@ -1234,6 +2401,26 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_rearrange_io2comp(test_comm, my_rank)))
         return ret;
 
+    printf("%d running tests for cached rearranger communication plans\n", my_rank);
+    if ((ret = test_rearr_comm_plan(test_comm, my_rank)))
+        return ret;
+
+    printf("%d running tests for neighborhood collective rearranger\n", my_rank);
+    if ((ret = test_rearr_neighbor(test_comm, my_rank)))
+        return ret;
+
+    printf("%d running tests for shared memory rearranger\n", my_rank);
+    if ((ret = test_rearr_shm(test_comm, my_rank)))
+        return ret;
+
+    printf("%d running tests for rearrange_comp2io_start\n", my_rank);
+    if ((ret = test_rearrange_comp2io_start(test_comm, my_rank)))
+        return ret;
+
+    printf("%d running tests for performance_tune_rearranger\n", my_rank);
+    if ((ret = test_performance_tune_rearranger(test_comm, my_rank)))
+        return ret;
+
      return 0;
 }
 
@@ -1469,6 +2656,10 @@ int run_iosys_tests(int numio, int iosysid, int my_rank, MPI_Comm test_comm,
     if ((ret = test_init_decomp(iosysid, test_comm, my_rank)))
         return ret;
 
+    printf("%d running test for decomposition cache\n", my_rank);
+    if ((ret = test_decomp_cache(iosysid, test_comm, my_rank)))
+        return ret;
+
     printf("%d running test for init_decomp\n", my_rank);
     if ((ret = test_scalar(numio, iosysid, test_comm, my_rank, num_flavors, flavor)))
         return ret;
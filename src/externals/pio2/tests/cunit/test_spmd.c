@@ -223,6 +223,90 @@ int test_lists()
     return 0;
 }
 
+/* Test adding, finding and deleting many files and decompositions,
+ * which grows the handle tables and leaves deleted slots in them. */
+int test_handle_tables(int iosysid)
+{
+#define NUM_HANDLES 300
+    iosystem_desc_t *ios;
+    file_desc_t *file[NUM_HANDLES];
+    io_desc_t *iodesc[NUM_HANDLES];
+    file_desc_t *fdesc;
+    int ioid;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    if (pio_get_iosystem_from_id(iosysid + 1) || pio_get_iosystem_from_id(0))
+        return ERR_WRONG;
+
+    /* Add the files and decompositions. */
+    for (int h = 0; h < NUM_HANDLES; h++)
+    {
+        if (!(file[h] = calloc(1, sizeof(file_desc_t))))
+            return PIO_ENOMEM;
+        file[h]->iosystem = ios;
+        file[h]->iotype = PIO_IOTYPE_NETCDF;
+        file[h]->pio_ncid = 100000 + h;
+        pio_add_to_file_list(file[h]);
+
+        if (!(iodesc[h] = calloc(1, sizeof(io_desc_t))))
+            return PIO_ENOMEM;
+        ioid = pio_add_to_iodesc_list(iodesc[h]);
+        if (h && ioid != iodesc[h - 1]->ioid + 1)
+            return ERR_WRONG;
+    }
+
+    /* Delete every other one. */
+    for (int h = 0; h < NUM_HANDLES; h += 2)
+    {
+        if ((ret = pio_delete_file_from_list(100000 + h)))
+            return ret;
+        if ((ret = pio_delete_iodesc_from_list(iodesc[h]->ioid)))
+            return ret;
+        file[h] = NULL;
+        iodesc[h] = NULL;
+    }
+
+    /* The rest are still found, and the deleted ones are not. */
+    for (int h = 1; h < NUM_HANDLES; h += 2)
+    {
+        if ((ret = pio_get_file(100000 + h, &fdesc)))
+            return ret;
+        if (fdesc != file[h])
+            return ERR_WRONG;
+        if (pio_get_iodesc_from_id(iodesc[h]->ioid) != iodesc[h])
+            return ERR_WRONG;
+        if (pio_get_file(100000 + h - 1, &fdesc) != PIO_EBADID)
+            return ERR_WRONG;
+        if (pio_delete_file_from_list(100000 + h - 1) != PIO_EBADID)
+            return ERR_WRONG;
+    }
+
+    /* A new decomposition gets an ID after the last one. */
+    if (!(iodesc[0] = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+    ioid = pio_add_to_iodesc_list(iodesc[0]);
+    if (ioid != iodesc[NUM_HANDLES - 1]->ioid + 1 || pio_get_iodesc_from_id(ioid) != iodesc[0])
+        return ERR_WRONG;
+    if ((ret = pio_delete_iodesc_from_list(ioid)))
+        return ret;
+
+    /* Delete the rest. */
+    for (int h = 1; h < NUM_HANDLES; h += 2)
+    {
+        ioid = iodesc[h]->ioid;
+        if ((ret = pio_delete_file_from_list(100000 + h)))
+            return ret;
+        if ((ret = pio_delete_iodesc_from_list(ioid)))
+            return ret;
+        if (pio_get_iodesc_from_id(ioid))
+            return ERR_WRONG;
+    }
+
+    return 0;
+}
+
 /* Test the ceil2() and pair() functions. */
 int test_ceil2_pair()
 {
@@ -349,6 +433,414 @@ int test_misc()
     return 0;
 }
 
+/* Test the table of var info of a file. */
+int test_var_desc()
+{
+    file_desc_t *file;
+    var_desc_t *vdesc, *vdesc2;
+    int ret;
+
+    if (!(file = calloc(1, sizeof(file_desc_t))))
+        return PIO_ENOMEM;
+
+    /* Invalid varids are rejected. */
+    if (get_var_desc(-1, file, &vdesc) != PIO_ENOTVAR)
+        return ERR_WRONG;
+    if (get_var_desc(PIO_MAX_VARS, file, &vdesc) != PIO_ENOTVAR)
+        return ERR_WRONG;
+    if (get_var_desc(0, NULL, &vdesc) != PIO_EINVAL || get_var_desc(0, file, NULL) != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* Entries are allocated on first use, with default values. */
+    if ((ret = get_var_desc(TEST_VAL_42, file, &vdesc)))
+        return ret;
+    if (vdesc->record != -1 || vdesc->ndims != -1 || vdesc->nreqs || vdesc->iobuf)
+        return ERR_WRONG;
+    if (file->nactive_vars != 1 || file->active_varids[0] != TEST_VAL_42 ||
+        file->varlist_size <= TEST_VAL_42 || file->varlist[0])
+        return ERR_WRONG;
+    vdesc->record = 3;
+
+    /* Growing the table keeps the entries in place. */
+    if ((ret = get_var_desc(PIO_MAX_VARS - 1, file, &vdesc2)))
+        return ret;
+    if (file->varlist_size != PIO_MAX_VARS || file->nactive_vars != 2)
+        return ERR_WRONG;
+    if ((ret = get_var_desc(TEST_VAL_42, file, &vdesc2)))
+        return ret;
+    if (vdesc2 != vdesc || vdesc2->record != 3 || file->nactive_vars != 2)
+        return ERR_WRONG;
+
+    free_var_descs(file);
+    if (file->varlist || file->nactive_vars)
+        return ERR_WRONG;
+    free(file);
+
+    return 0;
+}
+
+/* Test the hash table and growth of the write multi buffers. */
+int test_wmb()
+{
+    file_desc_t *file;
+    io_desc_t *iodesc;
+    wmulti_buffer *wmb, *wmb2, *wmb3, *wmb4;
+    PIO_Offset bytes_copied = 0;
+    int nrealloc = 0;
+    int ret;
+
+    if (!(file = calloc(1, sizeof(file_desc_t))))
+        return PIO_ENOMEM;
+    file->buffer.ioid = -1;
+    if (!(iodesc = calloc(1, sizeof(io_desc_t))))
+        return PIO_ENOMEM;
+    iodesc->basetype_size = sizeof(int);
+    iodesc->maxbytes = sizeof(int) * 6;
+    iodesc->needsfill = 1;
+
+    /* Buffers are found by ioid and recordvar. */
+    if ((ret = get_wmb(file, TEST_VAL_42, 0, &wmb)))
+        return ret;
+    if ((ret = get_wmb(file, TEST_VAL_42, 1, &wmb2)))
+        return ret;
+    if ((ret = get_wmb(file, TEST_VAL_42 + PIO_WMB_HASH_SIZE / 2, 0, &wmb3)))
+        return ret;
+    if (wmb == wmb2 || wmb == wmb3 || wmb2 == wmb3)
+        return ERR_WRONG;
+    if ((ret = get_wmb(file, TEST_VAL_42, 0, &wmb4)))
+        return ret;
+    if (wmb4 != wmb)
+        return ERR_WRONG;
+    if ((ret = get_wmb(file, TEST_VAL_42 + PIO_WMB_HASH_SIZE / 2, 0, &wmb4)))
+        return ret;
+    if (wmb4 != wmb3)
+        return ERR_WRONG;
+
+    /* The list is in the order the buffers were created. */
+    if (file->buffer.next != wmb || wmb->next != wmb2 || wmb2->next != wmb3 || wmb3->next)
+        return ERR_WRONG;
+
+    /* The capacity doubles up to the limit of maxbytes, then grows
+     * one array at a time. */
+    for (int i = 0; i < 10; i++)
+    {
+        int expected = i < 4 ? 4 : (i < 6 ? 6 : i + 1);
+
+        if (wmb->num_arrays == wmb->capacity)
+        {
+            if (wmb_next_capacity(iodesc, wmb) != expected)
+                return ERR_WRONG;
+            if (i)
+            {
+                nrealloc += 2;
+                bytes_copied += i * (sizeof(int) + sizeof(int) + sizeof(int) * TEST_VAL_42);
+            }
+        }
+        if ((ret = grow_wmb(file, iodesc, wmb, TEST_VAL_42)))
+            return ret;
+        if (wmb->capacity != expected || wmb->datasize < (i + 1) * TEST_VAL_42 * sizeof(int))
+            return ERR_WRONG;
+        if (!wmb->vid || !wmb->fillvalue || wmb->frame)
+            return ERR_WRONG;
+        wmb->arraylen = TEST_VAL_42;
+        wmb->num_arrays++;
+    }
+    if (file->wmb_nrealloc != nrealloc || file->wmb_bytes_copied != bytes_copied)
+        return ERR_WRONG;
+
+    /* Record var buffers get an array of record numbers. */
+    if ((ret = grow_wmb(file, iodesc, wmb2, TEST_VAL_42)))
+        return ret;
+    if (!wmb2->frame || wmb2->capacity != 4)
+        return ERR_WRONG;
+
+    /* Free the buffers. */
+    for (wmb = file->buffer.next; wmb; wmb = wmb2)
+    {
+        wmb2 = wmb->next;
+        if (wmb->data)
+            brel(wmb->data);
+        if (wmb->vid)
+            brel(wmb->vid);
+        if (wmb->frame)
+            brel(wmb->frame);
+        if (wmb->fillvalue)
+            brel(wmb->fillvalue);
+        brel(wmb);
+    }
+    free(iodesc);
+    free(file);
+
+    return 0;
+}
+
+/* Test the tracking of vars with pending pnetcdf requests, and the
+ * flush policy. */
+int test_flush_policy(int iosysid)
+{
+#define NUM_PENDING_VARS 40
+    file_desc_t *file;
+    iosystem_desc_t *ios;
+    int ret;
+
+    /* Check the inputs of the flush policy. */
+    if (PIOc_set_flush_policy(iosysid + TEST_VAL_42, 0, 0) != PIO_EBADID)
+        return ERR_WRONG;
+    if (PIOc_set_flush_policy(iosysid, -1, 0) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_set_flush_policy(iosysid, 0, -1) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    if (!(file = calloc(1, sizeof(file_desc_t))))
+        return PIO_ENOMEM;
+    file->iosystem = ios;
+
+    /* Vars are listed in the order of their first request. */
+    if ((ret = add_pending_var(file, 3, 100, false)))
+        return ret;
+    if ((ret = add_pending_var(file, 1, 50, true)))
+        return ret;
+    if ((ret = add_pending_var(file, 3, 20, false)))
+        return ret;
+    if (file->npending_vars != 2 || file->pending_varids[0] != 3 ||
+        file->pending_varids[1] != 1)
+        return ERR_WRONG;
+    if (!file->varlist[3]->pending || file->varlist[3]->pending_bytes != 120 ||
+        !file->varlist[1]->pending || file->varlist[1]->pending_bytes != 50 ||
+        file->varlist[0])
+        return ERR_WRONG;
+    if (file->iput_bytes != 120 || file->bput_bytes != 50)
+        return ERR_WRONG;
+
+    /* The list grows as needed. */
+    for (int v = NUM_PENDING_VARS; v > 0; v--)
+        if ((ret = add_pending_var(file, v, 1, false)))
+            return ret;
+    if (file->npending_vars != NUM_PENDING_VARS || file->pending_varids_size < NUM_PENDING_VARS ||
+        file->pending_varids[2] != NUM_PENDING_VARS || file->iput_bytes != 120 + NUM_PENDING_VARS)
+        return ERR_WRONG;
+
+#ifdef _PNETCDF
+    /* Under the buffer limit and with no budget, nothing is flushed. */
+    if ((ret = PIOc_set_flush_policy(iosysid, 0, 0)))
+        return ret;
+    if ((ret = flush_output_buffer(file, false, 0)))
+        return ret;
+    if (file->npending_vars != NUM_PENDING_VARS || file->iput_bytes != 120 + NUM_PENDING_VARS)
+        return ERR_WRONG;
+
+    /* Over the budget, the pending vars are flushed. */
+    if ((ret = PIOc_set_flush_policy(iosysid, 100, TEST_VAL_42)))
+        return ret;
+    if ((ret = flush_output_buffer(file, false, 0)))
+        return ret;
+    if (file->npending_vars || file->iput_bytes || file->bput_bytes)
+        return ERR_WRONG;
+    for (int v = 1; v <= NUM_PENDING_VARS; v++)
+        if (file->varlist[v]->pending || file->varlist[v]->pending_bytes)
+            return ERR_WRONG;
+    if ((ret = PIOc_set_flush_policy(iosysid, 0, 0)))
+        return ret;
+#endif /* _PNETCDF */
+
+    free(file->pending_varids);
+    free_var_descs(file);
+    free(file);
+
+    return 0;
+}
+
+/* Test the choice of the IO tasks of box decompositions from the
+ * size of the data. */
+int test_box_layout(int iosysid)
+{
+#define LAYOUT_NIOTASKS 8
+#define LAYOUT_DIM_LEN 64
+#define NUM_LAYOUT_TARGETS 4
+    iosystem_desc_t *ios, layout_ios = {0};
+    int gdims[2] = {LAYOUT_DIM_LEN, LAYOUT_DIM_LEN};
+    PIO_Offset target[NUM_LAYOUT_TARGETS] = {0, 2048, 3000, 100000};
+    int expected[NUM_LAYOUT_TARGETS] = {LAYOUT_NIOTASKS, 8, 4, 1};
+    int stride[NUM_LAYOUT_TARGETS] = {1, 1, 2, 8};
+    int ret;
+
+    /* Check the inputs. */
+    if (PIOc_set_iotask_target(iosysid + TEST_VAL_42, 0, 0) != PIO_EBADID)
+        return ERR_WRONG;
+    if (PIOc_set_iotask_target(iosysid, -1, 0) != PIO_EINVAL)
+        return ERR_WRONG;
+    if (PIOc_set_iotask_target(iosysid, 0, -1) != PIO_EINVAL)
+        return ERR_WRONG;
+
+    /* The number of tasks per node is found from MPI. */
+    if ((ret = PIOc_set_iotask_target(iosysid, 2048, 0)))
+        return ret;
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+    if (ios->iotask_target != 2048 || ios->ranks_per_node < 1 ||
+        ios->ranks_per_node > ios->num_comptasks)
+        return ERR_WRONG;
+    if ((ret = PIOc_set_iotask_target(iosysid, 0, 1)))
+        return ret;
+
+    /* 16 tasks on 4 nodes with 8 IO tasks. The data has 16384 bytes. */
+    layout_ios.ioproc = true;
+    layout_ios.num_iotasks = LAYOUT_NIOTASKS;
+    layout_ios.num_comptasks = 16;
+    layout_ios.ranks_per_node = 4;
+    for (int t = 0; t < NUM_LAYOUT_TARGETS; t++)
+    {
+        PIO_Offset total = 0;
+
+        layout_ios.iotask_target = target[t];
+        for (int r = 0; r < LAYOUT_NIOTASKS; r++)
+        {
+            PIO_Offset start[2], count[2];
+            int num_aiotasks;
+
+            layout_ios.io_rank = r;
+            if ((ret = calc_box_layout(&layout_ios, PIO_INT, 2, gdims, start, count,
+                                       &num_aiotasks)))
+                return ret;
+            if (num_aiotasks != expected[t])
+                return ERR_WRONG;
+
+            /* Only the strided IO tasks have data. */
+            if ((count[0] * count[1] > 0) != (r % stride[t] == 0))
+                return ERR_WRONG;
+            total += count[0] * count[1];
+        }
+        if (total != LAYOUT_DIM_LEN * LAYOUT_DIM_LEN)
+            return ERR_WRONG;
+    }
+
+    return 0;
+}
+
+/* Test the shared buffers of fill values. */
+int test_fill_bufs(int iosysid)
+{
+    file_desc_t *file;
+    int fill1 = TEST_VAL_42;
+    int fill2 = -1;
+    void *buf1, *buf2, *buf3;
+    int ret;
+
+    if (!(file = calloc(1, sizeof(file_desc_t))))
+        return PIO_ENOMEM;
+    if (!(file->iosystem = pio_get_iosystem_from_id(iosysid)))
+        return ERR_WRONG;
+
+    /* No buffer is needed for no values. */
+    if ((ret = get_fill_buf(file, sizeof(int), &fill1, 0, &buf1)))
+        return ret;
+    if (buf1 || file->fillbufs)
+        return ERR_WRONG;
+
+    /* Every value in the buffer is the fill value. */
+    if ((ret = get_fill_buf(file, sizeof(int), &fill1, 7, &buf1)))
+        return ret;
+    for (int i = 0; i < 7; i++)
+        if (((int *)buf1)[i] != TEST_VAL_42)
+            return ERR_WRONG;
+
+    /* A buffer is shared by all requests for the same value that fit
+     * in it. */
+    if ((ret = get_fill_buf(file, sizeof(int), &fill1, 5, &buf2)))
+        return ret;
+    if (buf2 != buf1)
+        return ERR_WRONG;
+
+    /* Other values, or more of them, get other buffers. */
+    if ((ret = get_fill_buf(file, sizeof(int), &fill2, 5, &buf2)))
+        return ret;
+    if ((ret = get_fill_buf(file, sizeof(int), &fill1, 8, &buf3)))
+        return ret;
+    if (buf2 == buf1 || buf3 == buf1 || ((int *)buf2)[4] != -1 ||
+        ((int *)buf3)[7] != TEST_VAL_42)
+        return ERR_WRONG;
+
+    free_fill_bufs(file);
+    if (file->fillbufs)
+        return ERR_WRONG;
+    free(file);
+
+    return 0;
+}
+
+/* Test the size-class pool allocator. */
+int test_pool()
+{
+#define NUM_POOL_SIZES 6
+    PIO_Offset size[NUM_POOL_SIZES] = {1, 32, 33, 100, 1000, 200000};
+    void *buf[NUM_POOL_SIZES];
+    pio_pool *pool;
+    PIO_Offset requested, inuse, footprint, highwater, nget, nrel;
+    PIO_Offset totfree, maxfree;
+    PIO_Offset total = 0;
+    void *buf2;
+    int ret;
+
+    if ((ret = pio_pool_create(1048576, &pool)))
+        return ret;
+
+    /* Blocks are 16-byte aligned, at most 25% bigger than asked. */
+    for (int i = 0; i < NUM_POOL_SIZES; i++)
+    {
+        if (!(buf[i] = pio_pool_get(pool, size[i])))
+            return ERR_WRONG;
+        if ((size_t)buf[i] % 16)
+            return ERR_WRONG;
+        memset(buf[i], i, size[i]);
+        total += size[i];
+    }
+    pio_pool_stats(pool, &requested, &inuse, &footprint, &highwater, &nget, &nrel);
+    if (requested != total || inuse < total || inuse > total + total / 4 + 32 * NUM_POOL_SIZES)
+        return ERR_WRONG;
+    if (footprint < inuse || highwater != inuse || nget != NUM_POOL_SIZES || nrel)
+        return ERR_WRONG;
+    pio_pool_freespace(pool, &totfree, &maxfree);
+    if (totfree != 1048576 - inuse || maxfree != totfree)
+        return ERR_WRONG;
+
+    /* A freed block is reused for a request of the same class. */
+    pio_pool_rel(pool, buf[3]);
+    if ((buf2 = pio_pool_get(pool, size[3] - 1)) != buf[3])
+        return ERR_WRONG;
+    buf[3] = buf2;
+
+    /* A block that is big enough is not moved. Otherwise the contents
+     * are copied. */
+    if (pio_pool_getr(pool, buf[2], 40) != buf[2])
+        return ERR_WRONG;
+    if (!(buf2 = pio_pool_getr(pool, buf[2], 5000)))
+        return ERR_WRONG;
+    for (int i = 0; i < size[2]; i++)
+        if (((char *)buf2)[i] != 2)
+            return ERR_WRONG;
+    buf[2] = buf2;
+
+    /* Releasing everything leaves nothing in use. */
+    for (int i = 0; i < NUM_POOL_SIZES; i++)
+        pio_pool_rel(pool, buf[i]);
+    pio_pool_stats(pool, &requested, &inuse, &footprint, &highwater, &nget, &nrel);
+    if (requested || inuse || highwater < total || nget != nrel)
+        return ERR_WRONG;
+
+    pio_pool_free(pool);
+
+    /* The stats of the compute buffer pool are available with any
+     * allocator. */
+    if ((ret = PIOc_get_buffer_pool_stats(&requested, &inuse, &footprint, &highwater)))
+        return ret;
+    if (inuse < 0 || highwater < inuse || footprint < inuse)
+        return ERR_WRONG;
+
+    return 0;
+}
+
 /* This test code was recovered from main() in pioc_sc.c. */
 int test_CalcStartandCount()
 {
@@ -503,6 +995,10 @@ int main(int argc, char **argv)
         if ((ret = test_lists()))
             return ret;
 
+        printf("%d running handle table tests\n", my_rank);
+        if ((ret = test_handle_tables(iosysid)))
+            return ret;
+
         printf("%d running ceil2/pair tests\n", my_rank);
         if ((ret = test_ceil2_pair()))
             return ret;
@@ -515,6 +1011,30 @@ int main(int argc, char **argv)
         if ((ret = test_misc()))
             return ret;
 
+        printf("%d running var info tests\n", my_rank);
+        if ((ret = test_var_desc()))
+            return ret;
+
+        printf("%d running write multi buffer tests\n", my_rank);
+        if ((ret = test_wmb()))
+            return ret;
+
+        printf("%d running flush policy tests\n", my_rank);
+        if ((ret = test_flush_policy(iosysid)))
+            return ret;
+
+        printf("%d running box layout tests\n", my_rank);
+        if ((ret = test_box_layout(iosysid)))
+            return ret;
+
+        printf("%d running fill buffer tests\n", my_rank);
+        if ((ret = test_fill_bufs(iosysid)))
+            return ret;
+
+        printf("%d running pool allocator tests\n", my_rank);
+        if ((ret = test_pool()))
+            return ret;
+
         /* Finalize PIO system. */
         if ((ret = PIOc_finalize(iosysid)))
             return ret;